@@ -1,5 +1,6 @@
 #include "VideoDecoder.h"
 #include <android/log.h>
+#include <cstring>
 
 #define LOG_TAG "VideoDecoder"
 #define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
@@ -12,12 +13,14 @@ VideoDecoder::~VideoDecoder() {
     Cleanup();
 }
 
-bool VideoDecoder::Initialize(uint32_t width, uint32_t height, CompressionType compression) {
+bool VideoDecoder::Initialize(uint32_t width, uint32_t height, CompressionType compression,
+                              const DecoderOptions& options) {
     LOGD("Initializing VideoDecoder: %dx%d, compression=%d", width, height, compression);
     
     m_Width = width;
     m_Height = height;
     m_CompressionType = compression;
+    m_Options = options; // MediaCodec manages its own threading
     
     m_androidDecoder = std::make_unique<AndroidVideoDecoder>();
     m_IsInitialized = m_androidDecoder->Initialize(width, height, compression);
@@ -31,7 +34,7 @@ bool VideoDecoder::DecodeFrame(const uint8_t* compressedData, size_t dataSize, s
     }
     
     // AndroidVideoDecoder outputs RGBA, but we need BGRA for compatibility
-    std::vector<uint8_t> rgbaData;
+    std::vector<uint8_t>& rgbaData = m_rgbaScratch;
     if (!m_androidDecoder->DecodeFrame(compressedData, dataSize, rgbaData)) {
         return false;
     }
@@ -74,4 +77,112 @@ const char* VideoDecoder::GetCodecName(CompressionType type) {
         case COMPRESSION_AV1:  return "AV1 (Android MediaCodec)";
         default: return "Unknown";
     }
-}
\ No newline at end of file
+}
+
+// MediaCodec is driven synchronously, one output per input, so each frame
+// carries the tag of the packet just submitted
+bool VideoDecoder::DecodeFrame(const BufferHandle& packet, std::vector<uint8_t>& bgraData, int64_t tag) {
+    // MediaCodec copies input into its own buffers, so padding is irrelevant here
+    if (!DecodeFrame(packet.data(), packet.size(), bgraData)) {
+        return false;
+    }
+    m_LastFrameTag = tag;
+    return true;
+}
+
+// MediaCodec hands back converted RGBA, so there are no YUV planes to expose
+DecodedPicture::DecodedPicture() = default;
+DecodedPicture::~DecodedPicture() = default;
+
+void DecodedPicture::Reset() {
+    width = 0;
+    height = 0;
+    format = PixelFormat::Unknown;
+    for (int i = 0; i < 3; ++i) {
+        planes[i] = nullptr;
+        strides[i] = 0;
+    }
+}
+
+bool VideoDecoder::DecodeFrame(const BufferHandle& packet, DecodedPicture& picture, int64_t tag) {
+    (void)packet;
+    (void)tag;
+    picture.Reset();
+    return false;
+}
+
+// MediaCodec output is synchronous here; nothing is held back to drain
+bool VideoDecoder::DrainFrame(DecodedPicture& picture) {
+    picture.Reset();
+    return false;
+}
+
+bool VideoDecoder::DrainFrame(std::vector<uint8_t>& bgraData) {
+    (void)bgraData;
+    return false;
+}
+
+FrameConverter::~FrameConverter() = default;
+
+bool FrameConverter::ConvertToBGRA(const DecodedPicture& picture, std::vector<uint8_t>& bgraData) {
+    (void)picture;
+    (void)bgraData;
+    return false;
+}
+
+bool VideoDecoder::DecodeFrame(const BufferHandle& packet, const FrameDestination& destination, int64_t tag) {
+    if (!m_IsInitialized || !m_androidDecoder || !destination.data) {
+        return false;
+    }
+    if (destination.format != PixelFormat::BGRA && destination.format != PixelFormat::RGBA) {
+        return false;
+    }
+    
+    std::vector<uint8_t>& rgbaData = m_rgbaScratch;
+    if (!m_androidDecoder->DecodeFrame(packet.data(), packet.size(), rgbaData)) {
+        return false;
+    }
+    size_t rowBytes = static_cast<size_t>(destination.width) * 4;
+    if (rgbaData.size() < rowBytes * destination.height) {
+        LOGD("Decoded frame smaller than destination %ux%u", destination.width, destination.height);
+        return false;
+    }
+    
+    // Write rows straight into the destination, swizzling for BGRA targets
+    for (uint32_t y = 0; y < destination.height; y++) {
+        const uint8_t* src = rgbaData.data() + y * rowBytes;
+        uint8_t* dst = destination.data + static_cast<ptrdiff_t>(y) * destination.stride;
+        if (destination.format == PixelFormat::RGBA) {
+            memcpy(dst, src, rowBytes);
+            continue;
+        }
+        for (size_t i = 0; i < rowBytes; i += 4) {
+            dst[i]     = src[i + 2]; // B
+            dst[i + 1] = src[i + 1]; // G
+            dst[i + 2] = src[i];     // R
+            dst[i + 3] = src[i + 3]; // A
+        }
+    }
+    m_LastFrameTag = tag;
+    return true;
+}
+
+bool FrameConverter::ConvertTo(const DecodedPicture& picture, const FrameDestination& destination) {
+    (void)picture;
+    (void)destination;
+    return false;
+}
+
+bool VideoDecoder::Reconfigure(uint32_t width, uint32_t height) {
+    if (!m_IsInitialized) {
+        return false;
+    }
+    
+    // MediaCodec is configured for a fixed output size, so rebuild it
+    LOGD("Reconfiguring VideoDecoder: %dx%d", width, height);
+    return Initialize(width, height, m_CompressionType, m_Options);
+}
+
+void VideoDecoder::Flush() {
+    // MediaCodec output is drained synchronously per frame; nothing is queued
+}
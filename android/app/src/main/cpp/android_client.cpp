@@ -21,7 +21,7 @@ public:
     bool Connect(const std::string& serverIP, int port) {
         LOGI("Attempting to connect to %s:%d", serverIP.c_str(), port);
         
-        receiver.SetFrameCallback([](const FrameMessage& msg, const std::vector<uint8_t>& data) {
+        receiver.SetFrameCallback([](const FrameMessage& msg, std::span<const uint8_t> data) {
             LOGI("Received frame: %dx%d, size: %zu bytes", msg.width, msg.height, data.size());
         });
         
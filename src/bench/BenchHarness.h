@@ -0,0 +1,162 @@
+#pragma once
+#include "PerfCounters.h"
+#include "SampleStats.h"
+#include "protocol.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Small self-contained benchmark harness. Benchmarks register themselves with
+// MR_BENCHMARK, sweep their own parameter space and Report() one BenchResult
+// per point. BenchMain prints a table and optionally writes JSON.
+
+struct BenchResult {
+    std::string name;                                    // Benchmark family, e.g. "decode"
+    std::vector<std::pair<std::string, std::string>> params; // Point in the sweep
+    SampleStats samplesMs;                               // Per-iteration time in ms
+    std::vector<std::pair<std::string, double>> metrics; // Extra numbers (fps, bytes, ...)
+};
+
+struct BenchResolution {
+    const char* name;
+    uint32_t width;
+    uint32_t height;
+};
+
+constexpr BenchResolution kBench720p{"720p", 1280, 720};
+constexpr BenchResolution kBench1080p{"1080p", 1920, 1080};
+constexpr BenchResolution kBench1440p{"1440p", 2560, 1440};
+constexpr BenchResolution kBench4K{"4k", 3840, 2160};
+
+// The resolutions every per-frame benchmark sweeps
+constexpr BenchResolution kBenchResolutions[] = { kBench720p, kBench1080p, kBench1440p, kBench4K };
+
+inline const char* CodecLabel(CompressionType codec) {
+    switch (codec) {
+        case COMPRESSION_H264: return "h264";
+        case COMPRESSION_H265: return "h265";
+        case COMPRESSION_AV1: return "av1";
+        default: return "none";
+    }
+}
+
+class BenchContext {
+private:
+    std::vector<BenchResult> m_results;
+    std::string m_filter;
+
+public:
+    int frames = 120;    // Iterations per point
+    bool quick = false;  // Trim sweeps to a representative subset
+
+    void SetFilter(const std::string& filter) { m_filter = filter; }
+
+    // True if a point labelled `label` (e.g. "decode/h264/1080p") should run
+    bool Matches(const std::string& label) const {
+        return m_filter.empty() || label.find(m_filter) != std::string::npos;
+    }
+
+    void Report(BenchResult&& result) { m_results.push_back(std::move(result)); }
+    const std::vector<BenchResult>& Results() const { return m_results; }
+};
+
+using BenchFunc = void (*)(BenchContext&);
+
+struct BenchCase {
+    const char* name;
+    BenchFunc func;
+};
+
+inline std::vector<BenchCase>& BenchCases() {
+    static std::vector<BenchCase> cases;
+    return cases;
+}
+
+struct BenchRegistrar {
+    BenchRegistrar(const char* name, BenchFunc func) { BenchCases().push_back({name, func}); }
+};
+
+#define MR_BENCHMARK(fn)                                   \
+    static void fn(BenchContext& ctx);                     \
+    static BenchRegistrar fn##_registrar(#fn, fn);         \
+    static void fn(BenchContext& ctx)
+
+// Hardware counter totals when a point starts; AddPerfMetrics() turns what
+// each stage added since into per-scope metrics. No-op without --perf-counters.
+struct BenchPerfSnapshot {
+    PerfStageTotals stages[static_cast<size_t>(PerfStage::Count)];
+
+    BenchPerfSnapshot() {
+        for (size_t stage = 0; stage < static_cast<size_t>(PerfStage::Count); stage++) {
+            stages[stage] = PerfCounters::GetTotals(static_cast<PerfStage>(stage));
+        }
+    }
+};
+
+// Adds "<stage>_ipc", "<stage>_cycles", "<stage>_llc_misses", ... for every
+// stage that ran since `before`, except stages on codec worker threads
+inline void AddPerfMetrics(BenchResult& result, const BenchPerfSnapshot& before) {
+    if (!PerfCounters::IsEnabled()) {
+        return;
+    }
+    BenchPerfSnapshot after;
+    for (size_t stage = 0; stage < static_cast<size_t>(PerfStage::Count); stage++) {
+        PerfStageTotals delta;
+        delta.samples = after.stages[stage].samples - before.stages[stage].samples;
+        if (delta.samples == 0 || PerfCounters::IsStageThreaded(static_cast<PerfStage>(stage))) {
+            continue; // Threaded codec stages only show the calling thread's share
+        }
+        for (int event = 0; event < kPerfEventCount; event++) {
+            delta.counts[event] = after.stages[stage].counts[event] - before.stages[stage].counts[event];
+        }
+        std::string prefix = std::string(PerfCounters::GetStageName(static_cast<PerfStage>(stage))) + "_";
+        result.metrics.push_back({ prefix + "ipc", delta.Ipc() });
+        for (PerfEvent event : { PerfCycles, PerfCacheMisses, PerfBranchMisses }) {
+            if (PerfCounters::IsEventSupported(event)) {
+                result.metrics.push_back({ prefix + PerfCounters::GetEventName(event), delta.PerSample(event) });
+            }
+        }
+    }
+}
+
+using BenchClock = std::chrono::steady_clock;
+
+inline double ElapsedMs(BenchClock::time_point start, BenchClock::time_point end = BenchClock::now()) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Desktop-like synthetic BGRA frame: flat window chrome, text-like detail and a
+// window that moves each frame, so encoders see realistic motion and residual.
+inline void GenerateSyntheticDesktop(uint32_t frameIndex, uint32_t width, uint32_t height,
+                                     std::vector<uint8_t>& bgra) {
+    bgra.resize(static_cast<size_t>(width) * height * 4);
+    uint32_t winX = (frameIndex * 8) % (width / 2);
+    uint32_t winY = height / 4;
+    uint32_t winW = width / 3;
+    uint32_t winH = height / 2;
+
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t* row = bgra.data() + static_cast<size_t>(y) * width * 4;
+        for (uint32_t x = 0; x < width; x++) {
+            uint8_t b = static_cast<uint8_t>(96 + (y * 64) / height);
+            uint8_t g = static_cast<uint8_t>(64 + (x * 32) / width);
+            uint8_t r = 40;
+            bool inWindow = x >= winX && x < winX + winW && y >= winY && y < winY + winH;
+            if (inWindow) {
+                b = g = r = 240;
+                // Glyph-like strokes on text lines
+                uint32_t lx = x - winX;
+                uint32_t ly = y - winY;
+                if (ly % 16 < 10 && lx % 7 < 3 && ((lx / 7 + ly / 16 * 13) * 2654435761u) % 5 != 0) {
+                    b = g = r = 20;
+                }
+            }
+            row[x * 4 + 0] = b;
+            row[x * 4 + 1] = g;
+            row[x * 4 + 2] = r;
+            row[x * 4 + 3] = 255;
+        }
+    }
+}
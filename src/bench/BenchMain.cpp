@@ -0,0 +1,131 @@
+#include "BenchHarness.h"
+#include "JsonWriter.h"
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+namespace {
+
+void PrintUsage() {
+    std::cout << "MRDesktop Benchmarks" << std::endl;
+    std::cout << "Usage: MRDesktopBench [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --filter=<text>    Only run points whose label contains text (e.g. decode/h264)" << std::endl;
+    std::cout << "  --frames=<N>       Iterations per point (default: 120)" << std::endl;
+    std::cout << "  --quick            Run a reduced parameter sweep" << std::endl;
+    std::cout << "  --json=<file>      Write results as JSON" << std::endl;
+    std::cout << "  --perf-counters    Add per-stage IPC and cache/branch misses (Linux perf_event_open)" << std::endl;
+    std::cout << "  --list             List registered benchmarks" << std::endl;
+    std::cout << "  --help             Show this help message" << std::endl;
+}
+
+std::string FormatParams(const BenchResult& result) {
+    std::string text;
+    for (const auto& param : result.params) {
+        if (!text.empty()) text += ' ';
+        text += param.first + "=" + param.second;
+    }
+    return text;
+}
+
+void PrintResults(const BenchContext& ctx) {
+    printf("\n%-16s %-60s %6s %9s %9s %9s %9s %9s\n",
+           "benchmark", "params", "n", "mean_ms", "p50_ms", "p95_ms", "p99_ms", "max_ms");
+    for (const BenchResult& result : ctx.Results()) {
+        const SampleStats& s = result.samplesMs;
+        printf("%-16s %-60s %6zu %9.3f %9.3f %9.3f %9.3f %9.3f",
+               result.name.c_str(), FormatParams(result).c_str(), s.Count(), s.Mean(),
+               s.Percentile(50), s.Percentile(95), s.Percentile(99), s.Max());
+        for (const auto& metric : result.metrics) {
+            printf("  %s=%.3f", metric.first.c_str(), metric.second);
+        }
+        printf("\n");
+    }
+}
+
+bool WriteJson(const BenchContext& ctx, const std::string& path) {
+    JsonWriter json;
+    json.BeginObject();
+    json.Key("frames_per_point").Int(ctx.frames);
+    json.Key("quick").Bool(ctx.quick);
+    json.Key("benchmarks").BeginArray();
+    for (const BenchResult& result : ctx.Results()) {
+        const SampleStats& s = result.samplesMs;
+        json.BeginObject();
+        json.Key("name").String(result.name);
+        json.Key("params").BeginObject();
+        for (const auto& param : result.params) {
+            json.Key(param.first).String(param.second);
+        }
+        json.EndObject();
+        json.Key("samples").UInt(s.Count());
+        json.Key("mean_ms").Double(s.Mean());
+        json.Key("stddev_ms").Double(s.StdDev());
+        json.Key("min_ms").Double(s.Min());
+        json.Key("p50_ms").Double(s.Percentile(50));
+        json.Key("p95_ms").Double(s.Percentile(95));
+        json.Key("p99_ms").Double(s.Percentile(99));
+        json.Key("max_ms").Double(s.Max());
+        json.Key("metrics").BeginObject();
+        for (const auto& metric : result.metrics) {
+            json.Key(metric.first).Double(metric.second);
+        }
+        json.EndObject();
+        json.EndObject();
+    }
+    json.EndArray();
+    json.EndObject();
+    return json.WriteToFile(path);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchContext ctx;
+    std::string jsonPath;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help") {
+            PrintUsage();
+            return 0;
+        } else if (arg == "--list") {
+            for (const BenchCase& benchCase : BenchCases()) {
+                std::cout << benchCase.name << std::endl;
+            }
+            return 0;
+        } else if (arg.find("--filter=") == 0) {
+            ctx.SetFilter(arg.substr(9));
+        } else if (arg.find("--frames=") == 0) {
+            ctx.frames = std::stoi(arg.substr(9));
+        } else if (arg == "--quick") {
+            ctx.quick = true;
+        } else if (arg.find("--json=") == 0) {
+            jsonPath = arg.substr(7);
+        } else if (arg == "--perf-counters") {
+            if (!PerfCounters::Start()) {
+                std::cerr << "Hardware counters unavailable; continuing without them" << std::endl;
+            }
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    for (const BenchCase& benchCase : BenchCases()) {
+        std::cout << "Running " << benchCase.name << "..." << std::endl;
+        benchCase.func(ctx);
+    }
+
+    PrintResults(ctx);
+
+    if (!jsonPath.empty()) {
+        if (!WriteJson(ctx, jsonPath)) {
+            std::cerr << "Failed to write " << jsonPath << std::endl;
+            return 1;
+        }
+        std::cout << "Results written to " << jsonPath << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,437 @@
+#include "BenchHarness.h"
+#include "BufferPool.h"
+#include "FrameQuality.h"
+#include "JsonWriter.h"
+#include "Log.h"
+#include "SessionRecording.h"
+#include "VideoDecoder.h"
+#include "VideoEncoder.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Sweeps codec x encoder x preset x tune x bitrate x resolution over a clip
+// and reports, per point, what the encoder costs and what it delivers: encode
+// and decode ms/frame, bytes/frame, keyframe/delta size ratio and luma
+// PSNR/SSIM. Meant for choosing EncoderOptions per deployment; the server
+// takes the winners as --encoder/--preset/--tune/--bitrate.
+
+namespace {
+
+constexpr uint32_t kFramerate = 60;  // As the server encodes
+
+void PrintUsage() {
+    std::cout << "MRDesktop Codec Matrix" << std::endl;
+    std::cout << "Usage: MRDesktopCodecMatrix [options]" << std::endl;
+    std::cout << "Lists are comma-separated; \"default\" is the server's built-in choice." << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --codecs=<list>       h264, h265, av1 (default: all)" << std::endl;
+    std::cout << "  --encoders=<list>     FFmpeg encoders, e.g. default,h264_nvenc,libsvtav1 (default: default)" << std::endl;
+    std::cout << "                        Each is only paired with the codec it produces" << std::endl;
+    std::cout << "  --presets=<list>      Encoder presets (default: a fast-to-slower sweep per codec)" << std::endl;
+    std::cout << "  --tunes=<list>        Encoder tunes; \"none\" sets no tune (default: default)" << std::endl;
+    std::cout << "  --bitrates=<list>     Target bitrates in kbps (default: 2000,5000,10000)" << std::endl;
+    std::cout << "  --resolutions=<list>  720p, 1080p, 1440p, 4k (default: 720p,1080p)" << std::endl;
+    std::cout << "  --clip=<file>         Raw capture from MRDesktopServer --record-raw, used at its own" << std::endl;
+    std::cout << "                        resolution (default: synthetic desktop)" << std::endl;
+    std::cout << "  --frames=<N>          Frames per point (default: 120)" << std::endl;
+    std::cout << "  --json=<file>         Write results as JSON" << std::endl;
+    std::cout << "  --help                Show this help message" << std::endl;
+}
+
+std::vector<std::string> SplitList(const std::string& text) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        if (end > start) {
+            items.push_back(text.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return items;
+}
+
+// "default" leaves the option empty, so VideoEncoder picks its default
+std::string OptionValue(const std::string& item) {
+    return item == "default" ? std::string() : item;
+}
+
+std::string OptionLabel(const std::string& value) {
+    return value.empty() ? "default" : value;
+}
+
+bool ParseCodec(const std::string& name, CompressionType& codec) {
+    for (CompressionType candidate : { COMPRESSION_H264, COMPRESSION_H265, COMPRESSION_AV1 }) {
+        if (name == CodecLabel(candidate)) {
+            codec = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Presets swept when none are given: the shipping default and two slower ones
+std::vector<std::string> DefaultPresets(CompressionType codec) {
+    if (codec == COMPRESSION_AV1) {
+        return { "", "6", "4" };
+    }
+    return { "", "superfast", "veryfast" };
+}
+
+// Source frames for one resolution: a raw session recording (frames are read
+// straight from the mapping) or the synthetic desktop, generated on demand.
+class MatrixClip {
+public:
+    bool OpenRecording(const std::string& path, int maxFrames) {
+        if (!m_reader.Open(path)) {
+            return false;
+        }
+        SessionReader::Cursor cursor = m_reader.Begin();
+        SessionFrame frame;
+        while (static_cast<int>(m_recorded.size()) < maxFrames && m_reader.ReadFrame(cursor, frame)) {
+            if (frame.codec != COMPRESSION_NONE) {
+                continue;
+            }
+            if (m_recorded.empty()) {
+                m_width = frame.width;
+                m_height = frame.height;
+            }
+            if (frame.width != m_width || frame.height != m_height ||
+                frame.payload.size() < static_cast<size_t>(m_width) * m_height * 4) {
+                continue; // Resolution changed mid-recording; keep the first size
+            }
+            m_recorded.push_back(frame.payload.data());
+        }
+        if (m_recorded.empty()) {
+            std::cerr << path << " has no raw frames (record one with MRDesktopServer --record-raw)" << std::endl;
+            return false;
+        }
+        m_frames = m_recorded.size();
+        m_name = std::to_string(m_width) + "x" + std::to_string(m_height);
+        return true;
+    }
+
+    void UseSynthetic(const BenchResolution& res, int frames) {
+        m_width = res.width;
+        m_height = res.height;
+        m_frames = static_cast<size_t>(frames);
+        m_name = res.name;
+        m_generated = SIZE_MAX;
+    }
+
+    // Frame `index` as BGRA. A synthetic frame stays valid until the next call.
+    const uint8_t* GetFrame(size_t index) {
+        if (!m_recorded.empty()) {
+            return m_recorded[index];
+        }
+        if (m_generated != index) {
+            GenerateSyntheticDesktop(static_cast<uint32_t>(index), m_width, m_height, m_synthetic);
+            m_generated = index;
+        }
+        return m_synthetic.data();
+    }
+
+    uint32_t GetWidth() const { return m_width; }
+    uint32_t GetHeight() const { return m_height; }
+    size_t GetFrameCount() const { return m_frames; }
+    const std::string& GetName() const { return m_name; }
+
+private:
+    SessionReader m_reader;
+    std::vector<const uint8_t*> m_recorded;
+    std::vector<uint8_t> m_synthetic;
+    size_t m_generated = SIZE_MAX;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    size_t m_frames = 0;
+    std::string m_name;
+};
+
+struct MatrixPoint {
+    CompressionType codec = COMPRESSION_NONE;
+    EncoderOptions options;
+};
+
+struct PointResult {
+    MatrixPoint point;
+    std::string encoderName;
+    std::string resolution;
+    SampleStats encodeMs;
+    SampleStats decodeMs;
+    SampleStats psnr;
+    SampleStats ssim;
+    uint64_t keyframeBytes = 0;
+    uint64_t deltaBytes = 0;
+    uint32_t keyframes = 0;
+    uint32_t deltas = 0;
+
+    uint32_t Packets() const { return keyframes + deltas; }
+    double BytesPerFrame() const {
+        return Packets() > 0 ? static_cast<double>(keyframeBytes + deltaBytes) / Packets() : 0.0;
+    }
+    // Average keyframe size over average delta size
+    double KeyframeDeltaRatio() const {
+        if (keyframes == 0 || deltas == 0 || deltaBytes == 0) {
+            return 0.0;
+        }
+        return (static_cast<double>(keyframeBytes) / keyframes) / (static_cast<double>(deltaBytes) / deltas);
+    }
+    // Bitrate actually produced, as if the clip played at kFramerate
+    double ActualKbps() const { return BytesPerFrame() * 8.0 * kFramerate / 1000.0; }
+};
+
+// Encodes every frame of the clip and decodes each packet straight away, as
+// the receiver would. Only EncodeFrame() and DecodeFrame() are timed; quality
+// is measured in between against the frame that produced the output (outputs
+// come in order, without B-frames).
+bool RunPoint(const MatrixPoint& point, MatrixClip& clip, PointResult& result) {
+    VideoEncoder encoder;
+    if (!encoder.Initialize(clip.GetWidth(), clip.GetHeight(), point.codec, point.options)) {
+        return false;
+    }
+    VideoDecoder decoder;
+    if (!decoder.Initialize(clip.GetWidth(), clip.GetHeight(), point.codec)) {
+        return false;
+    }
+    result.point = point;
+    result.encoderName = encoder.GetEncoderName();
+    result.resolution = clip.GetName();
+    result.encodeMs.Reserve(clip.GetFrameCount());
+    result.decodeMs.Reserve(clip.GetFrameCount());
+
+    BufferPool pool(VideoDecoder::kInputPaddingSize);
+    FrameQualityMeter meter;
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> decoded;
+    const size_t stride = static_cast<size_t>(clip.GetWidth()) * 4;
+    size_t decodedFrames = 0;
+    for (size_t i = 0; i < clip.GetFrameCount(); i++) {
+        const uint8_t* source = clip.GetFrame(i);
+        bool isKeyframe = false;
+        auto encodeStart = BenchClock::now();
+        bool produced = encoder.EncodeFrame(source, compressed, isKeyframe);
+        result.encodeMs.Add(ElapsedMs(encodeStart));
+        if (!produced) {
+            continue;
+        }
+        if (isKeyframe) {
+            result.keyframes++;
+            result.keyframeBytes += compressed.size();
+        } else {
+            result.deltas++;
+            result.deltaBytes += compressed.size();
+        }
+
+        BufferHandle packet = pool.Acquire(compressed.size());
+        std::memcpy(packet.data(), compressed.data(), compressed.size());
+        auto decodeStart = BenchClock::now();
+        bool output = decoder.DecodeFrame(packet, decoded);
+        double decodeMs = ElapsedMs(decodeStart);
+        if (!output) {
+            continue;
+        }
+        result.decodeMs.Add(decodeMs);
+        FrameQuality quality;
+        if (meter.Measure(clip.GetFrame(decodedFrames++), decoded.data(), clip.GetWidth(), clip.GetHeight(),
+                          stride, quality)) {
+            result.psnr.Add(quality.psnr);
+            result.ssim.Add(quality.ssim);
+        }
+    }
+    return result.Packets() > 0;
+}
+
+void PrintResults(const std::vector<PointResult>& results) {
+    printf("\n%-5s %-12s %-10s %-12s %6s %-10s %8s %8s %10s %7s %7s %7s %9s\n",
+           "codec", "encoder", "preset", "tune", "kbps", "res", "enc_ms", "dec_ms", "bytes/fr", "key/dlt",
+           "psnr", "ssim", "out_kbps");
+    for (const PointResult& r : results) {
+        printf("%-5s %-12s %-10s %-12s %6u %-10s %8.3f %8.3f %10.0f %7.2f %7.2f %7.4f %9.0f\n",
+               CodecLabel(r.point.codec), r.encoderName.c_str(), OptionLabel(r.point.options.preset).c_str(),
+               OptionLabel(r.point.options.tune).c_str(), r.point.options.bitrate / 1000, r.resolution.c_str(),
+               r.encodeMs.Mean(), r.decodeMs.Mean(), r.BytesPerFrame(), r.KeyframeDeltaRatio(),
+               r.psnr.Mean(), r.ssim.Mean(), r.ActualKbps());
+    }
+}
+
+bool WriteJson(const std::vector<PointResult>& results, const std::string& clip, int frames,
+               const std::string& path) {
+    JsonWriter json;
+    json.BeginObject();
+    json.Key("clip").String(clip);
+    json.Key("frames_per_point").Int(frames);
+    json.Key("points").BeginArray();
+    for (const PointResult& r : results) {
+        json.BeginObject();
+        json.Key("codec").String(CodecLabel(r.point.codec));
+        json.Key("encoder").String(r.encoderName);
+        json.Key("preset").String(OptionLabel(r.point.options.preset));
+        json.Key("tune").String(OptionLabel(r.point.options.tune));
+        json.Key("bitrate_kbps").UInt(r.point.options.bitrate / 1000);
+        json.Key("resolution").String(r.resolution);
+        json.Key("encode_ms").BeginObject();
+        json.Key("mean").Double(r.encodeMs.Mean());
+        json.Key("p95").Double(r.encodeMs.Percentile(95));
+        json.Key("max").Double(r.encodeMs.Max());
+        json.EndObject();
+        json.Key("decode_ms").BeginObject();
+        json.Key("mean").Double(r.decodeMs.Mean());
+        json.Key("p95").Double(r.decodeMs.Percentile(95));
+        json.Key("max").Double(r.decodeMs.Max());
+        json.EndObject();
+        json.Key("packets").UInt(r.Packets());
+        json.Key("keyframes").UInt(r.keyframes);
+        json.Key("bytes_per_frame").Double(r.BytesPerFrame());
+        json.Key("keyframe_delta_ratio").Double(r.KeyframeDeltaRatio());
+        json.Key("actual_kbps").Double(r.ActualKbps());
+        json.Key("psnr_db").BeginObject();
+        json.Key("mean").Double(r.psnr.Mean());
+        json.Key("min").Double(r.psnr.Min());
+        json.EndObject();
+        json.Key("ssim").BeginObject();
+        json.Key("mean").Double(r.ssim.Mean());
+        json.Key("min").Double(r.ssim.Min());
+        json.EndObject();
+        json.EndObject();
+    }
+    json.EndArray();
+    json.EndObject();
+    return json.WriteToFile(path);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<CompressionType> codecs = { COMPRESSION_H264, COMPRESSION_H265, COMPRESSION_AV1 };
+    std::vector<std::string> encoders = { "default" };
+    std::vector<std::string> presets;  // Empty: DefaultPresets() per codec
+    std::vector<std::string> tunes = { "default" };
+    std::vector<uint32_t> bitratesKbps = { 2000, 5000, 10000 };
+    std::vector<BenchResolution> resolutions = { kBench720p, kBench1080p };
+    std::string clipPath;
+    std::string jsonPath;
+    int frames = 120;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help") {
+            PrintUsage();
+            return 0;
+        } else if (arg.find("--codecs=") == 0) {
+            codecs.clear();
+            for (const std::string& name : SplitList(arg.substr(9))) {
+                CompressionType codec;
+                if (!ParseCodec(name, codec)) {
+                    std::cerr << "Unknown codec: " << name << std::endl;
+                    return 1;
+                }
+                codecs.push_back(codec);
+            }
+        } else if (arg.find("--encoders=") == 0) {
+            encoders = SplitList(arg.substr(11));
+        } else if (arg.find("--presets=") == 0) {
+            presets = SplitList(arg.substr(10));
+        } else if (arg.find("--tunes=") == 0) {
+            tunes = SplitList(arg.substr(8));
+        } else if (arg.find("--bitrates=") == 0) {
+            bitratesKbps.clear();
+            for (const std::string& kbps : SplitList(arg.substr(11))) {
+                bitratesKbps.push_back(static_cast<uint32_t>(std::stoul(kbps)));
+            }
+        } else if (arg.find("--resolutions=") == 0) {
+            resolutions.clear();
+            for (const std::string& name : SplitList(arg.substr(14))) {
+                const BenchResolution* match = nullptr;
+                for (const BenchResolution& res : kBenchResolutions) {
+                    if (name == res.name) {
+                        match = &res;
+                    }
+                }
+                if (!match) {
+                    std::cerr << "Unknown resolution: " << name << std::endl;
+                    return 1;
+                }
+                resolutions.push_back(*match);
+            }
+        } else if (arg.find("--clip=") == 0) {
+            clipPath = arg.substr(7);
+        } else if (arg.find("--frames=") == 0) {
+            frames = std::stoi(arg.substr(9));
+        } else if (arg.find("--json=") == 0) {
+            jsonPath = arg.substr(7);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (codecs.empty() || encoders.empty() || tunes.empty() || bitratesKbps.empty() || resolutions.empty() ||
+        frames <= 0) {
+        std::cerr << "Every axis needs at least one value" << std::endl;
+        return 1;
+    }
+    // Encoder init messages would bury the progress lines
+    Log::SetLevel(LogLevel::Warn);
+
+    std::vector<PointResult> results;
+    // A recording is used at its own size, so it is a single "resolution"
+    size_t clipCount = clipPath.empty() ? resolutions.size() : 1;
+    for (size_t clipIndex = 0; clipIndex < clipCount; clipIndex++) {
+        MatrixClip clip;
+        if (clipPath.empty()) {
+            clip.UseSynthetic(resolutions[clipIndex], frames);
+        } else if (!clip.OpenRecording(clipPath, frames)) {
+            return 1;
+        }
+
+        for (CompressionType codec : codecs) {
+            for (const std::string& encoder : encoders) {
+                if (encoder != "default" && !VideoEncoder::EncoderProduces(encoder, codec)) {
+                    continue;
+                }
+                for (const std::string& preset : presets.empty() ? DefaultPresets(codec) : presets) {
+                    for (const std::string& tune : tunes) {
+                        for (uint32_t kbps : bitratesKbps) {
+                            MatrixPoint point;
+                            point.codec = codec;
+                            point.options.framerate = kFramerate;
+                            point.options.bitrate = kbps * 1000;
+                            point.options.encoder = OptionValue(encoder);
+                            point.options.preset = OptionValue(preset);
+                            point.options.tune = OptionValue(tune);
+
+                            std::string label = std::string(CodecLabel(codec)) + "/" + encoder + "/" +
+                                                OptionLabel(point.options.preset) + "/" + tune + "/" +
+                                                std::to_string(kbps) + "k/" + clip.GetName();
+                            std::cout << "Running " << label << "..." << std::endl;
+                            PointResult result;
+                            if (!RunPoint(point, clip, result)) {
+                                std::cerr << "Skipping " << label << ": encoder unavailable or options rejected"
+                                          << std::endl;
+                                continue;
+                            }
+                            results.push_back(std::move(result));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    PrintResults(results);
+
+    if (!jsonPath.empty()) {
+        if (!WriteJson(results, clipPath.empty() ? "synthetic" : clipPath, frames, jsonPath)) {
+            std::cerr << "Failed to write " << jsonPath << std::endl;
+            return 1;
+        }
+        std::cout << "Results written to " << jsonPath << std::endl;
+    }
+    return results.empty() ? 1 : 0;
+}
@@ -0,0 +1,237 @@
+#include "BenchHarness.h"
+#include "ColorConvert.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <iostream>
+#include <string>
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+namespace {
+
+struct YuvImage {
+    std::vector<uint8_t> data;
+    YuvPlanes planes;
+};
+
+AVPixelFormat ToAVPixelFormat(PixelFormat format) {
+    return format == PixelFormat::NV12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
+}
+
+// Applies BT.709 limited range on the YUV side of a swscale context
+void SetBT709(SwsContext* sws, bool yuvIsSource) {
+    const int* bt709 = sws_getCoefficients(SWS_CS_ITU709);
+    sws_setColorspaceDetails(sws, bt709, yuvIsSource ? 0 : 1, bt709, yuvIsSource ? 1 : 0, 0, 1 << 16, 1 << 16);
+}
+
+// Converts a synthetic desktop frame to 4:2:0 the way the encoder would
+bool MakeSourceImage(PixelFormat format, const BenchResolution& res, YuvImage& image) {
+    std::vector<uint8_t> bgra;
+    GenerateSyntheticDesktop(0, res.width, res.height, bgra);
+
+    const size_t lumaSize = static_cast<size_t>(res.width) * res.height;
+    const uint32_t chromaWidth = (res.width + 1) / 2;
+    const uint32_t chromaHeight = (res.height + 1) / 2;
+    image.data.assign(lumaSize + static_cast<size_t>(chromaWidth) * chromaHeight * 2, 0);
+
+    YuvPlanes& p = image.planes;
+    p.format = format;
+    p.width = res.width;
+    p.height = res.height;
+    p.matrix = ColorMatrix::BT709;
+    p.range = ColorRange::Limited;
+    p.planes[0] = image.data.data();
+    p.strides[0] = static_cast<int>(res.width);
+    p.planes[1] = image.data.data() + lumaSize;
+    if (format == PixelFormat::NV12) {
+        p.strides[1] = static_cast<int>(chromaWidth * 2);
+    } else {
+        p.strides[1] = static_cast<int>(chromaWidth);
+        p.planes[2] = p.planes[1] + static_cast<size_t>(chromaWidth) * chromaHeight;
+        p.strides[2] = static_cast<int>(chromaWidth);
+    }
+
+    SwsContext* sws = sws_getContext(res.width, res.height, AV_PIX_FMT_BGRA, res.width, res.height,
+                                     ToAVPixelFormat(format), SWS_POINT, nullptr, nullptr, nullptr);
+    if (!sws) {
+        return false;
+    }
+    SetBT709(sws, false);
+    const uint8_t* srcData[4] = { bgra.data(), nullptr, nullptr, nullptr };
+    int srcStride[4] = { static_cast<int>(res.width * 4), 0, 0, 0 };
+    uint8_t* dstData[4] = { const_cast<uint8_t*>(p.planes[0]), const_cast<uint8_t*>(p.planes[1]),
+                            const_cast<uint8_t*>(p.planes[2]), nullptr };
+    int dstStride[4] = { p.strides[0], p.strides[1], p.strides[2], 0 };
+    sws_scale(sws, srcData, srcStride, 0, res.height, dstData, dstStride);
+    sws_freeContext(sws);
+    return true;
+}
+
+int MaxAbsDiff(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+    int maxDiff = 0;
+    for (size_t i = 0; i < std::min(a.size(), b.size()); i++) {
+        maxDiff = std::max(maxDiff, std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i])));
+    }
+    return maxDiff;
+}
+
+} // namespace
+
+// YUV 4:2:0 -> BGRA: the vectorized kernels against the swscale path the
+// decoder used before (SWS_FAST_BILINEAR). max_diff compares each kernel's
+// output with the scalar reference.
+MR_BENCHMARK(YuvToBgra) {
+    const PixelFormat formats[] = { PixelFormat::I420, PixelFormat::NV12 };
+    const ConvertIsa isas[] = { ConvertIsa::Scalar, ConvertIsa::SSE2, ConvertIsa::AVX2 };
+
+    for (PixelFormat format : formats) {
+        if (ctx.quick && format != PixelFormat::I420) {
+            continue;
+        }
+        const char* formatName = format == PixelFormat::NV12 ? "nv12" : "i420";
+        for (const BenchResolution& res : kBenchResolutions) {
+            std::string prefix = std::string("yuv2bgra/") + formatName + "/" + res.name;
+            if (!ctx.Matches(prefix)) {
+                continue;
+            }
+
+            YuvImage image;
+            if (!MakeSourceImage(format, res, image)) {
+                std::cerr << "Skipping " << prefix << ": could not create source image" << std::endl;
+                continue;
+            }
+            const YuvPlanes& src = image.planes;
+            const double megapixels = static_cast<double>(res.width) * res.height / 1e6;
+            const int dstStride = static_cast<int>(res.width * 4);
+
+            std::vector<uint8_t> reference(static_cast<size_t>(dstStride) * res.height);
+            ConvertYuvToRgb32(src, reference.data(), dstStride, PixelFormat::BGRA, ConvertIsa::Scalar);
+            std::vector<uint8_t> bgra(reference.size());
+
+            auto makeResult = [&](const char* impl) {
+                BenchResult result;
+                result.name = "yuv2bgra";
+                result.params = {
+                    { "format", formatName },
+                    { "resolution", res.name },
+                    { "impl", impl },
+                };
+                result.samplesMs.Reserve(static_cast<size_t>(ctx.frames));
+                return result;
+            };
+            auto finish = [&](BenchResult& result) {
+                double meanMs = result.samplesMs.Mean();
+                result.metrics = {
+                    { "mpix_per_s", meanMs > 0 ? megapixels * 1000.0 / meanMs : 0.0 },
+                    { "max_diff", static_cast<double>(MaxAbsDiff(bgra, reference)) },
+                };
+                ctx.Report(std::move(result));
+            };
+
+            // swscale baseline, configured like VideoDecoder used to
+            SwsContext* sws = sws_getContext(res.width, res.height, ToAVPixelFormat(format), res.width, res.height,
+                                             AV_PIX_FMT_BGRA, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+            if (sws) {
+                SetBT709(sws, true);
+                BenchResult result = makeResult("swscale");
+                // swscale reads four plane pointers
+                const uint8_t* srcData[4] = { src.planes[0], src.planes[1], src.planes[2], nullptr };
+                int srcLinesize[4] = { src.strides[0], src.strides[1], src.strides[2], 0 };
+                uint8_t* dstData[4] = { bgra.data(), nullptr, nullptr, nullptr };
+                int dstLinesize[4] = { dstStride, 0, 0, 0 };
+                for (int i = 0; i < ctx.frames; i++) {
+                    auto start = BenchClock::now();
+                    sws_scale(sws, srcData, srcLinesize, 0, res.height, dstData, dstLinesize);
+                    result.samplesMs.Add(ElapsedMs(start));
+                }
+                sws_freeContext(sws);
+                finish(result);
+            }
+
+            for (ConvertIsa isa : isas) {
+                if (!IsConvertIsaSupported(isa)) {
+                    continue;
+                }
+                BenchResult result = makeResult(GetConvertIsaName(isa));
+                for (int i = 0; i < ctx.frames; i++) {
+                    auto start = BenchClock::now();
+                    ConvertYuvToRgb32(src, bgra.data(), dstStride, PixelFormat::BGRA, isa);
+                    result.samplesMs.Add(ElapsedMs(start));
+                }
+                finish(result);
+            }
+        }
+    }
+}
+
+// BGRA -> YUV 4:2:0, the first step of every encode. FAST_BILINEAR is what
+// VideoEncoder uses; the other scalers show what a quality or speed change
+// would cost.
+MR_BENCHMARK(BgraToYuv) {
+    struct Scaler {
+        const char* name;
+        int flags;
+    };
+    const Scaler fullScalers[] = {
+        { "fast_bilinear", SWS_FAST_BILINEAR }, { "bilinear", SWS_BILINEAR }, { "point", SWS_POINT },
+    };
+    const Scaler quickScalers[] = { { "fast_bilinear", SWS_FAST_BILINEAR } };
+    std::vector<Scaler> scalers(std::begin(fullScalers), std::end(fullScalers));
+    if (ctx.quick) {
+        scalers.assign(std::begin(quickScalers), std::end(quickScalers));
+    }
+
+    for (const BenchResolution& res : kBenchResolutions) {
+        std::string prefix = std::string("bgra2yuv/i420/") + res.name;
+        if (!ctx.Matches(prefix)) {
+            continue;
+        }
+
+        std::vector<uint8_t> bgra;
+        GenerateSyntheticDesktop(0, res.width, res.height, bgra);
+        const double megapixels = static_cast<double>(res.width) * res.height / 1e6;
+
+        const size_t lumaSize = static_cast<size_t>(res.width) * res.height;
+        const uint32_t chromaWidth = (res.width + 1) / 2;
+        const uint32_t chromaHeight = (res.height + 1) / 2;
+        const size_t chromaSize = static_cast<size_t>(chromaWidth) * chromaHeight;
+        std::vector<uint8_t> yuv(lumaSize + chromaSize * 2);
+
+        const uint8_t* srcData[4] = { bgra.data(), nullptr, nullptr, nullptr };
+        int srcStride[4] = { static_cast<int>(res.width * 4), 0, 0, 0 };
+        uint8_t* dstData[4] = { yuv.data(), yuv.data() + lumaSize, yuv.data() + lumaSize + chromaSize, nullptr };
+        int dstStride[4] = { static_cast<int>(res.width), static_cast<int>(chromaWidth),
+                             static_cast<int>(chromaWidth), 0 };
+
+        for (const Scaler& scaler : scalers) {
+            SwsContext* sws = sws_getContext(res.width, res.height, AV_PIX_FMT_BGRA, res.width, res.height,
+                                             AV_PIX_FMT_YUV420P, scaler.flags, nullptr, nullptr, nullptr);
+            if (!sws) {
+                std::cerr << "Skipping " << prefix << "/" << scaler.name << ": no swscale context" << std::endl;
+                continue;
+            }
+
+            BenchResult result;
+            result.name = "bgra2yuv";
+            result.params = {
+                { "format", "i420" },
+                { "resolution", res.name },
+                { "impl", std::string("swscale_") + scaler.name },
+            };
+            result.samplesMs.Reserve(static_cast<size_t>(ctx.frames));
+            for (int i = 0; i < ctx.frames; i++) {
+                auto start = BenchClock::now();
+                sws_scale(sws, srcData, srcStride, 0, res.height, dstData, dstStride);
+                result.samplesMs.Add(ElapsedMs(start));
+            }
+            sws_freeContext(sws);
+
+            double meanMs = result.samplesMs.Mean();
+            result.metrics = { { "mpix_per_s", meanMs > 0 ? megapixels * 1000.0 / meanMs : 0.0 } };
+            ctx.Report(std::move(result));
+        }
+    }
+}
@@ -0,0 +1,138 @@
+#include "BenchHarness.h"
+#include "BufferPool.h"
+#include "VideoDecoder.h"
+#include "VideoEncoder.h"
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+
+namespace {
+
+const char* ThreadingLabel(DecodeThreading threading) {
+    switch (threading) {
+        case DecodeThreading::Slice: return "slice";
+        case DecodeThreading::Frame: return "frame";
+        default: return "none";
+    }
+}
+
+// Encodes `frames` synthetic desktop frames into pooled, decoder-padded
+// packets, the same way NetworkReceiver hands them to the decoder.
+bool EncodeClip(CompressionType codec, const BenchResolution& res, int frames,
+                BufferPool& pool, std::vector<BufferHandle>& packets) {
+    VideoEncoder encoder;
+    if (!encoder.Initialize(res.width, res.height, codec)) {
+        return false;
+    }
+
+    std::vector<uint8_t> bgra;
+    std::vector<uint8_t> compressed;
+    for (int i = 0; i < frames; i++) {
+        GenerateSyntheticDesktop(static_cast<uint32_t>(i), res.width, res.height, bgra);
+        bool isKeyframe = false;
+        if (encoder.EncodeFrame(bgra.data(), compressed, isKeyframe)) {
+            BufferHandle packet = pool.Acquire(compressed.size());
+            std::memcpy(packet.data(), compressed.data(), compressed.size());
+            packets.push_back(std::move(packet));
+        }
+    }
+    return !packets.empty();
+}
+
+struct ThreadConfig {
+    DecodeThreading threading;
+    int threads;
+};
+
+} // namespace
+
+// Per-frame decode latency: time from submitting a packet until the frame it
+// produced comes out as BGRA. Frame threading shows up as extra pipeline delay.
+MR_BENCHMARK(DecodeLatency) {
+    const CompressionType codecs[] = { COMPRESSION_H264, COMPRESSION_H265, COMPRESSION_AV1 };
+    const std::vector<ThreadConfig> fullConfigs = {
+        { DecodeThreading::None, 1 },
+        { DecodeThreading::Slice, 2 }, { DecodeThreading::Slice, 4 }, { DecodeThreading::Slice, 8 },
+        { DecodeThreading::Frame, 2 }, { DecodeThreading::Frame, 4 }, { DecodeThreading::Frame, 8 },
+    };
+    const std::vector<ThreadConfig> quickConfigs = {
+        { DecodeThreading::None, 1 }, { DecodeThreading::Slice, 4 }, { DecodeThreading::Frame, 4 },
+    };
+    const std::vector<ThreadConfig>& configs = ctx.quick ? quickConfigs : fullConfigs;
+
+    for (CompressionType codec : codecs) {
+        for (const BenchResolution& res : kBenchResolutions) {
+            if (ctx.quick && res.width != kBench1080p.width) {
+                continue;
+            }
+            std::string prefix = std::string("decode/") + CodecLabel(codec) + "/" + res.name;
+            if (!ctx.Matches(prefix)) {
+                continue;
+            }
+
+            BufferPool pool(VideoDecoder::kInputPaddingSize, static_cast<size_t>(ctx.frames));
+            std::vector<BufferHandle> packets;
+            if (!EncodeClip(codec, res, ctx.frames, pool, packets)) {
+                std::cerr << "Skipping " << prefix << ": encoder unavailable" << std::endl;
+                continue;
+            }
+
+            for (const ThreadConfig& config : configs) {
+                DecoderOptions options;
+                options.threading = config.threading;
+                options.threadCount = config.threads;
+
+                VideoDecoder decoder;
+                if (!decoder.Initialize(res.width, res.height, codec, options)) {
+                    std::cerr << "Skipping " << prefix << ": decoder unavailable" << std::endl;
+                    break;
+                }
+
+                BenchResult result;
+                result.name = "decode";
+                result.params = {
+                    { "codec", CodecLabel(codec) },
+                    { "resolution", res.name },
+                    { "threading", ThreadingLabel(config.threading) },
+                    { "threads", std::to_string(config.threads) },
+                };
+                result.samplesMs.Reserve(packets.size());
+
+                // Frames come out in submission order (no B-frames), so match
+                // each output to the oldest outstanding packet.
+                std::deque<BenchClock::time_point> inFlight;
+                std::vector<uint8_t> bgra;
+                int delayedPackets = -1;
+                BenchPerfSnapshot perfBefore;
+                auto start = BenchClock::now();
+                for (size_t i = 0; i < packets.size(); i++) {
+                    inFlight.push_back(BenchClock::now());
+                    if (decoder.DecodeFrame(packets[i], bgra)) {
+                        if (delayedPackets < 0) {
+                            delayedPackets = static_cast<int>(i);
+                        }
+                        result.samplesMs.Add(ElapsedMs(inFlight.front()));
+                        inFlight.pop_front();
+                    }
+                }
+                // Frames still in the pipeline belong to the last packets
+                while (!inFlight.empty() && decoder.DrainFrame(bgra)) {
+                    if (delayedPackets < 0) {
+                        delayedPackets = static_cast<int>(packets.size());
+                    }
+                    result.samplesMs.Add(ElapsedMs(inFlight.front()));
+                    inFlight.pop_front();
+                }
+                double totalMs = ElapsedMs(start);
+
+                result.metrics = {
+                    { "fps", totalMs > 0 ? result.samplesMs.Count() * 1000.0 / totalMs : 0.0 },
+                    { "pipeline_delay_frames", static_cast<double>(delayedPackets < 0 ? 0 : delayedPackets) },
+                };
+                AddPerfMetrics(result, perfBefore);
+                ctx.Report(std::move(result));
+            }
+        }
+    }
+}
@@ -0,0 +1,135 @@
+#include "BenchHarness.h"
+#include "FrameQuality.h"
+#include "VideoDecoder.h"
+#include "VideoEncoder.h"
+#include <iostream>
+#include <string>
+
+namespace {
+
+struct PresetSweep {
+    CompressionType codec;
+    std::vector<std::string> full;   // Fastest first; "" is the shipping default
+    std::vector<std::string> quick;
+};
+
+// Decodes the clip's packets and measures each output against the frame that
+// produced it. Outputs come in submission order (no B-frames), so output i is
+// clip frame i; encoder lookahead only shortens the tail.
+bool MeasureClipQuality(CompressionType codec, const BenchResolution& res,
+                        const std::vector<std::vector<uint8_t>>& clip,
+                        const std::vector<std::vector<uint8_t>>& packets, SampleStats& psnr, SampleStats& ssim) {
+    VideoDecoder decoder;
+    if (!decoder.Initialize(res.width, res.height, codec)) {
+        return false;
+    }
+    FrameQualityMeter meter;
+    std::vector<uint8_t> bgra;
+    size_t decoded = 0;
+    for (const std::vector<uint8_t>& packet : packets) {
+        if (!decoder.DecodeFrame(packet.data(), packet.size(), bgra) || decoded >= clip.size()) {
+            continue;
+        }
+        FrameQuality quality;
+        if (meter.Measure(clip[decoded].data(), bgra.data(), res.width, res.height,
+                          static_cast<size_t>(res.width) * 4, quality)) {
+            psnr.Add(quality.psnr);
+            ssim.Add(quality.ssim);
+        }
+        decoded++;
+    }
+    return decoded > 0;
+}
+
+} // namespace
+
+// Per-frame encode cost (BGRA -> YUV conversion included, as in the server)
+// for each codec and speed preset, plus the bitrate the preset produces on
+// the synthetic desktop at the default 5 Mbps target. The packets are then
+// decoded (untimed) for luma PSNR/SSIM, so presets can be compared on
+// quality per bit and per millisecond.
+MR_BENCHMARK(Encode) {
+    const PresetSweep sweeps[] = {
+        { COMPRESSION_H264, { "", "superfast", "veryfast", "faster" }, { "" } },
+        { COMPRESSION_H265, { "", "superfast", "veryfast", "faster" }, { "" } },
+        { COMPRESSION_AV1, { "", "6", "4" }, { "" } },
+    };
+
+    for (const PresetSweep& sweep : sweeps) {
+        for (const BenchResolution& res : kBenchResolutions) {
+            if (ctx.quick && res.width != kBench1080p.width) {
+                continue;
+            }
+            std::string prefix = std::string("encode/") + CodecLabel(sweep.codec) + "/" + res.name;
+            if (!ctx.Matches(prefix)) {
+                continue;
+            }
+
+            // Generate the clip up front so only the encoder is timed
+            std::vector<std::vector<uint8_t>> clip(static_cast<size_t>(ctx.frames));
+            for (int i = 0; i < ctx.frames; i++) {
+                GenerateSyntheticDesktop(static_cast<uint32_t>(i), res.width, res.height, clip[i]);
+            }
+
+            for (const std::string& preset : ctx.quick ? sweep.quick : sweep.full) {
+                EncoderOptions options;
+                options.preset = preset;
+                VideoEncoder encoder;
+                if (!encoder.Initialize(res.width, res.height, sweep.codec, options)) {
+                    std::cerr << "Skipping " << prefix << " preset " << (preset.empty() ? "default" : preset)
+                              << ": encoder unavailable or preset rejected" << std::endl;
+                    continue;
+                }
+
+                BenchResult result;
+                result.name = "encode";
+                result.params = {
+                    { "codec", CodecLabel(sweep.codec) },
+                    { "resolution", res.name },
+                    { "preset", preset.empty() ? "default" : preset },
+                };
+                result.samplesMs.Reserve(clip.size());
+
+                std::vector<uint8_t> compressed;
+                std::vector<std::vector<uint8_t>> encoded;
+                encoded.reserve(clip.size());
+                uint64_t totalBytes = 0;
+                int packets = 0;
+                int keyframes = 0;
+                BenchPerfSnapshot perfBefore;
+                auto start = BenchClock::now();
+                for (const std::vector<uint8_t>& frame : clip) {
+                    auto frameStart = BenchClock::now();
+                    bool isKeyframe = false;
+                    bool produced = encoder.EncodeFrame(frame.data(), compressed, isKeyframe);
+                    result.samplesMs.Add(ElapsedMs(frameStart));
+                    if (produced) {
+                        totalBytes += compressed.size();
+                        packets++;
+                        keyframes += isKeyframe ? 1 : 0;
+                        encoded.push_back(compressed);
+                    }
+                }
+                double totalMs = ElapsedMs(start);
+
+                // Bitrate as if the clip played at the encoder's 60 fps
+                double clipSeconds = packets / 60.0;
+                result.metrics = {
+                    { "fps", totalMs > 0 ? clip.size() * 1000.0 / totalMs : 0.0 },
+                    { "kbps", clipSeconds > 0 ? totalBytes * 8.0 / 1000.0 / clipSeconds : 0.0 },
+                    { "bytes_per_frame", packets > 0 ? static_cast<double>(totalBytes) / packets : 0.0 },
+                    { "keyframes", static_cast<double>(keyframes) },
+                };
+                AddPerfMetrics(result, perfBefore); // Before the quality pass decodes
+                SampleStats psnr;
+                SampleStats ssim;
+                if (MeasureClipQuality(sweep.codec, res, clip, encoded, psnr, ssim)) {
+                    result.metrics.push_back({ "psnr_db", psnr.Mean() });
+                    result.metrics.push_back({ "psnr_min_db", psnr.Min() });
+                    result.metrics.push_back({ "ssim", ssim.Mean() });
+                }
+                ctx.Report(std::move(result));
+            }
+        }
+    }
+}
@@ -0,0 +1,249 @@
+#include "BenchHarness.h"
+#include "Clock.h"
+#include "FrameSender.h"
+#include "NetworkReceiver.h"
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#endif
+
+namespace {
+
+using StampClock = std::chrono::steady_clock;
+
+// Every point in a frame's life, all on one clock since both ends share the process
+struct FrameStamps {
+    StampClock::time_point capture;
+    StampClock::time_point encodeDone;
+    StampClock::time_point sendDone;
+    StampClock::time_point received;
+    StampClock::time_point decoded;
+};
+
+constexpr int kDistinctFrames = 8;   // Synthetic frames cycled through, to bound memory at 4K
+constexpr int kTargetFps = 60;       // The server's capture rate
+constexpr int kDrainTimeoutMs = 3000;
+
+// Listening socket on 127.0.0.1 with an ephemeral port
+SOCKET ListenLoopback(uint16_t& port) {
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addrLen = sizeof(addr);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR ||
+        listen(listener, 1) == SOCKET_ERROR ||
+        getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &addrLen) == SOCKET_ERROR) {
+        closesocket(listener);
+        return INVALID_SOCKET;
+    }
+    port = ntohs(addr.sin_port);
+    return listener;
+}
+
+// Wakes a ServeFrames() thread still blocked in accept()
+void ReleaseAccept(uint16_t port) {
+    SOCKET poke = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    connect(poke, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    closesocket(poke);
+}
+
+// Server side: accept one client, take its compression request, then push
+// `frames` frames through FrameSender at the capture rate
+void ServeFrames(SOCKET listener, const std::vector<std::vector<uint8_t>>& clip, const BenchResolution& res,
+                 int frames, std::vector<FrameStamps>& stamps, std::atomic<int>& framesSent) {
+    SOCKET client = accept(listener, nullptr, nullptr);
+    if (client == INVALID_SOCKET) {
+        return;
+    }
+    CompressionRequestMessage request{};
+    CompressionType compression = COMPRESSION_NONE;
+    if (recv(client, reinterpret_cast<char*>(&request), sizeof(request), MSG_WAITALL) == sizeof(request) &&
+        request.header.type == MSG_COMPRESSION_REQUEST) {
+        compression = request.compression;
+    }
+
+    FrameSender sender(client, compression);
+    const auto interval = std::chrono::microseconds(1000000 / kTargetFps);
+    auto next = StampClock::now();
+    for (int i = 0; i < frames; i++) {
+        std::this_thread::sleep_until(next);
+        next += interval;
+
+        const std::vector<uint8_t>& pixels = clip[i % clip.size()];
+        CapturedFrame frame;
+        frame.data = pixels.data();
+        frame.width = res.width;
+        frame.height = res.height;
+        frame.dataSize = static_cast<uint32_t>(pixels.size());
+        frame.captureTimeUs = ClockNowUs();
+
+        FrameStamps& stamp = stamps[framesSent];
+        SentFrame sent;
+        FrameSender::Result result = sender.Send(frame, sent);
+        if (result == FrameSender::Result::Failed) {
+            break;
+        }
+        if (result == FrameSender::Result::Sent) {
+            // An encoder that buffers sends an earlier capture than this one
+            stamp.capture = StampClock::time_point(std::chrono::microseconds(sent.captureTimeUs));
+            stamp.encodeDone = sent.encodeDone;
+            stamp.sendDone = sent.sendDone;
+            framesSent++;
+        }
+    }
+    closesocket(client);
+}
+
+double StageMs(StampClock::time_point from, StampClock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+} // namespace
+
+// End-to-end latency over loopback TCP: FrameSender (the server's encode and
+// send step) on one thread, NetworkReceiver decoding to BGRA on this one.
+// Each frame is stamped at capture, encode done, send done, receive done and
+// decode done; stages (encode, send, transfer, decode) are reported
+// separately and as a total. Frames are
+// paced at the server's 60 fps, so fps below that means the pipeline can't
+// keep up. The receiver runs unthreaded so every frame is decoded; decoded
+// frames are matched to their stamps by sequence number.
+MR_BENCHMARK(LoopbackLatency) {
+    const CompressionType codecs[] = { COMPRESSION_H264, COMPRESSION_H265, COMPRESSION_AV1, COMPRESSION_NONE };
+
+    for (CompressionType codec : codecs) {
+        if (ctx.quick && codec != COMPRESSION_H264) {
+            continue;
+        }
+        for (const BenchResolution& res : kBenchResolutions) {
+            if (ctx.quick && res.width != kBench1080p.width) {
+                continue;
+            }
+            std::string prefix = std::string("loopback/") + CodecLabel(codec) + "/" + res.name;
+            if (!ctx.Matches(prefix)) {
+                continue;
+            }
+
+            std::vector<std::vector<uint8_t>> clip(kDistinctFrames);
+            for (int i = 0; i < kDistinctFrames; i++) {
+                GenerateSyntheticDesktop(static_cast<uint32_t>(i), res.width, res.height, clip[i]);
+            }
+
+            // The receiver comes first: on Windows it initializes Winsock
+            NetworkReceiver receiver;
+            receiver.SetCompression(codec);
+
+            uint16_t port = 0;
+            SOCKET listener = ListenLoopback(port);
+            if (listener == INVALID_SOCKET) {
+                std::cerr << "Skipping " << prefix << ": could not listen on loopback" << std::endl;
+                continue;
+            }
+
+            std::vector<FrameStamps> stamps(static_cast<size_t>(ctx.frames));
+            std::atomic<int> framesSent{0};
+            size_t framesReceived = 0;
+            size_t framesDecoded = 0;
+            receiver.SetRawFrameCallback([&](MessageType) {
+                if (framesReceived < stamps.size()) {
+                    stamps[framesReceived].received = StampClock::now();
+                }
+                framesReceived++;
+            });
+            receiver.SetFrameCallback([&](const FrameMessage& frameMsg, std::span<const uint8_t>) {
+                // Decoders may hold frames back, so match by sequence number
+                if (frameMsg.timing.sequence < stamps.size()) {
+                    stamps[frameMsg.timing.sequence].decoded = StampClock::now();
+                }
+                framesDecoded++;
+            });
+
+            BenchPerfSnapshot perfBefore;
+            std::thread server(ServeFrames, listener, std::cref(clip), std::cref(res), ctx.frames,
+                               std::ref(stamps), std::ref(framesSent));
+            if (!receiver.Connect("127.0.0.1", port)) {
+                std::cerr << "Skipping " << prefix << ": connect failed" << std::endl;
+                ReleaseAccept(port);
+                server.join();
+                closesocket(listener);
+                continue;
+            }
+
+            // Poll without sleeping so the poll interval doesn't show up as latency
+            auto lastProgress = StampClock::now();
+            size_t lastDecoded = 0;
+            while (framesDecoded < static_cast<size_t>(ctx.frames)) {
+                receiver.PollFrame();
+                if (framesDecoded != lastDecoded) {
+                    lastDecoded = framesDecoded;
+                    lastProgress = StampClock::now();
+                } else if (StageMs(lastProgress, StampClock::now()) > kDrainTimeoutMs) {
+                    break; // Encoder missing, or frames lost
+                }
+            }
+            server.join();
+            receiver.Disconnect();
+            closesocket(listener);
+
+            size_t complete = std::min({ static_cast<size_t>(framesSent.load()), framesReceived, framesDecoded });
+            if (complete == 0) {
+                std::cerr << "Skipping " << prefix << ": no frames made it through" << std::endl;
+                continue;
+            }
+
+            struct Stage {
+                const char* name;
+                StampClock::time_point FrameStamps::*from;
+                StampClock::time_point FrameStamps::*to;
+            };
+            // "send" is how long the server thread sat in send(); "transfer"
+            // runs from encode done until the receiver has parsed the whole
+            // message, so it overlaps "send" rather than following it.
+            const Stage stages[] = {
+                { "encode", &FrameStamps::capture, &FrameStamps::encodeDone },
+                { "send", &FrameStamps::encodeDone, &FrameStamps::sendDone },
+                { "transfer", &FrameStamps::encodeDone, &FrameStamps::received },
+                { "decode", &FrameStamps::received, &FrameStamps::decoded },
+                { "total", &FrameStamps::capture, &FrameStamps::decoded },
+            };
+            double spanSeconds = StageMs(stamps[0].capture, stamps[complete - 1].decoded) / 1000.0;
+            for (const Stage& stage : stages) {
+                BenchResult result;
+                result.name = "loopback";
+                result.params = {
+                    { "codec", CodecLabel(codec) },
+                    { "resolution", res.name },
+                    { "stage", stage.name },
+                };
+                result.samplesMs.Reserve(complete);
+                for (size_t i = 0; i < complete; i++) {
+                    result.samplesMs.Add(StageMs(stamps[i].*stage.from, stamps[i].*stage.to));
+                }
+                if (std::string(stage.name) == "total") {
+                    result.metrics = {
+                        { "fps", spanSeconds > 0 && complete > 1 ? (complete - 1) / spanSeconds : 0.0 },
+                        { "frames", static_cast<double>(complete) },
+                        { "lost", static_cast<double>(framesSent.load() - static_cast<int>(complete)) },
+                    };
+                    AddPerfMetrics(result, perfBefore); // Server and client stages together
+                }
+                ctx.Report(std::move(result));
+            }
+        }
+    }
+}
@@ -0,0 +1,148 @@
+#include "BenchHarness.h"
+#include "BufferPool.h"
+#include "FrameParser.h"
+#include "FrameUtils.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace {
+
+// Serialized frame messages served in socket-sized chunks. The stream holds
+// whole messages and wraps around, so any number of frames can be read.
+class MemoryStream {
+private:
+    std::vector<uint8_t> m_bytes;
+    size_t m_pos = 0;
+    int m_chunk;
+
+public:
+    explicit MemoryStream(int chunk) : m_chunk(chunk) {}
+
+    void AppendFrame(MessageType type, uint32_t width, uint32_t height, uint32_t payloadSize, uint8_t fill) {
+        size_t offset = m_bytes.size();
+        if (type == MSG_COMPRESSED_FRAME) {
+            CompressedFrameMessage msg{};
+            msg.header.type = MSG_COMPRESSED_FRAME;
+            msg.header.size = sizeof(msg);
+            msg.width = width;
+            msg.height = height;
+            msg.compressedSize = payloadSize;
+            msg.compression = COMPRESSION_H264;
+            m_bytes.resize(offset + sizeof(msg) + payloadSize, fill);
+            std::memcpy(m_bytes.data() + offset, &msg, sizeof(msg));
+        } else {
+            FrameMessage msg{};
+            msg.header.type = MSG_FRAME_DATA;
+            msg.header.size = sizeof(msg);
+            msg.width = width;
+            msg.height = height;
+            msg.dataSize = payloadSize;
+            m_bytes.resize(offset + sizeof(msg) + payloadSize, fill);
+            std::memcpy(m_bytes.data() + offset, &msg, sizeof(msg));
+        }
+    }
+
+    int Recv(uint8_t* buffer, int len) {
+        size_t count = std::min({ static_cast<size_t>(len), static_cast<size_t>(m_chunk), m_bytes.size() - m_pos });
+        std::memcpy(buffer, m_bytes.data() + m_pos, count);
+        m_pos = (m_pos + count) % m_bytes.size();
+        return static_cast<int>(count);
+    }
+};
+
+struct StreamKind {
+    const char* name;
+    MessageType type;
+    uint32_t bitsPerPixel;  // Payload size relative to the frame
+};
+
+} // namespace
+
+// Wire parsing throughput: the blocking ReadFrameGeneric used by the simple
+// clients against the resumable FrameParser used by NetworkReceiver, fed
+// 64 KB at a time like a socket. Compressed payloads are sized like a
+// keyframe at 1 bit per pixel; raw payloads are full BGRA frames.
+MR_BENCHMARK(Parse) {
+    const StreamKind kinds[] = {
+        { "compressed", MSG_COMPRESSED_FRAME, 1 },
+        { "raw", MSG_FRAME_DATA, 32 },
+    };
+    const int kChunkBytes = 64 * 1024;
+    const int kStreamFrames = 4;
+
+    for (const StreamKind& kind : kinds) {
+        for (const BenchResolution& res : kBenchResolutions) {
+            if (ctx.quick && res.width != kBench1080p.width) {
+                continue;
+            }
+            std::string prefix = std::string("parse/") + kind.name + "/" + res.name;
+            if (!ctx.Matches(prefix)) {
+                continue;
+            }
+
+            const uint32_t payloadSize =
+                static_cast<uint32_t>(static_cast<uint64_t>(res.width) * res.height * kind.bitsPerPixel / 8);
+            const size_t messageBytes = payloadSize +
+                (kind.type == MSG_COMPRESSED_FRAME ? sizeof(CompressedFrameMessage) : sizeof(FrameMessage));
+
+            auto report = [&](const char* impl, BenchResult& result, double totalMs) {
+                result.name = "parse";
+                result.params = {
+                    { "stream", kind.name },
+                    { "resolution", res.name },
+                    { "impl", impl },
+                };
+                double seconds = totalMs / 1000.0;
+                result.metrics = {
+                    { "msgs_per_s", seconds > 0 ? result.samplesMs.Count() / seconds : 0.0 },
+                    { "mb_per_s", seconds > 0 ? result.samplesMs.Count() * messageBytes / 1e6 / seconds : 0.0 },
+                };
+                ctx.Report(std::move(result));
+            };
+
+            MemoryStream stream(kChunkBytes);
+            for (int i = 0; i < kStreamFrames; i++) {
+                stream.AppendFrame(kind.type, res.width, res.height, payloadSize, static_cast<uint8_t>(i));
+            }
+            auto recv = [&stream](uint8_t* buffer, int len) { return stream.Recv(buffer, len); };
+
+            {
+                BenchResult result;
+                result.samplesMs.Reserve(static_cast<size_t>(ctx.frames));
+                FrameMessage frameMsg;
+                std::vector<uint8_t> frameData;
+                auto start = BenchClock::now();
+                for (int i = 0; i < ctx.frames; i++) {
+                    auto frameStart = BenchClock::now();
+                    if (!ReadFrameGeneric(recv, frameMsg, frameData)) {
+                        break;
+                    }
+                    result.samplesMs.Add(ElapsedMs(frameStart));
+                }
+                report("read_frame_generic", result, ElapsedMs(start));
+            }
+
+            {
+                BenchResult result;
+                result.samplesMs.Reserve(static_cast<size_t>(ctx.frames));
+                BufferPool pool;
+                FrameParser parser(pool);
+                ParsedMessage msg;
+                auto start = BenchClock::now();
+                for (int i = 0; i < ctx.frames; i++) {
+                    auto frameStart = BenchClock::now();
+                    FrameParser::Status status;
+                    while ((status = parser.Poll(recv, msg)) == FrameParser::Status::NeedMore) {
+                    }
+                    if (status != FrameParser::Status::Message) {
+                        break;
+                    }
+                    msg.payload.Reset(); // Recycle, as the receiver does once a frame is consumed
+                    result.samplesMs.Add(ElapsedMs(frameStart));
+                }
+                report("frame_parser", result, ElapsedMs(start));
+            }
+        }
+    }
+}
@@ -15,37 +15,26 @@
 #include <sys/ioctl.h>
 #endif
 #include <vector>
+#include <span>
 #include <thread>
 #include <chrono>
 #include <string>
+#include <fstream>
 #include <algorithm>
+#include <cstring>
 #include "protocol.h"
+#include "../shared/Clock.h"
 #include "../shared/FrameLogger.h"
+#include "../shared/FrameQuality.h"
+#include "../shared/JsonWriter.h"
+#include "../shared/Log.h"
+#include "../shared/Metrics.h"
 #include "../shared/NetworkReceiver.h"
-
-
-#pragma pack(push, 1)
-struct BMPFileHeader {
-    uint16_t bfType{0};
-    uint32_t bfSize{0};
-    uint16_t bfReserved1{0};
-    uint16_t bfReserved2{0};
-    uint32_t bfOffBits{0};
-};
-struct BMPInfoHeader {
-    uint32_t biSize{0};
-    int32_t  biWidth{0};
-    int32_t  biHeight{0};
-    uint16_t biPlanes{1};
-    uint16_t biBitCount{0};
-    uint32_t biCompression{0};
-    uint32_t biSizeImage{0};
-    int32_t  biXPelsPerMeter{0};
-    int32_t  biYPelsPerMeter{0};
-    uint32_t biClrUsed{0};
-    uint32_t biClrImportant{0};
-};
-#pragma pack(pop)
+#include "../shared/PerfCounters.h"
+#include "../shared/SessionRecording.h"
+#include "../shared/TestPattern.h"
+#include "../shared/Trace.h"
+#include "../shared/VideoDecoder.h"
 
 #ifndef _WIN32
 static int _kbhit()
@@ -68,47 +57,6 @@ static int _getch()
 }
 #endif
 
-void SaveFrameAsBMP(const FrameMessage &frameMsg, const std::vector<uint8_t> &frameData, const std::string &filename)
-{
-    BMPFileHeader fileHeader{};
-    BMPInfoHeader infoHeader{};
-
-    fileHeader.bfType = 0x4D42; // "BM"
-    fileHeader.bfSize = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader) + frameData.size();
-    fileHeader.bfOffBits = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader);
-
-    infoHeader.biSize = sizeof(BMPInfoHeader);
-    infoHeader.biWidth = static_cast<int32_t>(frameMsg.width);
-    infoHeader.biHeight = -static_cast<int32_t>(frameMsg.height); // top-down
-    infoHeader.biPlanes = 1;
-    infoHeader.biBitCount = 32;
-    infoHeader.biCompression = 0; // BI_RGB
-    infoHeader.biSizeImage = static_cast<uint32_t>(frameData.size());
-
-#ifdef _WIN32
-    HANDLE hFile = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, nullptr,
-                               CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (hFile != INVALID_HANDLE_VALUE)
-    {
-        DWORD written;
-        WriteFile(hFile, &fileHeader, sizeof(fileHeader), &written, nullptr);
-        WriteFile(hFile, &infoHeader, sizeof(infoHeader), &written, nullptr);
-        WriteFile(hFile, frameData.data(), frameData.size(), &written, nullptr);
-        CloseHandle(hFile);
-        std::cout << "Saved frame as " << filename << std::endl;
-    }
-#else
-    std::ofstream out(filename, std::ios::binary);
-    if (out.is_open()) {
-        out.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
-        out.write(reinterpret_cast<const char*>(&infoHeader), sizeof(infoHeader));
-        out.write(reinterpret_cast<const char*>(frameData.data()), frameData.size());
-        out.close();
-        std::cout << "Saved frame as " << filename << std::endl;
-    }
-#endif
-}
-
 void PrintUsage()
 {
     std::cout << "MRDesktop Console Client - Remote Desktop Controller" << std::endl;
@@ -118,10 +66,347 @@ void PrintUsage()
     std::cout << "  --port=<port>      Server port (default: 8080)" << std::endl;
     std::cout << "  --compression=<none|h264|h265|av1>  Preferred compression (default: h265)" << std::endl;
     std::cout << "  --debug-frames[=N] Save first N frames for debugging (default: 5)" << std::endl;
-    std::cout << "  --test             Run in test mode (validate frames and exit)" << std::endl;
+    std::cout << "  --flight-recorder[=N] Keep the last N frames and recent packets; dump with F or on errors (default: 8)" << std::endl;
+    std::cout << "  --test             Run in test mode (check frames against the test pattern and exit)" << std::endl;
+    std::cout << "  --bench[=seconds]  Headless benchmark: receive for N seconds (default: 10), report JSON" << std::endl;
+    std::cout << "  --bench-json=<file> Write the benchmark report to a file instead of stdout" << std::endl;
+    std::cout << "  --record=<file>    Record the compressed stream to a session file" << std::endl;
+    std::cout << "  --playback=<file>  Decode a recorded session offline and report decode times" << std::endl;
+    std::cout << "  --seek=<seconds>   Start playback at the keyframe before this time" << std::endl;
+    std::cout << "  --loops=<N>        Decode the recording N times (default: 1)" << std::endl;
+    std::cout << "  --log-level=<debug|info|warn|error|off>  Logging detail; debug adds per-frame messages (default: info)" << std::endl;
+    std::cout << "  --metrics=<file>   Write receiver metrics in OpenMetrics text format every second" << std::endl;
+    std::cout << "  --trace=<file>     Write a Chrome trace of per-stage timings on exit (SIGUSR1 for snapshots)" << std::endl;
+    std::cout << "  --perf-counters    Count cycles, instructions and cache misses per stage (Linux perf_event_open)" << std::endl;
     std::cout << "  --help             Show this help message" << std::endl;
 }
 
+const char* CompressionName(CompressionType compression)
+{
+    switch (compression)
+    {
+    case COMPRESSION_NONE: return "none";
+    case COMPRESSION_H264: return "h264";
+    case COMPRESSION_H265: return "h265";
+    case COMPRESSION_AV1:  return "av1";
+    }
+    return "unknown";
+}
+
+// --test fails below this luma PSNR. The pattern is smooth, so any working
+// encoder setting clears it easily; missing it means broken output.
+constexpr double kMinTestPsnr = 30.0;
+
+// What decoded frames of the server's --test pattern say about the stream:
+// frame order and pixel-to-pixel latency from the embedded timecode, and
+// PSNR/SSIM against the original, redrawn from that same timecode.
+struct TestPatternCheck
+{
+    TimecodeTracker timecodes;
+    SampleStats latencyMs;
+    SampleStats psnr;
+    SampleStats ssim;
+    FrameQualityMeter meter;
+    std::vector<uint8_t> reference;
+
+    // False if the frame carries no readable timecode
+    bool Observe(const FrameMessage &frameMsg, std::span<const uint8_t> frameData, NetworkReceiver &receiver,
+                 FrameQuality &quality)
+    {
+        size_t stride = static_cast<size_t>(frameMsg.width) * 4;
+        Timecode timecode;
+        if (frameData.size() < stride * frameMsg.height ||
+            !ReadTimecode(frameData.data(), frameMsg.width, frameMsg.height, stride, timecode))
+        {
+            return false;
+        }
+        timecodes.Observe(timecode.counter);
+        int64_t clockOffsetUs = 0;
+        int64_t clockRoundTripUs = 0;
+        if (receiver.GetClockOffset(clockOffsetUs, clockRoundTripUs))
+        {
+            latencyMs.Add(TimecodeAgeMs(timecode, ClockNowUs() + clockOffsetUs));
+        }
+
+        reference.resize(stride * frameMsg.height);
+        DrawTestPattern(timecode, frameMsg.width, frameMsg.height, reference.data());
+        if (meter.Measure(reference.data(), frameData.data(), frameMsg.width, frameMsg.height, stride, quality))
+        {
+            psnr.Add(quality.psnr);
+            ssim.Add(quality.ssim);
+        }
+        return true;
+    }
+};
+
+// Machine-readable summary of a --bench run. Frame counters and decode times
+// come from the receiver; `delivered` counts frames that reached the app.
+std::string BuildBenchReport(NetworkReceiver &receiver, const std::string &server, CompressionType compression,
+                             double seconds, int delivered, const TestPatternCheck &pattern)
+{
+    ReceiverStats stats = receiver.GetStats();
+    SampleStats decodeMs = receiver.GetDecodeTimes();
+    double perSecond = seconds > 0 ? 1.0 / seconds : 0.0;
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Key("server").String(server);
+    json.Key("compression").String(CompressionName(compression));
+    json.Key("duration_s").Double(seconds);
+    json.Key("frames").BeginObject();
+    json.Key("received").UInt(stats.framesReceived);
+    json.Key("decoded").UInt(stats.framesDecoded);
+    json.Key("presented").UInt(stats.framesPresented);
+    json.Key("delivered").Int(delivered);
+    json.Key("dropped").UInt(stats.framesDropped);
+    json.Key("skipped").UInt(stats.framesSkipped);
+    json.EndObject();
+    json.Key("keyframe_requests").UInt(stats.keyframeRequests);
+    json.Key("received_fps").Double(stats.framesReceived * perSecond);
+    json.Key("bytes_per_s").Double(stats.bytesReceived * perSecond);
+    json.Key("queue_high_water").UInt(stats.queueHighWater);
+    json.Key("decode_ms").BeginObject();
+    json.Key("samples").UInt(decodeMs.Count());
+    json.Key("mean").Double(decodeMs.Mean());
+    json.Key("p50").Double(decodeMs.Percentile(50));
+    json.Key("p95").Double(decodeMs.Percentile(95));
+    json.Key("p99").Double(decodeMs.Percentile(99));
+    json.Key("max").Double(decodeMs.Max());
+    json.EndObject();
+    json.Key("frames_missing").UInt(stats.framesMissing);
+    json.Key("keepalives").UInt(stats.keepalives);
+    // Capture on the server to presentation here, through the clock offset
+    // estimate; unknown if the server sends no timestamps
+    SampleStats latencyMs = receiver.GetLatencies();
+    int64_t clockOffsetUs = 0;
+    int64_t clockRoundTripUs = 0;
+    if (latencyMs.Empty() || !receiver.GetClockOffset(clockOffsetUs, clockRoundTripUs))
+    {
+        json.Key("latency_ms").Null();
+    }
+    else
+    {
+        json.Key("latency_ms").BeginObject();
+        json.Key("samples").UInt(latencyMs.Count());
+        json.Key("mean").Double(latencyMs.Mean());
+        json.Key("p50").Double(latencyMs.Percentile(50));
+        json.Key("p95").Double(latencyMs.Percentile(95));
+        json.Key("p99").Double(latencyMs.Percentile(99));
+        json.Key("max").Double(latencyMs.Max());
+        json.Key("clock_offset_ms").Double(clockOffsetUs / 1000.0);
+        json.Key("clock_round_trip_ms").Double(clockRoundTripUs / 1000.0);
+        json.EndObject();
+    }
+    // Glass-to-glass on the pixels themselves, including frames held in the codec
+    if (pattern.timecodes.GetFrames() == 0)
+    {
+        json.Key("timecode").Null();
+    }
+    else
+    {
+        const SampleStats &pixelLatencyMs = pattern.latencyMs;
+        json.Key("timecode").BeginObject();
+        json.Key("frames").UInt(pattern.timecodes.GetFrames());
+        json.Key("duplicated").UInt(pattern.timecodes.GetDuplicated());
+        json.Key("reordered").UInt(pattern.timecodes.GetReordered());
+        json.Key("dropped").UInt(pattern.timecodes.GetDropped());
+        if (pixelLatencyMs.Empty())
+        {
+            json.Key("latency_ms").Null();
+        }
+        else
+        {
+            json.Key("latency_ms").BeginObject();
+            json.Key("mean").Double(pixelLatencyMs.Mean());
+            json.Key("p50").Double(pixelLatencyMs.Percentile(50));
+            json.Key("p95").Double(pixelLatencyMs.Percentile(95));
+            json.Key("p99").Double(pixelLatencyMs.Percentile(99));
+            json.Key("max").Double(pixelLatencyMs.Max());
+            json.EndObject();
+        }
+        json.EndObject();
+    }
+    // Luma PSNR/SSIM of decoded frames against the redrawn test pattern
+    if (pattern.psnr.Empty())
+    {
+        json.Key("quality").Null();
+    }
+    else
+    {
+        json.Key("quality").BeginObject();
+        json.Key("frames").UInt(pattern.psnr.Count());
+        json.Key("psnr_db").BeginObject();
+        json.Key("mean").Double(pattern.psnr.Mean());
+        json.Key("p5").Double(pattern.psnr.Percentile(5));
+        json.Key("min").Double(pattern.psnr.Min());
+        json.EndObject();
+        json.Key("ssim").BeginObject();
+        json.Key("mean").Double(pattern.ssim.Mean());
+        json.Key("p5").Double(pattern.ssim.Percentile(5));
+        json.Key("min").Double(pattern.ssim.Min());
+        json.EndObject();
+        json.EndObject();
+    }
+    // Hardware counters per client stage, per scope
+    if (!PerfCounters::IsEnabled())
+    {
+        json.Key("perf_counters").Null();
+    }
+    else
+    {
+        json.Key("perf_counters").BeginObject();
+        for (PerfStage stage : { PerfStage::Parse, PerfStage::Decode, PerfStage::ConvertOut })
+        {
+            // Null when a threaded codec did the work out of the counters' sight
+            if (PerfCounters::IsStageThreaded(stage))
+            {
+                json.Key(PerfCounters::GetStageName(stage)).Null();
+                continue;
+            }
+            PerfStageTotals totals = PerfCounters::GetTotals(stage);
+            json.Key(PerfCounters::GetStageName(stage)).BeginObject();
+            json.Key("scopes").UInt(totals.samples);
+            json.Key("ipc").Double(totals.Ipc());
+            for (int event = 0; event < kPerfEventCount; event++)
+            {
+                if (PerfCounters::IsEventSupported(static_cast<PerfEvent>(event)))
+                {
+                    json.Key(PerfCounters::GetEventName(static_cast<PerfEvent>(event)))
+                        .Double(totals.PerSample(static_cast<PerfEvent>(event)));
+                }
+            }
+            json.EndObject();
+        }
+        json.EndObject();
+    }
+    json.EndObject();
+    return json.str();
+}
+
+bool WriteReport(const std::string &report, const std::string &path)
+{
+    if (path.empty())
+    {
+        Log::Flush(); // Keep the report the last line of stdout
+        std::cout << report << std::endl;
+        return true;
+    }
+    std::ofstream out(path, std::ios::binary);
+    out << report << std::endl;
+    if (!out)
+    {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    std::cout << "Report written to " << path << std::endl;
+    return true;
+}
+
+// Decodes a recorded session as fast as possible, without a server, so
+// decoder changes can be measured on identical input.
+int RunPlayback(const std::string &path, double seekSeconds, int loops, const std::string &jsonPath)
+{
+    SessionReader reader;
+    if (!reader.Open(path))
+    {
+        return 1;
+    }
+    std::cout << "Playback: " << path << " - " << reader.GetRecordCount() << " frames, "
+              << reader.GetKeyframes().size() << " keyframes, "
+              << reader.GetDurationUs() / 1e6 << " s" << std::endl;
+
+    SessionReader::Cursor start = reader.Begin();
+    if (seekSeconds > 0)
+    {
+        start = reader.SeekToKeyframe(static_cast<int64_t>(seekSeconds * 1e6));
+    }
+
+    VideoDecoder decoder;
+    DecodedPicture picture;
+    BufferPool packetPool(VideoDecoder::kInputPaddingSize);
+    SampleStats decodeMs;
+    decodeMs.Reserve(static_cast<size_t>(reader.GetRecordCount()) * std::max(loops, 1));
+    uint64_t framesRead = 0;
+    uint64_t framesDecoded = 0;
+    uint64_t decodeErrors = 0;
+    CompressionType codec = COMPRESSION_NONE;
+
+    auto wallStart = std::chrono::high_resolution_clock::now();
+    for (int loop = 0; loop < std::max(loops, 1); loop++)
+    {
+        decoder.Flush(); // Each pass restarts at a keyframe
+        SessionReader::Cursor cursor = start;
+        SessionFrame frame;
+        while (reader.ReadFrame(cursor, frame))
+        {
+            framesRead++;
+            if (frame.codec == COMPRESSION_NONE)
+            {
+                continue;
+            }
+            if (!decoder.IsInitialized() || decoder.GetCompressionType() != frame.codec)
+            {
+                decoder.Cleanup();
+                if (!decoder.Initialize(frame.width, frame.height, frame.codec))
+                {
+                    return 1;
+                }
+                codec = frame.codec;
+            }
+            else if (decoder.GetWidth() != frame.width || decoder.GetHeight() != frame.height)
+            {
+                decoder.Reconfigure(frame.width, frame.height);
+            }
+
+            // Copy out of the mapping into a padded buffer, as the receiver does
+            BufferHandle packet = packetPool.Acquire(frame.payload.size());
+            std::memcpy(packet.data(), frame.payload.data(), frame.payload.size());
+
+            auto decodeStart = std::chrono::high_resolution_clock::now();
+            bool decoded = decoder.DecodeFrame(packet, picture);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - decodeStart;
+            if (decoded)
+            {
+                framesDecoded++;
+                decodeMs.Add(elapsed.count());
+            }
+            else if (decoder.HadDecodeError())
+            {
+                decodeErrors++;
+            }
+        }
+    }
+    std::chrono::duration<double> wall = std::chrono::high_resolution_clock::now() - wallStart;
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Key("session").String(path);
+    json.Key("compression").String(CompressionName(codec));
+    json.Key("recording_s").Double(reader.GetDurationUs() / 1e6);
+    json.Key("loops").Int(std::max(loops, 1));
+    json.Key("frames").BeginObject();
+    json.Key("read").UInt(framesRead);
+    json.Key("decoded").UInt(framesDecoded);
+    json.Key("errors").UInt(decodeErrors);
+    json.EndObject();
+    json.Key("decoded_fps").Double(wall.count() > 0 ? framesDecoded / wall.count() : 0.0);
+    json.Key("decode_ms").BeginObject();
+    json.Key("samples").UInt(decodeMs.Count());
+    json.Key("mean").Double(decodeMs.Mean());
+    json.Key("p50").Double(decodeMs.Percentile(50));
+    json.Key("p95").Double(decodeMs.Percentile(95));
+    json.Key("p99").Double(decodeMs.Percentile(99));
+    json.Key("max").Double(decodeMs.Max());
+    json.EndObject();
+    json.EndObject();
+
+    if (!WriteReport(json.str(), jsonPath))
+    {
+        return 1;
+    }
+    return framesDecoded > 0 && decodeErrors == 0 ? 0 : 1;
+}
+
 int main(int argc, char *argv[])
 {
     // Parse command line arguments
@@ -130,7 +415,19 @@ int main(int argc, char *argv[])
     CompressionType compression = COMPRESSION_H265;
     bool debugFrames = false;
     int maxDebugFrames = 5;
+    bool flightRecorder = false;
+    int flightRecorderFrames = 8;
     bool testMode = false;
+    bool benchMode = false;
+    double benchSeconds = 10.0;
+    std::string benchJsonPath;
+    std::string recordPath;
+    std::string playbackPath;
+    double seekSeconds = 0.0;
+    int playbackLoops = 1;
+    std::string tracePath;
+    std::string metricsPath;
+    bool perfCounters = false;
 
     for (int i = 1; i < argc; i++)
     {
@@ -171,10 +468,71 @@ int main(int argc, char *argv[])
             debugFrames = true;
             maxDebugFrames = std::stoi(arg.substr(15));
         }
+        else if (arg == "--flight-recorder")
+        {
+            flightRecorder = true;
+        }
+        else if (arg.find("--flight-recorder=") == 0)
+        {
+            flightRecorder = true;
+            flightRecorderFrames = std::stoi(arg.substr(18));
+        }
         else if (arg == "--test")
         {
             testMode = true;
         }
+        else if (arg == "--bench")
+        {
+            benchMode = true;
+        }
+        else if (arg.find("--bench=") == 0)
+        {
+            benchMode = true;
+            benchSeconds = std::stod(arg.substr(8));
+        }
+        else if (arg.find("--bench-json=") == 0)
+        {
+            benchJsonPath = arg.substr(13);
+        }
+        else if (arg.find("--record=") == 0)
+        {
+            recordPath = arg.substr(9);
+        }
+        else if (arg.find("--playback=") == 0)
+        {
+            playbackPath = arg.substr(11);
+        }
+        else if (arg.find("--seek=") == 0)
+        {
+            seekSeconds = std::stod(arg.substr(7));
+        }
+        else if (arg.find("--loops=") == 0)
+        {
+            playbackLoops = std::stoi(arg.substr(8));
+        }
+        else if (arg.find("--trace=") == 0)
+        {
+            tracePath = arg.substr(8);
+        }
+        else if (arg.find("--metrics=") == 0)
+        {
+            metricsPath = arg.substr(10);
+        }
+        else if (arg == "--perf-counters")
+        {
+            perfCounters = true;
+        }
+        else if (arg.find("--log-level=") == 0)
+        {
+            LogLevel level;
+            if (!Log::ParseLevel(arg.substr(12), level))
+            {
+                std::cerr << "Unknown log level: " << arg.substr(12) << std::endl;
+                PrintUsage();
+                return 1;
+            }
+            Log::SetLevel(level);
+        }
         else
         {
             std::cerr << "Unknown option: " << arg << std::endl;
@@ -183,6 +541,25 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (!tracePath.empty() && Trace::Start(tracePath, "MRDesktopConsoleClient"))
+    {
+        Trace::SetThreadName("main");
+    }
+    if (perfCounters)
+    {
+        PerfCounters::Start();
+    }
+
+    if (!playbackPath.empty())
+    {
+        int result = RunPlayback(playbackPath, seekSeconds, playbackLoops, benchJsonPath);
+        if (PerfCounters::IsEnabled())
+        {
+            PerfCounters::LogSummary();
+        }
+        return result;
+    }
+
     std::cout << "MRDesktop Console Client - Remote Desktop Controller" << std::endl;
     std::cout << "====================================================" << std::endl;
     std::cout << "Server: " << serverIP << ":" << serverPort << std::endl;
@@ -194,21 +571,58 @@ int main(int argc, char *argv[])
     {
         std::cout << "TEST MODE: Will validate frames and exit after receiving 3 frames" << std::endl;
     }
+    if (benchMode)
+    {
+        std::cout << "BENCH MODE: Receiving for " << benchSeconds << " seconds" << std::endl;
+        testMode = false;
+        debugFrames = false;
+        flightRecorder = false;
+    }
     std::cout << std::endl;
 
-    // Initialize frame logger if debugging
+    // Initialize frame logger if debugging. Its writer thread also saves
+    // first_frame.bmp, so the frame callback never waits on the disk.
     std::unique_ptr<FrameLogger> frameLogger;
-    if (debugFrames)
+    if (flightRecorder)
+    {
+        frameLogger = std::make_unique<FrameLogger>(flightRecorderFrames, "debug_frames", FrameLogger::Mode::FlightRecorder);
+        std::cout << "Flight recorder enabled - press F to dump to debug_frames/" << std::endl;
+    }
+    else if (debugFrames)
     {
         frameLogger = std::make_unique<FrameLogger>(maxDebugFrames, "debug_frames");
         std::cout << "Frame logging enabled - will save to debug_frames/ directory" << std::endl;
     }
+    else if (!benchMode)
+    {
+        frameLogger = std::make_unique<FrameLogger>(0, "debug_frames");
+    }
 
     std::cout << "Initializing network connection..." << std::endl;
 
     // Connect to server
     NetworkReceiver receiver;
     receiver.SetCompression(compression);
+    receiver.SetThreadedDecoding(true); // Keep the socket drained while this loop sleeps
+    if (!recordPath.empty())
+    {
+        receiver.SetSessionRecording(recordPath);
+        std::cout << "Recording session to " << recordPath << std::endl;
+    }
+    if (benchMode)
+    {
+        receiver.SetDecodeTimingEnabled(true);
+    }
+    if (flightRecorder)
+    {
+        receiver.SetCompressedFrameCallback([&](const FrameMessage& frameMsg, CompressionType codec, bool isKeyframe,
+                                                std::span<const uint8_t> packet) {
+            frameLogger->LogPacket(frameMsg.width, frameMsg.height, codec, isKeyframe, packet.data(), packet.size());
+        });
+        receiver.SetDecodeErrorCallback([&]() {
+            frameLogger->RequestDump("decode error");
+        });
+    }
     if (!receiver.Connect(serverIP, serverPort))
     {
         std::cerr << "Failed to connect to server" << std::endl;
@@ -220,12 +634,15 @@ int main(int argc, char *argv[])
     std::cout << "Receiving desktop stream..." << std::endl;
     std::cout << std::endl;
     
-    if (!testMode) {
+    if (!testMode && !benchMode) {
         std::cout << "=== MOUSE CONTROL MODE ===" << std::endl;  
         std::cout << "WASD / Arrow Keys: Move mouse" << std::endl;
         std::cout << "Space: Left click" << std::endl;
         std::cout << "Enter: Right click" << std::endl;
         std::cout << "Q/E: Scroll up/down" << std::endl;
+        if (flightRecorder) {
+            std::cout << "F: Dump flight recorder" << std::endl;
+        }
         std::cout << "ESC: Exit control mode" << std::endl;
         std::cout << "===========================" << std::endl;
     }
@@ -247,6 +664,9 @@ int main(int argc, char *argv[])
     bool testPassed = true;
     bool exitRequested = false;
     
+    // Timecodes and quality of decoded test pattern frames (--test and --bench)
+    TestPatternCheck pattern;
+    
     // Track compression usage for test validation
     bool receivedCompressedFrame = false;
     bool receivedUncompressedFrame = false;
@@ -261,8 +681,14 @@ int main(int argc, char *argv[])
     });
     
     // Set up frame callback  
-    receiver.SetFrameCallback([&](const FrameMessage& frameMsg, const std::vector<uint8_t>& frameData) {
+    receiver.SetFrameCallback([&](const FrameMessage& frameMsg, std::span<const uint8_t> frameData) {
         frameCount++;
+        if (benchMode) {
+            // Only count and check the test pattern; no per-frame output or disk writes
+            FrameQuality quality;
+            pattern.Observe(frameMsg, frameData, receiver, quality);
+            return;
+        }
 
         // Test mode validation
         if (testMode) {
@@ -300,6 +726,21 @@ int main(int argc, char *argv[])
                 std::cout << "TEST: Frame " << frameCount << " pixel (0,0) = R:" << (int)red 
                           << " G:" << (int)green << " B:" << (int)blue << " A:" << (int)alpha << std::endl;
             }
+
+            // Compare against the original, redrawn from the frame's timecode
+            FrameQuality quality;
+            if (!pattern.Observe(frameMsg, frameData, receiver, quality)) {
+                std::cerr << "TEST FAILED: No readable timecode in frame " << frameCount << std::endl;
+                testPassed = false;
+            } else {
+                std::cout << "TEST: Frame " << frameCount << " PSNR " << quality.psnr << " dB, SSIM "
+                          << quality.ssim << std::endl;
+                if (quality.psnr < kMinTestPsnr) {
+                    std::cerr << "TEST FAILED: PSNR " << quality.psnr << " dB is below " << kMinTestPsnr
+                              << " dB" << std::endl;
+                    testPassed = false;
+                }
+            }
             
             // Exit after 3 frames in test mode
             if (frameCount >= 3) {
@@ -311,7 +752,7 @@ int main(int argc, char *argv[])
         // Log frame for debugging if enabled
         if (frameLogger && frameLogger->IsLogging())
         {
-            frameLogger->LogFrame(frameMsg.width, frameMsg.height, frameMsg.dataSize, frameData.data());
+            frameLogger->LogFrame(frameMsg.width, frameMsg.height, static_cast<uint32_t>(frameData.size()), frameData.data());
 
             // Print stats when logging is complete
             if (!frameLogger->IsLogging())
@@ -322,11 +763,10 @@ int main(int argc, char *argv[])
         }
 
         // Save first frame as BMP for verification (legacy behavior)
-        if (!savedFirstFrame)
+        if (!savedFirstFrame && frameLogger)
         {
-            SaveFrameAsBMP(frameMsg, frameData, "first_frame.bmp");
+            frameLogger->SaveBmpAsync(frameMsg.width, frameMsg.height, frameData.data(), frameData.size(), "first_frame.bmp");
             savedFirstFrame = true;
-            std::cout << "First frame saved as first_frame.bmp" << std::endl;
         }
 
         // Display stats every 60 frames (less frequent to avoid spam)
@@ -342,11 +782,12 @@ int main(int argc, char *argv[])
     });
 
     const int MOUSE_SPEED = 10; // Pixels per keypress
+    auto lastMetricsWrite = std::chrono::steady_clock::now();
 
     while (!exitRequested)
     {
-        // Check for keyboard input (skip in test mode)
-        if (!testMode && _kbhit())
+        // Check for keyboard input (skip in test and bench mode)
+        if (!testMode && !benchMode && _kbhit())
         {
             int key = _getch();
 
@@ -421,6 +862,13 @@ int main(int argc, char *argv[])
                     receiver.SendMouseScroll(0, -1);
                     std::cout << "Scroll down" << std::endl;
                     break;
+                case 'f':
+                case 'F': // Dump the flight recorder
+                    if (frameLogger && frameLogger->GetMode() == FrameLogger::Mode::FlightRecorder)
+                    {
+                        frameLogger->RequestDump("manual");
+                    }
+                    break;
                 case 27: // ESC
                     exitRequested = true;
                     std::cout << "Exiting mouse control mode..." << std::endl;
@@ -431,9 +879,36 @@ int main(int argc, char *argv[])
 
         // Poll for frames (non-blocking)
         receiver.PollFrame();
+        if (!receiver.IsConnected())
+        {
+            std::cout << "Connection to server closed" << std::endl;
+            if (flightRecorder)
+            {
+                frameLogger->RequestDump("connection lost");
+            }
+            break;
+        }
+
+        if (!metricsPath.empty() && std::chrono::steady_clock::now() - lastMetricsWrite >= std::chrono::seconds(1))
+        {
+            lastMetricsWrite = std::chrono::steady_clock::now();
+            OpenMetricsWriter metrics;
+            receiver.WriteMetrics(metrics);
+            metrics.AddPerfCounters("mrdesktop_client");
+            metrics.WriteToFile(metricsPath);
+        }
+
+        if (benchMode)
+        {
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+            if (elapsed.count() >= benchSeconds)
+            {
+                break;
+            }
+        }
 
         // Small delay to prevent busy waiting
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::this_thread::sleep_for(std::chrono::milliseconds(benchMode ? 1 : 10));
     }
 
 #ifdef _WIN32
@@ -441,7 +916,32 @@ int main(int argc, char *argv[])
     SetConsoleMode(hStdin, originalMode);
 #endif
 
+    if (benchMode)
+    {
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+        std::string report = BuildBenchReport(receiver, serverIP + ":" + std::to_string(serverPort),
+                                              compression, elapsed.count(), frameCount, pattern);
+        receiver.Disconnect();
+        if (!WriteReport(report, benchJsonPath))
+        {
+            return 1;
+        }
+        return frameCount > 0 ? 0 : 1;
+    }
+
     std::cout << "Streaming ended. Total frames received: " << frameCount << std::endl;
+    ReceiverStats receiverStats = receiver.GetStats();
+    std::cout << "Receiver: " << receiverStats.framesReceived << " received, "
+              << receiverStats.framesDecoded << " decoded, "
+              << receiverStats.framesPresented << " presented, "
+              << receiverStats.framesDropped << " dropped, "
+              << receiverStats.framesSkipped << " skipped awaiting keyframe ("
+              << receiverStats.keyframeRequests << " keyframe requests, queue high water "
+              << receiverStats.queueHighWater << ", " << receiverStats.keepalives << " keepalives)" << std::endl;
+    if (PerfCounters::IsEnabled())
+    {
+        PerfCounters::LogSummary();
+    }
     
     if (testMode) {
         std::cout << std::endl << "=== COMPRESSION TEST RESULTS ===" << std::endl;
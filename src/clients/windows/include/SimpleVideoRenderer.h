@@ -1,8 +1,10 @@
 #pragma once
 #include <windows.h>
 #include <vector>
+#include <span>
 #include <algorithm>
 #include "protocol.h"
+#include "PixelFormat.h"
 
 class SimpleVideoRenderer {
 private:
@@ -11,6 +13,7 @@ private:
     HDC m_memDC;
     HBITMAP m_bitmap;
     HBITMAP m_oldBitmap;
+    void* m_bits = nullptr; // DIB section pixels, top-down BGRA
     
     // Bitmap dimensions
     uint32_t m_bitmapWidth = 0;
@@ -24,7 +27,12 @@ private:
     LARGE_INTEGER m_lastFrameTime;
     LARGE_INTEGER m_frequency;
     
+    // Latest server-reported statistics; the overlay shows them once one arrives
+    StatsMessage m_serverStats{};
+    bool m_hasServerStats = false;
+    
     void CalculateFPS();
+    HRESULT EnsureBitmap(uint32_t width, uint32_t height);
     
 public:
     SimpleVideoRenderer();
@@ -33,10 +41,19 @@ public:
     HRESULT Initialize(HWND hwnd);
     void Cleanup();
     
-    HRESULT RenderFrame(const FrameMessage& frameMsg, const std::vector<BYTE>& frameData);
+    HRESULT RenderFrame(const FrameMessage& frameMsg, std::span<const BYTE> frameData);
+    
+    // Zero-copy path: hands out the DIB section so the decoder can write
+    // into it directly, then PresentFrame() blits what was written.
+    bool GetFrameTarget(uint32_t width, uint32_t height, FrameDestination& target);
+    HRESULT PresentFrame(const FrameMessage& frameMsg);
     void OnResize(UINT width, UINT height);
     
     // Statistics
+    void SetServerStats(const StatsMessage& stats) {
+        m_serverStats = stats;
+        m_hasServerStats = true;
+    }
     double GetFPS() const { return m_fps; }
     uint32_t GetFrameCount() const { return m_frameCount; }
     void GetCurrentResolution(uint32_t& width, uint32_t& height) const {
@@ -3,6 +3,7 @@
 #include <d2d1.h>
 #include <dwrite.h>
 #include <vector>
+#include <span>
 #include <memory>
 #include <algorithm>
 #include "protocol.h"
@@ -25,6 +26,10 @@ private:
     LARGE_INTEGER m_lastFrameTime;
     LARGE_INTEGER m_frequency;
     
+    // Latest server-reported statistics; the overlay shows them once one arrives
+    StatsMessage m_serverStats{};
+    bool m_hasServerStats = false;
+    
     HRESULT CreateDeviceIndependentResources();
     HRESULT CreateDeviceResources();
     void DiscardDeviceResources();
@@ -37,10 +42,14 @@ public:
     HRESULT Initialize(HWND hwnd);
     void Cleanup();
     
-    HRESULT RenderFrame(const FrameMessage& frameMsg, const std::vector<BYTE>& frameData);
+    HRESULT RenderFrame(const FrameMessage& frameMsg, std::span<const BYTE> frameData);
     void OnResize(UINT width, UINT height);
     
     // Statistics
+    void SetServerStats(const StatsMessage& stats) {
+        m_serverStats = stats;
+        m_hasServerStats = true;
+    }
     double GetFPS() const { return m_fps; }
     uint32_t GetFrameCount() const { return m_frameCount; }
     void GetCurrentResolution(uint32_t& width, uint32_t& height) const {
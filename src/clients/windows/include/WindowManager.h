@@ -4,6 +4,7 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <span>
 #include <functional>
 #include <thread>
 
@@ -59,7 +60,11 @@ private:
     void ShowConnectionDialog();
     void ConnectToServer(const std::string& ip, int port);
     void DisconnectFromServer();
-    void OnFrameReceived(const struct FrameMessage& frameMsg, const std::vector<uint8_t>& frameData);
+    void OnFrameReceived(const struct FrameMessage& frameMsg, std::span<const uint8_t> frameData);
+    bool OnAcquireFrameTarget(const struct FrameMessage& frameMsg, struct FrameDestination& target);
+    void OnFrameWritten(const struct FrameMessage& frameMsg);
+    void PrepareRenderer();
+    void TrackFrameRate();
     void OnNetworkError(const std::string& error);
     void OnNetworkDisconnected();
     
@@ -1,5 +1,7 @@
 #include "SimpleVideoRenderer.h"
+#include "PerfCounters.h"
 #include <iostream>
+#include <cstring>
 
 SimpleVideoRenderer::SimpleVideoRenderer()
     : m_hwnd(nullptr), m_hdc(nullptr), m_memDC(nullptr), m_bitmap(nullptr), m_oldBitmap(nullptr), m_frameCount(0), m_currentWidth(0), m_currentHeight(0), m_fps(0.0)
@@ -46,6 +48,7 @@ void SimpleVideoRenderer::Cleanup()
     {
         DeleteObject(m_bitmap);
         m_bitmap = nullptr;
+        m_bits = nullptr;
     }
 
     if (m_memDC)
@@ -61,63 +64,89 @@ void SimpleVideoRenderer::Cleanup()
     }
 }
 
-HRESULT SimpleVideoRenderer::RenderFrame(const FrameMessage &frameMsg, const std::vector<BYTE> &frameData)
+HRESULT SimpleVideoRenderer::EnsureBitmap(uint32_t width, uint32_t height)
 {
-    if (!m_hdc || !m_memDC)
-        return E_FAIL;
-
-    // Update frame statistics
-    m_frameCount++;
-    m_currentWidth = frameMsg.width;
-    m_currentHeight = frameMsg.height;
-    CalculateFPS();
-
     // Create or recreate bitmap if size changed
-    if (!m_bitmap || m_bitmapWidth != frameMsg.width || m_bitmapHeight != frameMsg.height)
+    if (m_bitmap && m_bitmapWidth == width && m_bitmapHeight == height)
     {
-        if (m_oldBitmap)
-        {
-            SelectObject(m_memDC, m_oldBitmap);
-            m_oldBitmap = nullptr;
-        }
-
-        if (m_bitmap)
-        {
-            DeleteObject(m_bitmap);
-            m_bitmap = nullptr;
-        }
+        return S_OK;
+    }
 
-        // Create DIB for BGRA data
-        BITMAPINFO bmi = {};
-        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-        bmi.bmiHeader.biWidth = frameMsg.width;
-        bmi.bmiHeader.biHeight = -(int)frameMsg.height; // Negative for top-down
-        bmi.bmiHeader.biPlanes = 1;
-        bmi.bmiHeader.biBitCount = 32;
-        bmi.bmiHeader.biCompression = BI_RGB;
-
-        void *pBits = nullptr;
-        m_bitmap = CreateDIBSection(m_memDC, &bmi, DIB_RGB_COLORS, &pBits, nullptr, 0);
-        if (!m_bitmap)
-        {
-            return E_FAIL;
-        }
+    if (m_oldBitmap)
+    {
+        SelectObject(m_memDC, m_oldBitmap);
+        m_oldBitmap = nullptr;
+    }
 
-        m_oldBitmap = (HBITMAP)SelectObject(m_memDC, m_bitmap);
-        m_bitmapWidth = frameMsg.width;
-        m_bitmapHeight = frameMsg.height;
+    if (m_bitmap)
+    {
+        DeleteObject(m_bitmap);
+        m_bitmap = nullptr;
+        m_bits = nullptr;
     }
 
-    // Copy frame data to bitmap
+    // Create DIB for BGRA data
     BITMAPINFO bmi = {};
     bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bmi.bmiHeader.biWidth = frameMsg.width;
-    bmi.bmiHeader.biHeight = -(int)frameMsg.height; // Negative for top-down
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -(int)height; // Negative for top-down
     bmi.bmiHeader.biPlanes = 1;
     bmi.bmiHeader.biBitCount = 32;
     bmi.bmiHeader.biCompression = BI_RGB;
 
-    SetDIBits(m_memDC, m_bitmap, 0, frameMsg.height, frameData.data(), &bmi, DIB_RGB_COLORS);
+    m_bitmap = CreateDIBSection(m_memDC, &bmi, DIB_RGB_COLORS, &m_bits, nullptr, 0);
+    if (!m_bitmap)
+    {
+        m_bits = nullptr;
+        return E_FAIL;
+    }
+
+    m_oldBitmap = (HBITMAP)SelectObject(m_memDC, m_bitmap);
+    m_bitmapWidth = width;
+    m_bitmapHeight = height;
+    return S_OK;
+}
+
+bool SimpleVideoRenderer::GetFrameTarget(uint32_t width, uint32_t height, FrameDestination &target)
+{
+    if (!m_hdc || !m_memDC || FAILED(EnsureBitmap(width, height)))
+        return false;
+
+    // Finish any GDI drawing that still reads the bitmap before it is overwritten
+    GdiFlush();
+
+    // 32bpp DIB rows are always DWORD aligned, so the stride is width * 4
+    target.data = static_cast<uint8_t *>(m_bits);
+    target.stride = static_cast<int>(width * 4);
+    target.width = width;
+    target.height = height;
+    target.format = PixelFormat::BGRA;
+    return true;
+}
+
+HRESULT SimpleVideoRenderer::RenderFrame(const FrameMessage &frameMsg, std::span<const BYTE> frameData)
+{
+    FrameDestination target;
+    if (!GetFrameTarget(frameMsg.width, frameMsg.height, target))
+        return E_FAIL;
+
+    // Copy frame data to bitmap
+    size_t bytes = std::min(frameData.size(), static_cast<size_t>(target.stride) * target.height);
+    memcpy(target.data, frameData.data(), bytes);
+
+    return PresentFrame(frameMsg);
+}
+
+HRESULT SimpleVideoRenderer::PresentFrame(const FrameMessage &frameMsg)
+{
+    if (!m_hdc || !m_memDC || !m_bitmap)
+        return E_FAIL;
+
+    // Update frame statistics
+    m_frameCount++;
+    m_currentWidth = frameMsg.width;
+    m_currentHeight = frameMsg.height;
+    CalculateFPS();
 
     // Get client area
     RECT clientRect;
@@ -146,15 +175,39 @@ HRESULT SimpleVideoRenderer::RenderFrame(const FrameMessage &frameMsg, const std
                m_memDC, 0, 0, frameMsg.width, frameMsg.height, SRCCOPY);
 
     // Draw statistics
-    char statsText[256];
-    sprintf_s(statsText, "FPS: %.1f | Frames: %u | Resolution: %ux%u | Data: %.1f MB/s",
-              m_fps, m_frameCount, m_currentWidth, m_currentHeight,
-              (m_fps * frameMsg.dataSize) / (1024.0 * 1024.0));
+    char statsText[512];
+    if (m_hasServerStats && m_serverStats.intervalMs > 0)
+    {
+        // Measured by the server rather than estimated from the last frame
+        double intervalSeconds = m_serverStats.intervalMs / 1000.0;
+        sprintf_s(statsText, "FPS: %.1f (server %.1f) | Frames: %u | Resolution: %ux%u | Data: %.2f Mbit/s | "
+                  "Encode: %.1f ms | Send: %.1f ms | Keyframe: %u KB",
+                  m_fps, m_serverStats.framesSent / intervalSeconds, m_frameCount, m_currentWidth, m_currentHeight,
+                  m_serverStats.bytesSent * 8.0 / 1e6 / intervalSeconds,
+                  m_serverStats.encodeUsAvg / 1000.0, m_serverStats.sendBlockedUsAvg / 1000.0,
+                  m_serverStats.lastKeyframeBytes / 1024);
+        for (uint32_t i = 0; i < kStatsPerfStages; i++)
+        {
+            if (m_serverStats.perfIpcX100[i] == 0)
+            {
+                continue;
+            }
+            size_t length = strlen(statsText);
+            sprintf_s(statsText + length, sizeof(statsText) - length, " | IPC %s: %.2f",
+                      PerfCounters::GetStageName(static_cast<PerfStage>(i)), m_serverStats.perfIpcX100[i] / 100.0);
+        }
+    }
+    else
+    {
+        sprintf_s(statsText, "FPS: %.1f | Frames: %u | Resolution: %ux%u | Data: %.1f MB/s",
+                  m_fps, m_frameCount, m_currentWidth, m_currentHeight,
+                  (m_fps * frameMsg.dataSize) / (1024.0 * 1024.0));
+    }
 
     SetBkColor(m_hdc, RGB(0, 0, 0));
     SetTextColor(m_hdc, RGB(255, 255, 255));
 
-    RECT textRect = {10, 10, 400, 80};
+    RECT textRect = {10, 10, 420, 140};
     DrawTextA(m_hdc, statsText, -1, &textRect, DT_LEFT | DT_TOP | DT_WORDBREAK);
 
     return S_OK;
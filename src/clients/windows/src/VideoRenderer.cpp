@@ -1,4 +1,5 @@
 #include "VideoRenderer.h"
+#include "PerfCounters.h"
 #include <iostream>
 
 VideoRenderer::VideoRenderer()
@@ -156,7 +157,7 @@ void VideoRenderer::DiscardDeviceResources() {
     }
 }
 
-HRESULT VideoRenderer::RenderFrame(const FrameMessage& frameMsg, const std::vector<BYTE>& frameData) {
+HRESULT VideoRenderer::RenderFrame(const FrameMessage& frameMsg, std::span<const BYTE> frameData) {
     HRESULT hr = CreateDeviceResources();
     if (FAILED(hr)) return hr;
     
@@ -235,12 +236,33 @@ HRESULT VideoRenderer::RenderFrame(const FrameMessage& frameMsg, const std::vect
     );
     
     // Draw statistics overlay
-    wchar_t statsText[256];
-    swprintf_s(statsText, L"FPS: %.1f\nFrames: %u\nResolution: %ux%u\nData: %.1f MB/s",
-               m_fps, m_frameCount, m_currentWidth, m_currentHeight,
-               (m_fps * frameMsg.dataSize) / (1024.0 * 1024.0));
-    
+    wchar_t statsText[512];
     D2D1_RECT_F textRect = D2D1::RectF(10, 10, 300, 100);
+    if (m_hasServerStats && m_serverStats.intervalMs > 0) {
+        // Measured by the server rather than estimated from the last frame
+        double intervalSeconds = m_serverStats.intervalMs / 1000.0;
+        swprintf_s(statsText, L"FPS: %.1f (server %.1f)\nFrames: %u\nResolution: %ux%u\nData: %.2f Mbit/s\n"
+                   L"Encode: %.1f ms\nSend: %.1f ms\nKeyframe: %u KB",
+                   m_fps, m_serverStats.framesSent / intervalSeconds, m_frameCount, m_currentWidth, m_currentHeight,
+                   m_serverStats.bytesSent * 8.0 / 1e6 / intervalSeconds,
+                   m_serverStats.encodeUsAvg / 1000.0, m_serverStats.sendBlockedUsAvg / 1000.0,
+                   m_serverStats.lastKeyframeBytes / 1024);
+        textRect.bottom = 160;
+        for (uint32_t i = 0; i < kStatsPerfStages; i++) {
+            if (m_serverStats.perfIpcX100[i] == 0) {
+                continue;
+            }
+            size_t length = wcslen(statsText);
+            swprintf_s(statsText + length, _countof(statsText) - length, L"\nIPC %S: %.2f (%u LLC misses)",
+                       PerfCounters::GetStageName(static_cast<PerfStage>(i)), m_serverStats.perfIpcX100[i] / 100.0,
+                       m_serverStats.perfCacheMissesAvg[i]);
+            textRect.bottom += 20;
+        }
+    } else {
+        swprintf_s(statsText, L"FPS: %.1f\nFrames: %u\nResolution: %ux%u\nData: %.1f MB/s",
+                   m_fps, m_frameCount, m_currentWidth, m_currentHeight,
+                   (m_fps * frameMsg.dataSize) / (1024.0 * 1024.0));
+    }
     
     // Draw text background
     ID2D1SolidColorBrush* bgBrush = nullptr;
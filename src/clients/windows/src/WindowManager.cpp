@@ -4,6 +4,7 @@
 #include "NetworkReceiver.h"
 #include "InputHandler.h"
 #include "protocol.h"
+#include "Trace.h"
 #include <commdlg.h>
 #include <sstream>
 #include <iostream>
@@ -198,6 +199,8 @@ void WindowManager::OnCreate() {
     m_videoRenderer = std::make_unique<VideoRenderer>();
     m_simpleVideoRenderer = std::make_unique<SimpleVideoRenderer>();
     m_networkReceiver = std::make_unique<NetworkReceiver>();
+    // Receive and decode off the UI thread; the message loop only presents
+    m_networkReceiver->SetThreadedDecoding(true);
     m_inputHandler = std::make_unique<InputHandler>();
     
     // Initialize GDI renderer as fallback (always works)
@@ -218,10 +221,19 @@ void WindowManager::OnCreate() {
     m_inputHandler->Initialize(m_hwnd);
     
     // Set up network callbacks
-    m_networkReceiver->SetFrameCallback([this](const FrameMessage& frameMsg, const std::vector<uint8_t>& frameData) {
+    m_networkReceiver->SetFrameCallback([this](const FrameMessage& frameMsg, std::span<const uint8_t> frameData) {
         OnFrameReceived(frameMsg, frameData);
     });
     
+    // The GDI renderer lets the decoder write straight into its DIB section
+    m_networkReceiver->SetFrameTargetCallback([this](const FrameMessage& frameMsg, FrameDestination& target) {
+        return OnAcquireFrameTarget(frameMsg, target);
+    });
+    
+    m_networkReceiver->SetFrameWrittenCallback([this](const FrameMessage& frameMsg) {
+        OnFrameWritten(frameMsg);
+    });
+    
     m_networkReceiver->SetErrorCallback([this](const std::string& error) {
         OnNetworkError(error);
     });
@@ -230,6 +242,12 @@ void WindowManager::OnCreate() {
         OnNetworkDisconnected();
     });
     
+    // Both renderers keep the server's numbers so the overlay survives a renderer switch
+    m_networkReceiver->SetStatsCallback([this](const StatsMessage& stats) {
+        m_simpleVideoRenderer->SetServerStats(stats);
+        m_videoRenderer->SetServerStats(stats);
+    });
+    
     // Set up input callbacks
     m_inputHandler->SetMouseMoveCallback([this](int32_t deltaX, int32_t deltaY) {
         if (m_networkReceiver && m_networkReceiver->IsConnected()) {
@@ -350,7 +368,7 @@ void WindowManager::DisconnectFromServer() {
     InvalidateRect(m_hwnd, nullptr, TRUE);
 }
 
-void WindowManager::OnFrameReceived(const FrameMessage& frameMsg, const std::vector<uint8_t>& frameData) {
+void WindowManager::PrepareRenderer() {
     // Try to upgrade to Direct2D renderer if we're still using GDI and haven't tried yet
     static bool triedDirect2DUpgrade = false;
     if (m_usingSimpleRenderer && !triedDirect2DUpgrade) {
@@ -364,7 +382,9 @@ void WindowManager::OnFrameReceived(const FrameMessage& frameMsg, const std::vec
             std::cout << "Direct2D upgrade failed with HRESULT: 0x" << std::hex << hr << std::dec << ". Continuing with GDI renderer." << std::endl;
         }
     }
-    
+}
+
+void WindowManager::TrackFrameRate() {
     // Add frame timing diagnostics
     static auto lastFrameTime = std::chrono::high_resolution_clock::now();
     static int frameCount = 0;
@@ -377,6 +397,12 @@ void WindowManager::OnFrameReceived(const FrameMessage& frameMsg, const std::vec
         std::cout << "Frame receive rate: " << std::fixed << std::setprecision(1) << actualFPS << " FPS" << std::endl;
         lastFrameTime = currentTime;
     }
+}
+
+void WindowManager::OnFrameReceived(const FrameMessage& frameMsg, std::span<const uint8_t> frameData) {
+    MR_TRACE_SCOPE("render");
+    PrepareRenderer();
+    TrackFrameRate();
     
     if (m_usingSimpleRenderer && m_simpleVideoRenderer) {
         m_simpleVideoRenderer->RenderFrame(frameMsg, frameData);
@@ -385,6 +411,25 @@ void WindowManager::OnFrameReceived(const FrameMessage& frameMsg, const std::vec
     }
 }
 
+bool WindowManager::OnAcquireFrameTarget(const FrameMessage& frameMsg, FrameDestination& target) {
+    PrepareRenderer();
+    
+    // Direct2D uploads from system memory itself, so it keeps the frame callback
+    if (!m_usingSimpleRenderer || !m_simpleVideoRenderer) {
+        return false;
+    }
+    return m_simpleVideoRenderer->GetFrameTarget(frameMsg.width, frameMsg.height, target);
+}
+
+void WindowManager::OnFrameWritten(const FrameMessage& frameMsg) {
+    MR_TRACE_SCOPE("render");
+    TrackFrameRate();
+    
+    if (m_usingSimpleRenderer && m_simpleVideoRenderer) {
+        m_simpleVideoRenderer->PresentFrame(frameMsg);
+    }
+}
+
 void WindowManager::OnNetworkError(const std::string& error) {
     m_connectionState = ConnectionState::Error;
     m_statusMessage = "Error: " + error;
@@ -3,6 +3,7 @@
 #include <io.h>
 #include <fcntl.h>
 #include "WindowManager.h"
+#include "Trace.h"
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
     UNREFERENCED_PARAMETER(hPrevInstance);
@@ -50,6 +51,16 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
                 serverPort = std::stoi(portStr);
                 std::cout << "Found port: " << serverPort << std::endl;
             }
+            
+            size_t tracePos = cmdLine.find("--trace=");
+            if (tracePos != std::string::npos) {
+                size_t start = tracePos + 8;
+                size_t end = cmdLine.find(' ', start);
+                if (end == std::string::npos) end = cmdLine.length();
+                if (Trace::Start(cmdLine.substr(start, end - start), "MRDesktopWindowsClient")) {
+                    Trace::SetThreadName("ui");
+                }
+            }
         }
         
         // Create and initialize window manager
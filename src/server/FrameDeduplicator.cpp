@@ -0,0 +1,122 @@
+#include "FrameDeduplicator.h"
+#include "Log.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+
+inline uint64_t RotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t Round(uint64_t lane, uint64_t input) {
+    return RotateLeft(lane + input * kPrime2, 31) * kPrime1;
+}
+
+inline uint64_t Load64(const uint8_t* data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// 64-bit hash in the style of XXH64's inner loop. Four independent lanes
+// keep the multiplier busy, so a 4K frame hashes at memory speed.
+uint64_t HashFrame(const uint8_t* data, size_t size) {
+    uint64_t lanes[4] = { kPrime1 + kPrime2, kPrime2, 0, 0 - kPrime1 };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        lanes[0] = Round(lanes[0], Load64(data + i));
+        lanes[1] = Round(lanes[1], Load64(data + i + 8));
+        lanes[2] = Round(lanes[2], Load64(data + i + 16));
+        lanes[3] = Round(lanes[3], Load64(data + i + 24));
+    }
+    uint64_t hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) +
+                    RotateLeft(lanes[3], 18) + size;
+    for (; i < size; i++) {
+        hash = RotateLeft(hash ^ (data[i] * kPrime1), 11) * kPrime2;
+    }
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+} // namespace
+
+FrameDeduplicator::Action FrameDeduplicator::Check(const CapturedFrame& frame, Clock::time_point now) {
+    uint64_t hash;
+    {
+        MR_TRACE_SCOPE("hash");
+        MR_PERF_SCOPE(PerfStage::Hash);
+        hash = HashFrame(frame.data, frame.dataSize);
+    }
+
+    if (m_forceSend || !m_hasLast || hash != m_lastHash || frame.width != m_lastWidth ||
+        frame.height != m_lastHeight) {
+        if (m_idle) {
+            MR_LOG_DEBUG("FrameDeduplicator: Frame changed after " << m_unchanged << " repeats, leaving idle");
+        }
+        m_hasLast = true;
+        m_forceSend = false;
+        m_lastHash = hash;
+        m_lastWidth = frame.width;
+        m_lastHeight = frame.height;
+        m_unchanged = 0;
+        m_idle = false;
+        m_lastChange = now;
+        m_lastSent = now;
+        return Action::Send;
+    }
+
+    m_unchanged++;
+    if (m_unchanged <= kRefineFrames) {
+        m_lastSent = now;
+        return Action::Send;
+    }
+    m_framesDeduplicated++;
+    return Unchanged(now);
+}
+
+FrameDeduplicator::Action FrameDeduplicator::Tick(Clock::time_point now) {
+    if (!m_hasLast) {
+        return Action::Skip;
+    }
+    if (m_forceSend) {
+        m_forceSend = false;
+        m_idle = false;
+        m_lastChange = now;
+        m_lastSent = now;
+        return Action::Send;
+    }
+    return Unchanged(now);
+}
+
+FrameDeduplicator::Action FrameDeduplicator::Unchanged(Clock::time_point now) {
+    if (!m_idle && now - m_lastChange >= kIdleAfter) {
+        m_idle = true;
+        m_idlePeriods++;
+        MR_LOG_DEBUG("FrameDeduplicator: No change for " << m_unchanged << " captures, going idle");
+    }
+    if (now - m_lastSent >= kKeepaliveInterval) {
+        m_lastSent = now;
+        return Action::Keepalive;
+    }
+    return Action::Skip;
+}
+
+void FrameDeduplicator::Wake(Clock::time_point now) {
+    m_idle = false;
+    m_lastChange = now;
+}
+
+void FrameDeduplicator::WriteMetrics(OpenMetricsWriter& metrics) const {
+    metrics.AddCounter("mrdesktop_server_frames_deduplicated", "Captures identical to the last frame, not encoded",
+                       m_framesDeduplicated);
+    metrics.AddCounter("mrdesktop_server_idle_periods", "Times the stream dropped to the idle capture rate",
+                       m_idlePeriods);
+    metrics.AddGauge("mrdesktop_server_idle", "1 while capturing at the idle rate", m_idle ? 1.0 : 0.0);
+}
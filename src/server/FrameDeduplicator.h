@@ -0,0 +1,69 @@
+#pragma once
+#include "FrameSource.h"
+#include "Metrics.h"
+#include <chrono>
+#include <cstdint>
+
+// Spots captures that are byte-identical to the last frame sent, so an
+// unchanged desktop is not converted, encoded and sent again every loop.
+// Frames are compared by a 64-bit hash of their pixels.
+//
+// The first few repeats still go to the encoder, which uses them to refine
+// the static image. After that repeats are skipped, with a keepalive about
+// once a second, and once nothing has changed for a while the stream goes
+// idle: the loop captures at a low rate until the frame changes or the
+// client sends input. Sources such as desktop duplication report no frame
+// at all while the screen is static; Tick() keeps the same clock running
+// for those loop iterations.
+class FrameDeduplicator {
+public:
+    enum class Action {
+        Send,       // New content, or a refinement repeat
+        Skip,       // Identical to the frame on the client's screen
+        Keepalive   // Identical; send a keepalive instead
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t kRefineFrames = 4;
+    static constexpr std::chrono::milliseconds kIdleAfter{500};
+    static constexpr std::chrono::milliseconds kIdleInterval{100};
+    static constexpr std::chrono::milliseconds kKeepaliveInterval{1000};
+
+    Action Check(const CapturedFrame& frame, Clock::time_point now = Clock::now());
+    // For a loop iteration where the source had no new frame. Send means
+    // send the last checked frame again, after Reset().
+    Action Tick(Clock::time_point now = Clock::now());
+
+    // Sends the next frame whatever it contains (the client asked for a
+    // keyframe), or repeats the last one if the source has nothing new
+    void Reset() { m_forceSend = true; }
+    // Leaves idle mode; the client's input is likely to change the screen
+    void Wake(Clock::time_point now = Clock::now());
+
+    bool IsIdle() const { return m_idle; }
+    // Time to wait between captures: the normal frame interval, or the idle one
+    std::chrono::milliseconds GetCaptureInterval(std::chrono::milliseconds active) const {
+        return m_idle ? kIdleInterval : active;
+    }
+    // Repeats skipped since the last frame sent
+    uint32_t GetUnchangedFrames() const { return m_unchanged > kRefineFrames ? m_unchanged - kRefineFrames : 0; }
+
+    void WriteMetrics(OpenMetricsWriter& metrics) const;
+
+private:
+    bool m_hasLast = false;
+    bool m_forceSend = false;
+    uint64_t m_lastHash = 0;
+    uint32_t m_lastWidth = 0;
+    uint32_t m_lastHeight = 0;
+    uint32_t m_unchanged = 0;   // Identical captures since the content changed
+    bool m_idle = false;
+    Clock::time_point m_lastChange;
+    Clock::time_point m_lastSent;   // Last frame or keepalive sent
+
+    uint64_t m_framesDeduplicated = 0;
+    uint64_t m_idlePeriods = 0;
+
+    Action Unchanged(Clock::time_point now);
+};
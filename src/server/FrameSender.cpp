@@ -0,0 +1,317 @@
+#include "FrameSender.h"
+#include "Clock.h"
+#include "Log.h"
+#include "PerfCounters.h"
+#include "SessionRecording.h"
+#include "Trace.h"
+#include <algorithm>
+#include <thread>
+#ifndef _WIN32
+#include <cerrno>
+#endif
+
+bool SendAllData(SOCKET socket, const char* data, size_t size) {
+    size_t totalSent = 0;
+
+    while (totalSent < size) {
+        int sent = send(socket, data + totalSent, static_cast<int>(size - totalSent), 0);
+
+        if (sent == SOCKET_ERROR) {
+#ifdef _WIN32
+            int error = WSAGetLastError();
+            if (error == WSAEWOULDBLOCK) {
+#else
+            int error = errno;
+            if (error == EWOULDBLOCK || error == EAGAIN) {
+#endif
+                // Non-blocking socket would block, try again
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            // Real error
+            MR_LOG_ERROR("Send error: " << error);
+            return false;
+        }
+
+        if (sent == 0) {
+            // Connection closed
+            MR_LOG_ERROR("Connection closed during send");
+            return false;
+        }
+
+        totalSent += sent;
+    }
+
+    return true;
+}
+
+FrameSender::FrameSender(SOCKET socket, CompressionType compression, const EncoderOptions& options)
+    : m_socket(socket), m_compression(compression), m_options(options),
+      m_useCompression(compression != COMPRESSION_NONE) {
+    if (m_useCompression) {
+        m_encoder = std::make_unique<VideoEncoder>();
+    }
+}
+
+void FrameSender::RequestKeyframe() {
+    if (m_encoder && m_encoder->IsInitialized()) {
+        m_encoder->RequestKeyframe();
+    }
+}
+
+bool FrameSender::PrepareEncoder(uint32_t width, uint32_t height) {
+    // Rebuild the encoder when the capture size changes (monitor
+    // switch, resolution change); the new stream opens with a keyframe
+    if (m_encoder->IsInitialized() &&
+        (m_encoder->GetWidth() != width || m_encoder->GetHeight() != height)) {
+        MR_LOG_INFO("Capture size changed to " << width << "x" << height
+                    << ", reinitializing encoder");
+        m_encoder->Cleanup();
+    }
+
+    // Initialize encoder with current frame dimensions
+    if (!m_encoder->IsInitialized()) {
+        if (!m_encoder->Initialize(width, height, m_compression, m_options)) {
+            MR_LOG_ERROR("Failed to initialize video encoder");
+            return false;
+        }
+        MR_LOG_INFO("Video encoder initialized successfully");
+        m_streamStart = true;
+    }
+    return true;
+}
+
+FrameSender::Result FrameSender::Send(const CapturedFrame& frame, SentFrame& sent) {
+    sent = {};
+    auto start = std::chrono::steady_clock::now();
+    sent.encodeDone = start;
+    sent.sequence = m_framesSent;
+
+    FrameTiming timing{};
+    timing.version = kFrameTimingVersion;
+    timing.sequence = m_framesSent;
+    timing.captureTimeUs = frame.captureTimeUs != 0 ? frame.captureTimeUs : ClockNowUs();
+    if (frame.isReplay) {
+        timing.flags |= FRAME_FLAG_REPLAY;
+    }
+
+    if (m_useCompression && !PrepareEncoder(frame.width, frame.height)) {
+        m_useCompression = false; // Fall back to uncompressed
+    }
+
+    if (m_useCompression) {
+        int64_t input = m_encoder->GetNextFrameIndex();
+        m_captureTimesUs[input % kCaptureSlots] = timing.captureTimeUs;
+        bool isKeyframe = false;
+        if (!m_encoder->EncodeFrame(frame.data, m_compressed, isKeyframe)) {
+            m_framesSkipped++;
+            m_intervalSkipped++;
+            return Result::Skipped;
+        }
+        int64_t packetFrame = m_encoder->GetLastPacketFrame();
+        if (packetFrame >= 0 && packetFrame <= input && input - packetFrame < kCaptureSlots) {
+            timing.captureTimeUs = m_captureTimesUs[packetFrame % kCaptureSlots];
+        }
+        sent.encodeDone = std::chrono::steady_clock::now();
+        sent.encodeMs = std::chrono::duration<double, std::milli>(sent.encodeDone - start).count();
+        sent.compressed = true;
+        sent.isKeyframe = isKeyframe;
+        sent.payloadBytes = m_compressed.size();
+
+        // Send compressed frame
+        CompressedFrameMessage compFrameMsg;
+        compFrameMsg.header.type = MSG_COMPRESSED_FRAME;
+        compFrameMsg.header.size = sizeof(CompressedFrameMessage);
+        compFrameMsg.width = frame.width;
+        compFrameMsg.height = frame.height;
+        compFrameMsg.compressedSize = static_cast<uint32_t>(m_compressed.size());
+        compFrameMsg.isKeyframe = isKeyframe ? 1 : 0;
+        compFrameMsg.compression = m_compression;
+        timing.encodeUs = static_cast<uint32_t>(sent.encodeMs * 1000.0);
+        if (isKeyframe) {
+            timing.flags |= FRAME_FLAG_KEYFRAME;
+        }
+        if (m_streamStart) {
+            timing.flags |= FRAME_FLAG_STREAM_START;
+        }
+        compFrameMsg.timing = timing;
+
+        MR_LOG_DEBUG("SERVER SEND: Frame seq=" << timing.sequence << " capture=" << timing.captureTimeUs
+                     << "us encode=" << timing.encodeUs << "us - Compressed: " << m_compressed.size()
+                     << " bytes (" << (isKeyframe ? "KEY" : "DELTA") << ")");
+
+        {
+            MR_TRACE_SCOPE("send");
+            MR_PERF_SCOPE(PerfStage::Send);
+            if (!SendAllData(m_socket, (char*)&compFrameMsg, sizeof(CompressedFrameMessage))) {
+                MR_LOG_ERROR("Failed to send compressed frame header");
+                return Result::Failed;
+            }
+
+            if (!SendAllData(m_socket, (char*)m_compressed.data(), m_compressed.size())) {
+                MR_LOG_ERROR("Failed to send compressed frame data");
+                return Result::Failed;
+            }
+        }
+
+        if (m_recorder && m_recorder->IsOpen()) {
+            m_recorder->Append(frame.width, frame.height, m_compression, isKeyframe,
+                               m_compressed.data(), m_compressed.size());
+        }
+    } else {
+        // Send uncompressed frame
+        FrameMessage frameMsg;
+        frameMsg.header.type = MSG_FRAME_DATA;
+        frameMsg.header.size = sizeof(FrameMessage);
+        frameMsg.width = frame.width;
+        frameMsg.height = frame.height;
+        frameMsg.dataSize = frame.dataSize;
+        sent.payloadBytes = frame.dataSize;
+        timing.flags |= FRAME_FLAG_KEYFRAME; // Raw frames stand alone
+        if (m_streamStart) {
+            timing.flags |= FRAME_FLAG_STREAM_START;
+        }
+        frameMsg.timing = timing;
+
+        MR_LOG_DEBUG("SERVER SEND: Frame seq=" << timing.sequence << " capture=" << timing.captureTimeUs
+                     << "us - Uncompressed: " << frame.dataSize << " bytes");
+
+        MR_TRACE_SCOPE("send");
+        MR_PERF_SCOPE(PerfStage::Send);
+        if (!SendAllData(m_socket, (char*)&frameMsg, sizeof(FrameMessage))) {
+            MR_LOG_ERROR("Failed to send frame header");
+            return Result::Failed;
+        }
+
+        if (!SendAllData(m_socket, (const char*)frame.data, frame.dataSize)) {
+            MR_LOG_ERROR("Failed to send frame data");
+            return Result::Failed;
+        }
+    }
+
+    sent.captureTimeUs = timing.captureTimeUs;
+    sent.sendDone = std::chrono::steady_clock::now();
+    m_framesSent++;
+    m_streamStart = false;
+    RecordSent(sent);
+    return Result::Sent;
+}
+
+void FrameSender::RecordSent(const SentFrame& sent) {
+    double sendMs = std::chrono::duration<double, std::milli>(sent.sendDone - sent.encodeDone).count();
+    m_bytesSent += sent.payloadBytes;
+    m_sendBlockedSeconds.Observe(sendMs / 1000.0);
+    m_intervalFrames++;
+    m_intervalBytes += sent.payloadBytes;
+    m_intervalSendMs.Add(sendMs);
+    if (sent.compressed) {
+        m_encodeSeconds.Observe(sent.encodeMs / 1000.0);
+        m_intervalEncodeMs.Add(sent.encodeMs);
+    }
+    if (sent.isKeyframe) {
+        m_keyframesSent++;
+        m_keyframeBytes.Observe(static_cast<double>(sent.payloadBytes));
+        m_intervalKeyframes++;
+        m_lastKeyframeBytes = static_cast<uint32_t>(sent.payloadBytes);
+    }
+}
+
+bool FrameSender::SendClockPong(uint64_t clientSendUs, uint64_t receivedUs) {
+    ClockPongMessage pong{};
+    pong.header.type = MSG_CLOCK_PONG;
+    pong.header.size = sizeof(ClockPongMessage);
+    pong.clientSendUs = clientSendUs;
+    pong.serverReceiveUs = receivedUs;
+    pong.serverSendUs = ClockNowUs();
+    return SendAllData(m_socket, reinterpret_cast<const char*>(&pong), sizeof(pong));
+}
+
+bool FrameSender::SendKeepalive(uint32_t framesUnchanged) {
+    KeepaliveMessage keepalive{};
+    keepalive.header.type = MSG_KEEPALIVE;
+    keepalive.header.size = sizeof(KeepaliveMessage);
+    keepalive.lastSequence = m_framesSent - 1; // Wraps to ~0 before the first frame
+    keepalive.framesUnchanged = framesUnchanged;
+    if (!SendAllData(m_socket, reinterpret_cast<const char*>(&keepalive), sizeof(keepalive))) {
+        MR_LOG_ERROR("Failed to send keepalive");
+        return false;
+    }
+    return true;
+}
+
+bool FrameSender::SendStats() {
+    auto now = std::chrono::steady_clock::now();
+    StatsMessage stats{};
+    stats.header.type = MSG_STATS;
+    stats.header.size = sizeof(StatsMessage);
+    stats.intervalMs = static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(now - m_intervalStart).count());
+    stats.framesSent = m_intervalFrames;
+    stats.framesSkipped = m_intervalSkipped;
+    stats.keyframes = m_intervalKeyframes;
+    stats.bytesSent = m_intervalBytes;
+    stats.lastKeyframeBytes = m_lastKeyframeBytes;
+    stats.encodeUsAvg = static_cast<uint32_t>(m_intervalEncodeMs.Mean() * 1000.0);
+    stats.encodeUsMax = static_cast<uint32_t>(m_intervalEncodeMs.Max() * 1000.0);
+    stats.sendBlockedUsAvg = static_cast<uint32_t>(m_intervalSendMs.Mean() * 1000.0);
+    stats.sendBlockedUsMax = static_cast<uint32_t>(m_intervalSendMs.Max() * 1000.0);
+    FillPerfStats(stats);
+    m_lastStats = stats;
+
+    m_intervalStart = now;
+    m_intervalFrames = 0;
+    m_intervalSkipped = 0;
+    m_intervalKeyframes = 0;
+    m_intervalBytes = 0;
+    m_intervalEncodeMs.Clear();
+    m_intervalSendMs.Clear();
+
+    if (!SendAllData(m_socket, reinterpret_cast<const char*>(&stats), sizeof(stats))) {
+        MR_LOG_ERROR("Failed to send stats");
+        return false;
+    }
+    return true;
+}
+
+void FrameSender::FillPerfStats(StatsMessage& stats) {
+    static_assert(static_cast<uint32_t>(PerfStage::Send) + 1 == kStatsPerfStages,
+                  "MSG_STATS carries the server stages, Capture through Send");
+    if (!PerfCounters::IsEnabled()) {
+        return;
+    }
+    for (uint32_t i = 0; i < kStatsPerfStages; i++) {
+        PerfStage stage = static_cast<PerfStage>(i);
+        PerfStageTotals totals = PerfCounters::GetTotals(stage);
+        PerfStageTotals interval;
+        interval.samples = totals.samples - m_intervalPerfStart[i].samples;
+        for (int e = 0; e < kPerfEventCount; e++) {
+            interval.counts[e] = totals.counts[e] - m_intervalPerfStart[i].counts[e];
+        }
+        m_intervalPerfStart[i] = totals;
+        if (interval.samples == 0 || PerfCounters::IsStageThreaded(stage)) {
+            continue;
+        }
+        stats.perfIpcX100[i] = static_cast<uint16_t>(std::min(interval.Ipc() * 100.0, 65535.0));
+        stats.perfCacheMissesAvg[i] = static_cast<uint32_t>(
+            std::min(interval.PerSample(PerfCacheMisses), 4294967295.0));
+    }
+}
+
+void FrameSender::WriteMetrics(OpenMetricsWriter& metrics) const {
+    double intervalSeconds = m_lastStats.intervalMs / 1000.0;
+    metrics.AddCounter("mrdesktop_server_frames_sent", "Frames sent to the client", m_framesSent);
+    metrics.AddCounter("mrdesktop_server_frames_skipped", "Captured frames the encoder produced no packet for",
+                       m_framesSkipped);
+    metrics.AddCounter("mrdesktop_server_keyframes_sent", "Keyframes sent to the client", m_keyframesSent);
+    metrics.AddCounter("mrdesktop_server_bytes_sent", "Frame payload bytes sent", m_bytesSent);
+    metrics.AddGauge("mrdesktop_server_fps", "Frames sent per second over the last stats interval",
+                     intervalSeconds > 0 ? m_lastStats.framesSent / intervalSeconds : 0.0);
+    metrics.AddGauge("mrdesktop_server_bytes_per_second", "Payload bytes sent per second over the last stats interval",
+                     intervalSeconds > 0 ? m_lastStats.bytesSent / intervalSeconds : 0.0);
+    metrics.AddGauge("mrdesktop_server_last_keyframe_bytes", "Size of the most recent keyframe", m_lastKeyframeBytes);
+    metrics.AddHistogram("mrdesktop_server_encode_seconds", "Encode time per frame, including BGRA to YUV conversion",
+                         m_encodeSeconds);
+    metrics.AddHistogram("mrdesktop_server_send_blocked_seconds", "Time per frame spent blocked writing to the socket",
+                         m_sendBlockedSeconds);
+    metrics.AddHistogram("mrdesktop_server_keyframe_bytes", "Keyframe sizes", m_keyframeBytes);
+}
@@ -0,0 +1,119 @@
+#pragma once
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <unistd.h>
+#ifndef INVALID_SOCKET
+#define INVALID_SOCKET -1
+#endif
+#ifndef SOCKET_ERROR
+#define SOCKET_ERROR   -1
+#endif
+inline int closesocket(int fd) { return close(fd); }
+using SOCKET = int;
+#endif
+#include "protocol.h"
+#include "FrameSource.h"
+#include "VideoEncoder.h"
+#include "Metrics.h"
+#include "PerfCounters.h"
+#include "SampleStats.h"
+#include <chrono>
+#include <memory>
+#include <vector>
+
+class SessionWriter;
+
+// Sends all of `data`, waiting out EWOULDBLOCK on non-blocking sockets
+bool SendAllData(SOCKET socket, const char* data, size_t size);
+
+// What happened to one frame on its way out
+struct SentFrame {
+    uint32_t sequence = 0;
+    bool compressed = false;
+    bool isKeyframe = false;
+    size_t payloadBytes = 0;   // Compressed size, or the raw frame size
+    double encodeMs = 0.0;     // Includes the BGRA -> YUV conversion
+    uint64_t captureTimeUs = 0; // Of the frame this packet encodes, which lags the input when the encoder buffers
+    std::chrono::steady_clock::time_point encodeDone; // Same as the start for raw frames
+    std::chrono::steady_clock::time_point sendDone;
+};
+
+// The server's per-frame pipeline: encode a captured frame with the codec
+// the client negotiated (or send it raw) and write it to the socket. The
+// encoder is created on the first frame and rebuilt when the capture size
+// changes; if it cannot be opened the stream falls back to raw frames.
+class FrameSender {
+public:
+    enum class Result {
+        Sent,
+        Skipped,  // The encoder produced no packet for this frame
+        Failed    // The connection is gone
+    };
+
+    FrameSender(SOCKET socket, CompressionType compression, const EncoderOptions& options = {});
+
+    Result Send(const CapturedFrame& frame, SentFrame& sent);
+
+    // Makes the next encoded frame a keyframe (client lost its references)
+    void RequestKeyframe();
+    // Compressed frames are also appended here when set
+    void SetRecorder(SessionWriter* recorder) { m_recorder = recorder; }
+
+    // Answers a client's MSG_CLOCK_PING; `receivedUs` is when it was read
+    bool SendClockPong(uint64_t clientSendUs, uint64_t receivedUs);
+
+    // Tells the client the last frame sent is still current (MSG_KEEPALIVE)
+    bool SendKeepalive(uint32_t framesUnchanged);
+
+    // Sends a MSG_STATS covering the frames since the previous call and
+    // starts a new interval. Returns false if the connection is gone.
+    bool SendStats();
+
+    // Totals since construction; the fps and average gauges come from the
+    // last SendStats() interval
+    void WriteMetrics(OpenMetricsWriter& metrics) const;
+
+    bool IsCompressing() const { return m_useCompression; }
+    uint32_t GetFramesSent() const { return m_framesSent; }
+
+private:
+    SOCKET m_socket;
+    CompressionType m_compression;
+    EncoderOptions m_options;
+    bool m_useCompression;
+    std::unique_ptr<VideoEncoder> m_encoder;
+    std::vector<uint8_t> m_compressed; // Reused between frames
+    SessionWriter* m_recorder = nullptr;
+    uint32_t m_framesSent = 0;          // Also the next frame's sequence number
+    bool m_streamStart = true;          // Flag the next frame FRAME_FLAG_STREAM_START
+    // Capture times of the frames given to the encoder, by input index, so
+    // a packet that comes out several inputs late is stamped with its own
+    static constexpr int64_t kCaptureSlots = 128;
+    uint64_t m_captureTimesUs[kCaptureSlots] = {};
+
+    // Totals for the metrics export
+    uint64_t m_framesSkipped = 0;
+    uint64_t m_keyframesSent = 0;
+    uint64_t m_bytesSent = 0;
+    Histogram m_encodeSeconds{kLatencyBuckets};
+    Histogram m_sendBlockedSeconds{kLatencyBuckets};
+    Histogram m_keyframeBytes{kFrameSizeBuckets};
+
+    // The current stats interval
+    std::chrono::steady_clock::time_point m_intervalStart = std::chrono::steady_clock::now();
+    uint32_t m_intervalFrames = 0;
+    uint32_t m_intervalSkipped = 0;
+    uint32_t m_intervalKeyframes = 0;
+    uint64_t m_intervalBytes = 0;
+    SampleStats m_intervalEncodeMs;
+    SampleStats m_intervalSendMs;
+    uint32_t m_lastKeyframeBytes = 0;
+    StatsMessage m_lastStats{};
+    PerfStageTotals m_intervalPerfStart[kStatsPerfStages];
+
+    bool PrepareEncoder(uint32_t width, uint32_t height);
+    void RecordSent(const SentFrame& sent);
+    void FillPerfStats(StatsMessage& stats);
+};
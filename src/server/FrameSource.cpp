@@ -0,0 +1,75 @@
+#include "FrameSource.h"
+#include "Clock.h"
+#include "Log.h"
+#include "TestPattern.h"
+
+bool TestPatternSource::CaptureFrame(CapturedFrame& frame) {
+    m_pixels.resize(static_cast<size_t>(m_width) * m_height * 4);
+
+    Timecode timecode;
+    timecode.counter = m_frameCount & kTimecodeCounterMask;
+    timecode.captureTime = TimecodeTime(ClockNowUs());
+    DrawTestPattern(timecode, m_width, m_height, m_pixels.data());
+    m_frameCount++;
+
+    frame.data = m_pixels.data();
+    frame.width = m_width;
+    frame.height = m_height;
+    frame.dataSize = static_cast<uint32_t>(m_pixels.size());
+    MR_LOG_DEBUG("Generated test frame " << m_frameCount << " (" << m_width << "x" << m_height << ")");
+    return true;
+}
+
+bool ReplayFrameSource::Initialize() {
+    if (!m_reader.Open(m_path)) {
+        return false;
+    }
+
+    m_cursor = m_reader.Begin();
+    if (!m_reader.ReadFrame(m_cursor, m_pending) || m_pending.codec != COMPRESSION_NONE) {
+        MR_LOG_ERROR("ReplayFrameSource: " << m_path << " is not a raw capture (record one with --record-raw)");
+        m_reader.Close();
+        return false;
+    }
+    m_hasPending = true;
+
+    MR_LOG_INFO("Replaying " << m_reader.GetRecordCount() << " frames ("
+                << m_pending.width << "x" << m_pending.height << ", "
+                << m_reader.GetDurationUs() / 1e6 << " s) from " << m_path
+                << (m_realTime ? " in real time" : " at maximum speed"));
+    return true;
+}
+
+bool ReplayFrameSource::CaptureFrame(CapturedFrame& frame) {
+    if (!m_hasPending) {
+        if (m_finished || !m_reader.ReadFrame(m_cursor, m_pending)) {
+            m_finished = true;
+            return false;
+        }
+        if (m_pending.codec != COMPRESSION_NONE) {
+            MR_LOG_WARN("ReplayFrameSource: Skipping compressed record in raw capture");
+            return false;
+        }
+        m_hasPending = true;
+    }
+
+    if (!m_started) {
+        m_startTime = std::chrono::steady_clock::now();
+        m_started = true;
+    }
+    if (m_realTime) {
+        auto due = m_startTime + std::chrono::microseconds(m_pending.timestampUs);
+        if (std::chrono::steady_clock::now() < due) {
+            return false; // Like a capture with no new frame yet
+        }
+    }
+
+    frame.data = m_pending.payload.data();
+    frame.width = m_pending.width;
+    frame.height = m_pending.height;
+    frame.dataSize = static_cast<uint32_t>(m_pending.payload.size());
+    frame.isReplay = true;
+    m_hasPending = false;
+    m_framesDelivered++;
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "SessionRecording.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A captured BGRA frame. `data` belongs to the source and stays valid until
+// its next CaptureFrame() call.
+struct CapturedFrame {
+    const uint8_t* data = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t dataSize = 0;
+    uint64_t captureTimeUs = 0; // ClockNowUs() at capture; FrameSender stamps frames left at 0
+    bool isReplay = false;
+};
+
+// Where the server's frames come from: the desktop, a synthetic pattern, or
+// a recording. The streaming loop polls CaptureFrame() and encodes whatever
+// it returns.
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    virtual bool Initialize() = 0;
+    // Returns false when no new frame is ready yet, leaving `frame` alone.
+    // Live sources keep the pixels valid until the next call that returns
+    // true; a replay may reuse them sooner.
+    virtual bool CaptureFrame(CapturedFrame& frame) = 0;
+    // True once a finite source has nothing more to deliver
+    virtual bool IsFinished() const { return false; }
+    // Whether the streaming loop should pace itself to the display rate;
+    // unpaced sources are drained as fast as the encoder allows
+    virtual bool IsPaced() const { return true; }
+};
+
+// The --test pattern (see TestPattern.h). Its Timecode block carries the
+// frame counter and capture time through the codec for pixel-to-pixel
+// latency and quality measurement.
+class TestPatternSource : public FrameSource {
+private:
+    std::vector<uint8_t> m_pixels;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_frameCount = 0;
+
+public:
+    TestPatternSource(uint32_t width = 640, uint32_t height = 480) : m_width(width), m_height(height) {}
+
+    bool Initialize() override { return true; }
+    bool CaptureFrame(CapturedFrame& frame) override;
+};
+
+// Plays back raw captures recorded with --record-raw: a session file (see
+// SessionRecording.h) whose records are uncompressed BGRA frames. Frames are
+// handed out straight from the memory mapping. In real-time mode a frame is
+// only returned once its recorded timestamp is due.
+class ReplayFrameSource : public FrameSource {
+private:
+    SessionReader m_reader;
+    std::string m_path;
+    bool m_realTime;
+    SessionReader::Cursor m_cursor = 0;
+    SessionFrame m_pending;
+    bool m_hasPending = false;
+    bool m_finished = false;
+    bool m_started = false;
+    std::chrono::steady_clock::time_point m_startTime;
+    uint32_t m_framesDelivered = 0;
+
+public:
+    ReplayFrameSource(const std::string& path, bool realTime) : m_path(path), m_realTime(realTime) {}
+
+    bool Initialize() override;
+    bool CaptureFrame(CapturedFrame& frame) override;
+    bool IsFinished() const override { return m_finished; }
+    bool IsPaced() const override { return m_realTime; }
+
+    uint32_t GetFrameCount() const { return m_reader.GetRecordCount(); }
+    int64_t GetDurationUs() const { return m_reader.GetDurationUs(); }
+    uint32_t GetFramesDelivered() const { return m_framesDelivered; }
+};
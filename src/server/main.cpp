@@ -1,4 +1,3 @@
-#include <iostream>
 #ifdef _WIN32
 #include <windows.h>
 #include <dxgi.h>
@@ -9,23 +8,32 @@
 #pragma comment(lib, "ws2_32.lib")
 #else
 #include <sys/socket.h>
+#include <sys/select.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <cstring>
 #include <errno.h>
-#define INVALID_SOCKET -1
-#define SOCKET_ERROR   -1
-inline int closesocket(int fd) { return close(fd); }
-using SOCKET = int;
 #endif
 #include <vector>
 #include <thread>
 #include <chrono>
 #include <algorithm>
+#include <cstdlib>
 #include "protocol.h"
+#include "FrameParser.h"
 #include "VideoEncoder.h"
+#include "SessionRecording.h"
+#include "FrameSource.h"
+#include "FrameSender.h"
+#include "FrameDeduplicator.h"
+#include "Clock.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "PerfCounters.h"
+#include "SampleStats.h"
+#include "Trace.h"
 
 #ifndef _WIN32
 #include <cstdint>
@@ -36,16 +44,17 @@ using INT32 = int32_t;
 #endif
 
 #ifdef _WIN32
-class DesktopDuplicator {
+class DesktopDuplicator : public FrameSource {
 private:
     ID3D11Device* m_Device = nullptr;
     ID3D11DeviceContext* m_Context = nullptr;
     IDXGIOutputDuplication* m_DeskDupl = nullptr;
     IDXGIOutput1* m_Output1 = nullptr;
     DXGI_OUTPUT_DESC m_OutputDesc = {};
+    std::vector<BYTE> m_PixelData;
     
 public:
-    bool Initialize() {
+    bool Initialize() override {
         HRESULT hr = S_OK;
         
         // Create D3D11 device
@@ -53,7 +62,7 @@ public:
         hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, 
                               nullptr, 0, D3D11_SDK_VERSION, &m_Device, &featureLevel, &m_Context);
         if (FAILED(hr)) {
-            std::cerr << "Failed to create D3D11 device: " << std::hex << hr << std::endl;
+            MR_LOG_ERROR("Failed to create D3D11 device: " << std::hex << hr);
             return false;
         }
         
@@ -61,7 +70,7 @@ public:
         IDXGIDevice* dxgiDevice = nullptr;
         hr = m_Device->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgiDevice);
         if (FAILED(hr)) {
-            std::cerr << "Failed to get DXGI device: " << std::hex << hr << std::endl;
+            MR_LOG_ERROR("Failed to get DXGI device: " << std::hex << hr);
             return false;
         }
         
@@ -70,7 +79,7 @@ public:
         hr = dxgiDevice->GetAdapter(&dxgiAdapter);
         dxgiDevice->Release();
         if (FAILED(hr)) {
-            std::cerr << "Failed to get DXGI adapter: " << std::hex << hr << std::endl;
+            MR_LOG_ERROR("Failed to get DXGI adapter: " << std::hex << hr);
             return false;
         }
         
@@ -79,38 +88,38 @@ public:
         hr = dxgiAdapter->EnumOutputs(0, &dxgiOutput);
         dxgiAdapter->Release();
         if (FAILED(hr)) {
-            std::cerr << "Failed to get primary output: " << std::hex << hr << std::endl;
+            MR_LOG_ERROR("Failed to get primary output: " << std::hex << hr);
             return false;
         }
         
         // Get output description
         dxgiOutput->GetDesc(&m_OutputDesc);
-        std::cout << "Primary display: " << m_OutputDesc.DesktopCoordinates.right - m_OutputDesc.DesktopCoordinates.left 
-                  << "x" << m_OutputDesc.DesktopCoordinates.bottom - m_OutputDesc.DesktopCoordinates.top << std::endl;
+        MR_LOG_INFO("Primary display: " << m_OutputDesc.DesktopCoordinates.right - m_OutputDesc.DesktopCoordinates.left 
+                    << "x" << m_OutputDesc.DesktopCoordinates.bottom - m_OutputDesc.DesktopCoordinates.top);
         
         // Get IDXGIOutput1
         hr = dxgiOutput->QueryInterface(__uuidof(IDXGIOutput1), (void**)&m_Output1);
         dxgiOutput->Release();
         if (FAILED(hr)) {
-            std::cerr << "Failed to get IDXGIOutput1: " << std::hex << hr << std::endl;
+            MR_LOG_ERROR("Failed to get IDXGIOutput1: " << std::hex << hr);
             return false;
         }
         
         // Create desktop duplication
         hr = m_Output1->DuplicateOutput(m_Device, &m_DeskDupl);
         if (FAILED(hr)) {
-            std::cerr << "Failed to create desktop duplication: " << std::hex << hr << std::endl;
+            MR_LOG_ERROR("Failed to create desktop duplication: " << std::hex << hr);
             if (hr == DXGI_ERROR_NOT_CURRENTLY_AVAILABLE) {
-                std::cerr << "Desktop duplication is not available (may be in use by another process)" << std::endl;
+                MR_LOG_ERROR("Desktop duplication is not available (may be in use by another process)");
             }
             return false;
         }
         
-        std::cout << "Desktop Duplication initialized successfully!" << std::endl;
+        MR_LOG_INFO("Desktop Duplication initialized successfully!");
         return true;
     }
     
-    bool CaptureFrame(std::vector<BYTE>& pixelData, UINT32& width, UINT32& height, UINT32& dataSize) {
+    bool CaptureFrame(CapturedFrame& frame) override {
         if (!m_DeskDupl) return false;
         
         DXGI_OUTDUPL_FRAME_INFO frameInfo;
@@ -121,7 +130,7 @@ public:
             return false; // No new frame
         }
         if (FAILED(hr)) {
-            std::cerr << "Failed to acquire next frame: " << std::hex << hr << std::endl;
+            MR_LOG_ERROR("Failed to acquire next frame: " << std::hex << hr);
             return false;
         }
         
@@ -160,23 +169,20 @@ public:
         hr = m_Context->Map(stagingTexture, 0, D3D11_MAP_READ, 0, &mappedResource);
         if (SUCCEEDED(hr)) {
             // Set frame dimensions and data size
-            width = textureDesc.Width;
-            height = textureDesc.Height;
-            dataSize = mappedResource.RowPitch * textureDesc.Height;
+            UINT32 dataSize = mappedResource.RowPitch * textureDesc.Height;
             
             // Debug: Log frame capture details
-            std::cout << "Capturing frame - Width: " << width 
-                     << ", Height: " << height 
-                     << ", RowPitch: " << mappedResource.RowPitch
-                     << ", DataSize: " << dataSize << std::endl;
+            MR_LOG_DEBUG("Capturing frame - Width: " << textureDesc.Width 
+                         << ", Height: " << textureDesc.Height 
+                         << ", RowPitch: " << mappedResource.RowPitch
+                         << ", DataSize: " << dataSize);
             
             // Resize buffer for pixel data only
-            pixelData.clear();
-            pixelData.resize(dataSize);
+            m_PixelData.resize(dataSize);
             
             // Copy pixel data directly
             BYTE* srcData = (BYTE*)mappedResource.pData;
-            BYTE* dstData = pixelData.data();
+            BYTE* dstData = m_PixelData.data();
             
             for (UINT row = 0; row < textureDesc.Height; ++row) {
                 memcpy(dstData + row * mappedResource.RowPitch, 
@@ -185,6 +191,11 @@ public:
             }
             
             m_Context->Unmap(stagingTexture, 0);
+            
+            frame.data = m_PixelData.data();
+            frame.width = textureDesc.Width;
+            frame.height = textureDesc.Height;
+            frame.dataSize = dataSize;
         }
         
         stagingTexture->Release();
@@ -203,11 +214,12 @@ public:
     ~DesktopDuplicator() {
         Cleanup();
     }
+};
 #else
-class DesktopDuplicator {
+class DesktopDuplicator : public FrameSource {
 public:
-    bool Initialize() { return false; }
-    bool CaptureFrame(std::vector<uint8_t>&, uint32_t&, uint32_t&, uint32_t&) { return false; }
+    bool Initialize() override { return false; }
+    bool CaptureFrame(CapturedFrame&) override { return false; }
     void Cleanup() {}
 };
 #endif
@@ -304,6 +316,7 @@ public:
         
         return true;
     }
+};
 #else
 class InputInjector {
 public:
@@ -313,69 +326,116 @@ public:
 };
 #endif
 
-// Helper function to dump hex data for debugging
-void HexDump(const char* data, size_t size, const std::string& label) {
-    std::cout << label << " (size=" << size << "):" << std::endl;
-    size_t maxBytes = (size < 32) ? size : 32;
-    for (size_t i = 0; i < maxBytes; i++) {
-        printf("%02X ", (unsigned char)data[i]);
-        if ((i + 1) % 16 == 0) std::cout << std::endl;
+// Waits until the client has sent something or `deadline` passes; returns
+// true if there is input to read
+bool WaitForInput(SOCKET socket, std::chrono::steady_clock::time_point deadline) {
+    auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0) {
+        return false;
     }
-    if (size > 32) std::cout << "... (truncated)";
-    std::cout << std::endl;
-}
-
-// Helper function to ensure all data is sent over the network
-bool SendAllData(SOCKET socket, const char* data, size_t size) {
-    size_t totalSent = 0;
-    
-    while (totalSent < size) {
-        int sent = send(socket, data + totalSent, static_cast<int>(size - totalSent), 0);
-        
-        if (sent == SOCKET_ERROR) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(socket, &readSet);
+    timeval timeout;
+    timeout.tv_sec = static_cast<long>(remaining.count() / 1000000);
+    timeout.tv_usec = static_cast<long>(remaining.count() % 1000000);
 #ifdef _WIN32
-            int error = WSAGetLastError();
-            if (error == WSAEWOULDBLOCK) {
+    return select(0, &readSet, nullptr, nullptr, &timeout) > 0;
 #else
-            int error = errno;
-            if (error == EWOULDBLOCK || error == EAGAIN) {
+    return select(socket + 1, &readSet, nullptr, nullptr, &timeout) > 0;
 #endif
-                // Non-blocking socket would block, try again
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                continue;
-            }
-            // Real error
-            std::cerr << "Send error: " << error << std::endl;
-            return false;
-        }
-        
-        if (sent == 0) {
-            // Connection closed
-            std::cerr << "Connection closed during send" << std::endl;
-            return false;
+}
+
+// Helper function to dump hex data for debugging
+void HexDump(const char* data, size_t size, const std::string& label) {
+    MR_LOG_DEBUG(label << " (size=" << size << "):");
+    size_t maxBytes = (size < 32) ? size : 32;
+    for (size_t row = 0; row < maxBytes; row += 16) {
+        char line[16 * 3 + 1] = {};
+        for (size_t i = row; i < maxBytes && i < row + 16; i++) {
+            snprintf(line + (i - row) * 3, 4, "%02X ", (unsigned char)data[i]);
         }
-        
-        totalSent += sent;
+        MR_LOG_DEBUG(line);
     }
-    
-    return true;
+    if (size > 32) MR_LOG_DEBUG("... (truncated)");
 }
 
 int main(int argc, char* argv[]) {
     bool testMode = false;
+    std::string recordPath;
+    std::string recordRawPath;
+    std::string replayPath;
+    std::string tracePath;
+    std::string metricsPath;
+    bool perfCounters = false;
+    bool dedupFrames = true;
+    bool replayRealTime = true;
+    EncoderOptions encoderOptions;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--test") == 0) {
             testMode = true;
+        } else if (strncmp(argv[i], "--record=", 9) == 0) {
+            recordPath = argv[i] + 9;
+        } else if (strncmp(argv[i], "--record-raw=", 13) == 0) {
+            recordRawPath = argv[i] + 13;
+        } else if (strncmp(argv[i], "--replay=", 9) == 0) {
+            replayPath = argv[i] + 9;
+        } else if (strcmp(argv[i], "--replay-speed=max") == 0) {
+            replayRealTime = false;
+        } else if (strcmp(argv[i], "--replay-speed=realtime") == 0) {
+            replayRealTime = true;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            tracePath = argv[i] + 8;
+        } else if (strncmp(argv[i], "--metrics=", 10) == 0) {
+            metricsPath = argv[i] + 10;
+        } else if (strcmp(argv[i], "--perf-counters") == 0) {
+            perfCounters = true;
+        } else if (strcmp(argv[i], "--no-dedup") == 0) {
+            dedupFrames = false;
+        } else if (strncmp(argv[i], "--encoder=", 10) == 0) {
+            encoderOptions.encoder = argv[i] + 10;
+        } else if (strncmp(argv[i], "--preset=", 9) == 0) {
+            encoderOptions.preset = argv[i] + 9;
+        } else if (strncmp(argv[i], "--tune=", 7) == 0) {
+            encoderOptions.tune = argv[i] + 7;
+        } else if (strncmp(argv[i], "--encoder-threads=", 18) == 0) {
+            int threads = atoi(argv[i] + 18);
+            if (threads <= 0) {
+                MR_LOG_ERROR("Invalid encoder thread count: " << argv[i] + 18);
+                return 1;
+            }
+            encoderOptions.threads = static_cast<uint32_t>(threads);
+        } else if (strncmp(argv[i], "--bitrate=", 10) == 0) {
+            int kbps = atoi(argv[i] + 10);
+            if (kbps <= 0) {
+                MR_LOG_ERROR("Invalid bitrate: " << argv[i] + 10);
+                return 1;
+            }
+            encoderOptions.bitrate = static_cast<uint32_t>(kbps) * 1000;
+        } else if (strncmp(argv[i], "--log-level=", 12) == 0) {
+            LogLevel level;
+            if (!Log::ParseLevel(argv[i] + 12, level)) {
+                MR_LOG_ERROR("Unknown log level: " << argv[i] + 12);
+                return 1;
+            }
+            Log::SetLevel(level);
         }
     }
     
-    std::cout << "MRDesktop Server - Desktop Duplication Service" << std::endl;
-    std::cout << "=============================================" << std::endl;
+    if (!tracePath.empty() && Trace::Start(tracePath, "MRDesktopServer")) {
+        Trace::SetThreadName("stream");
+    }
+    if (perfCounters) {
+        PerfCounters::Start();
+    }
+    
+    MR_LOG_INFO("MRDesktop Server - Desktop Duplication Service");
+    MR_LOG_INFO("=============================================");
     
     if (testMode) {
-        std::cout << "RUNNING IN TEST MODE" << std::endl;
+        MR_LOG_INFO("RUNNING IN TEST MODE");
     }
     
     // Initialize platform networking
@@ -383,7 +443,7 @@ int main(int argc, char* argv[]) {
     // Initialize COM
     HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
     if (FAILED(hr)) {
-        std::cerr << "Failed to initialize COM: " << std::hex << hr << std::endl;
+        MR_LOG_ERROR("Failed to initialize COM: " << std::hex << hr);
         return 1;
     }
 
@@ -391,20 +451,30 @@ int main(int argc, char* argv[]) {
     WSADATA wsaData;
     int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
     if (result != 0) {
-        std::cerr << "WSAStartup failed: " << result << std::endl;
+        MR_LOG_ERROR("WSAStartup failed: " << result);
         CoUninitialize();
         return 1;
     }
-    std::cout << "Network and COM initialized successfully" << std::endl;
+    MR_LOG_INFO("Network and COM initialized successfully");
 #else
     int result = 0; // nothing needed on POSIX
-    std::cout << "Network initialized" << std::endl;
+    MR_LOG_INFO("Network initialized");
 #endif
     
-    // Initialize desktop duplicator (skip in test mode)
-    DesktopDuplicator duplicator;
-    if (!testMode && !duplicator.Initialize()) {
-        std::cerr << "Failed to initialize desktop duplicator" << std::endl;
+    // Pick the frame source: a replayed capture, the test pattern, or the desktop
+    std::unique_ptr<FrameSource> frameSource;
+    ReplayFrameSource* replaySource = nullptr;
+    if (!replayPath.empty()) {
+        auto replay = std::make_unique<ReplayFrameSource>(replayPath, replayRealTime);
+        replaySource = replay.get();
+        frameSource = std::move(replay);
+    } else if (testMode) {
+        frameSource = std::make_unique<TestPatternSource>();
+    } else {
+        frameSource = std::make_unique<DesktopDuplicator>();
+    }
+    if (!frameSource->Initialize()) {
+        MR_LOG_ERROR("Failed to initialize frame source");
 #ifdef _WIN32
         WSACleanup();
         CoUninitialize();
@@ -416,9 +486,9 @@ int main(int argc, char* argv[]) {
     SOCKET serverSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (serverSocket == INVALID_SOCKET) {
 #ifdef _WIN32
-        std::cerr << "Failed to create socket: " << WSAGetLastError() << std::endl;
+        MR_LOG_ERROR("Failed to create socket: " << WSAGetLastError());
 #else
-        std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
+        MR_LOG_ERROR("Failed to create socket: " << strerror(errno));
 #endif
 #ifdef _WIN32
         WSACleanup();
@@ -435,9 +505,9 @@ int main(int argc, char* argv[]) {
     
     if (bind(serverSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
 #ifdef _WIN32
-        std::cerr << "Bind failed: " << WSAGetLastError() << std::endl;
+        MR_LOG_ERROR("Bind failed: " << WSAGetLastError());
 #else
-        std::cerr << "Bind failed: " << strerror(errno) << std::endl;
+        MR_LOG_ERROR("Bind failed: " << strerror(errno));
 #endif
         closesocket(serverSocket);
 #ifdef _WIN32
@@ -449,9 +519,9 @@ int main(int argc, char* argv[]) {
     
     if (listen(serverSocket, 1) == SOCKET_ERROR) {
 #ifdef _WIN32
-        std::cerr << "Listen failed: " << WSAGetLastError() << std::endl;
+        MR_LOG_ERROR("Listen failed: " << WSAGetLastError());
 #else
-        std::cerr << "Listen failed: " << strerror(errno) << std::endl;
+        MR_LOG_ERROR("Listen failed: " << strerror(errno));
 #endif
         closesocket(serverSocket);
 #ifdef _WIN32
@@ -461,16 +531,16 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    std::cout << "Server listening on port 8080..." << std::endl;
-    std::cout << "Waiting for client connection..." << std::endl;
+    MR_LOG_INFO("Server listening on port 8080...");
+    MR_LOG_INFO("Waiting for client connection...");
     
     // Accept client connection
     SOCKET clientSocket = accept(serverSocket, nullptr, nullptr);
     if (clientSocket == INVALID_SOCKET) {
 #ifdef _WIN32
-        std::cerr << "Accept failed: " << WSAGetLastError() << std::endl;
+        MR_LOG_ERROR("Accept failed: " << WSAGetLastError());
 #else
-        std::cerr << "Accept failed: " << strerror(errno) << std::endl;
+        MR_LOG_ERROR("Accept failed: " << strerror(errno));
 #endif
         closesocket(serverSocket);
 #ifdef _WIN32
@@ -480,7 +550,7 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    std::cout << "Client connected! Starting desktop streaming..." << std::endl;
+    MR_LOG_INFO("Client connected! Starting desktop streaming...");
 
     // Wait for compression negotiation from client
     CompressionType clientCompression = COMPRESSION_NONE;
@@ -488,9 +558,9 @@ int main(int argc, char* argv[]) {
     int received = recv(clientSocket, (char*)&compressionRequest, sizeof(compressionRequest), 0);
     if (received == sizeof(compressionRequest) && compressionRequest.header.type == MSG_COMPRESSION_REQUEST) {
         clientCompression = compressionRequest.compression;
-        std::cout << "Client requested compression type: " << clientCompression << std::endl;
+        MR_LOG_INFO("Client requested compression type: " << clientCompression);
     } else {
-        std::cout << "No compression request received, using uncompressed frames" << std::endl;
+        MR_LOG_INFO("No compression request received, using uncompressed frames");
     }
 
     // Set socket to non-blocking for input checking
@@ -503,195 +573,268 @@ int main(int argc, char* argv[]) {
 #endif
     
     // Streaming and input handling loop
-    std::vector<BYTE> pixelData;
-    UINT32 frameWidth, frameHeight, frameDataSize;
+    CapturedFrame capturedFrame;
     int frameCount = 0;
     auto startTime = std::chrono::high_resolution_clock::now();
     
-    // Initialize video encoder if compression is requested
-    std::unique_ptr<VideoEncoder> encoder;
-    bool useCompression = (clientCompression != COMPRESSION_NONE);
+    // Encode cost and output size, reported at the end of a replay
+    SampleStats encodeMs;
+    uint64_t compressedBytes = 0;
+    
+    // Encodes (if compression is requested) and sends each captured frame
+    FrameSender sender(clientSocket, clientCompression, encoderOptions);
+    bool useCompression = sender.IsCompressing();
+    
+    // Unchanged captures are not re-encoded, and a static screen drops to the
+    // idle capture rate. Replays encode every frame so their stats compare
+    // encoders on identical work.
+    FrameDeduplicator dedup;
+    bool useDedup = dedupFrames && !replaySource;
+    // capturedFrame holds a valid frame; its pixels stay put until the next
+    // successful capture, so it can be sent again
+    bool haveFrame = false;
+    
+    // Stream statistics go to the client (and the metrics file) once a second
+    constexpr auto kStatsInterval = std::chrono::seconds(1);
+    auto lastStats = std::chrono::steady_clock::now();
     
     if (useCompression) {
-        encoder = std::make_unique<VideoEncoder>();
-        std::cout << "Compression enabled, encoder will be initialized with first frame" << std::endl;
+        MR_LOG_INFO("Compression enabled, encoder will be initialized with first frame");
     } else {
-        std::cout << "Ready to stream uncompressed frames" << std::endl;
+        MR_LOG_INFO("Ready to stream uncompressed frames");
     }
     
-    while (true) {
-        // Check for incoming input messages
-        MessageHeader msgHeader;
-        int received = recv(clientSocket, (char*)&msgHeader, sizeof(msgHeader), 0);
-        if (received == sizeof(msgHeader)) {
-            // Process input message based on type
-            switch (msgHeader.type) {
+    // Optional recording of the encoded stream exactly as sent
+    SessionWriter recorder;
+    if (!recordPath.empty()) {
+        if (!useCompression) {
+            MR_LOG_WARN("Session recording needs a compressed stream; not recording");
+        } else if (recorder.Open(recordPath)) {
+            MR_LOG_INFO("Recording session to " << recordPath);
+            sender.SetRecorder(&recorder);
+        }
+    }
+    
+    // Raw captures are large, so allow only a few to queue for the disk
+    SessionWriter rawRecorder;
+    if (!recordRawPath.empty() && rawRecorder.Open(recordRawPath, 8)) {
+        MR_LOG_INFO("Recording raw captures to " << recordRawPath);
+    }
+    
+    // Client messages are parsed incrementally, so a message split across
+    // TCP segments is resumed instead of desynchronizing the stream
+    BufferPool inputPool;
+    FrameParser inputParser(inputPool);
+    auto recvInput = [clientSocket](uint8_t* buf, int len) -> int {
+        int r = recv(clientSocket, reinterpret_cast<char*>(buf), len, 0);
+        if (r == 0) {
+            return -1; // Client closed the connection
+        }
+        if (r == SOCKET_ERROR) {
+#ifdef _WIN32
+            if (WSAGetLastError() == WSAEWOULDBLOCK)
+                return 0;
+#else
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
+                return 0;
+#endif
+            return -1;
+        }
+        return r;
+    };
+    
+    // Handles all pending input messages; returns false once the client is gone
+    auto handleInput = [&]() -> bool {
+        ParsedMessage inputMsg;
+        FrameParser::Status inputStatus;
+        while ((inputStatus = inputParser.Poll(recvInput, inputMsg)) == FrameParser::Status::Message) {
+            switch (inputMsg.header.type) {
                 case MSG_MOUSE_MOVE: {
-                    MouseMoveMessage mouseMsg;
-                    received = recv(clientSocket, (char*)&mouseMsg + sizeof(MessageHeader), 
-                                   sizeof(MouseMoveMessage) - sizeof(MessageHeader), 0);
-                    if (received == sizeof(MouseMoveMessage) - sizeof(MessageHeader)) {
-                        InputInjector::InjectMouseMove(mouseMsg.deltaX, mouseMsg.deltaY, 
-                                                     mouseMsg.absolute, mouseMsg.x, mouseMsg.y);
-                        std::cout << "Mouse move: dx=" << mouseMsg.deltaX << " dy=" << mouseMsg.deltaY << std::endl;
-                    }
+                    const MouseMoveMessage& mouseMsg = inputMsg.As<MouseMoveMessage>();
+                    InputInjector::InjectMouseMove(mouseMsg.deltaX, mouseMsg.deltaY, 
+                                                 mouseMsg.absolute, mouseMsg.x, mouseMsg.y);
+                    dedup.Wake();
+                    MR_LOG_DEBUG("Mouse move: dx=" << mouseMsg.deltaX << " dy=" << mouseMsg.deltaY);
                     break;
                 }
                 case MSG_MOUSE_CLICK: {
-                    MouseClickMessage clickMsg;
-                    received = recv(clientSocket, (char*)&clickMsg + sizeof(MessageHeader), 
-                                   sizeof(MouseClickMessage) - sizeof(MessageHeader), 0);
-                    if (received == sizeof(MouseClickMessage) - sizeof(MessageHeader)) {
-                        InputInjector::InjectMouseClick(clickMsg.button, clickMsg.pressed);
-                        std::cout << "Mouse " << (clickMsg.pressed ? "press" : "release") 
-                                 << " button " << clickMsg.button << std::endl;
-                    }
+                    const MouseClickMessage& clickMsg = inputMsg.As<MouseClickMessage>();
+                    InputInjector::InjectMouseClick(clickMsg.button, clickMsg.pressed);
+                    dedup.Wake();
+                    MR_LOG_DEBUG("Mouse " << (clickMsg.pressed ? "press" : "release") 
+                                 << " button " << clickMsg.button);
                     break;
                 }
                 case MSG_MOUSE_SCROLL: {
-                    MouseScrollMessage scrollMsg;
-                    received = recv(clientSocket, (char*)&scrollMsg + sizeof(MessageHeader), 
-                                   sizeof(MouseScrollMessage) - sizeof(MessageHeader), 0);
-                    if (received == sizeof(MouseScrollMessage) - sizeof(MessageHeader)) {
-                        InputInjector::InjectMouseScroll(scrollMsg.deltaX, scrollMsg.deltaY);
-                        std::cout << "Mouse scroll: dx=" << scrollMsg.deltaX << " dy=" << scrollMsg.deltaY << std::endl;
+                    const MouseScrollMessage& scrollMsg = inputMsg.As<MouseScrollMessage>();
+                    InputInjector::InjectMouseScroll(scrollMsg.deltaX, scrollMsg.deltaY);
+                    dedup.Wake();
+                    MR_LOG_DEBUG("Mouse scroll: dx=" << scrollMsg.deltaX << " dy=" << scrollMsg.deltaY);
+                    break;
+                }
+                case MSG_CLOCK_PING: {
+                    uint64_t receivedUs = ClockNowUs();
+                    if (!sender.SendClockPong(inputMsg.As<ClockPingMessage>().clientSendUs, receivedUs)) {
+                        MR_LOG_ERROR("Failed to answer clock ping");
                     }
                     break;
                 }
+                case MSG_KEYFRAME_REQUEST: {
+                    // The client lost its reference chain; restart it with the next frame
+                    MR_LOG_INFO("Client requested a keyframe");
+                    sender.RequestKeyframe();
+                    dedup.Reset(); // Even if the screen has not changed
+                    break;
+                }
+                default:
+                    break;
             }
         }
+        return inputStatus != FrameParser::Status::Error;
+    };
+
+    while (true) {
+        if (!handleInput()) {
+            MR_LOG_INFO("Client disconnected");
+            break;
+        }
         
-        // Capture or generate test frame
-        bool frameReady = false;
-        if (testMode) {
-            // Generate test frame data
-            frameWidth = 640;
-            frameHeight = 480;
-            frameDataSize = frameWidth * frameHeight * 4; // BGRA format
-            
-            pixelData.clear();
-            pixelData.resize(frameDataSize);
-            
-            // Create test pattern: red-green gradient with frame counter
-            for (uint32_t y = 0; y < frameHeight; y++) {
-                for (uint32_t x = 0; x < frameWidth; x++) {
-                    uint32_t index = (y * frameWidth + x) * 4;
-                    uint8_t red = static_cast<uint8_t>((x * 255) / frameWidth);
-                    uint8_t green = static_cast<uint8_t>((y * 255) / frameHeight);
-                    uint8_t blue = static_cast<uint8_t>(frameCount % 256);
-                    
-                    pixelData[index + 0] = blue;   // B
-                    pixelData[index + 1] = green;  // G
-                    pixelData[index + 2] = red;    // R
-                    pixelData[index + 3] = 255;    // A
-                }
+        bool frameReady;
+        {
+            TraceScope captureScope("capture");
+            PerfScope capturePerf(PerfStage::Capture);
+            frameReady = frameSource->CaptureFrame(capturedFrame);
+            if (!frameReady) {
+                captureScope.Discard(); // Nothing new on screen
+                capturePerf.Discard();
             }
-            frameReady = true;
-            std::cout << "Generated test frame " << frameCount + 1 << " (640x480)" << std::endl;
-        } else {
-            frameReady = duplicator.CaptureFrame(pixelData, frameWidth, frameHeight, frameDataSize);
+            capturedFrame.captureTimeUs = ClockNowUs();
         }
-        
+        if (!frameReady && frameSource->IsFinished()) {
+            MR_LOG_INFO("Replay finished");
+            break;
+        }
+        bool sendFrame = frameReady;
         if (frameReady) {
+            if (rawRecorder.IsOpen()) {
+                rawRecorder.Append(capturedFrame.width, capturedFrame.height, COMPRESSION_NONE, true,
+                                   capturedFrame.data, capturedFrame.dataSize);
+            }
+            
             // Validate frame dimensions are reasonable
-            if (frameWidth == 0 || frameHeight == 0 ||
-                frameWidth > 10000 || frameHeight > 10000 ||
-                frameDataSize > 100000000) {
-                std::cerr << "Invalid frame data - Width: " << frameWidth 
-                         << ", Height: " << frameHeight 
-                         << ", DataSize: " << frameDataSize << std::endl;
+            if (capturedFrame.width == 0 || capturedFrame.height == 0 ||
+                capturedFrame.width > 10000 || capturedFrame.height > 10000 ||
+                capturedFrame.dataSize > 100000000) {
+                MR_LOG_RATE_LIMITED(LogLevel::Error, 1000,
+                                    "Invalid frame data - Width: " << capturedFrame.width 
+                                    << ", Height: " << capturedFrame.height 
+                                    << ", DataSize: " << capturedFrame.dataSize);
+                haveFrame = false;
                 continue;
             }
-            
-            if (useCompression) {
-                // Initialize encoder with first frame dimensions
-                if (!encoder->IsInitialized()) {
-                    if (!encoder->Initialize(frameWidth, frameHeight, clientCompression)) {
-                        std::cerr << "Failed to initialize video encoder" << std::endl;
-                        useCompression = false; // Fall back to uncompressed
-                    } else {
-                        std::cout << "Video encoder initialized successfully" << std::endl;
-                    }
-                }
-                
-                if (encoder->IsInitialized()) {
-                    // Encode frame
-                    std::vector<uint8_t> compressedData;
-                    bool isKeyframe = false;
-                    
-                    if (encoder->EncodeFrame(pixelData.data(), compressedData, isKeyframe)) {
-                        // Send compressed frame
-                        CompressedFrameMessage compFrameMsg;
-                        compFrameMsg.header.type = MSG_COMPRESSED_FRAME;
-                        compFrameMsg.header.size = sizeof(CompressedFrameMessage);
-                        compFrameMsg.width = frameWidth;
-                        compFrameMsg.height = frameHeight;
-                        compFrameMsg.compressedSize = compressedData.size();
-                        compFrameMsg.isKeyframe = isKeyframe ? 1 : 0;
-                        
-                        std::cout << "SERVER SEND: Frame " << frameCount + 1 << " - Compressed: " << compressedData.size() 
-                                  << " bytes (" << (isKeyframe ? "KEY" : "DELTA") << ")" << std::endl;
-                        
-                        if (!SendAllData(clientSocket, (char*)&compFrameMsg, sizeof(CompressedFrameMessage))) {
-                            std::cerr << "Failed to send compressed frame header" << std::endl;
-                            break;
-                        }
-                        
-                        if (!SendAllData(clientSocket, (char*)compressedData.data(), compressedData.size())) {
-                            std::cerr << "Failed to send compressed frame data" << std::endl;
-                            break;
-                        }
-                    } else {
-                        // Skip this frame if encoding failed
-                        continue;
-                    }
-                } else {
-                    useCompression = false; // Fall back to uncompressed
-                }
+            haveFrame = true;
+        }
+        if (useDedup && haveFrame) {
+            // A static desktop delivers no frames at all, so keepalives and
+            // keyframe requests are timed here rather than per capture
+            FrameDeduplicator::Action action = frameReady ? dedup.Check(capturedFrame) : dedup.Tick();
+            if (action == FrameDeduplicator::Action::Keepalive &&
+                !sender.SendKeepalive(dedup.GetUnchangedFrames())) {
+                break;
             }
-            
-            if (!useCompression) {
-                // Send uncompressed frame
-                FrameMessage frameMsg;
-                frameMsg.header.type = MSG_FRAME_DATA;
-                frameMsg.header.size = sizeof(FrameMessage);
-                frameMsg.width = frameWidth;
-                frameMsg.height = frameHeight;
-                frameMsg.dataSize = frameDataSize;
-                
-                std::cout << "SERVER SEND: Frame " << frameCount + 1 << " - Uncompressed: " << frameDataSize << " bytes" << std::endl;
-                
-                if (!SendAllData(clientSocket, (char*)&frameMsg, sizeof(FrameMessage))) {
-                    std::cerr << "Failed to send frame header" << std::endl;
-                    break;
-                }
-                
-                if (!SendAllData(clientSocket, (char*)pixelData.data(), frameDataSize)) {
-                    std::cerr << "Failed to send frame data" << std::endl;
-                    break;
-                }
+            // Without a new frame, Send repeats the last one for a keyframe request
+            sendFrame = action == FrameDeduplicator::Action::Send;
+        }
+        if (sendFrame) {
+            SentFrame sent;
+            FrameSender::Result sendResult = sender.Send(capturedFrame, sent);
+            if (sendResult == FrameSender::Result::Failed) {
+                break;
+            }
+            if (sendResult == FrameSender::Result::Skipped) {
+                continue; // Skip this frame if encoding failed
+            }
+            if (sent.compressed) {
+                encodeMs.Add(sent.encodeMs);
+                compressedBytes += sent.payloadBytes;
             }
-            
-            std::cout << "SERVER SEND: Frame " << frameCount + 1 << " - COMPLETE" << std::endl;
             
             frameCount++;
             if (frameCount % 30 == 0) {
                 auto currentTime = std::chrono::high_resolution_clock::now();
                 auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime);
                 double fps = (frameCount * 1000.0) / duration.count();
-                std::cout << "Sent " << frameCount << " frames, FPS: " << fps << ", Frame size: " << formatBytes(frameDataSize) << std::endl;
+                MR_LOG_INFO("Sent " << frameCount << " frames, FPS: " << fps << ", Frame size: " << formatBytes(capturedFrame.dataSize));
             }
             
             // In test mode, exit after sending 3 frames
             if (testMode && frameCount >= 3) {
-                std::cout << "TEST MODE: Sent 3 frames, exiting successfully" << std::endl;
+                MR_LOG_INFO("TEST MODE: Sent 3 frames, exiting successfully");
+                break;
+            }
+        }
+        
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastStats >= kStatsInterval) {
+            lastStats = now;
+            if (!sender.SendStats()) {
                 break;
             }
+            if (!metricsPath.empty()) {
+                OpenMetricsWriter metrics;
+                sender.WriteMetrics(metrics);
+                if (useDedup) {
+                    dedup.WriteMetrics(metrics);
+                }
+                metrics.AddPerfCounters("mrdesktop_server");
+                metrics.WriteToFile(metricsPath);
+            }
         }
         
-        std::this_thread::sleep_for(std::chrono::milliseconds(16)); // ~60fps target
+        if (frameSource->IsPaced()) {
+            // Wait out the frame interval (~60fps target, or the idle rate),
+            // but answer input and clock pings as they arrive so their
+            // timestamps stay honest
+            bool wasIdle = dedup.IsIdle();
+            auto due = std::chrono::steady_clock::now() + dedup.GetCaptureInterval(std::chrono::milliseconds(16));
+            bool connected = true;
+            while (connected && WaitForInput(clientSocket, due)) {
+                connected = handleInput();
+                if (wasIdle && !dedup.IsIdle()) {
+                    break; // Input woke the stream; capture straight away
+                }
+            }
+            if (!connected) {
+                MR_LOG_INFO("Client disconnected");
+                break;
+            }
+        }
+    }
+    
+    if (replaySource && frameCount > 0) {
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+        MR_LOG_INFO("Replay summary: " << frameCount << " frames in " << elapsed.count() << " s ("
+                    << frameCount / elapsed.count() << " fps)");
+        if (!encodeMs.Empty()) {
+            MR_LOG_INFO("  Encode ms: mean " << encodeMs.Mean() << ", p50 " << encodeMs.Percentile(50)
+                        << ", p95 " << encodeMs.Percentile(95) << ", max " << encodeMs.Max());
+            LogMessage output(LogLevel::Info);
+            output.Stream() << "  Output: " << formatBytes(compressedBytes) << ", "
+                            << formatBytes(compressedBytes / frameCount) << "/frame";
+            if (replaySource->GetDurationUs() > 0) {
+                // Bitrate at the pace the capture was recorded, whatever the replay speed
+                double kbps = compressedBytes * 8.0 / 1000.0 / (replaySource->GetDurationUs() / 1e6);
+                output.Stream() << ", " << kbps << " kbit/s at recorded rate";
+            }
+        }
+    }
+    
+    if (PerfCounters::IsEnabled()) {
+        PerfCounters::LogSummary();
     }
     
+    recorder.Close();
+    rawRecorder.Close();
     closesocket(clientSocket);
     closesocket(serverSocket);
 #ifdef _WIN32
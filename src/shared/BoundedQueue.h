@@ -0,0 +1,96 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Fixed-capacity blocking FIFO between two threads. Push() waits while the
+// queue is full, which propagates backpressure to the producer instead of
+// growing without bound. Close() wakes everyone; consumers drain what is left.
+template <typename T>
+class BoundedQueue {
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    std::vector<T> m_items;
+    size_t m_head = 0;
+    size_t m_count = 0;
+    size_t m_highWater = 0;
+    bool m_closed = false;
+
+public:
+    explicit BoundedQueue(size_t capacity) : m_items(capacity) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Returns false if the queue was closed before there was room
+    bool Push(T&& item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_count < m_items.size(); });
+        if (m_closed) {
+            return false;
+        }
+        m_items[(m_head + m_count) % m_items.size()] = std::move(item);
+        m_count++;
+        if (m_count > m_highWater) {
+            m_highWater = m_count;
+        }
+        lock.unlock();
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // Returns false once the queue is closed and empty
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || m_count > 0; });
+        if (m_count == 0) {
+            return false;
+        }
+        item = std::move(m_items[m_head]);
+        m_head = (m_head + 1) % m_items.size();
+        m_count--;
+        lock.unlock();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+    // Drops queued items and reopens the queue for a new session. The high
+    // water mark is kept until ResetHighWater().
+    void Reset() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (T& item : m_items) {
+            item = T();
+        }
+        m_head = 0;
+        m_count = 0;
+        m_closed = false;
+    }
+
+    void ResetHighWater() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_highWater = m_count;
+    }
+
+    size_t Size() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_count;
+    }
+
+    size_t GetHighWater() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_highWater;
+    }
+};
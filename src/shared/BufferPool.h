@@ -0,0 +1,157 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+class BufferPool;
+
+// Storage block owned by a BufferPool. Never used directly; see BufferHandle.
+class PooledBuffer {
+private:
+    friend class BufferPool;
+    friend class BufferHandle;
+
+    std::vector<uint8_t> m_storage;
+    size_t m_size = 0;
+    std::atomic<int> m_refs{0};
+    BufferPool* m_pool = nullptr;
+};
+
+// Reference-counted handle to a pooled buffer. Copying a handle shares the
+// buffer; the storage goes back to its pool when the last handle is dropped.
+// The pool must outlive every handle it has handed out.
+class BufferHandle {
+private:
+    PooledBuffer* m_buffer = nullptr;
+
+    friend class BufferPool;
+    explicit BufferHandle(PooledBuffer* buffer) : m_buffer(buffer) {
+        m_buffer->m_refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Release();
+
+public:
+    BufferHandle() = default;
+    ~BufferHandle() { Release(); }
+
+    BufferHandle(const BufferHandle& other) : m_buffer(other.m_buffer) {
+        if (m_buffer) {
+            m_buffer->m_refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    BufferHandle(BufferHandle&& other) noexcept : m_buffer(std::exchange(other.m_buffer, nullptr)) {}
+
+    BufferHandle& operator=(BufferHandle other) noexcept {
+        std::swap(m_buffer, other.m_buffer);
+        return *this;
+    }
+
+    void Reset() { Release(); }
+
+    uint8_t* data() const { return m_buffer ? m_buffer->m_storage.data() : nullptr; }
+    size_t size() const { return m_buffer ? m_buffer->m_size : 0; }
+    size_t padding() const;
+    bool empty() const { return size() == 0; }
+    explicit operator bool() const { return m_buffer != nullptr; }
+
+    // Takes an extra reference as an opaque token, for C APIs that manage
+    // lifetime through a free callback. Balance with ReleaseToken().
+    void* RetainToken() const {
+        m_buffer->m_refs.fetch_add(1, std::memory_order_relaxed);
+        return m_buffer;
+    }
+
+    static void ReleaseToken(void* token) {
+        BufferHandle handle;
+        handle.m_buffer = static_cast<PooledBuffer*>(token);
+    }
+};
+
+// Recycles byte buffers so steady-state streaming does not hit the allocator.
+// Every buffer carries `padding` zeroed bytes past its logical size, which
+// lets consumers such as bitstream readers over-read safely.
+class BufferPool {
+private:
+    friend class BufferHandle;
+
+    // Storage grows in coarse steps so slowly growing frames don't reallocate
+    // on every acquire.
+    static constexpr size_t kGrowthGranularity = 64 * 1024;
+
+    std::mutex m_mutex;
+    std::vector<PooledBuffer*> m_idle;
+    size_t m_padding;
+    size_t m_maxIdle;
+
+    void Recycle(PooledBuffer* buffer) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_idle.size() < m_maxIdle) {
+                m_idle.push_back(buffer);
+                return;
+            }
+        }
+        delete buffer;
+    }
+
+public:
+    explicit BufferPool(size_t padding = 0, size_t maxIdle = 8)
+        : m_padding(padding), m_maxIdle(maxIdle) {
+        m_idle.reserve(maxIdle);
+    }
+
+    ~BufferPool() {
+        for (PooledBuffer* buffer : m_idle) {
+            delete buffer;
+        }
+    }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Returns a buffer of exactly `size` logical bytes. Contents are
+    // unspecified except for the zeroed padding tail.
+    BufferHandle Acquire(size_t size) {
+        PooledBuffer* buffer = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_idle.empty()) {
+                buffer = m_idle.back();
+                m_idle.pop_back();
+            }
+        }
+        if (!buffer) {
+            buffer = new PooledBuffer();
+            buffer->m_pool = this;
+        }
+
+        size_t required = size + m_padding;
+        if (buffer->m_storage.size() < required) {
+            size_t rounded = (required + kGrowthGranularity - 1) / kGrowthGranularity * kGrowthGranularity;
+            buffer->m_storage.resize(rounded);
+        }
+        buffer->m_size = size;
+        if (m_padding > 0) {
+            std::memset(buffer->m_storage.data() + size, 0, m_padding);
+        }
+        return BufferHandle(buffer);
+    }
+
+    size_t GetPadding() const { return m_padding; }
+};
+
+inline size_t BufferHandle::padding() const {
+    return m_buffer ? m_buffer->m_pool->GetPadding() : 0;
+}
+
+inline void BufferHandle::Release() {
+    if (m_buffer && m_buffer->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_buffer->m_pool->Recycle(m_buffer);
+    }
+    m_buffer = nullptr;
+}
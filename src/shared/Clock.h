@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Microseconds on the monotonic clock all frame timestamps use. Every
+// machine has its own epoch; ClockOffsetEstimator relates two of them.
+inline uint64_t ClockNowUs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Estimates how far the server's clock is ahead of ours from ping/pong
+// exchanges (t0 ping sent, t1 server received, t2 server replied, t3 pong
+// received). Each exchange gives offset = ((t1 - t0) + (t2 - t3)) / 2, wrong
+// by at most half its round trip, so the estimate comes from the exchange
+// with the shortest round trip among the last kWindow. That follows drift
+// while ignoring exchanges that sat in a queue. Not thread-safe.
+class ClockOffsetEstimator {
+public:
+    static constexpr size_t kWindow = 8;
+
+    void AddSample(uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3) {
+        Sample& sample = m_samples[m_next];
+        sample.offsetUs = (static_cast<int64_t>(t1 - t0) + static_cast<int64_t>(t2 - t3)) / 2;
+        sample.roundTripUs = std::max<int64_t>(static_cast<int64_t>(t3 - t0) - static_cast<int64_t>(t2 - t1), 0);
+        m_next = (m_next + 1) % kWindow;
+        m_count = std::min(m_count + 1, kWindow);
+
+        const Sample* best = &m_samples[0];
+        for (size_t i = 1; i < m_count; i++) {
+            if (m_samples[i].roundTripUs < best->roundTripUs) {
+                best = &m_samples[i];
+            }
+        }
+        m_best = *best;
+    }
+
+    void Reset() {
+        m_count = 0;
+        m_next = 0;
+        m_best = {};
+    }
+
+    bool HasEstimate() const { return m_count > 0; }
+    size_t GetSampleCount() const { return m_count; }
+    // Server clock minus ours
+    int64_t GetOffsetUs() const { return m_best.offsetUs; }
+    int64_t GetRoundTripUs() const { return m_best.roundTripUs; }
+
+    uint64_t ToLocalUs(uint64_t serverUs) const { return serverUs - static_cast<uint64_t>(m_best.offsetUs); }
+    uint64_t ToServerUs(uint64_t localUs) const { return localUs + static_cast<uint64_t>(m_best.offsetUs); }
+
+private:
+    struct Sample {
+        int64_t offsetUs = 0;
+        int64_t roundTripUs = 0;
+    };
+
+    Sample m_samples[kWindow];
+    size_t m_count = 0;
+    size_t m_next = 0;
+    Sample m_best;
+};
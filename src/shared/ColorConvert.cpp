@@ -0,0 +1,341 @@
+#include "ColorConvert.h"
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MR_COLORCONVERT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 instructions inside functions that opt in;
+// MSVC allows intrinsics anywhere, so no per-file /arch flag is needed.
+#if defined(MR_COLORCONVERT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define MR_TARGET_SSE2 __attribute__((target("sse2")))
+#define MR_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MR_TARGET_SSE2
+#define MR_TARGET_AVX2
+#endif
+
+namespace {
+
+// Fixed-point conversion shared by every kernel so they agree bit for bit.
+// Samples are scaled by 2^6 and multiplied by Q13 coefficients keeping the
+// high 16 bits (the SIMD mulhi), which leaves results in Q3:
+//   y' = ((Y - yOffset) << 6) * yScale >> 16
+//   R  = y' + (V' * rv >> 16)
+//   G  = y' - (U' * gu >> 16) - (V' * gv >> 16)
+//   B  = y' + (U' * bu >> 16)          with U' = (U - 128) << 6
+// and each channel is (x + 4) >> 3 clamped to [0, 255].
+struct YuvCoefficients {
+    int16_t yOffset;
+    int16_t yScale;
+    int16_t rv;
+    int16_t gu;
+    int16_t gv;
+    int16_t bu;
+};
+
+constexpr int16_t Q13(double value) {
+    return static_cast<int16_t>(value * 8192.0 + 0.5);
+}
+
+constexpr YuvCoefficients kBT601Limited{16, Q13(255.0 / 219.0), Q13(1.596027), Q13(0.391762), Q13(0.812968), Q13(2.017232)};
+constexpr YuvCoefficients kBT601Full{0, Q13(1.0), Q13(1.402), Q13(0.344136), Q13(0.714136), Q13(1.772)};
+constexpr YuvCoefficients kBT709Limited{16, Q13(255.0 / 219.0), Q13(1.792741), Q13(0.213249), Q13(0.532909), Q13(2.112402)};
+constexpr YuvCoefficients kBT709Full{0, Q13(1.0), Q13(1.5748), Q13(0.187324), Q13(0.468124), Q13(1.8556)};
+
+const YuvCoefficients& SelectCoefficients(ColorMatrix matrix, ColorRange range) {
+    if (matrix == ColorMatrix::BT709) {
+        return range == ColorRange::Full ? kBT709Full : kBT709Limited;
+    }
+    return range == ColorRange::Full ? kBT601Full : kBT601Limited;
+}
+
+// One output row. `u`/`v` are the chroma row for this luma row; for NV12 `v`
+// is null and `u` points at interleaved UV. Returns the number of pixels done.
+using RowFunc = uint32_t (*)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst,
+                             uint32_t width, const YuvCoefficients& c, bool rgba);
+
+inline int MulHi(int a, int b) {
+    return (a * b) >> 16;
+}
+
+inline uint8_t ClampQ3(int value) {
+    value = (value + 4) >> 3;
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+uint32_t ConvertRowScalarFrom(uint32_t start, const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                              uint8_t* dst, uint32_t width, const YuvCoefficients& c, bool rgba) {
+    const int ri = rgba ? 0 : 2;
+    const int bi = rgba ? 2 : 0;
+    for (uint32_t x = start; x < width; x++) {
+        int cu, cv;
+        if (v) {
+            cu = u[x / 2];
+            cv = v[x / 2];
+        } else {
+            cu = u[(x / 2) * 2];
+            cv = u[(x / 2) * 2 + 1];
+        }
+        int yy = MulHi((y[x] - c.yOffset) << 6, c.yScale);
+        int uu = (cu - 128) << 6;
+        int vv = (cv - 128) << 6;
+        uint8_t* px = dst + static_cast<size_t>(x) * 4;
+        px[ri] = ClampQ3(yy + MulHi(vv, c.rv));
+        px[1] = ClampQ3(yy - MulHi(uu, c.gu) - MulHi(vv, c.gv));
+        px[bi] = ClampQ3(yy + MulHi(uu, c.bu));
+        px[3] = 255;
+    }
+    return width;
+}
+
+uint32_t ConvertRowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst,
+                          uint32_t width, const YuvCoefficients& c, bool rgba) {
+    return ConvertRowScalarFrom(0, y, u, v, dst, width, c, rgba);
+}
+
+#ifdef MR_COLORCONVERT_X86
+
+// Converts 8 pixels held as 16-bit lanes; chroma is already upsampled
+MR_TARGET_SSE2 inline void YuvToRgbSSE2(__m128i y16, __m128i u16, __m128i v16, const YuvCoefficients& c,
+                                        __m128i& r, __m128i& g, __m128i& b) {
+    const __m128i chromaBias = _mm_set1_epi16(128 << 6);
+    const __m128i round = _mm_set1_epi16(4);
+    __m128i yy = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(y16, _mm_set1_epi16(c.yOffset)), 6),
+                                 _mm_set1_epi16(c.yScale));
+    __m128i uu = _mm_sub_epi16(_mm_slli_epi16(u16, 6), chromaBias);
+    __m128i vv = _mm_sub_epi16(_mm_slli_epi16(v16, 6), chromaBias);
+    yy = _mm_add_epi16(yy, round);
+    r = _mm_srai_epi16(_mm_add_epi16(yy, _mm_mulhi_epi16(vv, _mm_set1_epi16(c.rv))), 3);
+    g = _mm_srai_epi16(_mm_sub_epi16(_mm_sub_epi16(yy, _mm_mulhi_epi16(uu, _mm_set1_epi16(c.gu))),
+                                     _mm_mulhi_epi16(vv, _mm_set1_epi16(c.gv))), 3);
+    b = _mm_srai_epi16(_mm_add_epi16(yy, _mm_mulhi_epi16(uu, _mm_set1_epi16(c.bu))), 3);
+}
+
+MR_TARGET_SSE2 uint32_t ConvertRowSSE2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst,
+                                       uint32_t width, const YuvCoefficients& c, bool rgba) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i yBytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+        __m128i u8, v8; // 8 chroma samples as 16-bit lanes
+        if (v) {
+            u8 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x / 2)), zero);
+            v8 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x / 2)), zero);
+        } else {
+            __m128i uv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x));
+            u8 = _mm_and_si128(uv, lowBytes);
+            v8 = _mm_srli_epi16(uv, 8);
+        }
+
+        __m128i rLo, gLo, bLo, rHi, gHi, bHi;
+        YuvToRgbSSE2(_mm_unpacklo_epi8(yBytes, zero), _mm_unpacklo_epi16(u8, u8), _mm_unpacklo_epi16(v8, v8),
+                     c, rLo, gLo, bLo);
+        YuvToRgbSSE2(_mm_unpackhi_epi8(yBytes, zero), _mm_unpackhi_epi16(u8, u8), _mm_unpackhi_epi16(v8, v8),
+                     c, rHi, gHi, bHi);
+        __m128i r = _mm_packus_epi16(rLo, rHi);
+        __m128i g = _mm_packus_epi16(gLo, gHi);
+        __m128i b = _mm_packus_epi16(bLo, bHi);
+        if (rgba) {
+            __m128i t = r;
+            r = b;
+            b = t;
+        }
+
+        // Interleave to B G R A
+        __m128i bgLo = _mm_unpacklo_epi8(b, g);
+        __m128i bgHi = _mm_unpackhi_epi8(b, g);
+        __m128i raLo = _mm_unpacklo_epi8(r, alpha);
+        __m128i raHi = _mm_unpackhi_epi8(r, alpha);
+        __m128i* out = reinterpret_cast<__m128i*>(dst + static_cast<size_t>(x) * 4);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(bgLo, raLo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bgLo, raLo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(bgHi, raHi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(bgHi, raHi));
+    }
+    return x;
+}
+
+// Converts 16 pixels held as 16-bit lanes; chroma is already upsampled
+MR_TARGET_AVX2 inline void YuvToRgbAVX2(__m256i y16, __m256i u16, __m256i v16, const YuvCoefficients& c,
+                                        __m256i& r, __m256i& g, __m256i& b) {
+    const __m256i chromaBias = _mm256_set1_epi16(128 << 6);
+    const __m256i round = _mm256_set1_epi16(4);
+    __m256i yy = _mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y16, _mm256_set1_epi16(c.yOffset)), 6),
+                                    _mm256_set1_epi16(c.yScale));
+    __m256i uu = _mm256_sub_epi16(_mm256_slli_epi16(u16, 6), chromaBias);
+    __m256i vv = _mm256_sub_epi16(_mm256_slli_epi16(v16, 6), chromaBias);
+    yy = _mm256_add_epi16(yy, round);
+    r = _mm256_srai_epi16(_mm256_add_epi16(yy, _mm256_mulhi_epi16(vv, _mm256_set1_epi16(c.rv))), 3);
+    g = _mm256_srai_epi16(_mm256_sub_epi16(_mm256_sub_epi16(yy, _mm256_mulhi_epi16(uu, _mm256_set1_epi16(c.gu))),
+                                           _mm256_mulhi_epi16(vv, _mm256_set1_epi16(c.gv))), 3);
+    b = _mm256_srai_epi16(_mm256_add_epi16(yy, _mm256_mulhi_epi16(uu, _mm256_set1_epi16(c.bu))), 3);
+}
+
+MR_TARGET_AVX2 uint32_t ConvertRowAVX2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst,
+                                       uint32_t width, const YuvCoefficients& c, bool rgba) {
+    const __m256i alpha = _mm256_set1_epi8(static_cast<char>(0xFF));
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    uint32_t x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i yBytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + x));
+        __m256i u16, v16; // 16 chroma samples as 16-bit lanes, in order
+        if (v) {
+            u16 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x / 2)));
+            v16 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + x / 2)));
+        } else {
+            __m256i uv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(u + x));
+            u16 = _mm256_and_si256(uv, lowBytes);
+            v16 = _mm256_srli_epi16(uv, 8);
+        }
+        // Unpacks work within 128-bit lanes; reorder quadwords so duplicating
+        // the low/high halves yields chroma for pixels 0-15 and 16-31 in order
+        u16 = _mm256_permute4x64_epi64(u16, 0xD8);
+        v16 = _mm256_permute4x64_epi64(v16, 0xD8);
+
+        __m256i rLo, gLo, bLo, rHi, gHi, bHi;
+        YuvToRgbAVX2(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(yBytes)),
+                     _mm256_unpacklo_epi16(u16, u16), _mm256_unpacklo_epi16(v16, v16), c, rLo, gLo, bLo);
+        YuvToRgbAVX2(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(yBytes, 1)),
+                     _mm256_unpackhi_epi16(u16, u16), _mm256_unpackhi_epi16(v16, v16), c, rHi, gHi, bHi);
+        // packus interleaves lanes; restore pixel order
+        __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(rLo, rHi), 0xD8);
+        __m256i g = _mm256_permute4x64_epi64(_mm256_packus_epi16(gLo, gHi), 0xD8);
+        __m256i b = _mm256_permute4x64_epi64(_mm256_packus_epi16(bLo, bHi), 0xD8);
+        if (rgba) {
+            __m256i t = r;
+            r = b;
+            b = t;
+        }
+
+        // Interleave to B G R A; each 128-bit lane holds pixels n..n+7 and n+16..n+23
+        __m256i bgLo = _mm256_unpacklo_epi8(b, g);
+        __m256i bgHi = _mm256_unpackhi_epi8(b, g);
+        __m256i raLo = _mm256_unpacklo_epi8(r, alpha);
+        __m256i raHi = _mm256_unpackhi_epi8(r, alpha);
+        __m256i p0 = _mm256_unpacklo_epi16(bgLo, raLo); // pixels 0-3 | 16-19
+        __m256i p1 = _mm256_unpackhi_epi16(bgLo, raLo); // pixels 4-7 | 20-23
+        __m256i p2 = _mm256_unpacklo_epi16(bgHi, raHi); // pixels 8-11 | 24-27
+        __m256i p3 = _mm256_unpackhi_epi16(bgHi, raHi); // pixels 12-15 | 28-31
+        __m256i* out = reinterpret_cast<__m256i*>(dst + static_cast<size_t>(x) * 4);
+        _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+    return x;
+}
+
+bool CpuSupportsAVX2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    // The OS must save YMM state across context switches
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // MR_COLORCONVERT_X86
+
+RowFunc GetRowFunc(ConvertIsa isa) {
+    switch (isa) {
+#ifdef MR_COLORCONVERT_X86
+        case ConvertIsa::SSE2: return ConvertRowSSE2;
+        case ConvertIsa::AVX2: return ConvertRowAVX2;
+#endif
+        default: return ConvertRowScalar;
+    }
+}
+
+} // namespace
+
+bool IsConvertIsaSupported(ConvertIsa isa) {
+    switch (isa) {
+        case ConvertIsa::Scalar:
+            return true;
+#ifdef MR_COLORCONVERT_X86
+        case ConvertIsa::SSE2:
+            return true; // Baseline on every x86 target we build for
+        case ConvertIsa::AVX2: {
+            static const bool supported = CpuSupportsAVX2();
+            return supported;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+ConvertIsa GetBestConvertIsa() {
+    static const ConvertIsa best = IsConvertIsaSupported(ConvertIsa::AVX2) ? ConvertIsa::AVX2
+                                 : IsConvertIsaSupported(ConvertIsa::SSE2) ? ConvertIsa::SSE2
+                                 : ConvertIsa::Scalar;
+    return best;
+}
+
+const char* GetConvertIsaName(ConvertIsa isa) {
+    switch (isa) {
+        case ConvertIsa::SSE2: return "sse2";
+        case ConvertIsa::AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+bool ConvertYuvToRgb32(const YuvPlanes& src, uint8_t* dst, int dstStride, PixelFormat dstFormat) {
+    return ConvertYuvToRgb32(src, dst, dstStride, dstFormat, GetBestConvertIsa());
+}
+
+bool ConvertYuvToRgb32(const YuvPlanes& src, uint8_t* dst, int dstStride, PixelFormat dstFormat,
+                       ConvertIsa isa) {
+    if (src.format != PixelFormat::I420 && src.format != PixelFormat::NV12) {
+        return false;
+    }
+    if (dstFormat != PixelFormat::BGRA && dstFormat != PixelFormat::RGBA) {
+        return false;
+    }
+    if (!IsConvertIsaSupported(isa)) {
+        return false;
+    }
+    const bool nv12 = src.format == PixelFormat::NV12;
+    if (!dst || !src.planes[0] || !src.planes[1] || (!nv12 && !src.planes[2])) {
+        return false;
+    }
+    // Negative strides (bottom-up DIBs) are fine as long as rows don't overlap
+    const int64_t rowBytes = static_cast<int64_t>(src.width) * 4;
+    if ((dstStride < 0 ? -static_cast<int64_t>(dstStride) : dstStride) < rowBytes) {
+        return false;
+    }
+
+    const YuvCoefficients& coefficients = SelectCoefficients(src.matrix, src.range);
+    const bool rgba = dstFormat == PixelFormat::RGBA;
+    RowFunc rowFunc = GetRowFunc(isa);
+
+    for (uint32_t row = 0; row < src.height; row++) {
+        const uint8_t* y = src.planes[0] + static_cast<ptrdiff_t>(row) * src.strides[0];
+        const uint8_t* u = src.planes[1] + static_cast<ptrdiff_t>(row / 2) * src.strides[1];
+        const uint8_t* v = nv12 ? nullptr : src.planes[2] + static_cast<ptrdiff_t>(row / 2) * src.strides[2];
+        uint8_t* out = dst + static_cast<ptrdiff_t>(row) * dstStride;
+
+        uint32_t done = rowFunc(y, u, v, out, src.width, coefficients, rgba);
+        if (done < src.width) {
+            ConvertRowScalarFrom(done, y, u, v, out, src.width, coefficients, rgba);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "PixelFormat.h"
+#include <cstdint>
+
+// 8-bit 4:2:0 source image. I420 uses all three planes; NV12 uses planes[0]
+// for Y and planes[1] for interleaved UV.
+struct YuvPlanes {
+    PixelFormat format = PixelFormat::I420;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    const uint8_t* planes[3] = {};
+    int strides[3] = {};
+    ColorMatrix matrix = ColorMatrix::BT601;
+    ColorRange range = ColorRange::Limited;
+};
+
+// Instruction set used by the YUV -> RGB kernels
+enum class ConvertIsa {
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+// Converts an I420/NV12 image to 32-bit BGRA or RGBA (alpha = 255) at `dst`,
+// whose rows are `dstStride` bytes apart. The destination can be any strided
+// memory, e.g. a DIB section or a mapped texture. Uses the fastest kernel the
+// CPU supports. Returns false for unsupported formats or bad arguments.
+bool ConvertYuvToRgb32(const YuvPlanes& src, uint8_t* dst, int dstStride, PixelFormat dstFormat);
+
+// Same, forcing a specific kernel (for benchmarks and validation). Returns
+// false if `isa` is not available on this CPU or build.
+bool ConvertYuvToRgb32(const YuvPlanes& src, uint8_t* dst, int dstStride, PixelFormat dstFormat,
+                       ConvertIsa isa);
+
+bool IsConvertIsaSupported(ConvertIsa isa);
+ConvertIsa GetBestConvertIsa();
+const char* GetConvertIsaName(ConvertIsa isa);
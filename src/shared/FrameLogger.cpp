@@ -1,196 +1,435 @@
 #include "FrameLogger.h"
-#include <iostream>
+#include "Log.h"
 #include <iomanip>
 #include <sstream>
 #include <filesystem>
 #include <algorithm>
 #include <cstring>
-#ifdef _WIN32
-#define NOMINMAX
-#include <windows.h>
-#endif
 
-FrameLogger::FrameLogger(uint32_t maxFrames, const std::string& outputDir)
+#pragma pack(push, 1)
+struct BmpFileHeader {
+    uint16_t type = 0x4D42; // "BM"
+    uint32_t size = 0;
+    uint16_t reserved1 = 0;
+    uint16_t reserved2 = 0;
+    uint32_t offBits = 0;
+};
+struct BmpInfoHeader {
+    uint32_t size = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    uint16_t planes = 1;
+    uint16_t bitCount = 32;
+    uint32_t compression = 0; // BI_RGB
+    uint32_t sizeImage = 0;
+    int32_t xPelsPerMeter = 0;
+    int32_t yPelsPerMeter = 0;
+    uint32_t clrUsed = 0;
+    uint32_t clrImportant = 0;
+};
+#pragma pack(pop)
+
+FrameLogger::FrameLogger(uint32_t maxFrames, const std::string& outputDir, Mode mode, uint32_t maxPackets)
     : m_maxFrames(maxFrames)
+    , m_maxPackets(mode == Mode::FlightRecorder ? maxPackets : 0)
     , m_outputDir(outputDir)
-    , m_frameCounter(0) {
-    EnsureOutputDirectory();
+    , m_mode(mode) {
+    m_frames.frames.resize(maxFrames);
+    m_dumpFrames.frames.resize(maxFrames);
+
+    // Packet buffers are reserved now so recording never allocates unless a
+    // packet is unusually large
+    for (PacketRing* ring : { &m_packets, &m_dumpPackets }) {
+        ring->packets.resize(m_maxPackets);
+        for (LoggedPacket& packet : ring->packets) {
+            packet.data.reserve(kPacketReserveBytes);
+        }
+    }
+
+    m_writer = std::thread(&FrameLogger::WriterMain, this);
 }
 
 FrameLogger::~FrameLogger() {
-    if (!m_loggedFrames.empty()) {
-        std::cout << "FrameLogger: Auto-saving " << m_loggedFrames.size() << " frames to disk..." << std::endl;
+    if (m_mode == Mode::FirstFrames && IsLogging() && GetFrameCount() > 0) {
+        MR_LOG_INFO("FrameLogger: Auto-saving " << GetFrameCount() << " frames to disk...");
         SaveFramesToDisk();
     }
+
+    // Finish queued writes before going away
+    {
+        std::lock_guard<std::mutex> lock(m_jobMutex);
+        m_stopWriter = true;
+    }
+    m_jobReady.notify_one();
+    if (m_writer.joinable()) {
+        m_writer.join();
+    }
 }
 
 bool FrameLogger::LogFrame(uint32_t width, uint32_t height, uint32_t dataSize, const uint8_t* frameData) {
-    if (m_loggedFrames.size() >= m_maxFrames) {
+    std::unique_lock<std::mutex> lock(m_frameMutex);
+    if (m_maxFrames == 0 || (m_mode == Mode::FirstFrames && m_frameCounter >= m_maxFrames)) {
         return false;
     }
-    
-    LoggedFrame frame;
+
+    if (dataSize > m_frames.slotBytes) {
+        // First frame or a larger resolution; the only allocation on this path
+        ResizeFrameRing(m_frames, dataSize);
+    }
+
+    uint32_t slot = m_frames.next;
+    LoggedFrame& frame = m_frames.frames[slot];
     frame.frameIndex = m_frameCounter++;
     frame.width = width;
     frame.height = height;
     frame.dataSize = dataSize;
     frame.timestamp = std::chrono::high_resolution_clock::now();
-    frame.filename = GenerateFrameFilename(frame.frameIndex, width, height);
-    
-    // Copy frame data
-    frame.frameData.resize(dataSize);
-    std::memcpy(frame.frameData.data(), frameData, dataSize);
-    
-    m_loggedFrames.push_back(std::move(frame));
-    
-    std::cout << "FrameLogger: Logged frame " << frame.frameIndex 
-              << " (" << width << "x" << height << ", " << dataSize << " bytes)" << std::endl;
-    
+    std::memcpy(m_frames.arena.data() + slot * m_frames.slotBytes, frameData, dataSize);
+
+    m_frames.next = (slot + 1) % m_maxFrames;
+    m_frames.count = std::min(m_frames.count + 1, m_maxFrames);
+
+    if (m_mode == Mode::FirstFrames) {
+        MR_LOG_INFO("FrameLogger: Logged frame " << frame.frameIndex
+                    << " (" << width << "x" << height << ", " << dataSize << " bytes)");
+
+        if (m_frameCounter == m_maxFrames) {
+            // Complete; write the set out in the background
+            std::swap(m_frames, m_dumpFrames);
+            lock.unlock();
+            WriteJob job;
+            job.kind = WriteJob::Kind::Dump;
+            job.path = m_outputDir;
+            job.reason = "first frames";
+            Enqueue(std::move(job));
+        }
+    }
     return true;
 }
 
-bool FrameLogger::SaveFrameAsBMP(uint32_t width, uint32_t height, const std::vector<uint8_t>& frameData, const std::string& filename) {
-#ifdef _WIN32
-    // Create BMP file headers (assumes BGRA format)
-    BITMAPFILEHEADER fileHeader = {};
-    BITMAPINFOHEADER infoHeader = {};
-
-    fileHeader.bfType = 0x4D42; // "BM"
-    fileHeader.bfSize = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + frameData.size();
-    fileHeader.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
-
-    infoHeader.biSize = sizeof(BITMAPINFOHEADER);
-    infoHeader.biWidth = width;
-    infoHeader.biHeight = -(int)height; // Top-down DIB
-    infoHeader.biPlanes = 1;
-    infoHeader.biBitCount = 32;
-    infoHeader.biCompression = BI_RGB;
-    infoHeader.biSizeImage = frameData.size();
-
-    HANDLE hFile = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, nullptr,
-                               CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (hFile != INVALID_HANDLE_VALUE) {
-        DWORD written;
-        bool success = WriteFile(hFile, &fileHeader, sizeof(fileHeader), &written, nullptr) &&
-                       WriteFile(hFile, &infoHeader, sizeof(infoHeader), &written, nullptr) &&
-                       WriteFile(hFile, frameData.data(), frameData.size(), &written, nullptr);
-        CloseHandle(hFile);
-        return success;
-    }
-    return false;
-#else
-    // For non-Windows platforms, save as raw data for now
-    std::ofstream file(filename, std::ios::binary);
-    if (file.is_open()) {
-        file.write(reinterpret_cast<const char*>(frameData.data()), frameData.size());
-        file.close();
-        return true;
+bool FrameLogger::LogPacket(uint32_t width, uint32_t height, CompressionType codec, bool isKeyframe,
+                            const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(m_packetMutex);
+    if (m_maxPackets == 0) {
+        return false;
     }
-    return false;
-#endif
+
+    LoggedPacket& packet = m_packets.packets[m_packets.next];
+    packet.packetIndex = m_packetCounter++;
+    packet.width = width;
+    packet.height = height;
+    packet.codec = codec;
+    packet.isKeyframe = isKeyframe;
+    packet.timestamp = std::chrono::high_resolution_clock::now();
+    packet.data.assign(data, data + size);
+
+    m_packets.next = (m_packets.next + 1) % m_maxPackets;
+    m_packets.count = std::min(m_packets.count + 1, m_maxPackets);
+    return true;
 }
 
-void FrameLogger::SaveFramesToDisk() {
-    if (m_loggedFrames.empty()) {
-        std::cout << "FrameLogger: No frames to save" << std::endl;
-        return;
+bool FrameLogger::RequestDump(const std::string& reason) {
+    if (m_mode != Mode::FlightRecorder) {
+        return false;
+    }
+
+    WriteJob job;
+    {
+        // Lock order: frames, packets, jobs
+        std::lock_guard<std::mutex> frameLock(m_frameMutex);
+        std::lock_guard<std::mutex> packetLock(m_packetMutex);
+        if (m_dumpInFlight) {
+            MR_LOG_WARN("FrameLogger: Dump already in progress, ignoring request (" << reason << ")");
+            return false;
+        }
+
+        // Hand the recording to the writer by swapping in the spare rings;
+        // recording continues without copying or waiting for the disk
+        std::swap(m_frames, m_dumpFrames);
+        std::swap(m_packets, m_dumpPackets);
+        m_frames.next = m_frames.count = 0;
+        m_packets.next = m_packets.count = 0;
+        if (m_frames.slotBytes < m_dumpFrames.slotBytes) {
+            ResizeFrameRing(m_frames, m_dumpFrames.slotBytes);
+        }
+        m_dumpInFlight = true;
+
+        std::ostringstream dir;
+        dir << m_outputDir << "/dump_" << std::setfill('0') << std::setw(3) << m_dumpCount++;
+        job.path = dir.str();
+    }
+
+    MR_LOG_INFO("FrameLogger: Dumping flight recorder to " << job.path << " (" << reason << ")");
+    job.kind = WriteJob::Kind::Dump;
+    job.reason = reason;
+    Enqueue(std::move(job));
+    return true;
+}
+
+void FrameLogger::SaveBmpAsync(uint32_t width, uint32_t height, const uint8_t* frameData, size_t dataSize,
+                               const std::string& filename) {
+    WriteJob job;
+    job.kind = WriteJob::Kind::Bmp;
+    job.path = filename;
+    job.width = width;
+    job.height = height;
+    job.bmpData.assign(frameData, frameData + dataSize);
+    Enqueue(std::move(job));
+}
+
+void FrameLogger::Enqueue(WriteJob&& job) {
+    {
+        std::lock_guard<std::mutex> lock(m_jobMutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_jobReady.notify_one();
+}
+
+void FrameLogger::WriterMain() {
+    for (;;) {
+        WriteJob job;
+        {
+            std::unique_lock<std::mutex> lock(m_jobMutex);
+            m_jobReady.wait(lock, [this] { return m_stopWriter || !m_jobs.empty(); });
+            if (m_jobs.empty()) {
+                return; // Stopping and drained
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        if (job.kind == WriteJob::Kind::Bmp) {
+            if (SaveFrameAsBMP(job.width, job.height, job.bmpData.data(), job.bmpData.size(), job.path)) {
+                MR_LOG_INFO("Saved frame as " << job.path);
+            } else {
+                MR_LOG_ERROR("FrameLogger: Failed to save " << job.path);
+            }
+        } else {
+            WriteDump(job);
+        }
+    }
+}
+
+void FrameLogger::WriteDump(const WriteJob& job) {
+    // The dump rings belong to the writer until m_dumpInFlight is cleared
+    WriteFrames(m_dumpFrames, job.path, job.reason);
+    if (m_mode == Mode::FlightRecorder) {
+        WritePackets(m_dumpPackets, job.path);
     }
-    
-    EnsureOutputDirectory();
-    
-    // Save frame data files as BMP
-    for (const auto& frame : m_loggedFrames) {
-        std::string framePath = m_outputDir + "/" + frame.filename;
-        if (SaveFrameAsBMP(frame.width, frame.height, frame.frameData, framePath)) {
-            std::cout << "FrameLogger: Saved " << framePath << std::endl;
+
+    std::lock_guard<std::mutex> frameLock(m_frameMutex);
+    std::lock_guard<std::mutex> packetLock(m_packetMutex);
+    m_dumpInFlight = false;
+}
+
+void FrameLogger::WriteFrames(const FrameRing& ring, const std::string& dir, const std::string& reason) {
+    EnsureOutputDirectory(dir);
+
+    // Save frame data files as BMP, oldest first
+    uint32_t first = ring.count > 0 ? ring.Oldest() : 0;
+    for (uint32_t i = 0; i < ring.count; i++) {
+        uint32_t slot = (first + i) % static_cast<uint32_t>(ring.frames.size());
+        const LoggedFrame& frame = ring.frames[slot];
+        std::string framePath = dir + "/" + GenerateFrameFilename(frame.frameIndex, frame.width, frame.height);
+        if (SaveFrameAsBMP(frame.width, frame.height, ring.SlotData(slot), frame.dataSize, framePath)) {
+            MR_LOG_INFO("FrameLogger: Saved " << framePath);
         } else {
-            std::cerr << "FrameLogger: Failed to save " << framePath << std::endl;
+            MR_LOG_ERROR("FrameLogger: Failed to save " << framePath);
         }
     }
-    
+
     // Save metadata file
-    std::string metadataPath = m_outputDir + "/frame_metadata.txt";
+    std::string metadataPath = dir + "/frame_metadata.txt";
     std::ofstream metaFile(metadataPath);
     if (metaFile.is_open()) {
-        metaFile << "Frame Debug Log - " << m_loggedFrames.size() << " frames captured\n";
+        metaFile << "Frame Debug Log - " << ring.count << " frames captured (" << reason << ")\n";
         metaFile << "Generated: " << std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::system_clock::now().time_since_epoch()).count() << "ms\n\n";
-        
-        metaFile << std::left << std::setw(8) << "Index" 
-                 << std::setw(12) << "Width" 
-                 << std::setw(12) << "Height" 
-                 << std::setw(12) << "DataSize" 
-                 << std::setw(20) << "Filename" 
+
+        metaFile << std::left << std::setw(8) << "Index"
+                 << std::setw(12) << "Width"
+                 << std::setw(12) << "Height"
+                 << std::setw(12) << "DataSize"
+                 << std::setw(28) << "Filename"
                  << "Timestamp\n";
-        metaFile << std::string(80, '-') << "\n";
-        
-        for (const auto& frame : m_loggedFrames) {
+        metaFile << std::string(88, '-') << "\n";
+
+        for (uint32_t i = 0; i < ring.count; i++) {
+            const LoggedFrame& frame = ring.frames[(first + i) % ring.frames.size()];
             auto timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
                 frame.timestamp.time_since_epoch()).count();
-            
+
             metaFile << std::left << std::setw(8) << frame.frameIndex
                      << std::setw(12) << frame.width
-                     << std::setw(12) << frame.height  
+                     << std::setw(12) << frame.height
                      << std::setw(12) << frame.dataSize
-                     << std::setw(20) << frame.filename
+                     << std::setw(28) << GenerateFrameFilename(frame.frameIndex, frame.width, frame.height)
                      << timeMs << "ms\n";
         }
-        
+
         metaFile.close();
-        std::cout << "FrameLogger: Saved metadata to " << metadataPath << std::endl;
+        MR_LOG_INFO("FrameLogger: Saved metadata to " << metadataPath);
+    }
+}
+
+void FrameLogger::WritePackets(const PacketRing& ring, const std::string& dir) {
+    if (ring.count == 0) {
+        return;
+    }
+
+    // Start at the oldest keyframe so the elementary stream is decodable
+    // on its own (e.g. `ffplay stream.h265`)
+    uint32_t capacity = static_cast<uint32_t>(ring.packets.size());
+    uint32_t oldest = (ring.next + capacity - ring.count) % capacity;
+    uint32_t start = ring.count;
+    for (uint32_t i = 0; i < ring.count; i++) {
+        if (ring.packets[(oldest + i) % capacity].isKeyframe) {
+            start = i;
+            break;
+        }
+    }
+    if (start == ring.count) {
+        start = 0; // No keyframe recorded; keep everything for inspection
+    }
+
+    const LoggedPacket& firstPacket = ring.packets[(oldest + start) % capacity];
+    const char* extension = firstPacket.codec == COMPRESSION_H264 ? "h264"
+                          : firstPacket.codec == COMPRESSION_H265 ? "h265"
+                          : firstPacket.codec == COMPRESSION_AV1 ? "obu" : "bin";
+    std::string streamPath = dir + "/stream." + extension;
+    std::ofstream stream(streamPath, std::ios::binary);
+    std::ofstream index(dir + "/packets.txt");
+    index << std::left << std::setw(8) << "Index" << std::setw(12) << "Size" << std::setw(10) << "Type"
+          << std::setw(12) << "Resolution" << "Timestamp\n";
+
+    for (uint32_t i = start; i < ring.count; i++) {
+        const LoggedPacket& packet = ring.packets[(oldest + i) % capacity];
+        stream.write(reinterpret_cast<const char*>(packet.data.data()), packet.data.size());
+        auto timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            packet.timestamp.time_since_epoch()).count();
+        index << std::left << std::setw(8) << packet.packetIndex
+              << std::setw(12) << packet.data.size()
+              << std::setw(10) << (packet.isKeyframe ? "KEY" : "DELTA")
+              << std::setw(12) << (std::to_string(packet.width) + "x" + std::to_string(packet.height))
+              << timeMs << "ms\n";
+    }
+
+    if (stream) {
+        MR_LOG_INFO("FrameLogger: Saved " << (ring.count - start) << " packets to " << streamPath);
+    } else {
+        MR_LOG_ERROR("FrameLogger: Failed to save " << streamPath);
+    }
+}
+
+void FrameLogger::ResizeFrameRing(FrameRing& ring, size_t slotBytes) {
+    ring.slotBytes = slotBytes;
+    ring.arena.assign(slotBytes * ring.frames.size(), 0);
+    ring.next = 0;
+    ring.count = 0;
+}
+
+bool FrameLogger::SaveFrameAsBMP(uint32_t width, uint32_t height, const uint8_t* frameData, size_t dataSize, const std::string& filename) {
+    // Create BMP file headers (assumes BGRA format)
+    BmpFileHeader fileHeader;
+    BmpInfoHeader infoHeader;
+    fileHeader.size = static_cast<uint32_t>(sizeof(BmpFileHeader) + sizeof(BmpInfoHeader) + dataSize);
+    fileHeader.offBits = sizeof(BmpFileHeader) + sizeof(BmpInfoHeader);
+    infoHeader.size = sizeof(BmpInfoHeader);
+    infoHeader.width = static_cast<int32_t>(width);
+    infoHeader.height = -static_cast<int32_t>(height); // Top-down DIB
+    infoHeader.sizeImage = static_cast<uint32_t>(dataSize);
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+    file.write(reinterpret_cast<const char*>(&infoHeader), sizeof(infoHeader));
+    file.write(reinterpret_cast<const char*>(frameData), dataSize);
+    return file.good();
+}
+
+void FrameLogger::SaveFramesToDisk() {
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    if (m_frames.count == 0) {
+        MR_LOG_INFO("FrameLogger: No frames to save");
+        return;
     }
+    WriteFrames(m_frames, m_outputDir, "saved on request");
 }
 
 void FrameLogger::PrintFrameStats() const {
-    if (m_loggedFrames.empty()) {
-        std::cout << "FrameLogger: No frames logged" << std::endl;
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+
+    // A completed first-frames set has already moved to the writer
+    const FrameRing& ring = (m_mode == Mode::FirstFrames && m_frameCounter >= m_maxFrames) ? m_dumpFrames : m_frames;
+    if (ring.count == 0) {
+        MR_LOG_INFO("FrameLogger: No frames logged");
         return;
     }
-    
-    std::cout << "\n=== Frame Logger Statistics ===" << std::endl;
-    std::cout << "Total frames logged: " << m_loggedFrames.size() << "/" << m_maxFrames << std::endl;
-    
+
+    MR_LOG_INFO("\n=== Frame Logger Statistics ===");
+    MR_LOG_INFO("Total frames logged: " << ring.count << "/" << m_maxFrames);
+
     // Calculate stats
-    uint32_t totalBytes = 0;
+    uint64_t totalBytes = 0;
     uint32_t minWidth = UINT32_MAX, maxWidth = 0;
     uint32_t minHeight = UINT32_MAX, maxHeight = 0;
-    
-    for (const auto& frame : m_loggedFrames) {
+
+    for (uint32_t i = 0; i < ring.count; i++) {
+        const LoggedFrame& frame = ring.frames[(ring.Oldest() + i) % ring.frames.size()];
         totalBytes += frame.dataSize;
         minWidth = std::min(minWidth, frame.width);
         maxWidth = std::max(maxWidth, frame.width);
         minHeight = std::min(minHeight, frame.height);
         maxHeight = std::max(maxHeight, frame.height);
     }
-    
-    std::cout << "Total data size: " << totalBytes << " bytes (" 
-              << (totalBytes / 1024.0f / 1024.0f) << " MB)" << std::endl;
-    std::cout << "Resolution range: " << minWidth << "x" << minHeight 
-              << " to " << maxWidth << "x" << maxHeight << std::endl;
-    std::cout << "Output directory: " << m_outputDir << std::endl;
-    std::cout << "==============================\n" << std::endl;
+
+    MR_LOG_INFO("Total data size: " << totalBytes << " bytes ("
+                << (totalBytes / 1024.0f / 1024.0f) << " MB)");
+    MR_LOG_INFO("Resolution range: " << minWidth << "x" << minHeight
+                << " to " << maxWidth << "x" << maxHeight);
+    MR_LOG_INFO("Output directory: " << m_outputDir);
+    MR_LOG_INFO("==============================\n");
 }
 
 void FrameLogger::Clear() {
-    m_loggedFrames.clear();
-    m_frameCounter = 0;
-    std::cout << "FrameLogger: Cleared all logged frames" << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(m_frameMutex);
+        m_frames.next = m_frames.count = 0;
+        m_frameCounter = 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_packetMutex);
+        m_packets.next = m_packets.count = 0;
+    }
+    MR_LOG_INFO("FrameLogger: Cleared all logged frames");
+}
+
+bool FrameLogger::IsLogging() const {
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    return m_mode == Mode::FlightRecorder ? m_maxFrames > 0 : m_frameCounter < m_maxFrames;
 }
 
-void FrameLogger::EnsureOutputDirectory() {
+uint32_t FrameLogger::GetFrameCount() const {
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    return m_mode == Mode::FirstFrames ? std::min(m_frameCounter, m_maxFrames) : m_frames.count;
+}
+
+void FrameLogger::EnsureOutputDirectory(const std::string& dir) {
     try {
-        if (!std::filesystem::exists(m_outputDir)) {
-            std::filesystem::create_directories(m_outputDir);
-            std::cout << "FrameLogger: Created output directory: " << m_outputDir << std::endl;
+        if (!std::filesystem::exists(dir)) {
+            std::filesystem::create_directories(dir);
+            MR_LOG_INFO("FrameLogger: Created output directory: " << dir);
         }
     } catch (const std::exception& e) {
-        std::cerr << "FrameLogger: Failed to create output directory: " << e.what() << std::endl;
+        MR_LOG_ERROR("FrameLogger: Failed to create output directory: " << e.what());
     }
 }
 
 std::string FrameLogger::GenerateFrameFilename(uint32_t frameIndex, uint32_t width, uint32_t height) {
     std::ostringstream oss;
-    oss << "frame_" << std::setfill('0') << std::setw(3) << frameIndex 
+    oss << "frame_" << std::setfill('0') << std::setw(3) << frameIndex
         << "_" << width << "x" << height << ".bmp";
     return oss.str();
-}
\ No newline at end of file
+}
@@ -4,47 +4,145 @@
 #include <string>
 #include <fstream>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "protocol.h"
 
 struct LoggedFrame {
-    uint32_t frameIndex;
-    uint32_t width;
-    uint32_t height;
-    uint32_t dataSize;
-    std::vector<uint8_t> frameData;
+    uint32_t frameIndex = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t dataSize = 0;
     std::chrono::high_resolution_clock::time_point timestamp;
-    std::string filename;
 };
 
+struct LoggedPacket {
+    uint32_t packetIndex = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    CompressionType codec = COMPRESSION_NONE;
+    bool isKeyframe = false;
+    std::chrono::high_resolution_clock::time_point timestamp;
+    std::vector<uint8_t> data; // Capacity is reserved up front and reused
+};
+
+// Captures frames for debugging. All disk I/O happens on a background writer
+// thread, so logging from a frame callback costs one memcpy into a
+// preallocated arena.
+//
+// FirstFrames keeps the first maxFrames frames and writes them once full.
+// FlightRecorder keeps overwriting the last maxFrames decoded frames and
+// maxPackets compressed packets; RequestDump() (on demand or on error)
+// hands the recording to the writer and keeps recording into a spare arena.
 class FrameLogger {
 public:
-    FrameLogger(uint32_t maxFrames = 5, const std::string& outputDir = "debug_frames");
+    enum class Mode {
+        FirstFrames,
+        FlightRecorder
+    };
+
+    FrameLogger(uint32_t maxFrames = 5, const std::string& outputDir = "debug_frames",
+                Mode mode = Mode::FirstFrames, uint32_t maxPackets = 300);
     ~FrameLogger();
 
     // Log a frame (returns true if frame was logged, false if max frames reached)
     bool LogFrame(uint32_t width, uint32_t height, uint32_t dataSize, const uint8_t* frameData);
-    
-    // Save all logged frames to disk
+
+    // Log a compressed packet (flight recorder only). Thread-safe with LogFrame().
+    bool LogPacket(uint32_t width, uint32_t height, CompressionType codec, bool isKeyframe,
+                   const uint8_t* data, size_t size);
+
+    // Writes the current recording to <outputDir>/dump_NNN/ in the background.
+    // Returns false if the previous dump is still being written.
+    bool RequestDump(const std::string& reason);
+
+    // Copies a BGRA frame and writes it as a BMP in the background
+    void SaveBmpAsync(uint32_t width, uint32_t height, const uint8_t* frameData, size_t dataSize,
+                      const std::string& filename);
+
+    // Save all logged frames to disk (synchronous)
     void SaveFramesToDisk();
-    
+
     // Get statistics about logged frames
     void PrintFrameStats() const;
-    
+
     // Clear all logged frames
     void Clear();
-    
+
     // Check if logging is still active
-    bool IsLogging() const { return m_loggedFrames.size() < m_maxFrames; }
-    
+    bool IsLogging() const;
+
     // Get number of frames logged
-    uint32_t GetFrameCount() const { return static_cast<uint32_t>(m_loggedFrames.size()); }
+    uint32_t GetFrameCount() const;
+
+    Mode GetMode() const { return m_mode; }
+    uint32_t GetDumpCount() const { return m_dumpCount; }
 
 private:
+    // Fixed number of equally sized slots carved out of one allocation
+    struct FrameRing {
+        std::vector<uint8_t> arena;
+        std::vector<LoggedFrame> frames;
+        size_t slotBytes = 0;
+        uint32_t next = 0; // Slot the next frame goes into
+        uint32_t count = 0;
+
+        const uint8_t* SlotData(uint32_t slot) const { return arena.data() + slot * slotBytes; }
+        uint32_t Oldest() const { return (next + static_cast<uint32_t>(frames.size()) - count) % frames.size(); }
+    };
+
+    struct PacketRing {
+        std::vector<LoggedPacket> packets;
+        uint32_t next = 0;
+        uint32_t count = 0;
+    };
+
+    struct WriteJob {
+        enum class Kind { Dump, Bmp } kind = Kind::Dump;
+        std::string path;   // Dump directory or BMP file
+        std::string reason;
+        std::vector<uint8_t> bmpData;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+
+    static constexpr size_t kPacketReserveBytes = 256 * 1024;
+
     uint32_t m_maxFrames;
+    uint32_t m_maxPackets;
     std::string m_outputDir;
-    std::vector<LoggedFrame> m_loggedFrames;
-    uint32_t m_frameCounter;
-    
-    void EnsureOutputDirectory();
+    Mode m_mode;
+    uint32_t m_frameCounter = 0;
+    uint32_t m_packetCounter = 0;
+    uint32_t m_dumpCount = 0;
+
+    mutable std::mutex m_frameMutex;
+    std::mutex m_packetMutex;
+    FrameRing m_frames;
+    PacketRing m_packets;
+
+    // Swapped with the live rings on RequestDump(); owned by the writer
+    // until the dump has been written
+    FrameRing m_dumpFrames;
+    PacketRing m_dumpPackets;
+    bool m_dumpInFlight = false;
+
+    std::mutex m_jobMutex;
+    std::condition_variable m_jobReady;
+    std::deque<WriteJob> m_jobs;
+    bool m_stopWriter = false;
+    std::thread m_writer;
+
+    void WriterMain();
+    void WriteDump(const WriteJob& job);
+    void WriteFrames(const FrameRing& ring, const std::string& dir, const std::string& reason);
+    void WritePackets(const PacketRing& ring, const std::string& dir);
+    void Enqueue(WriteJob&& job);
+    void ResizeFrameRing(FrameRing& ring, size_t slotBytes);
+    void EnsureOutputDirectory(const std::string& dir);
     std::string GenerateFrameFilename(uint32_t frameIndex, uint32_t width, uint32_t height);
-    bool SaveFrameAsBMP(uint32_t width, uint32_t height, const std::vector<uint8_t>& frameData, const std::string& filename);
-};
\ No newline at end of file
+    bool SaveFrameAsBMP(uint32_t width, uint32_t height, const uint8_t* frameData, size_t dataSize, const std::string& filename);
+};
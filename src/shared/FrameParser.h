@@ -0,0 +1,257 @@
+#pragma once
+#include "protocol.h"
+#include "BufferPool.h"
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Fixed-capacity byte ring used to batch socket reads. Positions grow
+// monotonically and wrap through a power-of-two mask.
+class ByteRing {
+private:
+    std::vector<uint8_t> m_data;
+    size_t m_mask;
+    size_t m_head = 0; // Next byte to read
+    size_t m_tail = 0; // Next byte to write
+
+public:
+    explicit ByteRing(size_t capacity) {
+        size_t pow2 = 1;
+        while (pow2 < capacity) pow2 <<= 1;
+        m_data.resize(pow2);
+        m_mask = pow2 - 1;
+    }
+
+    size_t Capacity() const { return m_data.size(); }
+    size_t Size() const { return m_tail - m_head; }
+    size_t Free() const { return Capacity() - Size(); }
+    void Clear() { m_head = m_tail = 0; }
+
+    // Largest contiguous writable region at the tail.
+    uint8_t* WriteSpan(size_t& length) {
+        size_t offset = m_tail & m_mask;
+        length = std::min(Free(), Capacity() - offset);
+        return m_data.data() + offset;
+    }
+
+    void Commit(size_t count) { m_tail += count; }
+
+    void Peek(uint8_t* out, size_t count) const {
+        size_t offset = m_head & m_mask;
+        size_t first = std::min(count, Capacity() - offset);
+        std::memcpy(out, m_data.data() + offset, first);
+        std::memcpy(out + first, m_data.data(), count - first);
+    }
+
+    void Consume(size_t count) {
+        m_head += count;
+        if (m_head == m_tail) {
+            // Rewind when empty so the next write gets the whole buffer
+            m_head = m_tail = 0;
+        }
+    }
+
+    size_t Read(uint8_t* out, size_t count) {
+        count = std::min(count, Size());
+        Peek(out, count);
+        Consume(count);
+        return count;
+    }
+};
+
+// A complete message produced by FrameParser. `body` holds the fixed-size
+// portion (header included), zero-extended so that fields a peer did not send
+// read as 0. It stays valid until the next Poll(). `payload` owns the trailing
+// variable-length data, if any.
+struct ParsedMessage {
+    static constexpr size_t kMaxFixedSize = 256;
+
+    MessageHeader header{};
+    const uint8_t* body = nullptr;
+    BufferHandle payload;
+
+    template <typename T>
+    const T& As() const {
+        static_assert(sizeof(T) <= kMaxFixedSize, "message struct exceeds parser body storage");
+        return *reinterpret_cast<const T*>(body);
+    }
+};
+
+// Incremental, resumable parser for the MRDesktop wire protocol. Poll() pulls
+// whatever bytes the receive callback has, keeps partial messages across calls
+// and returns once a full message is available. Small messages are batched
+// through a ring buffer; large payloads are read straight into pooled storage.
+class FrameParser {
+public:
+    enum class Status {
+        NeedMore, // No complete message yet; call again when data arrives
+        Message,  // `msg` holds a complete message
+        Error     // Stream is corrupt or the connection failed
+    };
+
+    static constexpr uint32_t kMaxPayloadSize = 100000000;
+
+    explicit FrameParser(BufferPool& payloadPool, size_t ringCapacity = 256 * 1024)
+        : m_ring(ringCapacity), m_pool(payloadPool) {}
+
+    // The callback mimics `recv`: returns bytes read, 0 if no data is
+    // available yet, or a negative value on error or disconnect.
+    template <typename RecvFunc>
+    Status Poll(RecvFunc&& recvFunc, ParsedMessage& msg) {
+        for (;;) {
+            switch (m_state) {
+            case State::Header: {
+                if (m_ring.Size() < sizeof(MessageHeader)) {
+                    int r = FillRing(recvFunc);
+                    if (r < 0) return Fail();
+                    if (r == 0) return Status::NeedMore;
+                    continue;
+                }
+                m_ring.Peek(reinterpret_cast<uint8_t*>(&m_header), sizeof(MessageHeader));
+                if (m_header.size < sizeof(MessageHeader) || m_header.size > ParsedMessage::kMaxFixedSize) {
+                    return Fail();
+                }
+                m_state = State::Fixed;
+                continue;
+            }
+            case State::Fixed: {
+                if (m_ring.Size() < m_header.size) {
+                    int r = FillRing(recvFunc);
+                    if (r < 0) return Fail();
+                    if (r == 0) return Status::NeedMore;
+                    continue;
+                }
+                std::memset(m_body, 0, sizeof(m_body));
+                m_ring.Read(m_body, m_header.size);
+
+                if (!IsKnownType(m_header.type)) {
+                    // Fixed part is consumed; unknown types carry no payload we can size
+                    m_skippedMessages++;
+                    m_state = State::Header;
+                    continue;
+                }
+
+                uint32_t payloadSize = 0;
+                if (!GetPayloadSize(payloadSize)) {
+                    return Fail();
+                }
+                m_payload = m_pool.Acquire(payloadSize);
+                m_payloadFilled = 0;
+                m_state = State::Payload;
+                continue;
+            }
+            case State::Payload: {
+                size_t remaining = m_payload.size() - m_payloadFilled;
+                if (remaining > 0 && m_ring.Size() > 0) {
+                    m_payloadFilled += m_ring.Read(m_payload.data() + m_payloadFilled, remaining);
+                } else if (remaining >= m_ring.Capacity() / 2) {
+                    // Large tail: read directly into the payload, skipping the ring copy
+                    int r = recvFunc(m_payload.data() + m_payloadFilled,
+                                     static_cast<int>(std::min<size_t>(remaining, INT_MAX)));
+                    if (r < 0) return Fail();
+                    if (r == 0) return Status::NeedMore;
+                    m_payloadFilled += static_cast<size_t>(r);
+                } else if (remaining > 0) {
+                    int r = FillRing(recvFunc);
+                    if (r < 0) return Fail();
+                    if (r == 0) return Status::NeedMore;
+                    continue;
+                }
+
+                if (m_payloadFilled < m_payload.size()) {
+                    continue;
+                }
+
+                msg.header = m_header;
+                msg.body = m_body;
+                msg.payload = std::move(m_payload);
+                m_state = State::Header;
+                return Status::Message;
+            }
+            }
+        }
+    }
+
+    // Drops any partially parsed message and buffered bytes.
+    void Reset() {
+        m_ring.Clear();
+        m_payload.Reset();
+        m_payloadFilled = 0;
+        m_state = State::Header;
+    }
+
+    uint64_t GetSkippedMessages() const { return m_skippedMessages; }
+
+private:
+    enum class State {
+        Header,  // Waiting for a MessageHeader
+        Fixed,   // Waiting for the rest of the fixed-size struct
+        Payload  // Filling the variable-length payload
+    };
+
+    ByteRing m_ring;
+    BufferPool& m_pool;
+    State m_state = State::Header;
+    MessageHeader m_header{};
+    alignas(8) uint8_t m_body[ParsedMessage::kMaxFixedSize];
+    BufferHandle m_payload;
+    size_t m_payloadFilled = 0;
+    uint64_t m_skippedMessages = 0;
+
+    template <typename RecvFunc>
+    int FillRing(RecvFunc& recvFunc) {
+        size_t length = 0;
+        uint8_t* dst = m_ring.WriteSpan(length);
+        if (length == 0) {
+            return 0;
+        }
+        int r = recvFunc(dst, static_cast<int>(std::min<size_t>(length, INT_MAX)));
+        if (r > 0) {
+            m_ring.Commit(static_cast<size_t>(r));
+        }
+        return r;
+    }
+
+    Status Fail() {
+        Reset();
+        return Status::Error;
+    }
+
+    static bool IsKnownType(uint32_t type) {
+        switch (type) {
+            case MSG_FRAME_DATA:
+            case MSG_MOUSE_MOVE:
+            case MSG_MOUSE_CLICK:
+            case MSG_MOUSE_SCROLL:
+            case MSG_COMPRESSED_FRAME:
+            case MSG_COMPRESSION_REQUEST:
+            case MSG_KEYFRAME_REQUEST:
+            case MSG_STATS:
+            case MSG_CLOCK_PING:
+            case MSG_CLOCK_PONG:
+            case MSG_KEEPALIVE:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Reads the payload length out of the fixed body. Peers may send a
+    // shorter struct than ours, but it must reach the size field.
+    bool GetPayloadSize(uint32_t& payloadSize) const {
+        payloadSize = 0;
+        if (m_header.type == MSG_FRAME_DATA) {
+            if (m_header.size < offsetof(FrameMessage, dataSize) + sizeof(uint32_t)) return false;
+            const FrameMessage& frame = *reinterpret_cast<const FrameMessage*>(m_body);
+            if (frame.width == 0 || frame.height == 0 || frame.width > 10000 || frame.height > 10000) return false;
+            payloadSize = frame.dataSize;
+        } else if (m_header.type == MSG_COMPRESSED_FRAME) {
+            if (m_header.size < offsetof(CompressedFrameMessage, compressedSize) + sizeof(uint32_t)) return false;
+            payloadSize = reinterpret_cast<const CompressedFrameMessage*>(m_body)->compressedSize;
+        }
+        return payloadSize <= kMaxPayloadSize;
+    }
+};
@@ -0,0 +1,195 @@
+#include "FrameQuality.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MR_FRAMEQUALITY_X86 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// SSIM works on 8x8 windows stepped by 4 pixels. Each window is the sum of
+// 2x2 blocks of 4x4 pixels, so every pixel is read once per pass.
+constexpr uint32_t kBlock = 4;
+constexpr double kWindowPixels = 64.0;
+constexpr double kC1 = (0.01 * 255) * (0.01 * 255);
+constexpr double kC2 = (0.03 * 255) * (0.03 * 255);
+
+// Per 4x4 block: sum of a, sum of b, sum of a^2 + b^2, sum of a*b
+enum BlockSum { SumA, SumB, SumSquares, SumProducts, kBlockSumCount };
+
+void ExtractLuma(const uint8_t* bgra, uint32_t width, uint32_t height, size_t stride, uint8_t* luma) {
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* pixel = bgra + static_cast<size_t>(y) * stride;
+        uint8_t* out = luma + static_cast<size_t>(y) * width;
+        for (uint32_t x = 0; x < width; x++, pixel += 4) {
+            out[x] = static_cast<uint8_t>((29 * pixel[0] + 150 * pixel[1] + 77 * pixel[2] + 128) >> 8);
+        }
+    }
+}
+
+uint64_t SquaredErrorScalar(const uint8_t* a, const uint8_t* b, size_t count) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        int diff = a[i] - b[i];
+        sum += static_cast<uint32_t>(diff * diff);
+    }
+    return sum;
+}
+
+void BlockRowScalar(const uint8_t* a, const uint8_t* b, uint32_t width, uint32_t firstBlock, uint32_t blocks,
+                    int32_t* sums) {
+    for (uint32_t block = firstBlock; block < blocks; block++) {
+        int32_t* out = sums + block * kBlockSumCount;
+        out[SumA] = out[SumB] = out[SumSquares] = out[SumProducts] = 0;
+        for (uint32_t y = 0; y < kBlock; y++) {
+            const uint8_t* rowA = a + static_cast<size_t>(y) * width + block * kBlock;
+            const uint8_t* rowB = b + static_cast<size_t>(y) * width + block * kBlock;
+            for (uint32_t x = 0; x < kBlock; x++) {
+                out[SumA] += rowA[x];
+                out[SumB] += rowB[x];
+                out[SumSquares] += rowA[x] * rowA[x] + rowB[x] * rowB[x];
+                out[SumProducts] += rowA[x] * rowB[x];
+            }
+        }
+    }
+}
+
+#ifdef MR_FRAMEQUALITY_X86
+
+uint64_t SquaredErrorSSE2(const uint8_t* a, const uint8_t* b, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;  // 64-bit lanes
+    size_t i = 0;
+    while (i + 16 <= count) {
+        // At most 4 squares of 255^2 per 32-bit lane per step; flush well before overflow
+        __m128i partial = zero;
+        size_t end = std::min(count & ~static_cast<size_t>(15), i + 16 * 1024);
+        for (; i < end; i += 16) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            __m128i dLo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+            __m128i dHi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+            partial = _mm_add_epi32(partial, _mm_madd_epi16(dLo, dLo));
+            partial = _mm_add_epi32(partial, _mm_madd_epi16(dHi, dHi));
+        }
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(partial, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(partial, zero));
+    }
+    alignas(16) uint64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+    return lanes[0] + lanes[1] + SquaredErrorScalar(a + i, b + i, count - i);
+}
+
+// Sums of four 4x4 blocks per step. Returns the number of blocks done.
+uint32_t BlockRowSSE2(const uint8_t* a, const uint8_t* b, uint32_t width, uint32_t blocks, int32_t* sums) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    uint32_t block = 0;
+    for (; block + 4 <= blocks; block += 4) {
+        __m128i sumA[2] = { zero, zero };      // 16-bit, per pixel column
+        __m128i sumB[2] = { zero, zero };
+        __m128i squares[2] = { zero, zero };   // 32-bit, per pixel column pair
+        __m128i products[2] = { zero, zero };
+        for (uint32_t y = 0; y < kBlock; y++) {
+            size_t offset = static_cast<size_t>(y) * width + block * kBlock;
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + offset));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + offset));
+            __m128i a16[2] = { _mm_unpacklo_epi8(va, zero), _mm_unpackhi_epi8(va, zero) };
+            __m128i b16[2] = { _mm_unpacklo_epi8(vb, zero), _mm_unpackhi_epi8(vb, zero) };
+            for (int half = 0; half < 2; half++) {
+                sumA[half] = _mm_add_epi16(sumA[half], a16[half]);
+                sumB[half] = _mm_add_epi16(sumB[half], b16[half]);
+                squares[half] = _mm_add_epi32(squares[half], _mm_madd_epi16(a16[half], a16[half]));
+                squares[half] = _mm_add_epi32(squares[half], _mm_madd_epi16(b16[half], b16[half]));
+                products[half] = _mm_add_epi32(products[half], _mm_madd_epi16(a16[half], b16[half]));
+            }
+        }
+        for (int half = 0; half < 2; half++) {
+            // Pixel column pairs -> 4-pixel blocks in lanes 0 and 2
+            __m128i pairs[kBlockSumCount] = {
+                _mm_madd_epi16(sumA[half], ones), _mm_madd_epi16(sumB[half], ones), squares[half], products[half]
+            };
+            for (int sum = 0; sum < kBlockSumCount; sum++) {
+                __m128i blockSums = _mm_add_epi32(pairs[sum], _mm_shuffle_epi32(pairs[sum], _MM_SHUFFLE(2, 3, 0, 1)));
+                int32_t* out = sums + (block + half * 2) * kBlockSumCount + sum;
+                out[0] = _mm_cvtsi128_si32(blockSums);
+                out[kBlockSumCount] = _mm_cvtsi128_si32(_mm_srli_si128(blockSums, 8));
+            }
+        }
+    }
+    return block;
+}
+
+#endif // MR_FRAMEQUALITY_X86
+
+uint64_t SquaredError(const uint8_t* a, const uint8_t* b, size_t count) {
+#ifdef MR_FRAMEQUALITY_X86
+    return SquaredErrorSSE2(a, b, count);
+#else
+    return SquaredErrorScalar(a, b, count);
+#endif
+}
+
+void BlockRow(const uint8_t* a, const uint8_t* b, uint32_t width, uint32_t blocks, int32_t* sums) {
+    uint32_t done = 0;
+#ifdef MR_FRAMEQUALITY_X86
+    done = BlockRowSSE2(a, b, width, blocks, sums);
+#endif
+    BlockRowScalar(a, b, width, done, blocks, sums);
+}
+
+// SSIM of one 8x8 window from its summed blocks
+double WindowSsim(const int32_t* sums) {
+    double meanA = sums[SumA] / kWindowPixels;
+    double meanB = sums[SumB] / kWindowPixels;
+    double meanSquares = meanA * meanA + meanB * meanB;
+    double variances = sums[SumSquares] / kWindowPixels - meanSquares;
+    double covariance = sums[SumProducts] / kWindowPixels - meanA * meanB;
+    return ((2 * meanA * meanB + kC1) * (2 * covariance + kC2)) / ((meanSquares + kC1) * (variances + kC2));
+}
+
+} // namespace
+
+bool FrameQualityMeter::Measure(const uint8_t* reference, const uint8_t* decoded, uint32_t width, uint32_t height,
+                                size_t stride, FrameQuality& quality) {
+    if (width < 2 * kBlock || height < 2 * kBlock || stride < static_cast<size_t>(width) * 4) {
+        return false;
+    }
+    size_t pixels = static_cast<size_t>(width) * height;
+    m_referenceLuma.resize(pixels);
+    m_decodedLuma.resize(pixels);
+    ExtractLuma(reference, width, height, stride, m_referenceLuma.data());
+    ExtractLuma(decoded, width, height, stride, m_decodedLuma.data());
+
+    quality.mse = static_cast<double>(SquaredError(m_referenceLuma.data(), m_decodedLuma.data(), pixels)) / pixels;
+    quality.psnr = quality.mse > 0 ? std::min(10.0 * std::log10(255.0 * 255.0 / quality.mse), kMaxPsnr) : kMaxPsnr;
+
+    // Two rows of block sums; each row of windows combines the previous and current one
+    const uint32_t blocksX = width / kBlock;
+    const uint32_t blocksY = height / kBlock;
+    const size_t rowSums = static_cast<size_t>(blocksX) * kBlockSumCount;
+    m_blockSums.resize(rowSums * 2);
+    double ssimSum = 0.0;
+    for (uint32_t blockY = 0; blockY < blocksY; blockY++) {
+        size_t offset = static_cast<size_t>(blockY) * kBlock * width;
+        int32_t* current = m_blockSums.data() + (blockY & 1) * rowSums;
+        BlockRow(m_referenceLuma.data() + offset, m_decodedLuma.data() + offset, width, blocksX, current);
+        if (blockY == 0) {
+            continue;
+        }
+        const int32_t* previous = m_blockSums.data() + ((blockY - 1) & 1) * rowSums;
+        for (uint32_t blockX = 0; blockX + 1 < blocksX; blockX++) {
+            int32_t window[kBlockSumCount];
+            for (int sum = 0; sum < kBlockSumCount; sum++) {
+                size_t left = static_cast<size_t>(blockX) * kBlockSumCount + sum;
+                size_t right = left + kBlockSumCount;
+                window[sum] = previous[left] + previous[right] + current[left] + current[right];
+            }
+            ssimSum += WindowSsim(window);
+        }
+    }
+    quality.ssim = ssimSum / (static_cast<double>(blocksX - 1) * (blocksY - 1));
+    return true;
+}
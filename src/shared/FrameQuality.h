@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Full-reference quality of a decoded frame against the frame that was
+// encoded, on full-range BT.601 luma (where codecs spend most of their bits).
+struct FrameQuality {
+    double mse = 0.0;
+    double psnr = 0.0;  // dB, capped at kMaxPsnr for identical frames
+    double ssim = 0.0;  // Mean over 8x8 windows, 4 pixels apart
+};
+
+constexpr double kMaxPsnr = 100.0;
+
+// Measures BGRA frame pairs, keeping its luma planes between calls so the
+// per-frame path does not allocate. PSNR and SSIM sums use SSE2 on x86 and
+// the scalar path elsewhere; both give identical results.
+class FrameQualityMeter {
+public:
+    // False if the frame is smaller than one SSIM window
+    bool Measure(const uint8_t* reference, const uint8_t* decoded, uint32_t width, uint32_t height,
+                 size_t stride, FrameQuality& quality);
+
+private:
+    std::vector<uint8_t> m_referenceLuma;
+    std::vector<uint8_t> m_decodedLuma;
+    std::vector<int32_t> m_blockSums;
+};
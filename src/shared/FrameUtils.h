@@ -1,16 +1,18 @@
 #pragma once
 #include "protocol.h"
+#include <cstring>
 #include <vector>
-#include <functional>
 #include <thread>
 #include <chrono>
 
 // Generic helper to read bytes until the requested size has been read.
 // The callback should mimic the `recv` function and return the number of
 // bytes read, 0 if no data is available yet, or a negative value on error.
-inline bool ReadExact(const std::function<int(uint8_t*, int)>& recvFunc,
-                      uint8_t* buffer,
-                      int size)
+// Taken as a template parameter so the per-call dispatch can be inlined.
+template <typename RecvFunc>
+bool ReadExact(const RecvFunc& recvFunc,
+               uint8_t* buffer,
+               int size)
 {
     int total = 0;
     while (total < size) {
@@ -30,30 +32,45 @@ inline bool ReadExact(const std::function<int(uint8_t*, int)>& recvFunc,
 
 // Generic helper to read a full frame using a provided receive callback.
 // The callback should mimic the `recv` function as described above.
-inline bool ReadFrameGeneric(const std::function<int(uint8_t*, int)>& recvFunc,
-                             FrameMessage& frameMsg,
-                             std::vector<uint8_t>& frameData)
+// This blocks until a whole frame has arrived; non-blocking callers should
+// use FrameParser instead.
+template <typename RecvFunc>
+bool ReadFrameGeneric(const RecvFunc& recvFunc,
+                      FrameMessage& frameMsg,
+                      std::vector<uint8_t>& frameData)
 {
-    // Read basic header
+    // Read each message's fixed part by its declared size, skipping non-frame
+    // messages. Structs from older peers are zero-extended and fields newer
+    // peers append are ignored.
     MessageHeader hdr;
-    if (!ReadExact(recvFunc, reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr)))
-        return false;
+    uint8_t body[256];
+    for (;;) {
+        if (!ReadExact(recvFunc, reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr)))
+            return false;
+        if (hdr.size < sizeof(MessageHeader) || hdr.size > sizeof(body))
+            return false;
+
+        std::memset(body, 0, sizeof(body));
+        std::memcpy(body, &hdr, sizeof(hdr));
+        if (!ReadExact(recvFunc, body + sizeof(MessageHeader), static_cast<int>(hdr.size - sizeof(MessageHeader))))
+            return false;
+        if (hdr.type == MSG_COMPRESSED_FRAME || hdr.type == MSG_FRAME_DATA)
+            break;
+    }
 
     if (hdr.type == MSG_COMPRESSED_FRAME) {
         // Handle compressed frames - use separate CompressedFrameMessage variable
         CompressedFrameMessage compFrameMsg;
-        compFrameMsg.header = hdr;
-        int remaining = sizeof(CompressedFrameMessage) - sizeof(MessageHeader);
-        if (!ReadExact(recvFunc,
-                       reinterpret_cast<uint8_t*>(&compFrameMsg) + sizeof(MessageHeader),
-                       remaining))
-            return false;
+        std::memcpy(&compFrameMsg, body, sizeof(CompressedFrameMessage));
         
         // Copy compatible fields to frameMsg for callers expecting FrameMessage
         frameMsg.header = compFrameMsg.header;
         frameMsg.width = compFrameMsg.width;
         frameMsg.height = compFrameMsg.height;
         frameMsg.dataSize = compFrameMsg.compressedSize;
+        frameMsg.timing = compFrameMsg.timing;
+        if (compFrameMsg.compressedSize > 100000000)
+            return false;
         
         // Read compressed data
         frameData.resize(compFrameMsg.compressedSize);
@@ -62,16 +79,7 @@ inline bool ReadFrameGeneric(const std::function<int(uint8_t*, int)>& recvFunc,
         return true; // Compressed frame successfully read
     }
 
-    if (hdr.type != MSG_FRAME_DATA)
-        return false;
-
-    // Read rest of FrameMessage
-    frameMsg.header = hdr;
-    int remaining = sizeof(FrameMessage) - sizeof(MessageHeader);
-    if (!ReadExact(recvFunc,
-                   reinterpret_cast<uint8_t*>(&frameMsg) + sizeof(MessageHeader),
-                   remaining))
-        return false;
+    std::memcpy(&frameMsg, body, sizeof(FrameMessage));
 
     if (frameMsg.width == 0 || frameMsg.height == 0 ||
         frameMsg.width > 10000 || frameMsg.height > 10000 ||
@@ -0,0 +1,91 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Minimal streaming JSON writer for machine-readable reports. Call Key()
+// before each value inside an object; commas and nesting are tracked for you.
+class JsonWriter {
+private:
+    std::string m_out;
+    std::vector<bool> m_firstInScope;
+    bool m_afterKey = false;
+
+    void BeforeValue() {
+        if (m_afterKey) {
+            m_afterKey = false;
+            return;
+        }
+        if (!m_firstInScope.empty()) {
+            if (!m_firstInScope.back()) m_out += ',';
+            m_firstInScope.back() = false;
+        }
+    }
+
+    void AppendEscaped(const std::string& text) {
+        m_out += '"';
+        for (char c : text) {
+            switch (c) {
+                case '"': m_out += "\\\""; break;
+                case '\\': m_out += "\\\\"; break;
+                case '\n': m_out += "\\n"; break;
+                case '\r': m_out += "\\r"; break;
+                case '\t': m_out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char buf[8];
+                        snprintf(buf, sizeof(buf), "\\u%04x", c);
+                        m_out += buf;
+                    } else {
+                        m_out += c;
+                    }
+            }
+        }
+        m_out += '"';
+    }
+
+public:
+    JsonWriter& BeginObject() { BeforeValue(); m_out += '{'; m_firstInScope.push_back(true); return *this; }
+    JsonWriter& EndObject() { m_firstInScope.pop_back(); m_out += '}'; return *this; }
+    JsonWriter& BeginArray() { BeforeValue(); m_out += '['; m_firstInScope.push_back(true); return *this; }
+    JsonWriter& EndArray() { m_firstInScope.pop_back(); m_out += ']'; return *this; }
+
+    JsonWriter& Key(const std::string& key) {
+        BeforeValue();
+        AppendEscaped(key);
+        m_out += ':';
+        m_afterKey = true;
+        return *this;
+    }
+
+    JsonWriter& String(const std::string& value) { BeforeValue(); AppendEscaped(value); return *this; }
+    JsonWriter& Bool(bool value) { BeforeValue(); m_out += value ? "true" : "false"; return *this; }
+    JsonWriter& Null() { BeforeValue(); m_out += "null"; return *this; }
+    JsonWriter& Int(int64_t value) { BeforeValue(); m_out += std::to_string(value); return *this; }
+    JsonWriter& UInt(uint64_t value) { BeforeValue(); m_out += std::to_string(value); return *this; }
+
+    // `precision` is in significant digits
+    JsonWriter& Double(double value, int precision = 6) {
+        BeforeValue();
+        if (!std::isfinite(value)) {
+            m_out += "null"; // JSON has no NaN/Inf
+        } else {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.*g", precision, value);
+            m_out += buf;
+        }
+        return *this;
+    }
+
+    const std::string& str() const { return m_out; }
+
+    bool WriteToFile(const std::string& path) const {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file) return false;
+        bool ok = fwrite(m_out.data(), 1, m_out.size(), file) == m_out.size();
+        ok = (fputc('\n', file) != EOF) && ok;
+        return (fclose(file) == 0) && ok;
+    }
+};
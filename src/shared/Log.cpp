@@ -0,0 +1,217 @@
+#include "Log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <streambuf>
+#include <thread>
+
+namespace {
+
+// Appends to a string whose capacity is kept between messages
+class LogStreamBuf : public std::streambuf {
+public:
+    std::string text;
+
+protected:
+    int_type overflow(int_type c) override {
+        if (c != traits_type::eof()) {
+            text.push_back(static_cast<char>(c));
+        }
+        return c;
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        text.append(s, static_cast<size_t>(n));
+        return n;
+    }
+};
+
+struct ThreadLogStream {
+    LogStreamBuf buffer;
+    std::ostream stream{&buffer};
+};
+
+ThreadLogStream& LocalStream() {
+    thread_local ThreadLogStream local;
+    return local;
+}
+
+struct LogSlot {
+    std::atomic<uint64_t> sequence{0};
+    LogLevel level = LogLevel::Info;
+    uint16_t length = 0;
+    char text[Log::kMaxMessageBytes];
+};
+
+void WriteLine(LogLevel level, const char* text, size_t length) {
+    FILE* out = level >= LogLevel::Warn ? stderr : stdout;
+    fwrite(text, 1, length, out);
+    fputc('\n', out);
+}
+
+// Bounded multi-producer, single-consumer ring. Each slot's sequence number
+// says whose turn it is: producers claim a slot by advancing m_tail, fill it,
+// then publish it; the writer thread consumes slots in order.
+class Logger {
+public:
+    Logger() : m_slots(std::make_unique<LogSlot[]>(Log::kQueueSlots)) {
+        for (size_t i = 0; i < Log::kQueueSlots; i++) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        m_writer = std::thread(&Logger::WriterMain, this);
+    }
+
+    ~Logger() {
+        m_stop = true;
+        if (m_writer.joinable()) {
+            m_writer.join();
+        }
+        s_gone = true;
+    }
+
+    static Logger& Instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    // Set once the logger has been destroyed at exit; later messages are
+    // written synchronously
+    static inline std::atomic<bool> s_gone{false};
+
+    void Push(LogLevel level, std::string_view text) {
+        uint64_t pos = m_tail.load(std::memory_order_relaxed);
+        LogSlot* slot;
+        for (;;) {
+            slot = &m_slots[pos % Log::kQueueSlots];
+            uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return; // Full; the writer is behind
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        size_t length = std::min(text.size(), Log::kMaxMessageBytes);
+        std::memcpy(slot->text, text.data(), length);
+        slot->length = static_cast<uint16_t>(length);
+        slot->level = level;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    void Flush() {
+        uint64_t target = m_tail.load(std::memory_order_acquire);
+        while (m_head.load(std::memory_order_acquire) < target && !m_stop) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    uint64_t GetDropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr auto kIdleWait = std::chrono::milliseconds(10);
+
+    std::unique_ptr<LogSlot[]> m_slots;
+    std::atomic<uint64_t> m_tail{0};    // Next slot a producer claims
+    std::atomic<uint64_t> m_head{0};    // Next slot the writer reads
+    std::atomic<uint64_t> m_dropped{0};
+    uint64_t m_droppedReported = 0;
+    std::atomic<bool> m_stop{false};
+    std::thread m_writer;
+
+    // Writes everything published so far; returns false if there was nothing
+    bool Drain() {
+        bool wroteStdout = false;
+        bool wroteStderr = false;
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        for (;;) {
+            LogSlot& slot = m_slots[head % Log::kQueueSlots];
+            if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+                break; // Not published yet
+            }
+            WriteLine(slot.level, slot.text, slot.length);
+            (slot.level >= LogLevel::Warn ? wroteStderr : wroteStdout) = true;
+            slot.sequence.store(head + Log::kQueueSlots, std::memory_order_release);
+            head++;
+            m_head.store(head, std::memory_order_release);
+        }
+
+        uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped != m_droppedReported) {
+            fprintf(stderr, "Log: %llu messages dropped\n",
+                    static_cast<unsigned long long>(dropped - m_droppedReported));
+            m_droppedReported = dropped;
+            wroteStderr = true;
+        }
+
+        // One flush per batch rather than one per line
+        if (wroteStdout) fflush(stdout);
+        if (wroteStderr) fflush(stderr);
+        return wroteStdout || wroteStderr;
+    }
+
+    void WriterMain() {
+        while (!m_stop) {
+            if (!Drain()) {
+                std::this_thread::sleep_for(kIdleWait);
+            }
+        }
+        Drain();
+    }
+};
+
+} // namespace
+
+bool Log::ParseLevel(const std::string& name, LogLevel& level) {
+    static const struct { const char* name; LogLevel level; } kLevels[] = {
+        { "debug", LogLevel::Debug },
+        { "info", LogLevel::Info },
+        { "warn", LogLevel::Warn },
+        { "error", LogLevel::Error },
+        { "off", LogLevel::Off },
+    };
+    for (const auto& entry : kLevels) {
+        if (name == entry.name) {
+            level = entry.level;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Log::Write(LogLevel level, std::string_view text) {
+    if (Logger::s_gone) {
+        WriteLine(level, text.data(), text.size());
+        return;
+    }
+    Logger::Instance().Push(level, text);
+}
+
+void Log::Flush() {
+    if (!Logger::s_gone) {
+        Logger::Instance().Flush();
+    }
+}
+
+uint64_t Log::GetDroppedCount() {
+    return Logger::s_gone ? 0 : Logger::Instance().GetDropped();
+}
+
+LogMessage::LogMessage(LogLevel level)
+    : m_level(level), m_stream(LocalStream().stream) {
+    LocalStream().buffer.text.clear();
+    m_stream.flags(std::ios_base::dec | std::ios_base::skipws);
+    m_stream.precision(6);
+}
+
+LogMessage::~LogMessage() {
+    if (Log::IsEnabled(m_level)) {
+        Log::Write(m_level, LocalStream().buffer.text);
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+enum class LogLevel : uint8_t {
+    Debug,  // Per-frame detail; off by default
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+// Asynchronous leveled logging. Messages are formatted on the calling thread
+// into a reusable thread-local buffer, pushed into a lock-free ring and
+// written out by a background thread, so logging from a frame loop never
+// blocks on the console. Debug and Info go to stdout, Warn and Error to
+// stderr. If the ring is full the message is dropped and counted.
+//
+//     MR_LOG_INFO("VideoDecoder: Reconfigured for " << width << "x" << height);
+//
+// Below the current level a log statement costs one relaxed load; its
+// arguments are not evaluated.
+class Log {
+public:
+    static constexpr size_t kMaxMessageBytes = 240; // Longer messages are truncated
+    static constexpr size_t kQueueSlots = 2048;
+
+    static void SetLevel(LogLevel level) { s_level.store(level, std::memory_order_relaxed); }
+    static LogLevel GetLevel() { return s_level.load(std::memory_order_relaxed); }
+    static bool IsEnabled(LogLevel level) { return level >= GetLevel(); }
+
+    // Parses "debug", "info", "warn", "error" or "off"
+    static bool ParseLevel(const std::string& name, LogLevel& level);
+
+    static void Write(LogLevel level, std::string_view text);
+
+    // Blocks until everything logged so far has been written
+    static void Flush();
+
+    static uint64_t GetDroppedCount();
+
+private:
+    static inline std::atomic<LogLevel> s_level{LogLevel::Info};
+};
+
+// One message being formatted; written out when it goes out of scope if its
+// level is enabled. The macros below skip formatting entirely when it isn't;
+// use this directly for a line built up across statements.
+class LogMessage {
+public:
+    explicit LogMessage(LogLevel level);
+    ~LogMessage();
+
+    std::ostream& Stream() { return m_stream; }
+
+    LogMessage(const LogMessage&) = delete;
+    LogMessage& operator=(const LogMessage&) = delete;
+
+private:
+    LogLevel m_level;
+    std::ostream& m_stream;
+};
+
+// Lets through one message per interval from a call site and remembers how
+// many were held back in between
+class LogRateLimiter {
+public:
+    bool Allow(int intervalMs, uint32_t& suppressed) {
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t last = m_lastMs.load(std::memory_order_relaxed);
+        if (last != 0 && now - last < intervalMs) {
+            m_suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (!m_lastMs.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+            m_suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false; // Another thread just logged it
+        }
+        suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    std::atomic<int64_t> m_lastMs{0};
+    std::atomic<uint32_t> m_suppressed{0};
+};
+
+#define MR_LOG(level, expr) \
+    do { \
+        if (Log::IsEnabled(level)) { \
+            LogMessage mrLogMessage(level); \
+            mrLogMessage.Stream() << expr; \
+        } \
+    } while (0)
+
+#define MR_LOG_DEBUG(expr) MR_LOG(LogLevel::Debug, expr)
+#define MR_LOG_INFO(expr) MR_LOG(LogLevel::Info, expr)
+#define MR_LOG_WARN(expr) MR_LOG(LogLevel::Warn, expr)
+#define MR_LOG_ERROR(expr) MR_LOG(LogLevel::Error, expr)
+
+// At most one message per `intervalMs` from this call site, for conditions
+// that can repeat every frame
+#define MR_LOG_RATE_LIMITED(level, intervalMs, expr) \
+    do { \
+        if (Log::IsEnabled(level)) { \
+            static LogRateLimiter mrLogLimiter; \
+            uint32_t mrLogSuppressed = 0; \
+            if (mrLogLimiter.Allow(intervalMs, mrLogSuppressed)) { \
+                LogMessage mrLogMessage(level); \
+                mrLogMessage.Stream() << expr; \
+                if (mrLogSuppressed > 0) { \
+                    mrLogMessage.Stream() << " (" << mrLogSuppressed << " more since last report)"; \
+                } \
+            } \
+        } \
+    } while (0)
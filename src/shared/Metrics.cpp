@@ -0,0 +1,146 @@
+#include "Metrics.h"
+#include "Log.h"
+#include "PerfCounters.h"
+#include <cmath>
+#include <cstdio>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+
+void AppendNumber(std::string& out, double value) {
+    if (std::isnan(value)) {
+        out += "NaN";
+    } else if (std::isinf(value)) {
+        out += value > 0 ? "+Inf" : "-Inf";
+    } else {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.15g", value);
+        out += buf;
+    }
+}
+
+} // namespace
+
+void OpenMetricsWriter::AppendFamily(const char* name, const char* type, const char* help) {
+    m_out += "# TYPE ";
+    m_out += name;
+    m_out += ' ';
+    m_out += type;
+    m_out += "\n# HELP ";
+    m_out += name;
+    m_out += ' ';
+    m_out += help;
+    m_out += '\n';
+}
+
+void OpenMetricsWriter::AppendSample(const char* name, const char* suffix, const char* labels, double value) {
+    m_out += name;
+    m_out += suffix;
+    m_out += labels;
+    m_out += ' ';
+    AppendNumber(m_out, value);
+    m_out += '\n';
+}
+
+void OpenMetricsWriter::AddCounter(const char* name, const char* help, uint64_t value) {
+    AppendFamily(name, "counter", help);
+    m_out += name;
+    m_out += "_total ";
+    m_out += std::to_string(value);
+    m_out += '\n';
+}
+
+void OpenMetricsWriter::AddGauge(const char* name, const char* help, double value) {
+    AppendFamily(name, "gauge", help);
+    AppendSample(name, "", "", value);
+}
+
+void OpenMetricsWriter::AddHistogram(const char* name, const char* help, const Histogram& histogram) {
+    AppendFamily(name, "histogram", help);
+
+    // Buckets are exported cumulatively, ending with +Inf == count
+    const std::vector<double>& bounds = histogram.GetBounds();
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= bounds.size(); i++) {
+        cumulative += histogram.GetBucketCount(i);
+        std::string label = "{le=\"";
+        AppendNumber(label, i < bounds.size() ? bounds[i] : INFINITY);
+        label += "\"}";
+        m_out += name;
+        m_out += "_bucket";
+        m_out += label;
+        m_out += ' ';
+        m_out += std::to_string(cumulative);
+        m_out += '\n';
+    }
+    AppendSample(name, "_sum", "", histogram.GetSum());
+    m_out += name;
+    m_out += "_count ";
+    m_out += std::to_string(cumulative);
+    m_out += '\n';
+}
+
+void OpenMetricsWriter::AddPerfCounters(const char* prefix) {
+    if (!PerfCounters::IsEnabled()) {
+        return;
+    }
+    constexpr size_t kStages = static_cast<size_t>(PerfStage::Count);
+    PerfStageTotals totals[kStages];
+    for (size_t stage = 0; stage < kStages; stage++) {
+        totals[stage] = PerfCounters::GetTotals(static_cast<PerfStage>(stage));
+    }
+
+    // Scopes first, then one family per counted event
+    for (int family = -1; family < kPerfEventCount; family++) {
+        if (family >= 0 && !PerfCounters::IsEventSupported(static_cast<PerfEvent>(family))) {
+            continue;
+        }
+        std::string name = std::string(prefix) + "_perf_" +
+                           (family < 0 ? "scopes" : PerfCounters::GetEventName(static_cast<PerfEvent>(family)));
+        std::string help = family < 0 ? "Pipeline stage executions sampled with hardware counters"
+                                      : std::string("Hardware counter ") +
+                                            PerfCounters::GetEventName(static_cast<PerfEvent>(family)) +
+                                            " per pipeline stage (user space)";
+        AppendFamily(name.c_str(), "counter", help.c_str());
+        for (size_t stage = 0; stage < kStages; stage++) {
+            if (PerfCounters::IsStageThreaded(static_cast<PerfStage>(stage))) {
+                continue; // Counts would cover only the calling thread
+            }
+            uint64_t value = family < 0 ? totals[stage].samples : totals[stage].counts[family];
+            m_out += name;
+            m_out += "_total{stage=\"";
+            m_out += PerfCounters::GetStageName(static_cast<PerfStage>(stage));
+            m_out += "\"} ";
+            m_out += std::to_string(value);
+            m_out += '\n';
+        }
+    }
+}
+
+std::string OpenMetricsWriter::Finish() const {
+    return m_out + "# EOF\n";
+}
+
+bool OpenMetricsWriter::WriteToFile(const std::string& path) const {
+    std::string tempPath = path + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (!file) {
+        MR_LOG_RATE_LIMITED(LogLevel::Warn, 10000, "Metrics: Could not create " << tempPath);
+        return false;
+    }
+    std::string text = Finish();
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = (fclose(file) == 0) && ok;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    ok = ok && std::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!ok) {
+        MR_LOG_RATE_LIMITED(LogLevel::Warn, 10000, "Metrics: Failed to write " << path);
+        std::remove(tempPath.c_str());
+    }
+    return ok;
+}
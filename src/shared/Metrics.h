@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// Bucket upper bounds for per-frame stage durations, in seconds
+inline constexpr double kLatencyBuckets[] = {
+    0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.066, 0.125, 0.25, 0.5, 1.0
+};
+
+// Bucket upper bounds for encoded frame sizes, in bytes
+inline constexpr double kFrameSizeBuckets[] = {
+    1024, 4096, 16384, 65536, 262144, 1048576, 4194304, 16777216
+};
+
+// Fixed-bucket histogram. Observe() is lock-free and may be called from any
+// thread while another one exports it; an export taken mid-update can be off
+// by the one observation in flight.
+class Histogram {
+public:
+    explicit Histogram(std::span<const double> upperBounds)
+        : m_bounds(upperBounds.begin(), upperBounds.end()),
+          m_counts(std::make_unique<std::atomic<uint64_t>[]>(m_bounds.size() + 1)) {}
+
+    void Observe(double value) {
+        size_t bucket = 0;
+        while (bucket < m_bounds.size() && value > m_bounds[bucket]) {
+            bucket++;
+        }
+        m_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        double sum = m_sum.load(std::memory_order_relaxed);
+        while (!m_sum.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {
+        }
+    }
+
+    void Reset() {
+        for (size_t i = 0; i <= m_bounds.size(); i++) {
+            m_counts[i].store(0, std::memory_order_relaxed);
+        }
+        m_sum.store(0.0, std::memory_order_relaxed);
+    }
+
+    const std::vector<double>& GetBounds() const { return m_bounds; }
+    // Observations in bucket `i`; the last bucket is everything above the highest bound
+    uint64_t GetBucketCount(size_t i) const { return m_counts[i].load(std::memory_order_relaxed); }
+    double GetSum() const { return m_sum.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<double> m_bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_counts;
+    std::atomic<double> m_sum{0.0};
+};
+
+// Builds an OpenMetrics text exposition, one metric family per call.
+// Names are given without the `_total` suffix; counters get it added.
+//
+//     OpenMetricsWriter metrics;
+//     metrics.AddCounter("mrdesktop_server_frames_sent", "Frames sent to the client", framesSent);
+//     metrics.AddHistogram("mrdesktop_server_encode_seconds", "Encode time per frame", encodeSeconds);
+//     metrics.WriteToFile("/var/lib/node_exporter/mrdesktop.prom");
+class OpenMetricsWriter {
+public:
+    void AddCounter(const char* name, const char* help, uint64_t value);
+    void AddGauge(const char* name, const char* help, double value);
+    void AddHistogram(const char* name, const char* help, const Histogram& histogram);
+    // PerfCounters totals as `<prefix>_perf_<event>_total{stage="..."}`
+    // families; nothing unless PerfCounters is running
+    void AddPerfCounters(const char* prefix);
+
+    // The exposition so far, terminated with "# EOF"
+    std::string Finish() const;
+
+    // Writes next to `path` and renames over it, so a scraper reading the
+    // file never sees a partial exposition
+    bool WriteToFile(const std::string& path) const;
+
+private:
+    std::string m_out;
+
+    void AppendFamily(const char* name, const char* type, const char* help);
+    void AppendSample(const char* name, const char* suffix, const char* labels, double value);
+};
@@ -1,11 +1,17 @@
 #include "NetworkReceiver.h"
-#include "FrameUtils.h"
 #include "VideoDecoder.h"
-#include <iostream>
+#include "SessionRecording.h"
+#include "Log.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+#include <algorithm>
 #include <chrono>
 #include <cerrno>
+#include <cstring>
 
-NetworkReceiver::NetworkReceiver() : m_isConnected(false) {
+NetworkReceiver::NetworkReceiver()
+    : m_payloadPool(VideoDecoder::kInputPaddingSize)
+    , m_isConnected(false) {
 #ifdef _WIN32
     // Initialize Winsock
     WSADATA wsaData;
@@ -118,12 +124,59 @@ bool NetworkReceiver::Connect(const std::string& serverIP, int port) {
         return false;
     }
 
+    // Open the decoder now so the first frame doesn't pay for codec setup
+    if (m_compression != COMPRESSION_NONE) {
+        m_decoder = PrepareDecoder(m_compression, m_streamWidth, m_streamHeight);
+    }
+
+    m_framesReceived = 0;
+    m_framesDecoded = 0;
+    m_framesPresented = 0;
+    m_framesSkipped = 0;
+    m_keyframeRequests = 0;
+    m_bytesReceived = 0;
+    m_framesMissing = 0;
+    m_keepalives = 0;
+    m_haveSequence = false;
+    {
+        std::lock_guard<std::mutex> lock(m_clockMutex);
+        m_clock.Reset();
+    }
+    m_lastClockPing = {};
+    {
+        std::lock_guard<std::mutex> lock(m_decodeTimesMutex);
+        m_decodeTimes.Clear();
+        m_latencies.Clear();
+    }
+    m_decodeSeconds.Reset();
+    m_latencySeconds.Reset();
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_hasPendingStats = false;
+    }
+    m_awaitingKeyframe = true; // Never decode a delta without its references
+    m_keyframeRequestPending = false;
+    m_decodeQueue.ResetHighWater();
+    m_latestFrame.ResetCounters();
+    if (!m_recordPath.empty()) {
+        m_recorder = std::make_unique<SessionWriter>();
+        if (!m_recorder->Open(m_recordPath)) {
+            m_recorder.reset(); // Stream anyway, just unrecorded
+        }
+    }
+    if (m_threaded) {
+        StartThreads();
+    }
+
     m_isConnected = true;
     return true;
 }
 
 void NetworkReceiver::Disconnect() {
-    m_isConnected = false;
+    bool wasConnected = m_isConnected.exchange(false);
+    
+    // The threads use the socket and the decoders; stop them first
+    StopThreads();
     
     if (m_socket != INVALID_SOCKET) {
 #ifdef _WIN32
@@ -133,95 +186,270 @@ void NetworkReceiver::Disconnect() {
 #endif
         m_socket = INVALID_SOCKET;
     }
+    m_parser.Reset();
+    
+    if (m_recorder) {
+        m_recorder->Close(); // Drains pending writes and appends the index
+        m_recorder.reset();
+    }
     
-    if (m_onDisconnected) {
+    // Frames queued in the decoders belong to the old stream
+    for (auto& decoder : m_decoders) {
+        if (decoder) {
+            decoder->Flush();
+        }
+    }
+    m_decodeQueue.Reset();
+    m_latestFrame.Reset([](ReadyFrame& frame) {
+        frame.kind = ReadyFrame::Kind::Empty;
+        frame.raw.Reset();
+        if (frame.picture) {
+            frame.picture->Reset();
+        }
+    });
+    
+    // Only notify once; the callback may call back into Disconnect()
+    if (wasConnected && m_onDisconnected) {
         m_onDisconnected();
     }
 }
 
+namespace {
+
+// Describes a decoded frame the way raw BGRA frames arrive on the wire
+FrameMessage MakeDecodedFrameMessage(const FrameMessage& frameMsg) {
+    FrameMessage decodedFrameMsg;
+    decodedFrameMsg.header.type = MSG_FRAME_DATA;
+    decodedFrameMsg.header.size = sizeof(FrameMessage);
+    decodedFrameMsg.width = frameMsg.width;
+    decodedFrameMsg.height = frameMsg.height;
+    decodedFrameMsg.dataSize = frameMsg.width * frameMsg.height * 4;
+    decodedFrameMsg.timing = frameMsg.timing;
+    return decodedFrameMsg;
+}
+
+} // namespace
+
 bool NetworkReceiver::PollFrame() {
     if (!m_isConnected || m_socket == INVALID_SOCKET) {
         return false;
     }
+    
+    if (m_threaded) {
+        DeliverPendingStats();
+        return PresentLatestFrame();
+    }
 
-    FrameMessage frameMsg;
-    std::vector<uint8_t> frameData;
+    MaybeSendClockPing();
     
-    // Try to receive a frame (non-blocking)
-    if (!ReceiveFrame(frameMsg, frameData)) {
-        return false; // No frame available or connection error
+    // Try to receive a message (non-blocking, resumes partial messages)
+    ParsedMessage msg;
+    FrameParser::Status status = ReceiveMessage(msg);
+    if (status == FrameParser::Status::Error) {
+        if (m_onError) {
+            m_onError("Connection lost or stream corrupted");
+        }
+        Disconnect();
+        return false;
+    }
+    if (status != FrameParser::Status::Message) {
+        return false; // No complete message available
     }
     
-    // Debug: Print received message details
-    std::cout << "Received message - Type: " << std::dec << frameMsg.header.type 
-              << ", Size: " << frameMsg.header.size 
-              << ", Width: " << frameMsg.width 
-              << ", Height: " << frameMsg.height << std::endl;
+    ReceivedFrame frame;
+    if (!ToReceivedFrame(msg, frame)) {
+        return true; // Not a frame, or a corrupted one; nothing to present
+    }
+    m_framesReceived++;
     
     // Notify about raw frame type received
     if (m_onRawFrameReceived) {
-        m_onRawFrameReceived(frameMsg.header.type);
+        m_onRawFrameReceived(frame.frameMsg.header.type);
     }
     
-    // Handle different message types
+    if (frame.frameMsg.header.type == MSG_COMPRESSED_FRAME) {
+        DecodeAndPresent(frame);
+    } else {
+        PresentRawFrame(frame.frameMsg, std::span<const uint8_t>(frame.payload.data(), frame.payload.size()));
+        m_framesPresented++;
+        RecordPresentLatency(frame.frameMsg);
+    }
+    return true; // Frame received and processed
+}
+
+bool NetworkReceiver::ToReceivedFrame(ParsedMessage& msg, ReceivedFrame& frame) {
+    MR_TRACE_SCOPE("parse");
+    MR_PERF_SCOPE(PerfStage::Parse);
+    if (msg.header.type == MSG_STATS) {
+        OnStatsMessage(msg.As<StatsMessage>());
+        return false;
+    }
+    if (msg.header.type == MSG_CLOCK_PONG) {
+        OnClockPong(msg.As<ClockPongMessage>());
+        return false;
+    }
+    if (msg.header.type == MSG_KEEPALIVE) {
+        // The frame on screen is still current; nothing to decode
+        m_keepalives++;
+        MR_LOG_DEBUG("Keepalive: frame seq=" << msg.As<KeepaliveMessage>().lastSequence << " unchanged for "
+                     << msg.As<KeepaliveMessage>().framesUnchanged << " captures");
+        return false;
+    }
+    if (msg.header.type != MSG_FRAME_DATA && msg.header.type != MSG_COMPRESSED_FRAME) {
+        return false;
+    }
+    
+    FrameMessage& frameMsg = frame.frameMsg;
+    frameMsg.header = msg.header;
+    frame.codec = COMPRESSION_NONE;
+    if (msg.header.type == MSG_COMPRESSED_FRAME) {
+        const CompressedFrameMessage& compFrameMsg = msg.As<CompressedFrameMessage>();
+        frameMsg.width = compFrameMsg.width;
+        frameMsg.height = compFrameMsg.height;
+        frameMsg.dataSize = compFrameMsg.compressedSize;
+        frameMsg.timing = compFrameMsg.timing;
+        frame.isKeyframe = compFrameMsg.isKeyframe != 0;
+        // Older servers leave the codec zero; assume the negotiated one
+        frame.codec = compFrameMsg.compression != COMPRESSION_NONE ? compFrameMsg.compression : m_compression;
+    } else {
+        frameMsg = msg.As<FrameMessage>();
+    }
+    frame.payload = std::move(msg.payload);
+    m_bytesReceived += msg.header.size + frame.payload.size();
+    TrackSequence(frameMsg);
+    
+    MR_LOG_DEBUG("Received message - Type: " << frameMsg.header.type 
+                 << ", Size: " << frameMsg.header.size 
+                 << ", Width: " << frameMsg.width 
+                 << ", Height: " << frameMsg.height);
+    
     if (frameMsg.header.type == MSG_COMPRESSED_FRAME) {
-        // Use frameMsg fields directly (populated by FrameUtils)
-        std::cout << "Received compressed frame: " << frameMsg.dataSize << " bytes" << std::endl;
+        MR_LOG_DEBUG("Received compressed frame: " << frameMsg.dataSize << " bytes");
         
-        // Initialize decoder if needed
-        if (!m_decoder && m_compression != COMPRESSION_NONE) {
-            m_decoder = std::make_unique<VideoDecoder>();
-            if (!m_decoder->Initialize(frameMsg.width, frameMsg.height, m_compression)) {
-                std::cerr << "Failed to initialize video decoder" << std::endl;
-                m_decoder.reset();
-                return true; // Skip this frame
-            } else {
-                std::cout << "Video decoder initialized successfully" << std::endl;
-            }
+        if (frameMsg.width == 0 || frameMsg.height == 0 || frameMsg.width > 10000 || frameMsg.height > 10000) {
+            MR_LOG_RATE_LIMITED(LogLevel::Warn, 1000,
+                                "Skipping corrupted frame (" << frameMsg.width << "x" << frameMsg.height << ")");
+            m_awaitingKeyframe = true; // Later deltas may reference it
+            return false;
         }
         
-        // Decode frame if decoder is available
-        if (m_decoder) {
-            std::vector<uint8_t> decodedFrame;
-            if (m_decoder->DecodeFrame(frameData.data(), frameData.size(), decodedFrame)) {
-                // Create a FrameMessage for the decoded frame
-                FrameMessage decodedFrameMsg;
-                decodedFrameMsg.header.type = MSG_FRAME_DATA;
-                decodedFrameMsg.header.size = sizeof(FrameMessage);
-                decodedFrameMsg.width = frameMsg.width;
-                decodedFrameMsg.height = frameMsg.height;
-                decodedFrameMsg.dataSize = static_cast<uint32_t>(decodedFrame.size());
-                
-                // Call frame received callback with decoded frame
-                if (m_onFrameReceived) {
-                    m_onFrameReceived(decodedFrameMsg, decodedFrame);
+        if (m_recorder) {
+            m_recorder->Append(frameMsg.width, frameMsg.height, frame.codec, frame.isKeyframe, frame.payload);
+        }
+        if (m_onCompressedFrame) {
+            m_onCompressedFrame(frameMsg, frame.codec, frame.isKeyframe,
+                                std::span<const uint8_t>(frame.payload.data(), frame.payload.size()));
+        }
+    } else if (frameMsg.width > 10000 || frameMsg.height > 10000 || frameMsg.dataSize > 100000000) {
+        MR_LOG_RATE_LIMITED(LogLevel::Warn, 1000, "Skipping corrupted frame (Type: " << frameMsg.header.type << ")");
+        return false;
+    }
+    return true;
+}
+
+void NetworkReceiver::DecodeAndPresent(ReceivedFrame& frame) {
+    VideoDecoder* decoder = SelectDecoder(frame.frameMsg, frame.codec);
+    if (!decoder || !ShouldDecode(frame)) {
+        return; // Skip this frame
+    }
+    const BufferHandle& frameData = frame.payload;
+    
+    // Create a FrameMessage for the decoded frame
+    FrameMessage decodedFrameMsg = MakeDecodedFrameMessage(frame.frameMsg);
+    
+    // Presentation memory, if the app provides it
+    FrameDestination target;
+    bool haveTarget = m_acquireFrameTarget && m_acquireFrameTarget(decodedFrameMsg, target);
+    
+    int64_t tag = RememberTiming(frame.frameMsg);
+    bool decoded = false;
+    if (m_onPictureReceived) {
+        // Decode to YUV; convert only if someone also wants pixels
+        if (!m_picture) {
+            m_picture = std::make_unique<DecodedPicture>();
+        }
+        auto decodeStart = std::chrono::steady_clock::now();
+        decoded = decoder->DecodeFrame(frameData, *m_picture, tag);
+        RecordDecodeTime(decoded, decodeStart);
+        if (decoded) {
+            RestoreTiming(decoder->GetLastFrameTag(), decodedFrameMsg);
+            m_onPictureReceived(decodedFrameMsg, *m_picture);
+            
+            if (haveTarget) {
+                if (decoder->ConvertTo(*m_picture, target) && m_onFrameWritten) {
+                    m_onFrameWritten(decodedFrameMsg);
                 }
-            } else {
-                std::cout << "Failed to decode compressed frame" << std::endl;
+            } else if (m_onFrameReceived && decoder->ConvertToBGRA(*m_picture, m_decodedFrame)) {
+                m_onFrameReceived(decodedFrameMsg, m_decodedFrame);
+            }
+        }
+    } else if (haveTarget) {
+        // Color conversion writes straight into presentation memory
+        auto decodeStart = std::chrono::steady_clock::now();
+        decoded = decoder->DecodeFrame(frameData, target, tag);
+        RecordDecodeTime(decoded, decodeStart);
+        if (decoded) {
+            RestoreTiming(decoder->GetLastFrameTag(), decodedFrameMsg);
+        }
+        if (decoded && m_onFrameWritten) {
+            m_onFrameWritten(decodedFrameMsg);
+        }
+    } else {
+        auto decodeStart = std::chrono::steady_clock::now();
+        decoded = decoder->DecodeFrame(frameData, m_decodedFrame, tag);
+        RecordDecodeTime(decoded, decodeStart);
+        if (decoded) {
+            RestoreTiming(decoder->GetLastFrameTag(), decodedFrameMsg);
+            decodedFrameMsg.dataSize = static_cast<uint32_t>(m_decodedFrame.size());
+            
+            // Call frame received callback with decoded frame
+            if (m_onFrameReceived) {
+                m_onFrameReceived(decodedFrameMsg, m_decodedFrame);
             }
         }
-        
-        return true; // Frame received and processed
-    } else if (frameMsg.header.type != MSG_FRAME_DATA || 
-               frameMsg.width > 10000 || frameMsg.height > 10000 ||
-               frameMsg.dataSize > 100000000) {
-        std::cout << "Skipping corrupted frame (Type: " << frameMsg.header.type << ")" << std::endl;
-        return true; // Frame received but not processed
+    }
+    
+    if (decoder->HadDecodeError()) {
+        OnReferenceLost(*decoder);
+    }
+    if (!decoded) {
+        MR_LOG_RATE_LIMITED(LogLevel::Warn, 1000, "Failed to decode compressed frame");
+        return;
+    }
+    m_framesDecoded++;
+    m_framesPresented++;
+    RecordPresentLatency(decodedFrameMsg);
+}
+
+void NetworkReceiver::PresentRawFrame(const FrameMessage& frameMsg, std::span<const uint8_t> frameData) {
+    // Raw BGRA goes straight into presentation memory when available
+    FrameDestination target;
+    if (m_acquireFrameTarget && m_acquireFrameTarget(frameMsg, target) &&
+        CopyFrameToTarget(frameMsg, frameData, target)) {
+        if (m_onFrameWritten) {
+            m_onFrameWritten(frameMsg);
+        }
+        return;
     }
     
     // Call frame received callback
     if (m_onFrameReceived) {
         m_onFrameReceived(frameMsg, frameData);
     }
-    
-    return true; // Frame successfully received and processed
 }
 
-bool NetworkReceiver::ReceiveFrame(FrameMessage& frameMsg, std::vector<uint8_t>& frameData, int /*frameNumber*/) {
-    if (m_socket == INVALID_SOCKET) return false;
+FrameParser::Status NetworkReceiver::ReceiveMessage(ParsedMessage& msg) {
+    if (m_socket == INVALID_SOCKET) return FrameParser::Status::Error;
 
     auto recvWrapper = [this](uint8_t* buf, int len) -> int {
+        TraceScope recvScope("recv");
         int r = recv(m_socket, reinterpret_cast<char*>(buf), len, 0);
+        if (r <= 0) {
+            recvScope.Discard(); // Only trace reads that returned data
+        }
+        if (r == 0) {
+            return -1; // Peer closed the connection
+        }
         if (r == SOCKET_ERROR) {
 #ifdef _WIN32
             if (WSAGetLastError() == WSAEWOULDBLOCK)
@@ -235,12 +463,91 @@ bool NetworkReceiver::ReceiveFrame(FrameMessage& frameMsg, std::vector<uint8_t>&
         return r;
     };
 
-    std::vector<uint8_t> temp;
-    bool ok = ReadFrameGeneric(recvWrapper, frameMsg, temp);
-    if (ok) {
-        frameData.swap(temp);
+    return m_parser.Poll(recvWrapper, msg);
+}
+
+VideoDecoder* NetworkReceiver::SelectDecoder(const FrameMessage& frameMsg, CompressionType codec) {
+    // Follow codec and resolution changes announced in the frame header
+    if (!m_decoder || m_decoder->GetCompressionType() != codec ||
+        m_decoder->GetWidth() != frameMsg.width || m_decoder->GetHeight() != frameMsg.height) {
+        VideoDecoder* previous = m_decoder;
+        m_decoder = PrepareDecoder(codec, frameMsg.width, frameMsg.height);
+        if (!m_decoder) {
+            MR_LOG_ERROR("Failed to initialize video decoder");
+            return nullptr;
+        }
+        if (previous && previous != m_decoder) {
+            previous->Flush(); // Release frames of the old codec's stream
+        }
+        m_streamWidth = frameMsg.width;
+        m_streamHeight = frameMsg.height;
+        m_awaitingKeyframe = true; // The new stream starts at a keyframe
+    }
+    return m_decoder;
+}
+
+bool NetworkReceiver::ShouldDecode(const ReceivedFrame& frame) {
+    if (!m_awaitingKeyframe) {
+        return true;
+    }
+    if (frame.isKeyframe) {
+        m_awaitingKeyframe = false;
+        m_keyframeRequestPending = false;
+        return true;
     }
-    return ok;
+    
+    // This delta references pictures we don't have; decoding it would only
+    // smear, so drop it unseen and ask for a keyframe
+    m_framesSkipped++;
+    RequestKeyframe();
+    return false;
+}
+
+void NetworkReceiver::OnReferenceLost(VideoDecoder& decoder) {
+    MR_LOG_INFO("Decoder reference chain broken, waiting for keyframe");
+    if (m_onDecodeError) {
+        m_onDecodeError();
+    }
+    decoder.Flush();
+    m_awaitingKeyframe = true;
+    RequestKeyframe();
+}
+
+void NetworkReceiver::RequestKeyframe() {
+    // One request per round trip; only repeat if the keyframe never came
+    // (e.g. an older server that ignores the request)
+    auto now = std::chrono::steady_clock::now();
+    if (m_keyframeRequestPending && now - m_lastKeyframeRequest < kKeyframeRequestRetry) {
+        return;
+    }
+    if (SendKeyframeRequest()) {
+        m_lastKeyframeRequest = now;
+        m_keyframeRequestPending = true;
+        m_keyframeRequests++;
+    }
+}
+
+VideoDecoder* NetworkReceiver::PrepareDecoder(CompressionType codec, uint32_t width, uint32_t height) {
+    if (codec == COMPRESSION_NONE || static_cast<size_t>(codec) >= kCodecSlots) {
+        return nullptr;
+    }
+    
+    std::unique_ptr<VideoDecoder>& decoder = m_decoders[codec];
+    if (!decoder || !decoder->IsInitialized()) {
+        decoder = std::make_unique<VideoDecoder>();
+        if (!decoder->Initialize(width, height, codec)) {
+            decoder.reset();
+            return nullptr;
+        }
+        MR_LOG_INFO("Video decoder initialized successfully");
+    } else if (decoder->GetWidth() != width || decoder->GetHeight() != height) {
+        // Same codec, new size: flush and carry on without reopening
+        if (!decoder->Reconfigure(width, height)) {
+            decoder.reset();
+            return nullptr;
+        }
+    }
+    return decoder.get();
 }
 
 bool NetworkReceiver::SendCompressionRequest(CompressionType compression) {
@@ -251,8 +558,17 @@ bool NetworkReceiver::SendCompressionRequest(CompressionType compression) {
     msg.header.size = sizeof(CompressionRequestMessage);
     msg.compression = compression;
     
-    int sent = send(m_socket, reinterpret_cast<const char*>(&msg), sizeof(msg), 0);
-    return sent == sizeof(msg);
+    return SendBytes(&msg, sizeof(msg));
+}
+
+bool NetworkReceiver::SendKeyframeRequest() {
+    if (m_socket == INVALID_SOCKET) return false;
+    
+    KeyframeRequestMessage msg;
+    msg.header.type = MSG_KEYFRAME_REQUEST;
+    msg.header.size = sizeof(KeyframeRequestMessage);
+    
+    return SendBytes(&msg, sizeof(msg));
 }
 
 bool NetworkReceiver::SendMouseMove(int32_t deltaX, int32_t deltaY, bool absolute, int32_t x, int32_t y) {
@@ -267,8 +583,7 @@ bool NetworkReceiver::SendMouseMove(int32_t deltaX, int32_t deltaY, bool absolut
     msg.x = x;
     msg.y = y;
     
-    int sent = send(m_socket, reinterpret_cast<const char*>(&msg), sizeof(msg), 0);
-    return sent == sizeof(msg);
+    return SendBytes(&msg, sizeof(msg));
 }
 
 bool NetworkReceiver::SendMouseClick(MouseClickMessage::MouseButton button, bool pressed) {
@@ -280,8 +595,7 @@ bool NetworkReceiver::SendMouseClick(MouseClickMessage::MouseButton button, bool
     msg.button = button;
     msg.pressed = pressed ? 1 : 0;
     
-    int sent = send(m_socket, reinterpret_cast<const char*>(&msg), sizeof(msg), 0);
-    return sent == sizeof(msg);
+    return SendBytes(&msg, sizeof(msg));
 }
 
 bool NetworkReceiver::SendMouseScroll(int32_t deltaX, int32_t deltaY) {
@@ -293,6 +607,421 @@ bool NetworkReceiver::SendMouseScroll(int32_t deltaX, int32_t deltaY) {
     msg.deltaX = deltaX;
     msg.deltaY = deltaY;
     
-    int sent = send(m_socket, reinterpret_cast<const char*>(&msg), sizeof(msg), 0);
-    return sent == sizeof(msg);
-}
\ No newline at end of file
+    return SendBytes(&msg, sizeof(msg));
+}
+
+bool NetworkReceiver::SendBytes(const void* data, size_t size) {
+    // Input comes from the UI thread, keyframe requests from the decode thread
+    std::lock_guard<std::mutex> lock(m_sendMutex);
+    int sent = send(m_socket, static_cast<const char*>(data), static_cast<int>(size), 0);
+    return sent == static_cast<int>(size);
+}
+
+bool NetworkReceiver::CopyFrameToTarget(const FrameMessage& frameMsg, std::span<const uint8_t> frameData,
+                                        const FrameDestination& target) {
+    size_t rowBytes = static_cast<size_t>(frameMsg.width) * 4;
+    if (!target.data || target.format != PixelFormat::BGRA ||
+        target.width != frameMsg.width || target.height != frameMsg.height ||
+        frameData.size() < rowBytes * frameMsg.height) {
+        return false;
+    }
+    
+    for (uint32_t y = 0; y < frameMsg.height; y++) {
+        memcpy(target.data + static_cast<ptrdiff_t>(y) * target.stride, frameData.data() + y * rowBytes, rowBytes);
+    }
+    return true;
+}
+
+ReceiverStats NetworkReceiver::GetStats() {
+    ReceiverStats stats;
+    stats.framesReceived = m_framesReceived;
+    stats.framesDecoded = m_framesDecoded;
+    stats.framesPresented = m_framesPresented;
+    stats.framesDropped = m_latestFrame.GetDropped();
+    stats.framesSkipped = m_framesSkipped;
+    stats.bytesReceived = m_bytesReceived;
+    stats.keyframeRequests = m_keyframeRequests;
+    stats.framesMissing = m_framesMissing;
+    stats.keepalives = m_keepalives;
+    stats.queueHighWater = m_decodeQueue.GetHighWater();
+    return stats;
+}
+
+void NetworkReceiver::OnStatsMessage(const StatsMessage& stats) {
+    if (!m_onStats) {
+        return;
+    }
+    if (!m_threaded) {
+        m_onStats(stats);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_pendingStats = stats;
+    m_hasPendingStats = true;
+}
+
+void NetworkReceiver::DeliverPendingStats() {
+    StatsMessage stats;
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        if (!m_hasPendingStats) {
+            return;
+        }
+        stats = m_pendingStats;
+        m_hasPendingStats = false;
+    }
+    if (m_onStats) {
+        m_onStats(stats);
+    }
+}
+
+void NetworkReceiver::OnClockPong(const ClockPongMessage& pong) {
+    uint64_t receivedUs = ClockNowUs();
+    std::lock_guard<std::mutex> lock(m_clockMutex);
+    m_clock.AddSample(pong.clientSendUs, pong.serverReceiveUs, pong.serverSendUs, receivedUs);
+}
+
+void NetworkReceiver::MaybeSendClockPing() {
+    size_t samples;
+    {
+        std::lock_guard<std::mutex> lock(m_clockMutex);
+        samples = m_clock.GetSampleCount();
+    }
+    auto interval = samples < ClockOffsetEstimator::kWindow ? kClockPingFastInterval : kClockPingInterval;
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_lastClockPing < interval) {
+        return;
+    }
+    m_lastClockPing = now;
+    
+    ClockPingMessage ping{};
+    ping.header.type = MSG_CLOCK_PING;
+    ping.header.size = sizeof(ClockPingMessage);
+    ping.clientSendUs = ClockNowUs();
+    SendBytes(&ping, sizeof(ping)); // Servers that predate clock sync skip it
+}
+
+bool NetworkReceiver::GetClockOffset(int64_t& offsetUs, int64_t& roundTripUs) {
+    std::lock_guard<std::mutex> lock(m_clockMutex);
+    if (!m_clock.HasEstimate()) {
+        return false;
+    }
+    offsetUs = m_clock.GetOffsetUs();
+    roundTripUs = m_clock.GetRoundTripUs();
+    return true;
+}
+
+void NetworkReceiver::TrackSequence(const FrameMessage& frameMsg) {
+    if (frameMsg.timing.version == 0) {
+        return; // Older server
+    }
+    uint32_t sequence = frameMsg.timing.sequence;
+    if (m_haveSequence && sequence != m_nextSequence) {
+        uint32_t missing = sequence - m_nextSequence;
+        m_framesMissing += missing;
+        MR_LOG_RATE_LIMITED(LogLevel::Warn, 1000, "Frame sequence gap: expected " << m_nextSequence
+                            << ", got " << sequence);
+    }
+    m_nextSequence = sequence + 1;
+    m_haveSequence = true;
+}
+
+int64_t NetworkReceiver::RememberTiming(const FrameMessage& frameMsg) {
+    if (frameMsg.timing.version == 0) {
+        return VideoDecoder::kNoTag; // Older server: no sequence numbers
+    }
+    m_decodeTimings[frameMsg.timing.sequence % kDecodeTimingSlots] = frameMsg.timing;
+    return frameMsg.timing.sequence;
+}
+
+void NetworkReceiver::RestoreTiming(int64_t tag, FrameMessage& decodedFrameMsg) const {
+    if (tag == VideoDecoder::kNoTag) {
+        return;
+    }
+    const FrameTiming& timing = m_decodeTimings[static_cast<uint64_t>(tag) % kDecodeTimingSlots];
+    if (timing.version != 0 && timing.sequence == static_cast<uint32_t>(tag)) {
+        decodedFrameMsg.timing = timing;
+    }
+}
+
+void NetworkReceiver::RecordPresentLatency(const FrameMessage& frameMsg) {
+    if (frameMsg.timing.version == 0) {
+        return;
+    }
+    uint64_t nowUs = ClockNowUs();
+    uint64_t captureLocalUs;
+    uint64_t nowServerUs;
+    {
+        std::lock_guard<std::mutex> lock(m_clockMutex);
+        if (!m_clock.HasEstimate()) {
+            return;
+        }
+        captureLocalUs = m_clock.ToLocalUs(frameMsg.timing.captureTimeUs);
+        nowServerUs = m_clock.ToServerUs(nowUs);
+    }
+    double ms = static_cast<int64_t>(nowUs - captureLocalUs) / 1000.0;
+    m_latencySeconds.Observe(std::max(ms, 0.0) / 1000.0); // Below zero is estimate error
+    if (m_collectDecodeTimes) {
+        std::lock_guard<std::mutex> lock(m_decodeTimesMutex);
+        m_latencies.Add(ms);
+    }
+    // Both timestamps on the server's clock, so these line up with its log
+    MR_LOG_DEBUG("Presented frame seq=" << frameMsg.timing.sequence << " capture=" << frameMsg.timing.captureTimeUs
+                 << "us present=" << nowServerUs << "us latency=" << ms << "ms");
+}
+
+void NetworkReceiver::WriteMetrics(OpenMetricsWriter& metrics) {
+    ReceiverStats stats = GetStats();
+    metrics.AddCounter("mrdesktop_client_frames_received", "Frames received from the server", stats.framesReceived);
+    metrics.AddCounter("mrdesktop_client_frames_decoded", "Compressed frames decoded", stats.framesDecoded);
+    metrics.AddCounter("mrdesktop_client_frames_presented", "Frames handed to the presenter", stats.framesPresented);
+    metrics.AddCounter("mrdesktop_client_frames_dropped", "Decoded frames replaced by a newer one before presentation",
+                       stats.framesDropped);
+    metrics.AddCounter("mrdesktop_client_frames_skipped", "Deltas discarded while waiting for a keyframe",
+                       stats.framesSkipped);
+    metrics.AddCounter("mrdesktop_client_keyframe_requests", "Keyframes requested from the server",
+                       stats.keyframeRequests);
+    metrics.AddCounter("mrdesktop_client_frames_missing", "Gaps in the server's frame sequence numbers",
+                       stats.framesMissing);
+    metrics.AddCounter("mrdesktop_client_keepalives", "Keepalives received while the server's screen was unchanged",
+                       stats.keepalives);
+    metrics.AddCounter("mrdesktop_client_bytes_received", "Frame message bytes received", stats.bytesReceived);
+    metrics.AddGauge("mrdesktop_client_decode_queue_depth", "Frames waiting for the decode thread",
+                     static_cast<double>(m_decodeQueue.Size()));
+    metrics.AddGauge("mrdesktop_client_decode_queue_high_water", "Deepest the decode queue got since connecting",
+                     static_cast<double>(stats.queueHighWater));
+    metrics.AddHistogram("mrdesktop_client_decode_seconds", "Decode time per frame", m_decodeSeconds);
+    metrics.AddHistogram("mrdesktop_client_latency_seconds", "Capture on the server to presentation here",
+                         m_latencySeconds);
+    int64_t offsetUs = 0;
+    int64_t roundTripUs = 0;
+    if (GetClockOffset(offsetUs, roundTripUs)) {
+        metrics.AddGauge("mrdesktop_client_clock_offset_seconds", "Server clock minus client clock", offsetUs / 1e6);
+        metrics.AddGauge("mrdesktop_client_clock_round_trip_seconds", "Round trip of the clock offset estimate",
+                         roundTripUs / 1e6);
+    }
+}
+
+SampleStats NetworkReceiver::GetDecodeTimes() {
+    std::lock_guard<std::mutex> lock(m_decodeTimesMutex);
+    return m_decodeTimes;
+}
+
+SampleStats NetworkReceiver::GetLatencies() {
+    std::lock_guard<std::mutex> lock(m_decodeTimesMutex);
+    return m_latencies;
+}
+
+void NetworkReceiver::RecordDecodeTime(bool decoded, std::chrono::steady_clock::time_point start) {
+    if (!decoded) {
+        return;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_decodeSeconds.Observe(ms / 1000.0);
+    if (!m_collectDecodeTimes) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_decodeTimesMutex);
+    m_decodeTimes.Add(ms);
+}
+
+void NetworkReceiver::StartThreads() {
+    // Decoding to YUV only pays off if the presenter converts into its own
+    // memory or wants the planes; otherwise convert on the decode thread
+    m_decodeToPicture = VideoDecoder::kHasPictureOutput && (m_onPictureReceived || m_acquireFrameTarget);
+    if (!m_converter) {
+        m_converter = std::make_unique<FrameConverter>();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_streamErrorMutex);
+        m_streamError.clear();
+    }
+    m_streamEnded = false;
+    m_threadsRunning = true;
+    m_decodeThread = std::thread(&NetworkReceiver::DecodeThreadMain, this);
+    m_receiveThread = std::thread(&NetworkReceiver::ReceiveThreadMain, this);
+}
+
+void NetworkReceiver::StopThreads() {
+    m_threadsRunning = false;
+    m_decodeQueue.Close();
+    if (m_receiveThread.joinable()) {
+        m_receiveThread.join();
+    }
+    if (m_decodeThread.joinable()) {
+        m_decodeThread.join();
+    }
+}
+
+bool NetworkReceiver::WaitReadable(int timeoutMs) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(m_socket, &readSet);
+    timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+#ifdef _WIN32
+    int result = select(0, &readSet, nullptr, nullptr, &timeout);
+#else
+    int result = select(m_socket + 1, &readSet, nullptr, nullptr, &timeout);
+#endif
+    // On failure let recv() report what went wrong
+    return result != 0;
+}
+
+void NetworkReceiver::ReceiveThreadMain() {
+    Trace::SetThreadName("receive");
+    while (m_threadsRunning) {
+        if (!WaitReadable(kReceiveWaitMs)) {
+            continue;
+        }
+        
+        MaybeSendClockPing();
+        
+        // Drain everything that has arrived before waiting again
+        FrameParser::Status status;
+        for (;;) {
+            ParsedMessage msg;
+            status = ReceiveMessage(msg);
+            if (status != FrameParser::Status::Message) {
+                break;
+            }
+            ReceivedFrame frame;
+            if (!ToReceivedFrame(msg, frame)) {
+                continue;
+            }
+            m_framesReceived++;
+            // Blocks while the decoder is behind, which pushes back on the socket
+            if (!m_decodeQueue.Push(std::move(frame))) {
+                return; // Shutting down
+            }
+        }
+        
+        if (status == FrameParser::Status::Error) {
+            {
+                std::lock_guard<std::mutex> lock(m_streamErrorMutex);
+                m_streamError = "Connection lost or stream corrupted";
+            }
+            // Let the decode thread finish what is queued, then report from PollFrame()
+            m_decodeQueue.Close();
+            return;
+        }
+    }
+}
+
+void NetworkReceiver::DecodeThreadMain() {
+    Trace::SetThreadName("decode");
+    ReceivedFrame frame;
+    while (m_decodeQueue.Pop(frame)) {
+        if (!m_threadsRunning) {
+            break;
+        }
+        if (DecodeReadyFrame(frame, m_latestFrame.WriteSlot())) {
+            m_latestFrame.Publish();
+        }
+        frame = ReceivedFrame(); // Return the payload to the pool
+    }
+    m_streamEnded = true;
+}
+
+bool NetworkReceiver::DecodeReadyFrame(ReceivedFrame& frame, ReadyFrame& ready) {
+    ready.wireType = frame.frameMsg.header.type;
+    ready.raw.Reset();
+    
+    if (frame.frameMsg.header.type == MSG_FRAME_DATA) {
+        ready.kind = ReadyFrame::Kind::Raw;
+        ready.frameMsg = frame.frameMsg;
+        ready.raw = std::move(frame.payload);
+        return true;
+    }
+    
+    VideoDecoder* decoder = SelectDecoder(frame.frameMsg, frame.codec);
+    if (!decoder || !ShouldDecode(frame)) {
+        return false;
+    }
+    
+    ready.frameMsg = MakeDecodedFrameMessage(frame.frameMsg);
+    if (m_decodeToPicture && !ready.picture) {
+        ready.picture = std::make_unique<DecodedPicture>();
+    }
+    int64_t tag = RememberTiming(frame.frameMsg);
+    bool decoded;
+    auto decodeStart = std::chrono::steady_clock::now();
+    if (m_decodeToPicture) {
+        decoded = decoder->DecodeFrame(frame.payload, *ready.picture, tag);
+        ready.kind = ReadyFrame::Kind::Picture;
+    } else {
+        decoded = decoder->DecodeFrame(frame.payload, ready.bgra, tag);
+        ready.frameMsg.dataSize = static_cast<uint32_t>(ready.bgra.size());
+        ready.kind = ReadyFrame::Kind::Bgra;
+    }
+    RecordDecodeTime(decoded, decodeStart);
+    if (decoder->HadDecodeError()) {
+        OnReferenceLost(*decoder);
+    }
+    if (!decoded) {
+        MR_LOG_RATE_LIMITED(LogLevel::Warn, 1000, "Failed to decode compressed frame");
+        return false;
+    }
+    RestoreTiming(decoder->GetLastFrameTag(), ready.frameMsg);
+    m_framesDecoded++;
+    return true;
+}
+
+bool NetworkReceiver::PresentLatestFrame() {
+    if (!m_latestFrame.Acquire()) {
+        // Nothing new. If the stream is gone and everything decoded has been
+        // presented, report it the way polling mode does.
+        if (m_streamEnded && !m_latestFrame.HasFresh()) {
+            std::string error;
+            {
+                std::lock_guard<std::mutex> lock(m_streamErrorMutex);
+                error = m_streamError;
+            }
+            if (!error.empty() && m_onError) {
+                m_onError(error);
+            }
+            Disconnect();
+        }
+        return false;
+    }
+    
+    ReadyFrame& ready = m_latestFrame.ReadSlot();
+    m_framesPresented++;
+    
+    if (m_onRawFrameReceived) {
+        m_onRawFrameReceived(ready.wireType);
+    }
+    
+    switch (ready.kind) {
+        case ReadyFrame::Kind::Raw:
+            PresentRawFrame(ready.frameMsg, std::span<const uint8_t>(ready.raw.data(), ready.raw.size()));
+            ready.raw.Reset(); // Return the payload to the pool
+            break;
+            
+        case ReadyFrame::Kind::Bgra:
+            PresentRawFrame(ready.frameMsg, ready.bgra);
+            break;
+            
+        case ReadyFrame::Kind::Picture: {
+            const DecodedPicture& picture = *ready.picture;
+            if (m_onPictureReceived) {
+                m_onPictureReceived(ready.frameMsg, picture);
+            }
+            FrameDestination target;
+            if (m_acquireFrameTarget && m_acquireFrameTarget(ready.frameMsg, target)) {
+                if (m_converter->ConvertTo(picture, target) && m_onFrameWritten) {
+                    m_onFrameWritten(ready.frameMsg);
+                }
+            } else if (m_onFrameReceived && m_converter->ConvertToBGRA(picture, m_decodedFrame)) {
+                m_onFrameReceived(ready.frameMsg, m_decodedFrame);
+            }
+            break;
+        }
+            
+        case ReadyFrame::Kind::Empty:
+            break;
+    }
+    RecordPresentLatency(ready.frameMsg);
+    return true;
+}
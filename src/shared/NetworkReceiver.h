@@ -1,18 +1,30 @@
 #pragma once
 
 #include "protocol.h"
+#include "BufferPool.h"
+#include "Clock.h"
+#include "FrameParser.h"
+#include "Metrics.h"
+#include "PixelFormat.h"
+#include "SampleStats.h"
+#include "BoundedQueue.h"
+#include "TripleBuffer.h"
 #include <vector>
+#include <span>
 #include <chrono>
 #include <functional>
 #include <string>
 #include <atomic>
 #include <memory>
+#include <mutex>
+#include <thread>
 #ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
 using SocketType = SOCKET;
 #else
 #include <sys/socket.h>
+#include <sys/select.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
@@ -29,22 +41,156 @@ using SocketType = int;
 #endif
 
 class VideoDecoder;
+class DecodedPicture;
+class FrameConverter;
+class SessionWriter;
+
+// Frame counters since Connect(). In threaded mode framesDropped counts
+// decoded frames that were replaced by a newer one before PollFrame() got
+// to present them.
+struct ReceiverStats {
+    uint64_t framesReceived = 0;
+    uint64_t framesDecoded = 0;
+    uint64_t framesPresented = 0;
+    uint64_t framesDropped = 0;
+    uint64_t framesSkipped = 0;    // Deltas discarded undecoded while waiting for a keyframe
+    uint64_t keyframeRequests = 0;
+    uint64_t framesMissing = 0;    // Gaps in the server's frame sequence numbers
+    uint64_t keepalives = 0;       // Server said its screen was unchanged
+    uint64_t bytesReceived = 0;    // Frame messages including headers
+    size_t queueHighWater = 0; // Deepest the receive -> decode queue got
+};
 
 class NetworkReceiver {
 private:
     SocketType m_socket = INVALID_SOCKET;
-    std::vector<uint8_t> m_frameBuffer;
+    
+    // Incremental message parsing; payloads come from the pool and are
+    // recycled once the last consumer drops them. The pool pads every buffer
+    // for the decoder, so compressed payloads are decoded in place.
+    BufferPool m_payloadPool;
+    FrameParser m_parser{m_payloadPool};
     CompressionType m_compression = COMPRESSION_H265;
     std::atomic<bool> m_isConnected{false};
     
-    // Video decoder for compressed frames
-    std::unique_ptr<VideoDecoder> m_decoder;
+    // Video decoders for compressed frames, one per codec so switching codecs
+    // mid-stream reuses an already opened decoder. m_decoder is the active one.
+    static constexpr size_t kCodecSlots = 4; // Indexed by CompressionType
+    std::unique_ptr<VideoDecoder> m_decoders[kCodecSlots];
+    VideoDecoder* m_decoder = nullptr;
+    uint32_t m_streamWidth = 1920;  // Last stream size; decoders are pre-warmed with it
+    uint32_t m_streamHeight = 1080;
+    
+    // Decoded BGRA output, reused across frames so steady-state polling
+    // does not allocate
+    std::vector<uint8_t> m_decodedFrame;
+    
+    // Decoded YUV picture, reused across frames
+    std::unique_ptr<DecodedPicture> m_picture;
+    
+    // A frame as it came off the wire. Compressed frames are described
+    // through the FrameMessage view as well.
+    struct ReceivedFrame {
+        FrameMessage frameMsg{};
+        CompressionType codec = COMPRESSION_NONE;
+        bool isKeyframe = false;
+        BufferHandle payload;
+    };
+    
+    // A frame ready to be presented: raw pixels from the wire, BGRA from the
+    // decoder, or a YUV picture that is converted when it is presented
+    struct ReadyFrame {
+        enum class Kind { Empty, Raw, Bgra, Picture };
+        Kind kind = Kind::Empty;
+        MessageType wireType = MSG_FRAME_DATA;
+        FrameMessage frameMsg{};
+        BufferHandle raw;
+        std::vector<uint8_t> bgra;
+        std::unique_ptr<DecodedPicture> picture;
+    };
+    
+    // Threaded mode: the receive thread parses messages into a bounded
+    // queue, the decode thread drains it and publishes into a triple buffer,
+    // and PollFrame() presents whatever is newest.
+    static constexpr size_t kDecodeQueueDepth = 8;
+    static constexpr int kReceiveWaitMs = 50; // Receive thread wakeup for shutdown checks
+    bool m_threaded = false;
+    bool m_decodeToPicture = false; // Fixed when the threads start
+    std::atomic<bool> m_threadsRunning{false};
+    std::atomic<bool> m_streamEnded{false}; // Decode thread has drained a closed queue
+    std::thread m_receiveThread;
+    std::thread m_decodeThread;
+    BoundedQueue<ReceivedFrame> m_decodeQueue{kDecodeQueueDepth};
+    TripleBuffer<ReadyFrame> m_latestFrame;
+    std::unique_ptr<FrameConverter> m_converter; // Presentation-side YUV conversion
+    std::mutex m_streamErrorMutex;
+    std::string m_streamError;
+    
+    // Reference chain tracking: after a decode error, corruption or a new
+    // stream, deltas are discarded until a keyframe arrives. Owned by
+    // whichever thread decodes; the flag is also raised by the receiver.
+    static constexpr std::chrono::milliseconds kKeyframeRequestRetry{500};
+    std::atomic<bool> m_awaitingKeyframe{true};
+    bool m_keyframeRequestPending = false;
+    std::chrono::steady_clock::time_point m_lastKeyframeRequest;
+    std::mutex m_sendMutex;
     
-    // Callbacks
-    std::function<void(const FrameMessage&, const std::vector<uint8_t>&)> m_onFrameReceived;
+    std::atomic<uint64_t> m_framesReceived{0};
+    std::atomic<uint64_t> m_framesDecoded{0};
+    std::atomic<uint64_t> m_framesPresented{0};
+    std::atomic<uint64_t> m_framesSkipped{0};
+    std::atomic<uint64_t> m_keyframeRequests{0};
+    std::atomic<uint64_t> m_bytesReceived{0};
+    std::atomic<uint64_t> m_framesMissing{0};
+    std::atomic<uint64_t> m_keepalives{0};
+    uint32_t m_nextSequence = 0; // Expected sequence number; receiving thread only
+    
+    // Timing of the packets handed to the decoders, by sequence number, so a
+    // frame a decoder held back is reported with its own packet's timing
+    // rather than the latest one's. Decoding thread only.
+    static constexpr size_t kDecodeTimingSlots = 64;
+    FrameTiming m_decodeTimings[kDecodeTimingSlots] = {};
+    bool m_haveSequence = false;
+    
+    // Offset to the server's clock from periodic ping/pong exchanges, so
+    // capture timestamps can be compared with our clock. Pings go out from
+    // whichever thread receives, quickly until the estimator has a full
+    // window and then at a slower pace to follow drift.
+    static constexpr std::chrono::milliseconds kClockPingFastInterval{200};
+    static constexpr std::chrono::milliseconds kClockPingInterval{2000};
+    std::mutex m_clockMutex;
+    ClockOffsetEstimator m_clock;
+    std::chrono::steady_clock::time_point m_lastClockPing;
+    
+    // Optional per-frame decode times (ms); filled by whichever thread decodes
+    bool m_collectDecodeTimes = false;
+    std::mutex m_decodeTimesMutex;
+    SampleStats m_decodeTimes;
+    Histogram m_decodeSeconds{kLatencyBuckets}; // Always collected, for WriteMetrics()
+    SampleStats m_latencies; // Capture to present (ms); guarded by m_decodeTimesMutex
+    Histogram m_latencySeconds{kLatencyBuckets};
+    
+    // Threaded mode: the newest MSG_STATS, held for PollFrame() to deliver
+    std::mutex m_statsMutex;
+    StatsMessage m_pendingStats{};
+    bool m_hasPendingStats = false;
+    
+    // Compressed frames are appended here as they arrive, when enabled
+    std::string m_recordPath;
+    std::unique_ptr<SessionWriter> m_recorder;
+    
+    // Callbacks. Frame data is a view that is only valid for the duration of
+    // the callback; copy it out if it has to outlive the call.
+    std::function<void(const FrameMessage&, std::span<const uint8_t>)> m_onFrameReceived;
+    std::function<void(const FrameMessage&, const DecodedPicture&)> m_onPictureReceived;
+    std::function<bool(const FrameMessage&, FrameDestination&)> m_acquireFrameTarget;
+    std::function<void(const FrameMessage&)> m_onFrameWritten;
     std::function<void(const std::string&)> m_onError;
     std::function<void()> m_onDisconnected;
     std::function<void(MessageType)> m_onRawFrameReceived; // Called when any frame is received from network
+    std::function<void(const FrameMessage&, CompressionType, bool, std::span<const uint8_t>)> m_onCompressedFrame;
+    std::function<void()> m_onDecodeError;
+    std::function<void(const StatsMessage&)> m_onStats;
     
 #ifdef _WIN32
     bool m_winsockInitialized = false;
@@ -63,17 +209,69 @@ public:
     bool PollFrame(); // Returns true if frame was received and processed
     void SetCompression(CompressionType compression) { m_compression = compression; }
     
+    // Moves receiving and decoding onto background threads; PollFrame() then
+    // only presents the newest decoded frame, on the calling thread, and
+    // frames that were superseded in the meantime are dropped. Callbacks
+    // still run on the thread that calls PollFrame(). Takes effect on the
+    // next Connect().
+    void SetThreadedDecoding(bool enabled) { m_threaded = enabled; }
+    bool IsThreadedDecoding() const { return m_threaded; }
+    
+    ReceiverStats GetStats();
+    
+    // Records how long each frame took to decode (including conversion when
+    // the decoder writes straight into a target). Enable before Connect().
+    void SetDecodeTimingEnabled(bool enabled) { m_collectDecodeTimes = enabled; }
+    SampleStats GetDecodeTimes();
+    // With decode timing enabled, the capture-to-present latency of every
+    // frame presented once the server's clock offset was known (ms)
+    SampleStats GetLatencies();
+    
+    // The current estimate of the server's clock minus ours and the round
+    // trip it came from; false until the first clock exchange completed
+    bool GetClockOffset(int64_t& offsetUs, int64_t& roundTripUs);
+    
+    // Receiver counters, queue depth and decode time histogram in
+    // OpenMetrics form
+    void WriteMetrics(OpenMetricsWriter& metrics);
+    
+    // Records every compressed frame of each connection to a session file
+    // (see SessionRecording.h); an empty path turns recording off. Writing
+    // happens on a background thread. Takes effect on the next Connect().
+    void SetSessionRecording(const std::string& path) { m_recordPath = path; }
+    
     // Input message sending methods
     bool SendCompressionRequest(CompressionType compression);
+    bool SendKeyframeRequest();
     bool SendMouseMove(int32_t deltaX, int32_t deltaY, bool absolute = false, int32_t x = 0, int32_t y = 0);
     bool SendMouseClick(MouseClickMessage::MouseButton button, bool pressed);
     bool SendMouseScroll(int32_t deltaX, int32_t deltaY);
     
     // Callback setters
-    void SetFrameCallback(std::function<void(const FrameMessage&, const std::vector<uint8_t>&)> callback) {
+    void SetFrameCallback(std::function<void(const FrameMessage&, std::span<const uint8_t>)> callback) {
         m_onFrameReceived = callback;
     }
     
+    // Receives compressed frames as decoded YUV planes. When no frame
+    // callback is set as well, the BGRA conversion is skipped entirely.
+    void SetPictureCallback(std::function<void(const FrameMessage&, const DecodedPicture&)> callback) {
+        m_onPictureReceived = callback;
+    }
+    
+    // Lets the presenter supply the memory frames are written into (a DIB,
+    // a mapped texture, ...), which removes the copy out of the receiver's
+    // own buffer. The provider gets the frame size and returns false to fall
+    // back to the frame callback; the written callback fires once the frame
+    // is in place. A target may be requested without a frame being written,
+    // e.g. while the decoder is still filling its pipeline.
+    void SetFrameTargetCallback(std::function<bool(const FrameMessage&, FrameDestination&)> callback) {
+        m_acquireFrameTarget = callback;
+    }
+    
+    void SetFrameWrittenCallback(std::function<void(const FrameMessage&)> callback) {
+        m_onFrameWritten = callback;
+    }
+    
     void SetErrorCallback(std::function<void(const std::string&)> callback) {
         m_onError = callback;
     }
@@ -82,10 +280,64 @@ public:
         m_onDisconnected = callback;
     }
     
+    // In threaded mode this fires for presented frames only
     void SetRawFrameCallback(std::function<void(MessageType)> callback) {
         m_onRawFrameReceived = callback;
     }
+    
+    // Every compressed packet as it arrives (dataSize is the packet size),
+    // before decoding; in threaded mode this runs on the receive thread.
+    // Set before Connect().
+    void SetCompressedFrameCallback(
+        std::function<void(const FrameMessage&, CompressionType, bool isKeyframe, std::span<const uint8_t>)> callback) {
+        m_onCompressedFrame = callback;
+    }
+    
+    // Fired when the decoder's reference chain breaks; in threaded mode this
+    // runs on the decode thread. Set before Connect().
+    void SetDecodeErrorCallback(std::function<void()> callback) {
+        m_onDecodeError = callback;
+    }
+    
+    // Statistics the server pushes about once a second. Runs on the thread
+    // that calls PollFrame(); in threaded mode only the newest one since the
+    // last poll is delivered.
+    void SetStatsCallback(std::function<void(const StatsMessage&)> callback) {
+        m_onStats = callback;
+    }
 
 private:
-    bool ReceiveFrame(FrameMessage& frameMsg, std::vector<uint8_t>& frameData, int frameNumber = 0);
+    FrameParser::Status ReceiveMessage(ParsedMessage& msg);
+    bool ToReceivedFrame(ParsedMessage& msg, ReceivedFrame& frame);
+    void OnStatsMessage(const StatsMessage& stats);
+    void OnClockPong(const ClockPongMessage& pong);
+    void MaybeSendClockPing();
+    void TrackSequence(const FrameMessage& frameMsg);
+    void RecordPresentLatency(const FrameMessage& frameMsg);
+    // Stores the frame's timing and returns the decoder tag that finds it again
+    int64_t RememberTiming(const FrameMessage& frameMsg);
+    void RestoreTiming(int64_t tag, FrameMessage& decodedFrameMsg) const;
+    void DeliverPendingStats();
+    VideoDecoder* PrepareDecoder(CompressionType codec, uint32_t width, uint32_t height);
+    VideoDecoder* SelectDecoder(const FrameMessage& frameMsg, CompressionType codec);
+    bool ShouldDecode(const ReceivedFrame& frame);
+    void OnReferenceLost(VideoDecoder& decoder);
+    void RequestKeyframe();
+    void RecordDecodeTime(bool decoded, std::chrono::steady_clock::time_point start);
+    bool SendBytes(const void* data, size_t size);
+    
+    // Polling mode: decode and present on the caller's thread
+    void DecodeAndPresent(ReceivedFrame& frame);
+    void PresentRawFrame(const FrameMessage& frameMsg, std::span<const uint8_t> frameData);
+    bool CopyFrameToTarget(const FrameMessage& frameMsg, std::span<const uint8_t> frameData,
+                           const FrameDestination& target);
+    
+    // Threaded mode
+    void StartThreads();
+    void StopThreads();
+    void ReceiveThreadMain();
+    void DecodeThreadMain();
+    bool DecodeReadyFrame(ReceivedFrame& frame, ReadyFrame& ready);
+    bool PresentLatestFrame();
+    bool WaitReadable(int timeoutMs);
 };
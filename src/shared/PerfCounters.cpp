@@ -0,0 +1,233 @@
+#include "PerfCounters.h"
+#include "Log.h"
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+
+constexpr size_t kStageCount = static_cast<size_t>(PerfStage::Count);
+
+struct StageCounters {
+    std::atomic<uint64_t> samples{0};
+    std::atomic<uint64_t> counts[kPerfEventCount] = {};
+};
+
+StageCounters s_stages[kStageCount];
+std::atomic<int> s_threadedWorkers[kStageCount] = {};
+std::atomic<bool> s_supported[kPerfEventCount] = {};
+
+#ifdef __linux__
+
+constexpr uint64_t kEventConfigs[kPerfEventCount] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+// The calling thread's counter group. Events the PMU lacks are left out, so
+// each has its own position in the group's read() layout.
+struct ThreadGroup {
+    int fds[kPerfEventCount] = { -1, -1, -1, -1 };
+    int positions[kPerfEventCount] = { -1, -1, -1, -1 };
+    int leader = -1;
+    int opened = 0;
+    bool tried = false;
+    int error = 0;  // errno of the first failed open
+
+    ~ThreadGroup() {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    bool Open() {
+        tried = true;
+        for (int event = 0; event < kPerfEventCount; event++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = kEventConfigs[event];
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC));
+            if (fd < 0) {
+                if (error == 0) {
+                    error = errno;
+                }
+                continue;
+            }
+            if (leader < 0) {
+                leader = fd;
+            }
+            fds[event] = fd;
+            positions[event] = opened++;
+        }
+        // IPC needs at least cycles and instructions
+        return fds[PerfCycles] >= 0 && fds[PerfInstructions] >= 0;
+    }
+};
+
+thread_local ThreadGroup t_group;
+
+#endif // __linux__
+
+const char* const kStageNames[kStageCount] = {
+    "capture", "hash", "convert", "encode", "send", "parse", "decode", "convert-out"
+};
+
+const char* const kEventNames[kPerfEventCount] = {
+    "cycles", "instructions", "llc_misses", "branch_misses"
+};
+
+} // namespace
+
+bool PerfCounters::Start() {
+#ifdef __linux__
+    if (!t_group.tried && !t_group.Open()) {
+        MR_LOG_WARN("PerfCounters: perf_event_open failed (" << strerror(t_group.error)
+                    << "); check /proc/sys/kernel/perf_event_paranoid, or the machine has no PMU");
+        return false;
+    }
+    if (t_group.fds[PerfCycles] < 0 || t_group.fds[PerfInstructions] < 0) {
+        return false;
+    }
+    LogMessage message(LogLevel::Info);
+    message.Stream() << "PerfCounters: Counting";
+    for (int event = 0; event < kPerfEventCount; event++) {
+        s_supported[event].store(t_group.fds[event] >= 0, std::memory_order_relaxed);
+        if (t_group.fds[event] >= 0) {
+            message.Stream() << ' ' << kEventNames[event];
+        }
+    }
+    s_enabled.store(true, std::memory_order_relaxed);
+    return true;
+#else
+    MR_LOG_WARN("PerfCounters: Hardware counters need Linux perf_event_open");
+    return false;
+#endif
+}
+
+bool PerfCounters::IsEventSupported(PerfEvent event) {
+    return s_supported[event].load(std::memory_order_relaxed);
+}
+
+PerfStageTotals PerfCounters::GetTotals(PerfStage stage) {
+    const StageCounters& counters = s_stages[static_cast<size_t>(stage)];
+    PerfStageTotals totals;
+    totals.samples = counters.samples.load(std::memory_order_relaxed);
+    for (int event = 0; event < kPerfEventCount; event++) {
+        totals.counts[event] = counters.counts[event].load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+void PerfCounters::Reset() {
+    for (StageCounters& counters : s_stages) {
+        counters.samples.store(0, std::memory_order_relaxed);
+        for (std::atomic<uint64_t>& count : counters.counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void PerfCounters::AddThreadedWorker(PerfStage stage) {
+    s_threadedWorkers[static_cast<size_t>(stage)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void PerfCounters::RemoveThreadedWorker(PerfStage stage) {
+    s_threadedWorkers[static_cast<size_t>(stage)].fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool PerfCounters::IsStageThreaded(PerfStage stage) {
+    return s_threadedWorkers[static_cast<size_t>(stage)].load(std::memory_order_relaxed) > 0;
+}
+
+void PerfCounters::LogSummary() {
+    for (size_t stage = 0; stage < kStageCount; stage++) {
+        PerfStageTotals totals = GetTotals(static_cast<PerfStage>(stage));
+        if (totals.samples == 0) {
+            continue;
+        }
+        if (IsStageThreaded(static_cast<PerfStage>(stage))) {
+            MR_LOG_INFO("PerfCounters: " << kStageNames[stage]
+                        << " - not reported, runs on codec worker threads (open the codec with 1 thread to count it)");
+            continue;
+        }
+        LogMessage message(LogLevel::Info);
+        message.Stream() << "PerfCounters: " << kStageNames[stage] << " - " << totals.samples << " scopes, IPC "
+                         << totals.Ipc() << ", per scope:";
+        for (int event = 0; event < kPerfEventCount; event++) {
+            if (IsEventSupported(static_cast<PerfEvent>(event))) {
+                message.Stream() << ' ' << kEventNames[event] << ' '
+                                 << static_cast<uint64_t>(totals.PerSample(static_cast<PerfEvent>(event)));
+            }
+        }
+    }
+}
+
+const char* PerfCounters::GetStageName(PerfStage stage) {
+    size_t index = static_cast<size_t>(stage);
+    return index < kStageCount ? kStageNames[index] : "unknown";
+}
+
+const char* PerfCounters::GetEventName(PerfEvent event) {
+    return event < kPerfEventCount ? kEventNames[event] : "unknown";
+}
+
+bool PerfCounters::Read(PerfReading& reading) {
+#ifdef __linux__
+    if (!t_group.tried) {
+        t_group.Open();
+    }
+    if (t_group.leader < 0) {
+        return false;
+    }
+    uint64_t buffer[3 + kPerfEventCount];  // nr, time enabled, time running, values
+    if (read(t_group.leader, buffer, sizeof(buffer)) < static_cast<ssize_t>(3 * sizeof(uint64_t))) {
+        return false;
+    }
+    reading.timeEnabled = buffer[1];
+    reading.timeRunning = buffer[2];
+    for (int event = 0; event < kPerfEventCount; event++) {
+        int position = t_group.positions[event];
+        reading.counts[event] = position >= 0 && position < static_cast<int>(buffer[0]) ? buffer[3 + position] : 0;
+    }
+    return true;
+#else
+    (void)reading;
+    return false;
+#endif
+}
+
+void PerfCounters::Accumulate(PerfStage stage, const PerfReading& begin) {
+    PerfReading end;
+    if (!Read(end)) {
+        return;
+    }
+    uint64_t enabled = end.timeEnabled - begin.timeEnabled;
+    uint64_t running = end.timeRunning - begin.timeRunning;
+    if (running == 0) {
+        return; // The group never got onto the PMU during the scope
+    }
+    // Scale up for the part of the scope the kernel had the counters off
+    double scale = static_cast<double>(enabled) / running;
+    StageCounters& counters = s_stages[static_cast<size_t>(stage)];
+    counters.samples.fetch_add(1, std::memory_order_relaxed);
+    for (int event = 0; event < kPerfEventCount; event++) {
+        uint64_t delta = end.counts[event] - begin.counts[event];
+        if (running != enabled) {
+            delta = static_cast<uint64_t>(delta * scale);
+        }
+        counters.counts[event].fetch_add(delta, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Hardware performance counters (Linux perf_event_open) sampled around each
+// pipeline stage, to tell a stage that is compute-bound (high IPC) from one
+// that waits on memory (low IPC, many last-level cache misses).
+//
+// Each thread opens its own counter group on first use and reads it at the
+// start and end of every scope; the difference is added to the stage's
+// totals. Counts are user-space only, and scaled up when the kernel had to
+// multiplex the PMU. Nested scopes each count their full span.
+//
+// Only the thread running the scope is counted. Codecs that hand a stage's
+// work to their own worker threads register that stage while open (see
+// AddThreadedWorker), and reports leave it out rather than show the small
+// calling-thread share as if it were the whole stage.
+//
+// Off until Start(); while off a scope costs one relaxed atomic load.
+//
+//     void Encode() {
+//         MR_PERF_SCOPE(PerfStage::Encode);
+//         ...
+//     }
+enum class PerfStage {
+    Capture,     // Server: grabbing a frame from the source
+    Hash,        // Server: comparing it with the last frame sent
+    Convert,     // Server: BGRA -> YUV ahead of the encoder
+    Encode,
+    Send,
+    Parse,       // Client: assembling messages from the socket
+    Decode,
+    ConvertOut,  // Client: decoded YUV -> BGRA
+    Count
+};
+
+enum PerfEvent {
+    PerfCycles,
+    PerfInstructions,
+    PerfCacheMisses,   // Last-level cache
+    PerfBranchMisses,
+    kPerfEventCount
+};
+
+// Counts accumulated over every scope of one stage
+struct PerfStageTotals {
+    uint64_t samples = 0;
+    uint64_t counts[kPerfEventCount] = {};
+
+    double Ipc() const {
+        return counts[PerfCycles] ? static_cast<double>(counts[PerfInstructions]) / counts[PerfCycles] : 0.0;
+    }
+    double PerSample(PerfEvent event) const {
+        return samples ? static_cast<double>(counts[event]) / samples : 0.0;
+    }
+};
+
+// Counter values at one point on the calling thread
+struct PerfReading {
+    uint64_t counts[kPerfEventCount] = {};
+    uint64_t timeEnabled = 0;
+    uint64_t timeRunning = 0;
+};
+
+class PerfCounters {
+public:
+    // Turns sampling on. False if counters are unavailable: not Linux, no
+    // PMU (many VMs), or perf_event_paranoid forbids it (see the log).
+    static bool Start();
+
+    static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    // Whether this machine counts `event`; unsupported events stay at zero
+    static bool IsEventSupported(PerfEvent event);
+
+    static PerfStageTotals GetTotals(PerfStage stage);
+    static void Reset();
+
+    // Registers/unregisters an open codec that runs `stage` on worker threads
+    static void AddThreadedWorker(PerfStage stage);
+    static void RemoveThreadedWorker(PerfStage stage);
+    // Whether `stage` currently runs partly off the counted thread; such
+    // stages are left out of reports
+    static bool IsStageThreaded(PerfStage stage);
+
+    // One Info line per stage that ran: IPC and per-scope counts
+    static void LogSummary();
+
+    static const char* GetStageName(PerfStage stage);   // "encode", ...
+    static const char* GetEventName(PerfEvent event);   // "cycles", ...
+
+    // Reads the calling thread's counters, opening them on first use
+    static bool Read(PerfReading& reading);
+    // Adds the counts since `begin` to `stage`
+    static void Accumulate(PerfStage stage, const PerfReading& begin);
+
+private:
+    static inline std::atomic<bool> s_enabled{false};
+};
+
+// Counts its own lifetime against a stage
+class PerfScope {
+public:
+    explicit PerfScope(PerfStage stage)
+        : m_stage(stage), m_active(PerfCounters::IsEnabled() && PerfCounters::Read(m_begin)) {}
+
+    ~PerfScope() {
+        if (m_active) {
+            PerfCounters::Accumulate(m_stage, m_begin);
+        }
+    }
+
+    // Drops the sample, e.g. for a capture that found nothing new
+    void Discard() { m_active = false; }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+private:
+    PerfStage m_stage;
+    PerfReading m_begin;
+    bool m_active;
+};
+
+#define MR_PERF_CONCAT_INNER(a, b) a##b
+#define MR_PERF_CONCAT(a, b) MR_PERF_CONCAT_INNER(a, b)
+#define MR_PERF_SCOPE(stage) PerfScope MR_PERF_CONCAT(perfScope_, __LINE__)(stage)
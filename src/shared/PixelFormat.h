@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+
+// Pixel layouts exchanged between the decoder, color conversion and renderers
+enum class PixelFormat : uint32_t {
+    Unknown = 0,
+    BGRA,   // 32-bit packed, B first (Windows DIB / DXGI_FORMAT_B8G8R8A8)
+    RGBA,   // 32-bit packed, R first (GL / Android / PF_R8G8B8A8)
+    I420,   // 8-bit 4:2:0 planar: Y, U, V
+    NV12    // 8-bit 4:2:0 semi-planar: Y, interleaved UV
+};
+
+// YUV <-> RGB matrix coefficients
+enum class ColorMatrix : uint32_t {
+    BT601 = 0,
+    BT709
+};
+
+// Limited ("video", Y 16-235) or full ("PC", 0-255) sample range
+enum class ColorRange : uint32_t {
+    Limited = 0,
+    Full
+};
+
+// Caller-owned memory a decoded frame is written into, such as a DIB section,
+// a mapped staging texture or a shared-memory image. Only BGRA and RGBA are
+// valid destination formats. `stride` may be negative for bottom-up images.
+struct FrameDestination {
+    uint8_t* data = nullptr;
+    int stride = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    PixelFormat format = PixelFormat::BGRA;
+};
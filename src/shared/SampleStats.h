@@ -0,0 +1,70 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Collects timing samples and answers summary queries (mean, percentiles).
+// Reserve() up front to keep Add() allocation-free on hot paths.
+class SampleStats {
+private:
+    std::vector<double> m_samples;
+    mutable std::vector<double> m_sorted;
+    mutable bool m_sortedValid = false;
+
+    const std::vector<double>& Sorted() const {
+        if (!m_sortedValid) {
+            m_sorted = m_samples;
+            std::sort(m_sorted.begin(), m_sorted.end());
+            m_sortedValid = true;
+        }
+        return m_sorted;
+    }
+
+public:
+    void Reserve(size_t count) {
+        m_samples.reserve(count);
+        m_sorted.reserve(count);
+    }
+
+    void Add(double value) {
+        m_samples.push_back(value);
+        m_sortedValid = false;
+    }
+
+    void Clear() {
+        m_samples.clear();
+        m_sortedValid = false;
+    }
+
+    size_t Count() const { return m_samples.size(); }
+    bool Empty() const { return m_samples.empty(); }
+    const std::vector<double>& Samples() const { return m_samples; }
+
+    double Sum() const {
+        double sum = 0.0;
+        for (double v : m_samples) sum += v;
+        return sum;
+    }
+
+    double Mean() const { return Empty() ? 0.0 : Sum() / static_cast<double>(Count()); }
+    double Min() const { return Empty() ? 0.0 : Sorted().front(); }
+    double Max() const { return Empty() ? 0.0 : Sorted().back(); }
+
+    // Nearest-rank percentile, p in [0, 100]
+    double Percentile(double p) const {
+        if (Empty()) return 0.0;
+        const std::vector<double>& sorted = Sorted();
+        double rank = std::ceil(p / 100.0 * static_cast<double>(sorted.size()));
+        size_t index = rank < 1.0 ? 0 : static_cast<size_t>(rank) - 1;
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    double StdDev() const {
+        if (Count() < 2) return 0.0;
+        double mean = Mean();
+        double accum = 0.0;
+        for (double v : m_samples) accum += (v - mean) * (v - mean);
+        return std::sqrt(accum / static_cast<double>(Count() - 1));
+    }
+};
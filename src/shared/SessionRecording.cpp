@@ -0,0 +1,287 @@
+#include "SessionRecording.h"
+#include "Log.h"
+#include <algorithm>
+#include <cstring>
+
+// ---------------------------------------------------------------------------
+// SessionWriter
+// ---------------------------------------------------------------------------
+
+bool SessionWriter::Open(const std::string& path, size_t maxPending) {
+    Close();
+
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file) {
+        MR_LOG_ERROR("SessionWriter: Could not create " << path);
+        return false;
+    }
+
+    m_path = path;
+    m_maxPending = maxPending;
+    m_header = {};
+    std::memcpy(m_header.magic, kSessionMagic, sizeof(m_header.magic));
+    m_header.version = kSessionVersion;
+    m_header.headerSize = sizeof(SessionFileHeader);
+    m_header.startTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    if (fwrite(&m_header, sizeof(m_header), 1, m_file) != 1) {
+        MR_LOG_ERROR("SessionWriter: Failed to write header to " << path);
+        fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+
+    m_offset = sizeof(m_header);
+    m_index.clear();
+    m_start = std::chrono::steady_clock::now();
+    m_recorded = 0;
+    m_dropped = 0;
+    m_stop = false;
+    m_writeFailed = false;
+    m_thread = std::thread(&SessionWriter::WriterMain, this);
+    return true;
+}
+
+void SessionWriter::Close() {
+    if (!m_file) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_pending.notify_one();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    // The writer thread has exited; its state is ours now
+    if (!m_writeFailed) {
+        m_header.indexOffset = m_offset;
+        m_header.keyframeCount = static_cast<uint32_t>(m_index.size());
+        bool ok = m_index.empty() ||
+                  fwrite(m_index.data(), sizeof(SessionIndexEntry), m_index.size(), m_file) == m_index.size();
+        ok = ok && fseek(m_file, 0, SEEK_SET) == 0 && fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+        if (!ok) {
+            MR_LOG_ERROR("SessionWriter: Failed to write index to " << m_path);
+        }
+    }
+    fclose(m_file);
+    m_file = nullptr;
+
+    LogMessage summary(LogLevel::Info);
+    summary.Stream() << "SessionWriter: Recorded " << m_header.recordCount << " frames ("
+                     << m_header.keyframeCount << " keyframes) to " << m_path;
+    if (m_dropped > 0) {
+        summary.Stream() << ", dropped " << m_dropped;
+    }
+
+    m_queue.clear();
+    m_index.clear();
+}
+
+bool SessionWriter::Append(uint32_t width, uint32_t height, CompressionType codec, bool isKeyframe,
+                           BufferHandle payload) {
+    if (!m_file || !payload) {
+        return false;
+    }
+
+    PendingRecord record;
+    record.header.marker = kSessionRecordMarker;
+    record.header.payloadSize = static_cast<uint32_t>(payload.size());
+    record.header.width = width;
+    record.header.height = height;
+    record.header.codec = codec;
+    record.header.flags = isKeyframe ? kSessionFlagKeyframe : 0;
+    record.header.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - m_start).count();
+    record.payload = std::move(payload);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_writeFailed || m_queue.size() >= m_maxPending) {
+            m_dropped++;
+            return false;
+        }
+        m_queue.push_back(std::move(record));
+    }
+    m_pending.notify_one();
+    return true;
+}
+
+bool SessionWriter::Append(uint32_t width, uint32_t height, CompressionType codec, bool isKeyframe,
+                           const uint8_t* data, size_t size) {
+    if (!m_file || !data || size == 0) {
+        return false;
+    }
+    BufferHandle copy = m_copyPool.Acquire(size);
+    std::memcpy(copy.data(), data, size);
+    return Append(width, height, codec, isKeyframe, std::move(copy));
+}
+
+void SessionWriter::WriterMain() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_pending.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty()) {
+            break; // Stopped and drained
+        }
+
+        PendingRecord record = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+
+        bool ok = fwrite(&record.header, sizeof(record.header), 1, m_file) == 1 &&
+                  fwrite(record.payload.data(), 1, record.payload.size(), m_file) == record.payload.size();
+        if (ok) {
+            if (record.header.flags & kSessionFlagKeyframe) {
+                m_index.push_back({ m_offset, m_header.recordCount, record.header.timestampUs });
+            }
+            m_offset += sizeof(record.header) + record.payload.size();
+            m_header.recordCount++;
+            m_recorded++;
+        }
+        record.payload.Reset(); // Hand the buffer back before waiting again
+
+        lock.lock();
+        if (!ok) {
+            MR_LOG_ERROR("SessionWriter: Write failed, recording stopped (" << m_path << ")");
+            m_writeFailed = true;
+            m_dropped += m_queue.size();
+            m_queue.clear();
+            break;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// SessionReader
+// ---------------------------------------------------------------------------
+
+bool SessionReader::Open(const std::string& path) {
+    Close();
+
+    if (!m_file.Open(path)) {
+        return false;
+    }
+    if (m_file.size() < sizeof(SessionFileHeader)) {
+        MR_LOG_ERROR("SessionReader: " << path << " is too small to be a session recording");
+        Close();
+        return false;
+    }
+
+    std::memcpy(&m_header, m_file.data(), sizeof(m_header));
+    if (std::memcmp(m_header.magic, kSessionMagic, sizeof(m_header.magic)) != 0) {
+        MR_LOG_ERROR("SessionReader: " << path << " is not a session recording");
+        Close();
+        return false;
+    }
+    if (m_header.version != kSessionVersion || m_header.headerSize < sizeof(SessionFileHeader) ||
+        m_header.headerSize > m_file.size()) {
+        MR_LOG_ERROR("SessionReader: Unsupported session version " << m_header.version);
+        Close();
+        return false;
+    }
+
+    m_firstRecord = m_header.headerSize;
+    size_t indexBytes = static_cast<size_t>(m_header.keyframeCount) * sizeof(SessionIndexEntry);
+    m_hadIndex = m_header.indexOffset >= m_firstRecord && m_header.indexOffset <= m_file.size() &&
+                 m_file.size() - m_header.indexOffset == indexBytes;
+
+    if (m_hadIndex) {
+        m_recordsEnd = m_header.indexOffset;
+        m_recordCount = m_header.recordCount;
+        m_keyframes.resize(m_header.keyframeCount);
+        if (indexBytes > 0) {
+            std::memcpy(m_keyframes.data(), m_file.data() + m_header.indexOffset, indexBytes);
+        }
+        // Walk from the last keyframe to the end for the duration
+        Cursor cursor = m_keyframes.empty() ? m_firstRecord : m_keyframes.back().offset;
+        SessionFrame frame;
+        while (ReadFrame(cursor, frame)) {
+            m_durationUs = frame.timestampUs;
+        }
+    } else {
+        // Not closed cleanly; recover what was written
+        m_recordsEnd = m_file.size();
+        if (!ScanRecords()) {
+            Close();
+            return false;
+        }
+        MR_LOG_WARN("SessionReader: " << path << " has no index, recovered "
+                    << m_recordCount << " frames by scanning");
+    }
+    return true;
+}
+
+void SessionReader::Close() {
+    m_file.Close();
+    m_header = {};
+    m_firstRecord = 0;
+    m_recordsEnd = 0;
+    m_keyframes.clear();
+    m_recordCount = 0;
+    m_durationUs = 0;
+    m_hadIndex = false;
+}
+
+bool SessionReader::ScanRecords() {
+    Cursor cursor = m_firstRecord;
+    SessionFrame frame;
+    while (true) {
+        Cursor recordOffset = cursor;
+        if (!ReadFrame(cursor, frame)) {
+            // A truncated tail is expected after a crash; stop there
+            m_recordsEnd = recordOffset;
+            break;
+        }
+        if (frame.isKeyframe) {
+            m_keyframes.push_back({ recordOffset, m_recordCount, frame.timestampUs });
+        }
+        m_durationUs = frame.timestampUs;
+        m_recordCount++;
+    }
+    if (m_recordCount == 0) {
+        MR_LOG_ERROR("SessionReader: Recording contains no frames");
+        return false;
+    }
+    return true;
+}
+
+SessionReader::Cursor SessionReader::SeekToKeyframe(int64_t timestampUs) const {
+    if (m_keyframes.empty()) {
+        return m_firstRecord;
+    }
+    auto it = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), timestampUs,
+                               [](int64_t ts, const SessionIndexEntry& entry) { return ts < entry.timestampUs; });
+    if (it != m_keyframes.begin()) {
+        --it;
+    }
+    return it->offset;
+}
+
+bool SessionReader::ReadFrame(Cursor& cursor, SessionFrame& frame) const {
+    if (!m_file.IsOpen() || cursor < m_firstRecord || cursor >= m_recordsEnd ||
+        m_recordsEnd - cursor < sizeof(SessionRecordHeader)) {
+        return false;
+    }
+
+    SessionRecordHeader header;
+    std::memcpy(&header, m_file.data() + cursor, sizeof(header));
+    uint64_t payloadOffset = cursor + sizeof(header);
+    if (header.marker != kSessionRecordMarker || header.payloadSize > m_recordsEnd - payloadOffset) {
+        return false;
+    }
+
+    frame.width = header.width;
+    frame.height = header.height;
+    frame.codec = header.codec;
+    frame.isKeyframe = (header.flags & kSessionFlagKeyframe) != 0;
+    frame.timestampUs = header.timestampUs;
+    frame.payload = std::span<const uint8_t>(m_file.data() + payloadOffset, header.payloadSize);
+
+    cursor = payloadOffset + header.payloadSize;
+    return true;
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include "protocol.h"
+#include "BufferPool.h"
+#include "MappedFile.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Session recording file (.mrsession): every compressed frame of a stream,
+// exactly as it went over the wire, in an append-only file.
+//
+//   SessionFileHeader
+//   { SessionRecordHeader, payload } ...   appended while recording
+//   SessionIndexEntry[keyframeCount]       written on close
+//
+// indexOffset stays 0 until the writer closes cleanly; readers rebuild the
+// keyframe index by scanning if it is missing (e.g. after a crash).
+#pragma pack(push, 1)
+struct SessionFileHeader {
+    char magic[8];           // kSessionMagic
+    uint32_t version;
+    uint32_t headerSize;     // sizeof(SessionFileHeader) of the writer
+    uint64_t indexOffset;    // 0 if the index was never written
+    uint32_t recordCount;
+    uint32_t keyframeCount;
+    int64_t startTimeUs;     // Wall clock (Unix epoch) at recording start
+};
+
+struct SessionRecordHeader {
+    uint32_t marker;         // kSessionRecordMarker, for validation
+    uint32_t payloadSize;
+    uint32_t width;
+    uint32_t height;
+    CompressionType codec;
+    uint32_t flags;          // kSessionFlagKeyframe
+    int64_t timestampUs;     // Since recording start
+};
+
+struct SessionIndexEntry {
+    uint64_t offset;         // File offset of the keyframe's record header
+    uint32_t recordNumber;
+    int64_t timestampUs;
+};
+#pragma pack(pop)
+
+constexpr char kSessionMagic[8] = { 'M', 'R', 'D', 'S', 'E', 'S', 'S', '1' };
+constexpr uint32_t kSessionVersion = 1;
+constexpr uint32_t kSessionRecordMarker = 0x4D415246; // "FRAM"
+constexpr uint32_t kSessionFlagKeyframe = 1;
+
+// Appends frames to a session file from a background thread. Append() never
+// touches the disk; it queues the record and returns.
+class SessionWriter {
+private:
+    struct PendingRecord {
+        SessionRecordHeader header{};
+        BufferHandle payload;
+    };
+
+    static constexpr size_t kDefaultMaxPending = 256;
+
+    FILE* m_file = nullptr;
+    std::string m_path;
+    SessionFileHeader m_header{};
+    std::vector<SessionIndexEntry> m_index;  // Owned by the writer thread
+    uint64_t m_offset = 0;                   // Owned by the writer thread
+    std::chrono::steady_clock::time_point m_start;
+    BufferPool m_copyPool{0, 32};            // For the pointer overload of Append()
+
+    std::mutex m_mutex;
+    std::condition_variable m_pending;
+    std::deque<PendingRecord> m_queue;
+    size_t m_maxPending = kDefaultMaxPending; // Beyond this the disk can't keep up; drop
+    bool m_stop = false;
+    bool m_writeFailed = false;
+    std::thread m_thread;
+    std::atomic<uint64_t> m_recorded{0};
+    std::atomic<uint64_t> m_dropped{0};
+
+    void WriterMain();
+
+public:
+    SessionWriter() = default;
+    ~SessionWriter() { Close(); }
+
+    SessionWriter(const SessionWriter&) = delete;
+    SessionWriter& operator=(const SessionWriter&) = delete;
+
+    // Lower `maxPending` for large records (e.g. raw frames) to bound memory
+    bool Open(const std::string& path, size_t maxPending = kDefaultMaxPending);
+    // Drains the queue, appends the keyframe index and finalizes the header
+    void Close();
+    bool IsOpen() const { return m_file != nullptr; }
+
+    // Keeps a reference to the payload until it has been written; no copy
+    bool Append(uint32_t width, uint32_t height, CompressionType codec, bool isKeyframe, BufferHandle payload);
+    // Copies the payload into a pooled buffer first
+    bool Append(uint32_t width, uint32_t height, CompressionType codec, bool isKeyframe,
+                const uint8_t* data, size_t size);
+
+    uint64_t GetRecordedCount() const { return m_recorded; }
+    uint64_t GetDroppedCount() const { return m_dropped; }
+};
+
+// One recorded frame. The payload points into the mapped file and stays
+// valid while the reader is open.
+struct SessionFrame {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    CompressionType codec = COMPRESSION_NONE;
+    bool isKeyframe = false;
+    int64_t timestampUs = 0;
+    std::span<const uint8_t> payload;
+};
+
+// Memory-mapped reader for session files. Iteration is by cursor (a file
+// offset): start at Begin() or at a keyframe and call ReadFrame() repeatedly.
+class SessionReader {
+public:
+    using Cursor = uint64_t;
+
+    bool Open(const std::string& path);
+    void Close();
+    bool IsOpen() const { return m_file.IsOpen(); }
+
+    Cursor Begin() const { return m_firstRecord; }
+    // Cursor at the last keyframe at or before `timestampUs` (or the first
+    // keyframe), so decoding can start there without missing references
+    Cursor SeekToKeyframe(int64_t timestampUs) const;
+    // Reads the record at `cursor` and advances it. Returns false at the end
+    // of the recording or on a damaged record.
+    bool ReadFrame(Cursor& cursor, SessionFrame& frame) const;
+
+    const std::vector<SessionIndexEntry>& GetKeyframes() const { return m_keyframes; }
+    uint32_t GetRecordCount() const { return m_recordCount; }
+    int64_t GetDurationUs() const { return m_durationUs; }
+    int64_t GetStartTimeUs() const { return m_header.startTimeUs; }
+    bool HadIndex() const { return m_hadIndex; }
+
+private:
+    MappedFile m_file;
+    SessionFileHeader m_header{};
+    uint64_t m_firstRecord = 0;
+    uint64_t m_recordsEnd = 0;  // Index offset, or end of file
+    std::vector<SessionIndexEntry> m_keyframes;
+    uint32_t m_recordCount = 0;
+    int64_t m_durationUs = 0;
+    bool m_hadIndex = false;
+
+    bool ScanRecords();
+};
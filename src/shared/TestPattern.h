@@ -0,0 +1,23 @@
+#pragma once
+#include "Timecode.h"
+#include <cstddef>
+#include <cstdint>
+
+// The server's --test frame: a red-green gradient with the low byte of the
+// frame counter in the blue channel, and a Timecode in the top-left corner.
+// It depends only on the timecode and the size, so a client that reads the
+// timecode back can redraw the exact frame that was encoded and compare.
+inline void DrawTestPattern(const Timecode& timecode, uint32_t width, uint32_t height, uint8_t* bgra) {
+    uint8_t blue = static_cast<uint8_t>(timecode.counter % 256);
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t green = static_cast<uint8_t>((y * 255) / height);
+        uint8_t* row = bgra + static_cast<size_t>(y) * width * 4;
+        for (uint32_t x = 0; x < width; x++) {
+            row[x * 4 + 0] = blue;                                          // B
+            row[x * 4 + 1] = green;                                         // G
+            row[x * 4 + 2] = static_cast<uint8_t>((x * 255) / width);       // R
+            row[x * 4 + 3] = 255;                                           // A
+        }
+    }
+    WriteTimecode(bgra, width, height, static_cast<size_t>(width) * 4, timecode);
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Machine-readable timecode drawn into synthetic frames, so that latency
+// can be measured on the pixels that come out of the decoder rather than on
+// packet headers, which cannot see frames held inside the codec.
+//
+// Two rows of black and white blocks, one block in from the top-left
+// corner. Each row starts with a white and a black sync block followed by 32
+// data blocks: a 24-bit frame counter, the capture time in 100 us units
+// (wrapping every ~5 days) and a CRC-8. Blocks are large enough to survive
+// chroma subsampling and moderate quantization; each is read by averaging
+// its centre.
+struct Timecode {
+    uint32_t counter = 0;       // Low 24 bits of the source's frame counter
+    uint32_t captureTime = 0;   // ClockNowUs() / 100 at capture, truncated to 32 bits
+};
+
+constexpr uint32_t kTimecodeBlockSize = 16;
+constexpr uint32_t kTimecodeCounterMask = 0xFFFFFF;
+constexpr uint32_t kTimecodeRowBlocks = 34; // 2 sync + 32 data
+constexpr uint32_t kTimecodeWidth = (kTimecodeRowBlocks + 1) * kTimecodeBlockSize;  // Including the margin
+constexpr uint32_t kTimecodeHeight = 3 * kTimecodeBlockSize;
+
+inline uint32_t TimecodeTime(uint64_t clockUs) {
+    return static_cast<uint32_t>(clockUs / 100);
+}
+
+// Milliseconds from the embedded capture time to `nowUs` on the same clock
+inline double TimecodeAgeMs(const Timecode& timecode, uint64_t nowUs) {
+    int32_t ticks = static_cast<int32_t>(TimecodeTime(nowUs) - timecode.captureTime);
+    return ticks / 10.0;
+}
+
+namespace TimecodeDetail {
+
+inline uint8_t Crc8(uint64_t data, int bytes) {
+    uint8_t crc = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        crc ^= static_cast<uint8_t>(data >> (i * 8));
+        for (int bit = 0; bit < 8; bit++) {
+            crc = static_cast<uint8_t>((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+    }
+    return crc;
+}
+
+inline uint64_t Pack(const Timecode& timecode) {
+    uint64_t data = (static_cast<uint64_t>(timecode.counter & kTimecodeCounterMask) << 32) | timecode.captureTime;
+    return (data << 8) | Crc8(data, 7);
+}
+
+// Block `index` of row `row`, as the top-left pixel of the block
+inline size_t BlockOffset(uint32_t row, uint32_t index, size_t stride) {
+    return (static_cast<size_t>(row + 1) * kTimecodeBlockSize) * stride +
+           static_cast<size_t>(index + 1) * kTimecodeBlockSize * 4;
+}
+
+// Mean of R, G and B over the middle half of a block
+inline int BlockLevel(const uint8_t* bgra, size_t stride, size_t offset) {
+    constexpr uint32_t kInset = kTimecodeBlockSize / 4;
+    constexpr uint32_t kSpan = kTimecodeBlockSize / 2;
+    uint32_t sum = 0;
+    for (uint32_t y = kInset; y < kInset + kSpan; y++) {
+        const uint8_t* pixel = bgra + offset + y * stride + kInset * 4;
+        for (uint32_t x = 0; x < kSpan; x++, pixel += 4) {
+            sum += pixel[0] + pixel[1] + pixel[2];
+        }
+    }
+    return static_cast<int>(sum / (kSpan * kSpan * 3));
+}
+
+} // namespace TimecodeDetail
+
+// Draws `timecode` into a BGRA frame; false if the frame is too small
+inline bool WriteTimecode(uint8_t* bgra, uint32_t width, uint32_t height, size_t stride, const Timecode& timecode) {
+    if (width < kTimecodeWidth || height < kTimecodeHeight) {
+        return false;
+    }
+    uint64_t data = TimecodeDetail::Pack(timecode);
+    for (uint32_t row = 0; row < 2; row++) {
+        for (uint32_t index = 0; index < kTimecodeRowBlocks; index++) {
+            bool white;
+            if (index < 2) {
+                white = index == 0; // Sync
+            } else {
+                int bit = 63 - static_cast<int>(row * 32 + index - 2);
+                white = (data >> bit) & 1;
+            }
+            uint8_t level = white ? 255 : 0;
+            size_t offset = TimecodeDetail::BlockOffset(row, index, stride);
+            for (uint32_t y = 0; y < kTimecodeBlockSize; y++) {
+                uint8_t* pixel = bgra + offset + y * stride;
+                for (uint32_t x = 0; x < kTimecodeBlockSize; x++, pixel += 4) {
+                    pixel[0] = pixel[1] = pixel[2] = level;
+                    pixel[3] = 255;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Reads a timecode back from a (decoded) BGRA frame. False if the frame has
+// none, or it did not survive the codec intact.
+inline bool ReadTimecode(const uint8_t* bgra, uint32_t width, uint32_t height, size_t stride, Timecode& timecode) {
+    if (width < kTimecodeWidth || height < kTimecodeHeight) {
+        return false;
+    }
+    constexpr int kWhite = 160;
+    constexpr int kBlack = 96;
+    uint64_t data = 0;
+    for (uint32_t row = 0; row < 2; row++) {
+        if (TimecodeDetail::BlockLevel(bgra, stride, TimecodeDetail::BlockOffset(row, 0, stride)) < kWhite ||
+            TimecodeDetail::BlockLevel(bgra, stride, TimecodeDetail::BlockOffset(row, 1, stride)) > kBlack) {
+            return false;
+        }
+        for (uint32_t index = 2; index < kTimecodeRowBlocks; index++) {
+            int level = TimecodeDetail::BlockLevel(bgra, stride, TimecodeDetail::BlockOffset(row, index, stride));
+            data = (data << 1) | (level >= 128 ? 1 : 0);
+        }
+    }
+    if (TimecodeDetail::Crc8(data >> 8, 7) != static_cast<uint8_t>(data)) {
+        return false;
+    }
+    timecode.counter = static_cast<uint32_t>(data >> 40) & kTimecodeCounterMask;
+    timecode.captureTime = static_cast<uint32_t>(data >> 8);
+    return true;
+}
+
+// Follows the counters of decoded timecodes and classifies what the codec
+// and pipeline did to the sequence
+class TimecodeTracker {
+public:
+    void Observe(uint32_t counter) {
+        m_frames++;
+        if (!m_started) {
+            m_started = true;
+            m_last = counter;
+            return;
+        }
+        // Signed distance in 24-bit counter space
+        int32_t step = static_cast<int32_t>(((counter - m_last) & kTimecodeCounterMask) << 8) >> 8;
+        if (step == 0) {
+            m_duplicated++;
+        } else if (step < 0) {
+            m_reordered++; // Older than one already shown; keep the newest
+        } else {
+            m_dropped += static_cast<uint64_t>(step - 1);
+            m_last = counter;
+        }
+    }
+
+    uint64_t GetFrames() const { return m_frames; }
+    uint64_t GetDuplicated() const { return m_duplicated; }
+    uint64_t GetReordered() const { return m_reordered; }
+    uint64_t GetDropped() const { return m_dropped; }  // Counters never seen
+
+private:
+    bool m_started = false;
+    uint32_t m_last = 0;
+    uint64_t m_frames = 0;
+    uint64_t m_duplicated = 0;
+    uint64_t m_reordered = 0;
+    uint64_t m_dropped = 0;
+};
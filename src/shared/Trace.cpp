@@ -0,0 +1,263 @@
+#include "Trace.h"
+#include "JsonWriter.h"
+#include "Log.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// One ring slot. The fields are relaxed atomics so a snapshot can be taken
+// while the owning thread keeps recording; on the hot path they compile to
+// plain stores.
+struct EventSlot {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> beginNs{0};
+    std::atomic<int64_t> endNs{0};
+};
+
+struct RecordedEvent {
+    const char* name;
+    int64_t beginNs;
+    int64_t endNs;
+};
+
+struct ThreadRing {
+    std::unique_ptr<EventSlot[]> slots;
+    size_t capacity = 0;
+    std::atomic<uint64_t> head{0}; // Events ever recorded; only the owner writes it
+    uint32_t tid = 0;
+    std::string name;              // Guarded by TraceState::mutex
+
+    // Copies out the events that are still intact. Anything the owner may
+    // have overwritten while we were copying is dropped.
+    void Snapshot(std::vector<RecordedEvent>& out) const {
+        uint64_t end = head.load(std::memory_order_acquire);
+        uint64_t begin = end > capacity ? end - capacity : 0;
+        size_t first = out.size();
+        for (uint64_t i = begin; i < end; i++) {
+            const EventSlot& slot = slots[i % capacity];
+            out.push_back({ slot.name.load(std::memory_order_relaxed),
+                            slot.beginNs.load(std::memory_order_relaxed),
+                            slot.endNs.load(std::memory_order_relaxed) });
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // The slot for event `after` may already be half written
+        uint64_t after = head.load(std::memory_order_relaxed) + 1;
+        uint64_t valid = after > capacity ? after - capacity : 0;
+        if (valid > begin) {
+            size_t torn = static_cast<size_t>(std::min(valid, end) - begin);
+            out.erase(out.begin() + first, out.begin() + first + torn);
+        }
+    }
+};
+
+struct TraceState {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadRing>> rings;
+    size_t eventsPerThread = Trace::kDefaultEventsPerThread;
+    std::string path;
+    std::string processName;
+    int64_t startNs = 0;
+    bool warnedFull = false;
+
+    std::thread signalWatcher;
+    std::atomic<bool> stopWatcher{false};
+    uint32_t snapshotCount = 0;
+};
+
+TraceState& State() {
+    static TraceState state;
+    return state;
+}
+
+thread_local ThreadRing* t_ring = nullptr;
+thread_local bool t_untraced = false;
+
+std::atomic<bool> g_snapshotRequested{false};
+
+void OnSnapshotSignal(int) {
+    g_snapshotRequested.store(true);
+}
+
+ThreadRing* RegisterThread() {
+    TraceState& state = State();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.rings.size() >= Trace::kMaxThreads) {
+        if (!state.warnedFull) {
+            MR_LOG_WARN("Trace: More than " << Trace::kMaxThreads << " threads, not tracing the rest");
+            state.warnedFull = true;
+        }
+        t_untraced = true;
+        return nullptr;
+    }
+    auto ring = std::make_unique<ThreadRing>();
+    ring->capacity = state.eventsPerThread;
+    ring->slots = std::make_unique<EventSlot[]>(ring->capacity);
+    ring->tid = static_cast<uint32_t>(state.rings.size() + 1);
+    ring->name = "thread " + std::to_string(ring->tid);
+    state.rings.push_back(std::move(ring));
+    return state.rings.back().get();
+}
+
+std::string SnapshotPath(const std::string& path, uint32_t index) {
+    std::filesystem::path p(path);
+    std::filesystem::path name = p.stem();
+    name += "-" + std::to_string(index);
+    name += p.extension();
+    return (p.parent_path() / name).string();
+}
+
+void WatchForSnapshots() {
+    TraceState& state = State();
+    while (!state.stopWatcher.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (g_snapshotRequested.exchange(false)) {
+            std::string path = SnapshotPath(state.path, ++state.snapshotCount);
+            if (Trace::WriteChromeJson(path)) {
+                MR_LOG_INFO("Trace: Wrote snapshot " << path);
+            }
+        }
+    }
+}
+
+void WriteAtExit() {
+    TraceState& state = State();
+    state.stopWatcher = true;
+    if (state.signalWatcher.joinable()) {
+        state.signalWatcher.join();
+    }
+    if (Trace::WriteChromeJson(state.path)) {
+        MR_LOG_INFO("Trace: Wrote " << state.path);
+    }
+}
+
+int ProcessId() {
+#ifdef _WIN32
+    return _getpid();
+#else
+    return static_cast<int>(getpid());
+#endif
+}
+
+} // namespace
+
+bool Trace::Start(const std::string& path, const std::string& processName, size_t eventsPerThread) {
+    TraceState& state = State();
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (IsEnabled()) {
+            MR_LOG_ERROR("Trace: Already writing to " << state.path);
+            return false;
+        }
+        state.path = path;
+        state.processName = processName;
+        state.eventsPerThread = eventsPerThread > 0 ? eventsPerThread : kDefaultEventsPerThread;
+        state.startNs = NowNs();
+    }
+
+    if (std::atexit(WriteAtExit) != 0) {
+        MR_LOG_ERROR("Trace: Could not register the exit handler");
+        return false;
+    }
+#ifdef _WIN32
+    std::signal(SIGBREAK, OnSnapshotSignal);
+#else
+    std::signal(SIGUSR1, OnSnapshotSignal);
+#endif
+    state.signalWatcher = std::thread(WatchForSnapshots);
+
+    s_enabled = true;
+    MR_LOG_INFO("Tracing to " << path);
+    return true;
+}
+
+void Trace::SetThreadName(const char* name) {
+    if (!IsEnabled()) {
+        return; // Don't allocate a ring for a trace that isn't running
+    }
+    if (!t_ring && !t_untraced) {
+        t_ring = RegisterThread();
+    }
+    if (t_ring) {
+        std::lock_guard<std::mutex> lock(State().mutex);
+        t_ring->name = name;
+    }
+}
+
+void Trace::Record(const char* name, int64_t beginNs, int64_t endNs) {
+    ThreadRing* ring = t_ring;
+    if (!ring) {
+        if (t_untraced || !(ring = t_ring = RegisterThread())) {
+            return;
+        }
+    }
+    uint64_t index = ring->head.load(std::memory_order_relaxed);
+    EventSlot& slot = ring->slots[index % ring->capacity];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.beginNs.store(beginNs, std::memory_order_relaxed);
+    slot.endNs.store(endNs, std::memory_order_relaxed);
+    ring->head.store(index + 1, std::memory_order_release);
+}
+
+bool Trace::WriteChromeJson(const std::string& path) {
+    TraceState& state = State();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    int pid = ProcessId();
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Key("displayTimeUnit").String("ms");
+    json.Key("traceEvents").BeginArray();
+
+    json.BeginObject();
+    json.Key("name").String("process_name");
+    json.Key("ph").String("M");
+    json.Key("pid").Int(pid);
+    json.Key("args").BeginObject().Key("name").String(state.processName).EndObject();
+    json.EndObject();
+
+    std::vector<RecordedEvent> events;
+    for (const auto& ring : state.rings) {
+        json.BeginObject();
+        json.Key("name").String("thread_name");
+        json.Key("ph").String("M");
+        json.Key("pid").Int(pid);
+        json.Key("tid").UInt(ring->tid);
+        json.Key("args").BeginObject().Key("name").String(ring->name).EndObject();
+        json.EndObject();
+
+        events.clear();
+        ring->Snapshot(events);
+        for (const RecordedEvent& event : events) {
+            // Microseconds since Start(), kept to the nanosecond
+            json.BeginObject();
+            json.Key("name").String(event.name ? event.name : "?");
+            json.Key("ph").String("X");
+            json.Key("ts").Double((event.beginNs - state.startNs) / 1000.0, 15);
+            json.Key("dur").Double((event.endNs - event.beginNs) / 1000.0, 15);
+            json.Key("pid").Int(pid);
+            json.Key("tid").UInt(ring->tid);
+            json.EndObject();
+        }
+    }
+
+    json.EndArray();
+    json.EndObject();
+
+    if (!json.WriteToFile(path)) {
+        MR_LOG_ERROR("Trace: Could not write " << path);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Low-overhead per-stage tracing. Each thread records complete events (name,
+// begin, end on the steady clock) into its own fixed-size ring, so recording
+// takes no locks and never allocates after the thread's first event; once a
+// ring is full the oldest events are overwritten. The rings are written out
+// as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev open.
+//
+// Tracing is off until Start(). While it is off a traced scope costs one
+// relaxed atomic load.
+//
+//     void Encode() {
+//         MR_TRACE_SCOPE("encode");
+//         ...
+//     }
+//
+// Event names must be string literals (or otherwise outlive the trace);
+// only the pointer is recorded.
+class Trace {
+public:
+    static constexpr size_t kDefaultEventsPerThread = 32768;
+    static constexpr size_t kMaxThreads = 64; // Later threads go untraced
+
+    // Turns tracing on. The trace is written to `path` when the process exits
+    // and, on SIGUSR1 (Ctrl+Break on Windows), to numbered snapshots next to
+    // it (trace.json -> trace-1.json, trace-2.json, ...).
+    static bool Start(const std::string& path, const std::string& processName,
+                      size_t eventsPerThread = kDefaultEventsPerThread);
+
+    // Writes what the rings currently hold; safe while other threads record
+    static bool WriteChromeJson(const std::string& path);
+
+    // Label for the calling thread in the trace viewer; call after Start()
+    static void SetThreadName(const char* name);
+
+    static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    static int64_t NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void Record(const char* name, int64_t beginNs, int64_t endNs);
+
+private:
+    static inline std::atomic<bool> s_enabled{false};
+};
+
+// Records one event covering its own lifetime
+class TraceScope {
+public:
+    explicit TraceScope(const char* name)
+        : m_name(name), m_beginNs(Trace::IsEnabled() ? Trace::NowNs() : -1) {}
+
+    ~TraceScope() {
+        if (m_beginNs >= 0) {
+            Trace::Record(m_name, m_beginNs, Trace::NowNs());
+        }
+    }
+
+    // Drops the event, e.g. for a poll that found nothing to do
+    void Discard() { m_beginNs = -1; }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    int64_t m_beginNs;
+};
+
+#define MR_TRACE_CONCAT_INNER(a, b) a##b
+#define MR_TRACE_CONCAT(a, b) MR_TRACE_CONCAT_INNER(a, b)
+#define MR_TRACE_SCOPE(name) TraceScope MR_TRACE_CONCAT(traceScope_, __LINE__)(name)
@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer handoff of the latest value.
+// The writer fills WriteSlot() and publishes it; the reader swaps in the
+// newest published slot. Neither side ever waits on the other, and values
+// the reader never picked up are overwritten and counted as dropped.
+template <typename T>
+class TripleBuffer {
+private:
+    static constexpr uint32_t kIndexMask = 0x3;
+    static constexpr uint32_t kFreshBit = 0x4; // Middle slot holds an unread value
+
+    T m_slots[3];
+    alignas(64) std::atomic<uint32_t> m_middle{1};
+    alignas(64) uint32_t m_back = 0;  // Owned by the writer
+    alignas(64) uint32_t m_front = 2; // Owned by the reader
+    std::atomic<uint64_t> m_published{0};
+    std::atomic<uint64_t> m_dropped{0};
+
+public:
+    // Writer side
+    T& WriteSlot() { return m_slots[m_back]; }
+
+    // Makes the write slot visible to the reader. Returns true if this
+    // replaced a value the reader had not taken yet.
+    bool Publish() {
+        uint32_t previous = m_middle.exchange(m_back | kFreshBit, std::memory_order_acq_rel);
+        m_back = previous & kIndexMask;
+        m_published.fetch_add(1, std::memory_order_relaxed);
+        if (previous & kFreshBit) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    // Reader side
+    bool HasFresh() const { return (m_middle.load(std::memory_order_acquire) & kFreshBit) != 0; }
+
+    // Swaps the newest published value into ReadSlot(). Returns false if
+    // nothing new was published since the last call.
+    bool Acquire() {
+        if (!HasFresh()) {
+            return false;
+        }
+        uint32_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & kIndexMask;
+        return true;
+    }
+
+    T& ReadSlot() { return m_slots[m_front]; }
+
+    uint64_t GetPublished() const { return m_published.load(std::memory_order_relaxed); }
+    uint64_t GetDropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    void ResetCounters() {
+        m_published.store(0, std::memory_order_relaxed);
+        m_dropped.store(0, std::memory_order_relaxed);
+    }
+
+    // Forgets any unread value. Only call while neither side is active.
+    template <typename ClearFunc>
+    void Reset(ClearFunc&& clear) {
+        m_middle.store(1, std::memory_order_relaxed);
+        m_back = 0;
+        m_front = 2;
+        for (T& slot : m_slots) {
+            clear(slot);
+        }
+    }
+};
@@ -1,5 +1,64 @@
 #include "VideoDecoder.h"
-#include <iostream>
+#include "Log.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+
+DecodedPicture::DecodedPicture() {
+    m_frame = av_frame_alloc();
+}
+
+DecodedPicture::~DecodedPicture() {
+    av_frame_free(&m_frame);
+}
+
+void DecodedPicture::Reset() {
+    if (m_frame) {
+        av_frame_unref(m_frame);
+    }
+    UpdateFromFrame();
+}
+
+void DecodedPicture::UpdateFromFrame() {
+    width = 0;
+    height = 0;
+    format = PixelFormat::Unknown;
+    matrix = ColorMatrix::BT601;
+    range = ColorRange::Limited;
+    for (int i = 0; i < 3; ++i) {
+        planes[i] = nullptr;
+        strides[i] = 0;
+    }
+    if (!m_frame || !m_frame->data[0]) {
+        return;
+    }
+    
+    width = static_cast<uint32_t>(m_frame->width);
+    height = static_cast<uint32_t>(m_frame->height);
+    switch (m_frame->format) {
+        case AV_PIX_FMT_YUV420P:
+            format = PixelFormat::I420;
+            break;
+        case AV_PIX_FMT_YUVJ420P:
+            format = PixelFormat::I420;
+            range = ColorRange::Full;
+            break;
+        case AV_PIX_FMT_NV12:
+            format = PixelFormat::NV12;
+            break;
+        default:
+            break;
+    }
+    if (m_frame->color_range == AVCOL_RANGE_JPEG) {
+        range = ColorRange::Full;
+    }
+    if (m_frame->colorspace == AVCOL_SPC_BT709) {
+        matrix = ColorMatrix::BT709;
+    }
+    for (int i = 0; i < 3; ++i) {
+        planes[i] = m_frame->data[i];
+        strides[i] = m_frame->linesize[i];
+    }
+}
 
 VideoDecoder::VideoDecoder() {
     // FFmpeg 4.0+ automatically registers codecs, no need for avcodec_register_all()
@@ -22,48 +81,62 @@ const char* VideoDecoder::GetCodecName(CompressionType type) {
     }
 }
 
-bool VideoDecoder::Initialize(uint32_t width, uint32_t height, CompressionType compression) {
+bool VideoDecoder::Initialize(uint32_t width, uint32_t height, CompressionType compression,
+                              const DecoderOptions& options) {
     if (compression == COMPRESSION_NONE) {
-        std::cerr << "VideoDecoder: Cannot initialize with COMPRESSION_NONE" << std::endl;
+        MR_LOG_ERROR("VideoDecoder: Cannot initialize with COMPRESSION_NONE");
         return false;
     }
     
     const char* codecName = GetCodecName(compression);
     if (!codecName) {
-        std::cerr << "VideoDecoder: Unsupported compression type: " << compression << std::endl;
+        MR_LOG_ERROR("VideoDecoder: Unsupported compression type: " << compression);
         return false;
     }
     
     // Find decoder
     const AVCodec* codec = avcodec_find_decoder_by_name(codecName);
     if (!codec) {
-        std::cerr << "VideoDecoder: Could not find decoder: " << codecName << std::endl;
+        MR_LOG_ERROR("VideoDecoder: Could not find decoder: " << codecName);
         return false;
     }
     
     // Allocate codec context
     m_CodecContext = avcodec_alloc_context3(codec);
     if (!m_CodecContext) {
-        std::cerr << "VideoDecoder: Could not allocate codec context" << std::endl;
+        MR_LOG_ERROR("VideoDecoder: Could not allocate codec context");
         return false;
     }
     
-    // Set codec parameters
+    // Set codec parameters. The output pixel format is whatever the stream
+    // carries; conversion state is built from the first decoded frame.
     m_CodecContext->width = width;
     m_CodecContext->height = height;
-    m_CodecContext->pix_fmt = AV_PIX_FMT_YUV420P;
     
-    // Open codec
-    if (avcodec_open2(m_CodecContext, codec, nullptr) < 0) {
-        std::cerr << "VideoDecoder: Could not open codec" << std::endl;
-        Cleanup();
-        return false;
+    // Threading and latency options
+    switch (options.threading) {
+        case DecodeThreading::None:
+            m_CodecContext->thread_count = 1;
+            break;
+        case DecodeThreading::Slice:
+            m_CodecContext->thread_type = FF_THREAD_SLICE;
+            m_CodecContext->thread_count = options.threadCount;
+            break;
+        case DecodeThreading::Frame:
+            m_CodecContext->thread_type = FF_THREAD_FRAME;
+            m_CodecContext->thread_count = options.threadCount;
+            break;
+    }
+    if (options.lowDelay) {
+        m_CodecContext->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
+    if (options.fastDecode) {
+        m_CodecContext->flags2 |= AV_CODEC_FLAG2_FAST;
     }
     
-    // Allocate frame
-    m_Frame = av_frame_alloc();
-    if (!m_Frame) {
-        std::cerr << "VideoDecoder: Could not allocate frame" << std::endl;
+    // Open codec
+    if (avcodec_open2(m_CodecContext, codec, nullptr) < 0) {
+        MR_LOG_ERROR("VideoDecoder: Could not open codec");
         Cleanup();
         return false;
     }
@@ -71,17 +144,7 @@ bool VideoDecoder::Initialize(uint32_t width, uint32_t height, CompressionType c
     // Allocate packet
     m_Packet = av_packet_alloc();
     if (!m_Packet) {
-        std::cerr << "VideoDecoder: Could not allocate packet" << std::endl;
-        Cleanup();
-        return false;
-    }
-    
-    // Initialize scaling context for YUV420P to BGRA conversion
-    m_SwsContext = sws_getContext(width, height, AV_PIX_FMT_YUV420P,
-                                  width, height, AV_PIX_FMT_BGRA,
-                                  SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
-    if (!m_SwsContext) {
-        std::cerr << "VideoDecoder: Could not create scaling context" << std::endl;
+        MR_LOG_ERROR("VideoDecoder: Could not allocate packet");
         Cleanup();
         return false;
     }
@@ -89,13 +152,52 @@ bool VideoDecoder::Initialize(uint32_t width, uint32_t height, CompressionType c
     m_Width = width;
     m_Height = height;
     m_CompressionType = compression;
+    m_Options = options;
     m_IsInitialized = true;
     
-    std::cout << "VideoDecoder: Initialized " << codecName << " decoder (" << width << "x" << height << ")" << std::endl;
+    const char* threadingName = "none";
+    if (m_CodecContext->active_thread_type & FF_THREAD_FRAME) {
+        threadingName = "frame";
+    } else if (m_CodecContext->active_thread_type & FF_THREAD_SLICE) {
+        threadingName = "slice";
+    }
+    MR_LOG_INFO("VideoDecoder: Initialized " << codecName << " decoder (" << width << "x" << height
+                << ", " << m_CodecContext->thread_count << " threads, " << threadingName << " threading)");
+    m_PerfThreaded = m_CodecContext->active_thread_type != 0 && m_CodecContext->thread_count > 1;
+    if (m_PerfThreaded) {
+        PerfCounters::AddThreadedWorker(PerfStage::Decode);
+    }
     
     return true;
 }
 
+bool VideoDecoder::Reconfigure(uint32_t width, uint32_t height) {
+    if (!m_IsInitialized) {
+        return false;
+    }
+    
+    // The bitstream carries its own dimensions; the codec re-parses them at
+    // the next keyframe, and conversion state follows each frame's size, so a
+    // flush is all that is needed
+    Flush();
+    m_CodecContext->width = width;
+    m_CodecContext->height = height;
+    m_Width = width;
+    m_Height = height;
+    
+    MR_LOG_INFO("VideoDecoder: Reconfigured for " << width << "x" << height);
+    return true;
+}
+
+void VideoDecoder::Flush() {
+    if (m_CodecContext) {
+        avcodec_flush_buffers(m_CodecContext);
+    }
+    m_Picture.Reset();
+    m_DecodeError = false;
+    m_Draining = false;
+}
+
 bool VideoDecoder::DecodeFrame(const uint8_t* compressedData, size_t dataSize, std::vector<uint8_t>& bgraData) {
     if (!m_IsInitialized) {
         return false;
@@ -105,54 +207,212 @@ bool VideoDecoder::DecodeFrame(const uint8_t* compressedData, size_t dataSize, s
     m_Packet->data = const_cast<uint8_t*>(compressedData);
     m_Packet->size = static_cast<int>(dataSize);
     
-    // Send packet to decoder
+    return SendAndReceive(m_Picture, kNoTag) && ConvertToBGRA(m_Picture, bgraData);
+}
+
+bool VideoDecoder::DecodeFrame(const BufferHandle& packet, std::vector<uint8_t>& bgraData, int64_t tag) {
+    return DecodeFrame(packet, m_Picture, tag) && ConvertToBGRA(m_Picture, bgraData);
+}
+
+bool VideoDecoder::DecodeFrame(const BufferHandle& packet, DecodedPicture& picture, int64_t tag) {
+    if (!m_IsInitialized) {
+        return false;
+    }
+    
+    if (packet.padding() < AV_INPUT_BUFFER_PADDING_SIZE) {
+        // Not safe to hand to the bitstream readers directly; let libavcodec copy it
+        m_Packet->data = packet.data();
+        m_Packet->size = static_cast<int>(packet.size());
+        return SendAndReceive(picture, tag);
+    }
+    
+    // Wrap the pooled buffer so libavcodec can keep a reference instead of copying
+    void* token = packet.RetainToken();
+    m_Packet->buf = av_buffer_create(packet.data(), packet.size() + packet.padding(),
+                                     [](void* opaque, uint8_t*) { BufferHandle::ReleaseToken(opaque); },
+                                     token, 0);
+    if (!m_Packet->buf) {
+        // The free callback never took the reference; fall back to a copy
+        BufferHandle::ReleaseToken(token);
+        MR_LOG_RATE_LIMITED(LogLevel::Warn, 1000, "VideoDecoder: Could not wrap packet buffer, copying it");
+    }
+    m_Packet->data = packet.data();
+    m_Packet->size = static_cast<int>(packet.size());
+    
+    return SendAndReceive(picture, tag);
+}
+
+bool VideoDecoder::SendAndReceive(DecodedPicture& picture, int64_t tag) {
+    MR_TRACE_SCOPE("decode");
+    MR_PERF_SCOPE(PerfStage::Decode);
+    
+    m_DecodeError = false;
+    if (!picture.m_frame) {
+        av_packet_unref(m_Packet);
+        MR_LOG_ERROR("VideoDecoder: Picture has no frame storage");
+        return false;
+    }
+    
+    // The tag rides in pts, which libavcodec copies to the frame it produces
+    m_Packet->pts = tag == kNoTag ? AV_NOPTS_VALUE : tag;
+    
+    // Send packet to decoder. A frame-threaded decoder whose output is full
+    // answers EAGAIN: take a frame out first, then the packet goes in.
+    // Frames are received straight into the picture; the decoder's buffers
+    // are refcounted, so this hands over a reference without copying pixels.
+    bool received = false;
     int ret = avcodec_send_packet(m_CodecContext, m_Packet);
+    if (ret == AVERROR(EAGAIN)) {
+        ret = avcodec_receive_frame(m_CodecContext, picture.m_frame);
+        if (ret >= 0) {
+            received = true;
+            ret = avcodec_send_packet(m_CodecContext, m_Packet);
+        }
+    }
+    av_packet_unref(m_Packet);
     if (ret < 0) {
-        std::cerr << "VideoDecoder: Error sending packet to decoder" << std::endl;
-        return false;
+        MR_LOG_RATE_LIMITED(LogLevel::Error, 1000, "VideoDecoder: Error sending packet to decoder");
+        m_DecodeError = true;
+        if (!received) {
+            picture.UpdateFromFrame(); // The receive above may have released it
+            return false;
+        }
     }
     
-    // Receive decoded frame
-    ret = avcodec_receive_frame(m_CodecContext, m_Frame);
+    // The frame taken out to make room is this call's output
+    ret = received ? 0 : avcodec_receive_frame(m_CodecContext, picture.m_frame);
+    picture.UpdateFromFrame();
     if (ret == AVERROR(EAGAIN)) {
         // Need more packets before getting a frame
         return false;
     } else if (ret < 0) {
-        std::cerr << "VideoDecoder: Error receiving frame from decoder" << std::endl;
+        MR_LOG_RATE_LIMITED(LogLevel::Error, 1000, "VideoDecoder: Error receiving frame from decoder");
+        m_DecodeError = true;
         return false;
     }
     
-    // Prepare output buffer
-    size_t outputSize = m_Width * m_Height * 4; // BGRA format
-    bgraData.resize(outputSize);
+    m_LastFrameTag = picture.m_frame->pts == AV_NOPTS_VALUE ? kNoTag : picture.m_frame->pts;
     
-    // Convert YUV420P to BGRA
-    uint8_t* dstData[4] = { bgraData.data(), nullptr, nullptr, nullptr };
-    int dstLinesize[4] = { (int)(m_Width * 4), 0, 0, 0 };
-    
-    sws_scale(m_SwsContext, m_Frame->data, m_Frame->linesize, 0, m_Height,
-              dstData, dstLinesize);
+    // Concealed errors still produce a picture, but its references are damaged
+    if (picture.m_frame->decode_error_flags != 0) {
+        MR_LOG_RATE_LIMITED(LogLevel::Warn, 1000,
+                            "VideoDecoder: Frame decoded with errors (flags 0x" << std::hex
+                            << picture.m_frame->decode_error_flags << std::dec << ")");
+        m_DecodeError = true;
+    }
     
     return true;
 }
 
-void VideoDecoder::Cleanup() {
+bool VideoDecoder::DrainFrame(DecodedPicture& picture) {
+    if (!m_IsInitialized || !picture.m_frame) {
+        return false;
+    }
+    MR_TRACE_SCOPE("decode");
+    MR_PERF_SCOPE(PerfStage::Decode);
+    if (!m_Draining) {
+        avcodec_send_packet(m_CodecContext, nullptr);
+        m_Draining = true;
+    }
+    int ret = avcodec_receive_frame(m_CodecContext, picture.m_frame);
+    picture.UpdateFromFrame();
+    if (ret < 0) {
+        return false;
+    }
+    m_LastFrameTag = picture.m_frame->pts == AV_NOPTS_VALUE ? kNoTag : picture.m_frame->pts;
+    return true;
+}
+
+bool VideoDecoder::DrainFrame(std::vector<uint8_t>& bgraData) {
+    return DrainFrame(m_Picture) && ConvertToBGRA(m_Picture, bgraData);
+}
+
+bool VideoDecoder::DecodeFrame(const BufferHandle& packet, const FrameDestination& destination, int64_t tag) {
+    return DecodeFrame(packet, m_Picture, tag) && ConvertTo(m_Picture, destination);
+}
+
+bool FrameConverter::ConvertToBGRA(const DecodedPicture& picture, std::vector<uint8_t>& bgraData) {
+    if (!picture.IsValid()) {
+        return false;
+    }
+    
+    // Prepare output buffer
+    bgraData.resize(static_cast<size_t>(picture.width) * picture.height * 4);
+    
+    FrameDestination destination;
+    destination.data = bgraData.data();
+    destination.stride = static_cast<int>(picture.width) * 4;
+    destination.width = picture.width;
+    destination.height = picture.height;
+    destination.format = PixelFormat::BGRA;
+    return ConvertTo(picture, destination);
+}
+
+FrameConverter::~FrameConverter() {
     if (m_SwsContext) {
         sws_freeContext(m_SwsContext);
         m_SwsContext = nullptr;
     }
+}
+
+bool FrameConverter::ConvertTo(const DecodedPicture& picture, const FrameDestination& destination) {
+    MR_TRACE_SCOPE("convert-out");
+    MR_PERF_SCOPE(PerfStage::ConvertOut);
+    const AVFrame* frame = picture.m_frame;
+    if (!frame || !frame->data[0]) {
+        return false;
+    }
+    if (!destination.data || destination.width != picture.width || destination.height != picture.height) {
+        MR_LOG_ERROR("FrameConverter: Destination " << destination.width << "x" << destination.height
+                     << " does not match decoded frame " << picture.width << "x" << picture.height);
+        return false;
+    }
+    if (destination.format != PixelFormat::BGRA && destination.format != PixelFormat::RGBA) {
+        MR_LOG_ERROR("FrameConverter: Unsupported destination format");
+        return false;
+    }
     
+    // 8-bit 4:2:0 goes through the vectorized converter
+    if (picture.format == PixelFormat::I420 || picture.format == PixelFormat::NV12) {
+        return ConvertYuvToRgb32(picture.GetPlanes(), destination.data, destination.stride, destination.format);
+    }
+    
+    // Anything else falls back to swscale; (re)build the conversion context
+    // for the stream's actual format
+    AVPixelFormat srcFormat = static_cast<AVPixelFormat>(frame->format);
+    AVPixelFormat dstFormat = destination.format == PixelFormat::RGBA ? AV_PIX_FMT_RGBA : AV_PIX_FMT_BGRA;
+    m_SwsContext = sws_getCachedContext(m_SwsContext, frame->width, frame->height, srcFormat,
+                                        frame->width, frame->height, dstFormat,
+                                        SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+    if (!m_SwsContext) {
+        MR_LOG_ERROR("FrameConverter: Could not create scaling context");
+        return false;
+    }
+    
+    // Convert decoded YUV into the destination rows
+    uint8_t* dstData[4] = { destination.data, nullptr, nullptr, nullptr };
+    int dstLinesize[4] = { destination.stride, 0, 0, 0 };
+    
+    sws_scale(m_SwsContext, frame->data, frame->linesize, 0, frame->height,
+              dstData, dstLinesize);
+    
+    return true;
+}
+
+void VideoDecoder::Cleanup() {
     if (m_Packet) {
         av_packet_free(&m_Packet);
     }
     
-    if (m_Frame) {
-        av_frame_free(&m_Frame);
-    }
+    m_Picture.Reset();
     
     if (m_CodecContext) {
         avcodec_free_context(&m_CodecContext);
     }
     
+    if (m_PerfThreaded) {
+        PerfCounters::RemoveThreadedWorker(PerfStage::Decode);
+        m_PerfThreaded = false;
+    }
     m_IsInitialized = false;
 }
\ No newline at end of file
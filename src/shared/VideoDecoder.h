@@ -23,35 +23,185 @@ extern "C" {
 #include <vector>
 #include <memory>
 #include "protocol.h"
+#include "BufferPool.h"
+#include "PixelFormat.h"
+#include "ColorConvert.h"
+
+// Decoder threading model. Frame threading pipelines whole frames and adds
+// one frame of latency per extra thread, so interactive streaming defaults to
+// slice threading, which splits each frame without adding delay.
+enum class DecodeThreading {
+    None,
+    Slice,
+    Frame
+};
+
+struct DecoderOptions {
+    DecodeThreading threading = DecodeThreading::Slice;
+    int threadCount = 0;      // 0 lets libavcodec pick based on core count
+    bool lowDelay = true;     // AV_CODEC_FLAG_LOW_DELAY: output frames as soon as possible
+    bool fastDecode = true;   // AV_CODEC_FLAG2_FAST: allow non-spec-compliant speedups
+};
+
+// A decoded picture in the decoder's native YUV layout. It holds a reference
+// to the decoder's frame buffers, so the planes stay valid until Reset() or
+// the next decode into the same object, independent of other decodes.
+// `format` is Unknown for layouts other than 8-bit I420/NV12; those can still
+// be turned into pixels through FrameConverter.
+class DecodedPicture {
+public:
+    uint32_t width = 0;
+    uint32_t height = 0;
+    PixelFormat format = PixelFormat::Unknown;
+    ColorMatrix matrix = ColorMatrix::BT601;
+    ColorRange range = ColorRange::Limited;
+    const uint8_t* planes[3] = {};  // Y, U, V (I420) or Y, UV (NV12)
+    int strides[3] = {};
+
+    DecodedPicture();
+    ~DecodedPicture();
+    DecodedPicture(const DecodedPicture&) = delete;
+    DecodedPicture& operator=(const DecodedPicture&) = delete;
+
+    bool IsValid() const { return planes[0] != nullptr; }
+    void Reset();
+    
+    // Plane view for the ColorConvert kernels (I420/NV12 only)
+    YuvPlanes GetPlanes() const {
+        YuvPlanes view;
+        view.format = format;
+        view.width = width;
+        view.height = height;
+        view.matrix = matrix;
+        view.range = range;
+        for (int i = 0; i < 3; ++i) {
+            view.planes[i] = planes[i];
+            view.strides[i] = strides[i];
+        }
+        return view;
+    }
+
+private:
+    friend class VideoDecoder;
+    friend class FrameConverter;
+#ifndef ANDROID
+    AVFrame* m_frame = nullptr;
+    void UpdateFromFrame();
+#endif
+};
+
+// Turns decoded pictures into packed BGRA/RGBA. 8-bit 4:2:0 uses the SIMD
+// kernels; other layouts go through swscale, whose cached state lives here,
+// so use one converter per thread.
+class FrameConverter {
+private:
+#ifndef ANDROID
+    SwsContext* m_SwsContext = nullptr;
+#endif
+
+public:
+    FrameConverter() = default;
+    ~FrameConverter();
+    FrameConverter(const FrameConverter&) = delete;
+    FrameConverter& operator=(const FrameConverter&) = delete;
+    
+    bool ConvertTo(const DecodedPicture& picture, const FrameDestination& destination);
+    // Tightly packed BGRA, resizing `bgraData` to fit
+    bool ConvertToBGRA(const DecodedPicture& picture, std::vector<uint8_t>& bgraData);
+};
 
 class VideoDecoder {
 private:
 #ifdef ANDROID
     std::unique_ptr<AndroidVideoDecoder> m_androidDecoder;
+    std::vector<uint8_t> m_rgbaScratch; // Reused RGBA output from MediaCodec
 #else
     AVCodecContext* m_CodecContext = nullptr;
-    AVFrame* m_Frame = nullptr;
     AVPacket* m_Packet = nullptr;
-    SwsContext* m_SwsContext = nullptr;
 #endif
     
+    FrameConverter m_Converter;
     uint32_t m_Width = 0;
     uint32_t m_Height = 0;
     CompressionType m_CompressionType = COMPRESSION_NONE;
+    DecoderOptions m_Options;
     bool m_IsInitialized = false;
+    bool m_DecodeError = false;
+    bool m_Draining = false;
+    bool m_PerfThreaded = false; // Registered with PerfCounters as threaded
+    int64_t m_LastFrameTag = -1;
+    DecodedPicture m_Picture; // Scratch for the BGRA overloads
     
     const char* GetCodecName(CompressionType type);
+#ifndef ANDROID
+    bool SendAndReceive(DecodedPicture& picture, int64_t tag);
+#endif
     
 public:
+    // Whether DecodeFrame(packet, DecodedPicture&) is available. MediaCodec
+    // on Android only produces converted RGBA.
+#ifdef ANDROID
+    static constexpr bool kHasPictureOutput = false;
+#else
+    static constexpr bool kHasPictureOutput = true;
+#endif
+
+    // Zeroed tail the bitstream readers may over-read. Packet buffers handed
+    // to the BufferHandle overload should come from a pool with this padding.
+#ifdef ANDROID
+    static constexpr size_t kInputPaddingSize = 64;
+#else
+    static constexpr size_t kInputPaddingSize = AV_INPUT_BUFFER_PADDING_SIZE;
+#endif
+
+    // Packets decoded without a tag; see GetLastFrameTag()
+    static constexpr int64_t kNoTag = -1;
+
     VideoDecoder();
     ~VideoDecoder();
     
-    bool Initialize(uint32_t width, uint32_t height, CompressionType compression);
+    bool Initialize(uint32_t width, uint32_t height, CompressionType compression,
+                    const DecoderOptions& options = {});
+    // Mid-stream resolution change: drops queued frames and adopts the new
+    // size without reopening the codec. The stream must resume at a keyframe.
+    bool Reconfigure(uint32_t width, uint32_t height);
+    // Discards frames still in the decoder pipeline (e.g. on reconnect or codec switch)
+    void Flush();
+    // Plain memory has no padding, so libavcodec copies it into its own buffer
     bool DecodeFrame(const uint8_t* compressedData, size_t dataSize, std::vector<uint8_t>& bgraData);
+    // Zero-copy: the decoder takes a reference to the padded pooled buffer.
+    // `tag` (e.g. the frame's sequence number) travels with the packet
+    // through the decoder; see GetLastFrameTag().
+    bool DecodeFrame(const BufferHandle& packet, std::vector<uint8_t>& bgraData, int64_t tag = kNoTag);
+    // Decode without color conversion. Renderers that sample YUV directly
+    // (or convert on the GPU) should use this and skip ConvertToBGRA.
+    bool DecodeFrame(const BufferHandle& packet, DecodedPicture& picture, int64_t tag = kNoTag);
+    // Decode and convert straight into caller-owned memory, skipping the
+    // intermediate BGRA vector. The destination must match the frame size.
+    bool DecodeFrame(const BufferHandle& packet, const FrameDestination& destination, int64_t tag = kNoTag);
+    // Opt-in conversion of a decoded picture to tightly packed BGRA
+    bool ConvertToBGRA(const DecodedPicture& picture, std::vector<uint8_t>& bgraData) {
+        return m_Converter.ConvertToBGRA(picture, bgraData);
+    }
+    // End of stream: returns the frames a frame-threaded decoder still holds,
+    // one per call, then false. Flush() before decoding more packets.
+    bool DrainFrame(DecodedPicture& picture);
+    bool DrainFrame(std::vector<uint8_t>& bgraData);
+    bool ConvertTo(const DecodedPicture& picture, const FrameDestination& destination) {
+        return m_Converter.ConvertTo(picture, destination);
+    }
     void Cleanup();
     
     uint32_t GetWidth() const { return m_Width; }
     uint32_t GetHeight() const { return m_Height; }
     CompressionType GetCompressionType() const { return m_CompressionType; }
     bool IsInitialized() const { return m_IsInitialized; }
+    // Whether the last DecodeFrame() hit a bitstream error (as opposed to
+    // simply having no frame ready). Later deltas reference broken state
+    // until the next keyframe.
+    bool HadDecodeError() const { return m_DecodeError; }
+    // Tag of the packet the last decoded or drained frame came from. A
+    // decoder that holds frames back returns an earlier packet's frame than
+    // the one just submitted, so match outputs by this rather than by call.
+    int64_t GetLastFrameTag() const { return m_LastFrameTag; }
 };
\ No newline at end of file
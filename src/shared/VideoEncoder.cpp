@@ -1,5 +1,8 @@
 #include "VideoEncoder.h"
-#include <iostream>
+#include "Log.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+#include <cstring>
 
 VideoEncoder::VideoEncoder() {
     // FFmpeg 4.0+ automatically registers codecs, no need for avcodec_register_all()
@@ -22,30 +25,79 @@ const char* VideoEncoder::GetCodecName(CompressionType type) {
     }
 }
 
+namespace {
+
+AVCodecID GetCodecId(CompressionType type) {
+    switch (type) {
+        case COMPRESSION_H264: return AV_CODEC_ID_H264;
+        case COMPRESSION_H265: return AV_CODEC_ID_HEVC;
+        case COMPRESSION_AV1: return AV_CODEC_ID_AV1;
+        default: return AV_CODEC_ID_NONE;
+    }
+}
+
+// av_opt_set() on the encoder's private options, logging values it rejects
+bool SetPrivateOption(AVCodecContext* context, const char* name, const std::string& value) {
+    if (av_opt_set(context->priv_data, name, value.c_str(), 0) < 0) {
+        MR_LOG_ERROR("VideoEncoder: " << context->codec->name << " rejected " << name << " '" << value << "'");
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool VideoEncoder::EncoderProduces(const std::string& encoder, CompressionType compression) {
+    const AVCodec* codec = avcodec_find_encoder_by_name(encoder.c_str());
+    return codec && codec->id == GetCodecId(compression);
+}
+
 bool VideoEncoder::Initialize(uint32_t width, uint32_t height, CompressionType compression, 
                              uint32_t framerate, uint32_t bitrate) {
+    EncoderOptions options;
+    options.framerate = framerate;
+    options.bitrate = bitrate;
+    return Initialize(width, height, compression, options);
+}
+
+bool VideoEncoder::Initialize(uint32_t width, uint32_t height, CompressionType compression,
+                             const EncoderOptions& options) {
+    const uint32_t framerate = options.framerate;
+    const uint32_t bitrate = options.bitrate;
     if (compression == COMPRESSION_NONE) {
-        std::cerr << "VideoEncoder: Cannot initialize with COMPRESSION_NONE" << std::endl;
+        MR_LOG_ERROR("VideoEncoder: Cannot initialize with COMPRESSION_NONE");
         return false;
     }
     
     const char* codecName = GetCodecName(compression);
     if (!codecName) {
-        std::cerr << "VideoEncoder: Unsupported compression type: " << compression << std::endl;
+        MR_LOG_ERROR("VideoEncoder: Unsupported compression type: " << compression);
         return false;
     }
+    if (!options.encoder.empty() && options.encoder != codecName) {
+        if (!avcodec_find_encoder_by_name(options.encoder.c_str())) {
+            MR_LOG_ERROR("VideoEncoder: Could not find encoder: " << options.encoder);
+            return false;
+        }
+        if (EncoderProduces(options.encoder, compression)) {
+            codecName = options.encoder.c_str();
+        } else {
+            MR_LOG_WARN("VideoEncoder: " << options.encoder << " does not encode " << avcodec_get_name(GetCodecId(compression))
+                        << ", using " << codecName);
+        }
+    }
     
     // Find encoder
     const AVCodec* codec = avcodec_find_encoder_by_name(codecName);
     if (!codec) {
-        std::cerr << "VideoEncoder: Could not find encoder: " << codecName << std::endl;
+        MR_LOG_ERROR("VideoEncoder: Could not find encoder: " << codecName);
         return false;
     }
     
     // Allocate codec context
     m_CodecContext = avcodec_alloc_context3(codec);
     if (!m_CodecContext) {
-        std::cerr << "VideoEncoder: Could not allocate codec context" << std::endl;
+        MR_LOG_ERROR("VideoEncoder: Could not allocate codec context");
         return false;
     }
     
@@ -59,26 +111,29 @@ bool VideoEncoder::Initialize(uint32_t width, uint32_t height, CompressionType c
     m_CodecContext->max_b_frames = 0; // Disable B-frames for low latency
     m_CodecContext->pix_fmt = AV_PIX_FMT_YUV420P;
     
-    // Set codec-specific options for low latency
-    if (compression == COMPRESSION_H264) {
-        av_opt_set(m_CodecContext->priv_data, "preset", "ultrafast", 0);
-        av_opt_set(m_CodecContext->priv_data, "tune", "zerolatency", 0);
-    } else if (compression == COMPRESSION_H265) {
-        av_opt_set(m_CodecContext->priv_data, "preset", "ultrafast", 0);
-        av_opt_set(m_CodecContext->priv_data, "tune", "zerolatency", 0);
+    if (!SetCodecOptions(codecName, options)) {
+        Cleanup();
+        return false;
     }
     
     // Open codec
     if (avcodec_open2(m_CodecContext, codec, nullptr) < 0) {
-        std::cerr << "VideoEncoder: Could not open codec" << std::endl;
+        MR_LOG_ERROR("VideoEncoder: Could not open codec");
         Cleanup();
         return false;
     }
+    // x265 encodes on its own thread pool whatever thread_count says, unless
+    // SetCodecOptions pinned it to one thread; x264, libaom and the rest
+    // follow thread_count
+    m_PerfThreaded = strcmp(codecName, "libx265") == 0 ? options.threads != 1 : m_CodecContext->thread_count != 1;
+    if (m_PerfThreaded) {
+        PerfCounters::AddThreadedWorker(PerfStage::Encode);
+    }
     
     // Allocate frame
     m_Frame = av_frame_alloc();
     if (!m_Frame) {
-        std::cerr << "VideoEncoder: Could not allocate frame" << std::endl;
+        MR_LOG_ERROR("VideoEncoder: Could not allocate frame");
         Cleanup();
         return false;
     }
@@ -88,7 +143,7 @@ bool VideoEncoder::Initialize(uint32_t width, uint32_t height, CompressionType c
     m_Frame->height = height;
     
     if (av_frame_get_buffer(m_Frame, 32) < 0) {
-        std::cerr << "VideoEncoder: Could not allocate frame buffer" << std::endl;
+        MR_LOG_ERROR("VideoEncoder: Could not allocate frame buffer");
         Cleanup();
         return false;
     }
@@ -96,7 +151,7 @@ bool VideoEncoder::Initialize(uint32_t width, uint32_t height, CompressionType c
     // Allocate packet
     m_Packet = av_packet_alloc();
     if (!m_Packet) {
-        std::cerr << "VideoEncoder: Could not allocate packet" << std::endl;
+        MR_LOG_ERROR("VideoEncoder: Could not allocate packet");
         Cleanup();
         return false;
     }
@@ -106,7 +161,7 @@ bool VideoEncoder::Initialize(uint32_t width, uint32_t height, CompressionType c
                                   width, height, AV_PIX_FMT_YUV420P,
                                   SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
     if (!m_SwsContext) {
-        std::cerr << "VideoEncoder: Could not create scaling context" << std::endl;
+        MR_LOG_ERROR("VideoEncoder: Could not create scaling context");
         Cleanup();
         return false;
     }
@@ -118,34 +173,91 @@ bool VideoEncoder::Initialize(uint32_t width, uint32_t height, CompressionType c
     m_CompressionType = compression;
     m_IsInitialized = true;
     
-    std::cout << "VideoEncoder: Initialized " << codecName << " encoder (" << width << "x" << height 
-              << " @ " << framerate << "fps, " << bitrate << " bps)" << std::endl;
+    {
+        LogMessage message(LogLevel::Info);
+        message.Stream() << "VideoEncoder: Initialized " << codecName << " encoder (" << width << "x" << height 
+                         << " @ " << framerate << "fps, " << bitrate << " bps";
+        if (!options.preset.empty()) {
+            message.Stream() << ", preset " << options.preset;
+        }
+        if (!options.tune.empty()) {
+            message.Stream() << ", tune " << options.tune;
+        }
+        message.Stream() << ")";
+    }
     
     return true;
 }
 
+// Codec-specific options, tuned for low latency on the default encoders
+bool VideoEncoder::SetCodecOptions(const char* codecName, const EncoderOptions& options) {
+    const std::string name = codecName;
+    const bool noTune = options.tune == "none";
+    if (options.threads > 0) {
+        m_CodecContext->thread_count = static_cast<int>(options.threads);
+    }
+    if (name == "libx264" || name == "libx265") {
+        if (!SetPrivateOption(m_CodecContext, "preset", options.preset.empty() ? "ultrafast" : options.preset) ||
+            (!noTune && !SetPrivateOption(m_CodecContext, "tune", options.tune.empty() ? "zerolatency" : options.tune))) {
+            return false;
+        }
+        if (name == "libx265" && options.threads == 1 &&
+            !SetPrivateOption(m_CodecContext, "x265-params", "pools=none:frame-threads=1")) {
+            return false;
+        }
+    } else if (name == "libaom-av1") {
+        av_opt_set(m_CodecContext->priv_data, "usage", "realtime", 0);
+        av_opt_set_int(m_CodecContext->priv_data, "lag-in-frames", 0, 0);
+        if (!SetPrivateOption(m_CodecContext, "cpu-used", options.preset.empty() ? "8" : options.preset) ||
+            (!noTune && !options.tune.empty() && !SetPrivateOption(m_CodecContext, "tune", options.tune))) {
+            return false;
+        }
+    } else {
+        if ((!options.preset.empty() && !SetPrivateOption(m_CodecContext, "preset", options.preset)) ||
+            (!noTune && !options.tune.empty() && !SetPrivateOption(m_CodecContext, "tune", options.tune))) {
+            return false;
+        }
+    }
+    // Forced I-frames must be IDRs so a client can start decoding there.
+    // Encoders without the option (libaom) fail this harmlessly.
+    av_opt_set_int(m_CodecContext->priv_data, "forced-idr", 1, 0);
+    return true;
+}
+
 bool VideoEncoder::EncodeFrame(const uint8_t* bgraData, std::vector<uint8_t>& compressedData, bool& isKeyframe) {
     if (!m_IsInitialized) {
         return false;
     }
     
     // Convert BGRA to YUV420P
-    const uint8_t* srcData[4] = { bgraData, nullptr, nullptr, nullptr };
-    int srcLinesize[4] = { (int)(m_Width * 4), 0, 0, 0 };
-    
-    sws_scale(m_SwsContext, srcData, srcLinesize, 0, m_Height,
-              m_Frame->data, m_Frame->linesize);
+    {
+        MR_TRACE_SCOPE("convert");
+        MR_PERF_SCOPE(PerfStage::Convert);
+        const uint8_t* srcData[4] = { bgraData, nullptr, nullptr, nullptr };
+        int srcLinesize[4] = { (int)(m_Width * 4), 0, 0, 0 };
+        
+        sws_scale(m_SwsContext, srcData, srcLinesize, 0, m_Height,
+                  m_Frame->data, m_Frame->linesize);
+    }
     
     // Set frame PTS - let libavcodec handle keyframe decisions
     m_Frame->pts = m_FrameCount++;
     
-    // Don't override encoder decisions - let it use GOP settings naturally
-    m_Frame->pict_type = AV_PICTURE_TYPE_NONE;
+    // Don't override encoder decisions unless the client asked for a
+    // keyframe - otherwise let it use GOP settings naturally
+    m_Frame->pict_type = m_ForceKeyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    if (m_ForceKeyframe) {
+        MR_LOG_INFO("VideoEncoder: Forcing keyframe at frame " << m_Frame->pts);
+        m_ForceKeyframe = false;
+    }
+    
+    MR_TRACE_SCOPE("encode");
+    MR_PERF_SCOPE(PerfStage::Encode);
     
     // Send frame to encoder
     int ret = avcodec_send_frame(m_CodecContext, m_Frame);
     if (ret < 0) {
-        std::cerr << "VideoEncoder: Error sending frame to encoder" << std::endl;
+        MR_LOG_ERROR("VideoEncoder: Error sending frame to encoder");
         return false;
     }
     
@@ -155,7 +267,7 @@ bool VideoEncoder::EncodeFrame(const uint8_t* bgraData, std::vector<uint8_t>& co
         // Need more frames before getting a packet
         return false;
     } else if (ret < 0) {
-        std::cerr << "VideoEncoder: Error receiving packet from encoder" << std::endl;
+        MR_LOG_ERROR("VideoEncoder: Error receiving packet from encoder");
         return false;
     }
     
@@ -165,12 +277,13 @@ bool VideoEncoder::EncodeFrame(const uint8_t* bgraData, std::vector<uint8_t>& co
     
     // Check if this is a keyframe (output parameter - reports what encoder actually produced)
     isKeyframe = (m_Packet->flags & AV_PKT_FLAG_KEY) != 0;
+    // Encoders carry the input's pts through to its packet
+    m_LastPacketFrame = m_Packet->pts;
     
-    // Debug: Log frame information
-    std::cout << "VideoEncoder: Frame " << (m_FrameCount-1) << " - PTS=" << m_Packet->pts 
-              << ", Size=" << m_Packet->size << " bytes"
-              << ", Flags=0x" << std::hex << m_Packet->flags << std::dec
-              << " -> " << (isKeyframe ? "KEYFRAME" : "DELTA") << std::endl;
+    MR_LOG_DEBUG("VideoEncoder: Frame " << (m_FrameCount-1) << " - PTS=" << m_Packet->pts 
+                 << ", Size=" << m_Packet->size << " bytes"
+                 << ", Flags=0x" << std::hex << m_Packet->flags << std::dec
+                 << " -> " << (isKeyframe ? "KEYFRAME" : "DELTA"));
     
     av_packet_unref(m_Packet);
     
@@ -195,5 +308,9 @@ void VideoEncoder::Cleanup() {
         avcodec_free_context(&m_CodecContext);
     }
     
+    if (m_PerfThreaded) {
+        PerfCounters::RemoveThreadedWorker(PerfStage::Encode);
+        m_PerfThreaded = false;
+    }
     m_IsInitialized = false;
 }
\ No newline at end of file
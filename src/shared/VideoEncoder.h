@@ -19,8 +19,30 @@ extern "C" {
 
 #include <vector>
 #include <memory>
+#include <string>
 #include "protocol.h"
 
+struct EncoderOptions {
+    uint32_t framerate = 60;
+    uint32_t bitrate = 5000000;  // 5 Mbps
+    // Speed/quality trade-off. H.264/H.265 take an x264/x265 preset name
+    // ("ultrafast", "veryfast", ...); AV1 takes a libaom cpu-used level
+    // ("0" to "8", lower is slower). Empty keeps the low-latency default, 8.
+    std::string preset;
+    // x264/x265 tune ("zerolatency", "stillimage+zerolatency", ...) or libaom
+    // tune ("psnr", "ssim"). Empty keeps "zerolatency" for H.264/H.265;
+    // "none" sets no tune at all.
+    std::string tune;
+    // FFmpeg encoder to use instead of the default libx264/libx265/libaom-av1,
+    // e.g. "h264_nvenc" or "libsvtav1". Ignored (with a warning) if it encodes
+    // a different codec than requested. Other encoders get `preset` and
+    // `tune` passed through unchanged, and none of the low-latency defaults.
+    std::string encoder;
+    // Encoder threads; 0 keeps the encoder's default. 1 also turns off
+    // x265's own thread pool, so --perf-counters can count the encode stage.
+    uint32_t threads = 0;
+};
+
 class VideoEncoder {
 private:
     AVCodecContext* m_CodecContext = nullptr;
@@ -35,8 +57,12 @@ private:
     CompressionType m_CompressionType = COMPRESSION_NONE;
     bool m_IsInitialized = false;
     int64_t m_FrameCount = 0;
+    int64_t m_LastPacketFrame = -1;
+    bool m_ForceKeyframe = false;
+    bool m_PerfThreaded = false; // Registered with PerfCounters as threaded
     
     const char* GetCodecName(CompressionType type);
+    bool SetCodecOptions(const char* codecName, const EncoderOptions& options);
     
 public:
     VideoEncoder();
@@ -44,11 +70,24 @@ public:
     
     bool Initialize(uint32_t width, uint32_t height, CompressionType compression, 
                    uint32_t framerate = 60, uint32_t bitrate = 5000000);
+    bool Initialize(uint32_t width, uint32_t height, CompressionType compression, const EncoderOptions& options);
     bool EncodeFrame(const uint8_t* bgraData, std::vector<uint8_t>& compressedData, bool& isKeyframe);
+    // Makes the next encoded frame an IDR/keyframe, e.g. when the client
+    // lost its reference chain
+    void RequestKeyframe() { m_ForceKeyframe = true; }
+    // Index the next EncodeFrame() input gets (its pts)
+    int64_t GetNextFrameIndex() const { return m_FrameCount; }
+    // Input index of the frame in the last packet. Encoders with lookahead
+    // or frame threads return packets several inputs behind.
+    int64_t GetLastPacketFrame() const { return m_LastPacketFrame; }
     void Cleanup();
     
     uint32_t GetWidth() const { return m_Width; }
     uint32_t GetHeight() const { return m_Height; }
     CompressionType GetCompressionType() const { return m_CompressionType; }
+    // True if this FFmpeg build has `encoder` and it produces `compression`
+    static bool EncoderProduces(const std::string& encoder, CompressionType compression);
+    // The FFmpeg encoder in use, e.g. "libx264"
+    const char* GetEncoderName() const { return m_CodecContext ? m_CodecContext->codec->name : ""; }
     bool IsInitialized() const { return m_IsInitialized; }
 };
\ No newline at end of file
@@ -11,7 +11,12 @@ enum MessageType : uint32_t {
     MSG_MOUSE_CLICK = 3,
     MSG_MOUSE_SCROLL = 4,
     MSG_COMPRESSED_FRAME = 5,
-    MSG_COMPRESSION_REQUEST = 6
+    MSG_COMPRESSION_REQUEST = 6,
+    MSG_KEYFRAME_REQUEST = 7,
+    MSG_STATS = 8,
+    MSG_CLOCK_PING = 9,
+    MSG_CLOCK_PONG = 10,
+    MSG_KEEPALIVE = 11
 };
 
 // Supported compression formats
@@ -28,12 +33,31 @@ struct MessageHeader {
     uint32_t size;
 };
 
+// Frame timing, appended to both frame messages. Frames from servers that
+// predate it arrive with version 0 and every field zero.
+constexpr uint32_t kFrameTimingVersion = 1;
+
+enum FrameFlags : uint32_t {
+    FRAME_FLAG_KEYFRAME = 1,
+    FRAME_FLAG_STREAM_START = 2, // First frame after the encoder was (re)created
+    FRAME_FLAG_REPLAY = 4        // Captured from a replayed recording
+};
+
+struct FrameTiming {
+    uint32_t version;       // kFrameTimingVersion
+    uint32_t sequence;      // Counts frames sent on this connection, from 0
+    uint32_t flags;         // FrameFlags
+    uint32_t encodeUs;      // Encode time including the BGRA -> YUV conversion
+    uint64_t captureTimeUs; // Server clock (ClockNowUs) when the frame was captured
+};
+
 // Frame data message (existing - uncompressed)
 struct FrameMessage {
     MessageHeader header;
     uint32_t width;
     uint32_t height;
     uint32_t dataSize;
+    FrameTiming timing;
     // Pixel data follows
 };
 
@@ -44,6 +68,8 @@ struct CompressedFrameMessage {
     uint32_t height;
     uint32_t compressedSize;
     uint32_t isKeyframe;  // 1 for keyframe, 0 for delta frame
+    CompressionType compression; // Codec of this frame; COMPRESSION_NONE (older servers) means the negotiated one
+    FrameTiming timing;
     // Compressed data follows (format determined by negotiation)
 };
 
@@ -53,6 +79,61 @@ struct CompressionRequestMessage {
     CompressionType compression;
 };
 
+// Sent by the client when it can no longer decode the stream (decode error,
+// reconnect, lost reference); the server answers with a keyframe
+struct KeyframeRequestMessage {
+    MessageHeader header;
+};
+
+// Server-side stream statistics, sent about once a second. Counts and
+// averages cover the interval since the previous stats message; clients that
+// predate it skip the message.
+constexpr uint32_t kStatsPerfStages = 5; // capture, hash, convert, encode, send
+
+struct StatsMessage {
+    MessageHeader header;
+    uint32_t intervalMs;
+    uint32_t framesSent;
+    uint32_t framesSkipped;     // Captured but not sent (the encoder produced no packet)
+    uint32_t keyframes;
+    uint64_t bytesSent;         // Frame payload bytes
+    uint32_t lastKeyframeBytes; // Size of the most recent keyframe, from any interval
+    uint32_t encodeUsAvg;       // Encode time including the BGRA -> YUV conversion
+    uint32_t encodeUsMax;
+    uint32_t sendBlockedUsAvg;  // Time spent blocked writing frames to the socket
+    uint32_t sendBlockedUsMax;
+    // Hardware counters per server stage over the interval (--perf-counters),
+    // in PerfStage order. Zero for a stage that did not run or whose codec
+    // works on its own threads, and from servers that predate them.
+    uint16_t perfIpcX100[kStatsPerfStages];         // Instructions per cycle x100
+    uint32_t perfCacheMissesAvg[kStatsPerfStages];  // Last-level cache misses per scope
+};
+
+// Clock offset estimation, NTP style: the client sends its send time, the
+// server echoes it with its own receive and send times, and the client
+// stamps the arrival (see ClockOffsetEstimator). Times are microseconds on
+// each side's monotonic clock.
+struct ClockPingMessage {
+    MessageHeader header;
+    uint64_t clientSendUs;
+};
+
+struct ClockPongMessage {
+    MessageHeader header;
+    uint64_t clientSendUs;    // Echoed from the ping
+    uint64_t serverReceiveUs;
+    uint64_t serverSendUs;
+};
+
+// Sent about once a second in place of frames while the server's captures
+// are identical to the last frame it sent, so the client can tell a static
+// desktop from a stalled stream. Clients that predate it skip the message.
+struct KeepaliveMessage {
+    MessageHeader header;
+    uint32_t lastSequence;    // Sequence number of the frame still current
+    uint32_t framesUnchanged; // Identical captures skipped since that frame
+};
+
 // Mouse movement message
 struct MouseMoveMessage {
     MessageHeader header;